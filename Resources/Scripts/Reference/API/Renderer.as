@@ -34,6 +34,11 @@ namespace spades {
 		 * @param path file-system path. */
 		Image@ RegisterImage(const string@ path) {}
 		
+		/** Starts loading an image in background so that a later
+		 * `RegisterImage` with the same path doesn't stall.
+		 * @param path file-system path. */
+		void PreloadImage(const string@ path) {}
+		
 		/** Loads an model from the specified path or load one from
 		 * the cache, if exists.
 		 * @param path file-system path. */
@@ -39,14 +39,12 @@ attribute vec4 colorAttribute;
 // [nx, ny, nz]
 attribute vec3 normalAttribute;
 
-// [sx, sy, sz]
-attribute vec3 fixedPositionAttribute;
-
 varying vec2 ambientOcclusionCoord;
 varying vec4 color;
 varying vec3 fogDensity;
 varying vec2 detailCoord;
 
+vec3 GetMapChunkFixedPosition(vec3 position, vec3 normal);
 void PrepareForShadowForMap(vec3 vertexCoord, vec3 fixedVertexCoord, vec3 normal);
 vec4 FogDensity(float poweredLength);
 
@@ -70,7 +68,7 @@ void main() {
 	fogDensity = FogDensity(horzDistance).xyz;
 
 	vec3 fixedPosition = chunkPosition;
-	fixedPosition += fixedPositionAttribute * 0.5;
+	fixedPosition += GetMapChunkFixedPosition(positionAttribute, normalAttribute);
 	fixedPosition += normalAttribute * 0.1;
 
 	vec3 normal = normalAttribute;
@@ -39,12 +39,6 @@ attribute vec4 colorAttribute;
 // [nx, ny, nz]
 attribute vec3 normalAttribute;
 
-// [sx, sy, sz]
-attribute vec3 fixedPositionAttribute;
-
-// [ux, uy]																				// ADDED
-attribute vec2 blockTexCoordAttribute;													// ADDED
-
 varying vec2 ambientOcclusionCoord;
 varying vec4 color;
 varying vec3 fogDensity;
@@ -55,12 +49,14 @@ varying vec3 viewSpaceNormal;
 
 varying vec3 reflectionDir;
 
+vec3 GetMapChunkFixedPosition(vec3 position, vec3 normal);
+vec2 GetMapChunkBlockTexCoord();
 void PrepareForShadowForMap(vec3 vertexCoord, vec3 fixedVertexCoord, vec3 normal);
 vec4 FogDensity(float poweredLength);
 
 void main() {
 
-	blockTexCoord = blockTexCoordAttribute;												// ADDED
+	blockTexCoord = GetMapChunkBlockTexCoord();											// ADDED
 
 	vec4 vertexPos = vec4(chunkPosition, 1.);
 
@@ -85,7 +81,7 @@ void main() {
 	fogDensity = FogDensity(horzDistance).xyz;
 
 	vec3 fixedPosition = chunkPosition;
-	fixedPosition += fixedPositionAttribute * 0.5;
+	fixedPosition += GetMapChunkFixedPosition(positionAttribute, normalAttribute);
 	fixedPosition += normalAttribute * 0.1;
 
 	vec3 normal = normalAttribute;
@@ -39,24 +39,20 @@ attribute vec4 colorAttribute;
 // [nx, ny, nz]
 attribute vec3 normalAttribute;
 
-// [sx, sy, sz]
-attribute vec3 fixedPositionAttribute;
-
-// [ux, uy]																				// ADDED
-attribute vec2 blockTexCoordAttribute;													// ADDED
-
 varying vec2 ambientOcclusionCoord;
 varying vec4 color;
 varying vec3 fogDensity;
 varying vec2 detailCoord;
 varying vec2 blockTexCoord;																// ADDED
 
+vec3 GetMapChunkFixedPosition(vec3 position, vec3 normal);
+vec2 GetMapChunkBlockTexCoord();
 void PrepareForShadowForMap(vec3 vertexCoord, vec3 fixedVertexCoord, vec3 normal);
 vec4 FogDensity(float poweredLength);
 
 void main() {
 
-	blockTexCoord = blockTexCoordAttribute;												// ADDED
+	blockTexCoord = GetMapChunkBlockTexCoord();											// ADDED
 
 	vec4 vertexPos = vec4(chunkPosition, 1.);
 
@@ -76,7 +72,7 @@ void main() {
 	fogDensity = FogDensity(horzDistance).xyz;
 
 	vec3 fixedPosition = chunkPosition;
-	fixedPosition += fixedPositionAttribute * 0.5;
+	fixedPosition += GetMapChunkFixedPosition(positionAttribute, normalAttribute);
 	fixedPosition += normalAttribute * 0.1;
 
 	vec3 normal = normalAttribute;
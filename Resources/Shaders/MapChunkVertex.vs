@@ -0,0 +1,79 @@
+/*
+ Copyright (c) 2017 yvt
+ 
+ This file is part of OpenSpades.
+ 
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+
+// Decodes the attributes of the map chunk vertices (GLMapChunk). The vertex
+// format is selected by r_mapChunkCompactVertex.
+
+#if COMPACT_MAP_VERTEX
+
+// [u, v] position of the vertex in its quad, in faces
+attribute vec2 quadCoordAttribute;
+
+// tNumX + tNumY * 8, or 255 for the single texture mode
+attribute float textureTileAttribute;
+
+// must match `faceInfos` in GLMapChunk.cpp
+void GetMapChunkQuadAxes(vec3 normal, out vec3 u, out vec3 v) {
+	if (abs(normal.z) > .5) {
+		u = vec3(-normal.z, 0., 0.);
+		v = vec3(0., 1., 0.);
+	} else {
+		u = vec3(0., 0., 1.);
+		v = vec3(-normal.y, normal.x, 0.);
+	}
+}
+
+// returns the center of the quad's first face, relative to the chunk.
+// every vertex of a quad returns the same value.
+vec3 GetMapChunkFixedPosition(vec3 position, vec3 normal) {
+	vec3 u, v;
+	GetMapChunkQuadAxes(normal, u, v);
+	vec3 origin = position - u * quadCoordAttribute.x - v * quadCoordAttribute.y;
+	return origin + (u + v) * 0.5;
+}
+
+vec2 GetMapChunkBlockTexCoord() {
+	vec2 coord = vec2(1. - quadCoordAttribute.y, quadCoordAttribute.x);
+	float tile = textureTileAttribute;
+	if (tile > 63.5) {
+		return coord;
+	}
+	vec2 tileIndex = vec2(mod(tile, 8.), floor(tile / 8.));
+	return (tileIndex + coord) * (1. / 8.);
+}
+
+#else
+
+// [sx, sy, sz]
+attribute vec3 fixedPositionAttribute;
+
+// [ux, uy]
+attribute vec2 blockTexCoordAttribute;
+
+vec3 GetMapChunkFixedPosition(vec3 position, vec3 normal) {
+	return fixedPositionAttribute * 0.5;
+}
+
+vec2 GetMapChunkBlockTexCoord() {
+	return blockTexCoordAttribute;
+}
+
+#endif
@@ -0,0 +1,44 @@
+/*
+ Copyright (c) 2017 yvt
+ 
+ This file is part of OpenSpades.
+ 
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+
+// Transforms the vertices of a model instance given by uniforms. See
+// ModelTransformInstanced.vs for the instanced version.
+
+uniform mat4 projectionViewModelMatrix;
+uniform mat4 modelMatrix;
+uniform mat4 modelNormalMatrix;
+uniform vec3 customColor;
+
+vec4 ProjectModelVertex(vec4 vertexPos) {
+	return projectionViewModelMatrix * vertexPos;
+}
+
+vec3 TransformModelVertex(vec4 vertexPos) {
+	return (modelMatrix * vertexPos).xyz;
+}
+
+vec3 TransformModelNormal(vec3 normal) {
+	return (modelNormalMatrix * vec4(normal, 1.)).xyz;
+}
+
+vec3 GetModelCustomColor() {
+	return customColor;
+}
@@ -0,0 +1,53 @@
+/*
+ Copyright (c) 2017 yvt
+ 
+ This file is part of OpenSpades.
+ 
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+ 
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+ 
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+ 
+ */
+
+
+// Transforms the vertices of a model instance given by per-instance
+// attributes (GLOptimizedVoxelModel::Instance).
+
+uniform mat4 projectionViewMatrix;
+
+// the first three rows of the model matrix
+attribute vec4 modelMatrixRow0Attribute;
+attribute vec4 modelMatrixRow1Attribute;
+attribute vec4 modelMatrixRow2Attribute;
+
+// [r, g, b]
+attribute vec3 customColorAttribute;
+
+vec3 TransformModelVertex(vec4 vertexPos) {
+	return vec3(dot(modelMatrixRow0Attribute, vertexPos),
+	            dot(modelMatrixRow1Attribute, vertexPos),
+	            dot(modelMatrixRow2Attribute, vertexPos));
+}
+
+vec4 ProjectModelVertex(vec4 vertexPos) {
+	return projectionViewMatrix * vec4(TransformModelVertex(vertexPos), 1.);
+}
+
+vec3 TransformModelNormal(vec3 normal) {
+	return vec3(dot(modelMatrixRow0Attribute.xyz, normal),
+	            dot(modelMatrixRow1Attribute.xyz, normal),
+	            dot(modelMatrixRow2Attribute.xyz, normal));
+}
+
+vec3 GetModelCustomColor() {
+	return customColorAttribute;
+}
@@ -23,12 +23,12 @@
 varying vec4 textureCoord;
 //varying vec2 detailCoord;
 varying vec3 fogDensity;
+varying vec3 customColorValue;
 varying float flatShading;
 
 uniform sampler2D ambientOcclusionTexture;
 uniform sampler2D modelTexture;
 uniform vec3 fogColor;
-uniform vec3 customColor;
 
 vec3 EvaluateSunLight();
 vec3 EvaluateAmbientLight(float detailAmbientOcclusion);
@@ -39,7 +39,7 @@ void main() {
 	// model color
 	gl_FragColor = vec4(texData.xyz, 1.);
 	if(dot(gl_FragColor.xyz, vec3(1.)) < 0.0001){
-		gl_FragColor.xyz = customColor;
+		gl_FragColor.xyz = customColorValue;
 	}
 
 	// ambient occlusion
@@ -20,10 +20,6 @@
 
 
 
-uniform mat4 projectionViewModelMatrix;
-uniform mat4 modelMatrix;
-uniform mat4 modelNormalMatrix;
-uniform mat4 viewModelMatrix;
 uniform vec3 modelOrigin;
 uniform float fogDistance;
 uniform vec3 sunLightDirection;
@@ -43,10 +39,15 @@ varying vec4 textureCoord;
 varying vec4 color;
 varying vec3 fogDensity;
 varying float flatShading;
+varying vec3 customColorValue;
 //varying vec2 detailCoord;
 
 void PrepareForShadow(vec3 worldOrigin, vec3 normal);
 vec4 FogDensity(float poweredLength);
+vec4 ProjectModelVertex(vec4 vertexPos);
+vec3 TransformModelVertex(vec4 vertexPos);
+vec3 TransformModelNormal(vec3 normal);
+vec3 GetModelCustomColor();
 
 void main() {
 
@@ -54,23 +55,25 @@ void main() {
 
 	vertexPos.xyz += modelOrigin;
 
-	gl_Position = projectionViewModelMatrix * vertexPos;
+	gl_Position = ProjectModelVertex(vertexPos);
+	vec3 worldPos = TransformModelVertex(vertexPos);
 
 	textureCoord = textureCoordAttribute.xyxy * vec4(texScale.xy, vec2(1.));
 
 	// direct sunlight
 	vec3 normal = normalAttribute;
-	normal = (modelNormalMatrix * vec4(normal, 1.)).xyz;
+	normal = TransformModelNormal(normal);
 	normal = normalize(normal);
 	float sunlight = dot(normal, sunLightDirection);
 	sunlight = max(sunlight, 0.);
 	flatShading = sunlight;
 
-	vec4 viewPos = viewModelMatrix * vertexPos;
-	vec2 horzRelativePos = (modelMatrix * vertexPos).xy - viewOriginVector.xy;
+	vec2 horzRelativePos = worldPos.xy - viewOriginVector.xy;
 	float horzDistance = dot(horzRelativePos, horzRelativePos);
 	fogDensity = FogDensity(horzDistance).xyz;
 
-	PrepareForShadow((modelMatrix * vertexPos).xyz, normal);
+	customColorValue = GetModelCustomColor();
+
+	PrepareForShadow(worldPos, normal);
 }
 
@@ -23,9 +23,9 @@
 varying vec2 textureCoord;
 //varying vec2 detailCoord;
 varying vec3 fogDensity;
+varying vec3 customColorValue;
 
 uniform sampler2D modelTexture;
-uniform vec3 customColor;
 //uniform sampler2D detailTexture;
 
 vec3 EvaluateDynamicLightNoBump();
@@ -37,7 +37,7 @@ void main() {
 	// model color
 	gl_FragColor = vec4(texData.xyz, 1.);
 	if(dot(gl_FragColor.xyz, vec3(1.)) < 0.0001){
-		gl_FragColor.xyz = customColor;
+		gl_FragColor.xyz = customColorValue;
 	}
 	
 	// linearize
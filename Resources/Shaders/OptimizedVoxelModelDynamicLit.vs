@@ -20,10 +20,6 @@
 
 
 
-uniform mat4 projectionViewModelMatrix;
-uniform mat4 modelMatrix;
-uniform mat4 modelNormalMatrix;
-uniform mat4 viewModelMatrix;
 uniform vec3 modelOrigin;
 uniform float fogDistance;
 uniform vec2 texScale;
@@ -40,10 +36,15 @@ attribute vec3 normalAttribute;
 
 varying vec2 textureCoord;
 varying vec3 fogDensity;
+varying vec3 customColorValue;
 //varying vec2 detailCoord;
 
 void PrepareForDynamicLightNoBump(vec3 vertexCoord, vec3 normal);
 vec4 FogDensity(float poweredLength);
+vec4 ProjectModelVertex(vec4 vertexPos);
+vec3 TransformModelVertex(vec4 vertexPos);
+vec3 TransformModelNormal(vec3 normal);
+vec3 GetModelCustomColor();
 
 void main() {
 
@@ -51,20 +52,22 @@ void main() {
 
 	vertexPos.xyz += modelOrigin;
 
-	gl_Position = projectionViewModelMatrix * vertexPos;
+	gl_Position = ProjectModelVertex(vertexPos);
+	vec3 worldPos = TransformModelVertex(vertexPos);
 
 	textureCoord = textureCoordAttribute.xy * texScale.xy;
 
-	vec4 viewPos = viewModelMatrix * vertexPos;
-	vec2 horzRelativePos = (modelMatrix * vertexPos).xy - viewOriginVector.xy;
+	vec2 horzRelativePos = worldPos.xy - viewOriginVector.xy;
 	float horzDistance = dot(horzRelativePos, horzRelativePos);
 	fogDensity = FogDensity(horzDistance).xyz;
 
 	// compute normal
 	vec3 normal = normalAttribute;
-	normal = (modelNormalMatrix * vec4(normal, 1.)).xyz;
+	normal = TransformModelNormal(normal);
 	normal = normalize(normal);
 
-	PrepareForDynamicLightNoBump((modelMatrix * vertexPos).xyz, normal);
+	customColorValue = GetModelCustomColor();
+
+	PrepareForDynamicLightNoBump(worldPos, normal);
 }
 
@@ -1,12 +1,13 @@
-uniform mat4 projectionViewModelMatrix;
 uniform vec3 modelOrigin;
 
 attribute vec3 positionAttribute;
 
+vec4 ProjectModelVertex(vec4 vertexPos);
+
 void main() {
 	
 	vec4 vertexPos = vec4(positionAttribute.xyz, 1.0);
 	vertexPos.xyz += modelOrigin;
-	gl_Position = projectionViewModelMatrix * vertexPos;
+	gl_Position = ProjectModelVertex(vertexPos);
 }
 
@@ -1,6 +1,4 @@
-uniform mat4 projectionViewModelMatrix;
 uniform vec3 modelOrigin;
-uniform mat4 modelMatrix;
 uniform vec3 viewOriginVector;
 
 attribute vec3 positionAttribute;
@@ -8,14 +6,16 @@ attribute vec3 positionAttribute;
 varying vec3 fogDensity;
 
 vec4 FogDensity(float poweredLength);
+vec4 ProjectModelVertex(vec4 vertexPos);
+vec3 TransformModelVertex(vec4 vertexPos);
 
 void main() {
 	
 	vec4 vertexPos = vec4(positionAttribute.xyz, 1.0);
 	vertexPos.xyz += modelOrigin;
-	gl_Position = projectionViewModelMatrix * vertexPos;
+	gl_Position = ProjectModelVertex(vertexPos);
 	
-	vec2 horzRelativePos = (modelMatrix * vertexPos).xy - viewOriginVector.xy;
+	vec2 horzRelativePos = TransformModelVertex(vertexPos).xy - viewOriginVector.xy;
 	float horzDistance = dot(horzRelativePos, horzRelativePos);
 	fogDensity = FogDensity(horzDistance).xyz;
 }
@@ -20,8 +20,6 @@
 
 
 
-uniform mat4 modelMatrix;
-uniform mat4 modelNormalMatrix;
 uniform vec3 modelOrigin;
 
 // [x, y, z, AO ID]
@@ -35,6 +33,8 @@ varying vec3 fogDensity;
 //varying vec2 detailCoord;
 
 void PrepareForShadowMapRender(vec3 position, vec3 normal);
+vec3 TransformModelVertex(vec4 vertexPos);
+vec3 TransformModelNormal(vec3 normal);
 
 void main() {
 
@@ -43,9 +43,9 @@ void main() {
 	vertexPos.xyz += modelOrigin;
 
 	vec3 normal = normalAttribute;
-	normal = (modelNormalMatrix * vec4(normal, 1.)).xyz;
+	normal = TransformModelNormal(normal);
 	normal = normalize(normal);
 
-	PrepareForShadowMapRender((modelMatrix * vertexPos).xyz, normal);
+	PrepareForShadowMapRender(TransformModelVertex(vertexPos), normal);
 }
 
@@ -29,9 +29,13 @@ uniform vec2 zNearFar;
 
 uniform float fogDistance;
 
+// per-instance attributes (GLSpriteInstancer::Instance)
 attribute vec4 positionAttribute;
-attribute vec3 spritePosAttribute;
 attribute vec4 colorAttribute;
+attribute float angleAttribute;
+
+// [-1, 1]
+attribute vec2 cornerAttribute;
 
 varying vec4 color;
 varying vec4 texCoord;
@@ -49,11 +53,11 @@ void main() {
 	vec3 right = rightVector * radius;
 	vec3 up = upVector * radius;
 
-	float angle = spritePosAttribute.z;
+	float angle = angleAttribute;
 	float c = cos(angle), s = sin(angle);
 	vec2 sprP;
-	sprP.x = dot(spritePosAttribute.xy, vec2(c, -s));
-	sprP.y = dot(spritePosAttribute.xy, vec2(s, c));
+	sprP.x = dot(cornerAttribute, vec2(c, -s));
+	sprP.y = dot(cornerAttribute, vec2(s, c));
 	sprP *= radius;
 	pos += right * sprP.x;
 	pos += up * sprP.y;
@@ -78,7 +82,7 @@ void main() {
 	color = colorAttribute;
 
 	// sprite texture coord
-	texCoord.xy = spritePosAttribute.xy * .5 + .5;
+	texCoord.xy = cornerAttribute * .5 + .5;
 
 	// depth texture coord
 	texCoord.zw = vec2(.5) + (gl_Position.xy / gl_Position.w) * .5;
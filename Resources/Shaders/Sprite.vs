@@ -27,9 +27,13 @@ uniform vec3 viewOriginVector;
 
 uniform float fogDistance;
 
+// per-instance attributes (GLSpriteInstancer::Instance)
 attribute vec4 positionAttribute;
-attribute vec3 spritePosAttribute;
 attribute vec4 colorAttribute;
+attribute float angleAttribute;
+
+// [-1, 1]
+attribute vec2 cornerAttribute;
 
 varying vec4 color;
 varying vec2 texCoord;
@@ -44,11 +48,11 @@ void main() {
 	vec3 right = rightVector * radius;
 	vec3 up = upVector * radius;
 
-	float angle = spritePosAttribute.z;
+	float angle = angleAttribute;
 	float c = cos(angle), s = sin(angle);
 	vec2 sprP;
-	sprP.x = dot(spritePosAttribute.xy, vec2(c, -s));
-	sprP.y = dot(spritePosAttribute.xy, vec2(s, c));
+	sprP.x = dot(cornerAttribute, vec2(c, -s));
+	sprP.y = dot(cornerAttribute, vec2(s, c));
 	sprP *= radius;
 	pos += right * sprP.x;
 	pos += up * sprP.y;
@@ -57,7 +61,7 @@ void main() {
 
 	color = colorAttribute;
 
-	texCoord = spritePosAttribute.xy * .5 + .5;
+	texCoord = cornerAttribute * .5 + .5;
 
 	// fog.
 	// cannot gamma correct because sprite may be
@@ -55,7 +55,7 @@ function Make-Pak
 
 Make-Pak -PakName pak002-Base.pak -RelativePaths `
   License/Credits-pak002-Base.md,
-  Gfx, Scripts/Main.as,
+  Benchmarks, Gfx, Scripts/Main.as,
   Scripts/Gui, Scripts/Base, Shaders, Sounds/Feedback,
   Sounds/Misc, Sounds/Player, Textures
 
@@ -20,7 +20,7 @@ file . | grep ".DS_Store" >> $EXCLUDELIST
 ZIPARGS=-x@${EXCLUDELIST}
 
 zip -r "$OUTPUT_DIR/pak002-Base.pak" \
-License/Credits-pak002-Base.md Gfx Scripts/Main.as \
+License/Credits-pak002-Base.md Benchmarks Gfx Scripts/Main.as \
 Scripts/Gui Scripts/Base Shaders \
 Sounds/Feedback Sounds/Misc Sounds/Player Textures $ZIPARGS > "$LOG_FILE"
 
@@ -26,9 +26,12 @@
 #include "Client.h"
 #include "Fonts.h"
 #include <Core/FileManager.h>
+#include <Core/FilePrefetcher.h>
+#include <Core/IBitmapCodec.h>
 #include <Core/IStream.h>
 #include <Core/Settings.h>
 #include <Core/Strings.h>
+#include <Core/TraceRecorder.h>
 
 #include "IAudioChunk.h"
 #include "IAudioDevice.h"
@@ -43,6 +46,7 @@
 #include "MapView.h"
 #include "PaletteView.h"
 #include "ScoreboardView.h"
+#include "ScreenShotWriter.h"
 #include "TCProgressView.h"
 
 #include "Corpse.h"
@@ -50,6 +54,7 @@
 #include "SmokeSpriteEntity.h"
 
 #include "GameMap.h"
+#include "GameMapSnapshot.h"
 #include "GameMapWrapper.h"
 #include "Weapon.h"
 #include "World.h"
@@ -62,6 +67,9 @@ DEFINE_SPADES_SETTING(cg_serverAlert, "1");
 
 DEFINE_SPADES_SETTING(cg_skipDeadPlayersWhenDead, "1");
 
+// compresses map snapshots (Mapshots/*.vxl.zlib) by zlib
+DEFINE_SPADES_SETTING(cg_mapshotCompression, "0");
+
 SPADES_SETTING(cg_playerName);
 
 // ADDED: Define default values for added mod settings
@@ -89,6 +97,17 @@ namespace spades {
 		// ADDED: Define static variables for Client class
 		Client *Client::globalInstance = nullptr;
 		// END OF ADDED
+
+		namespace {
+			bool IsImageFileName(const std::string &name) {
+				for (IBitmapCodec *codec : IBitmapCodec::GetAllCodecs()) {
+					if (codec->CanLoad() && codec->CheckExtension(name)) {
+						return true;
+					}
+				}
+				return false;
+			}
+		}
         
 		Client::Client(IRenderer *r, IAudioDevice *audioDev, const ServerAddress &host,
 		               FontManager *fontManager, bool replay, std::string demo_name)
@@ -162,6 +181,7 @@ namespace spades {
 			paletteView.reset(new PaletteView(this));
 			tcView.reset(new TCProgressView(this));
 			scriptedUI.Set(new ClientUI(renderer, audioDev, fontManager, this), false);
+			screenShotWriter = std::make_shared<ScreenShotWriter>();
 
 			renderer->SetGameMap(nullptr);
 		}
@@ -287,9 +307,22 @@ namespace spades {
 			renderer->Init();
 			SmokeSpriteEntity::Preload(renderer);
 
-			renderer->RegisterImage("Textures/Fluid.png");
-			renderer->RegisterImage("Textures/WaterExpl.png");
-			renderer->RegisterImage("Gfx/White.tga");
+			// the scripts load most of their images lazily, so decode the ones used
+			// by the last session now instead of in the middle of the game
+			for (const std::string &name : FilePrefetcher::GetPrefetchedFiles()) {
+				if (!IsImageFileName(name)) {
+					continue;
+				}
+				try {
+					renderer->PreloadImage(name.c_str());
+				} catch (const std::exception &ex) {
+					SPLog("Failed to preload '%s': %s", name.c_str(), ex.what());
+				}
+			}
+
+			renderer->PreloadImage("Textures/Fluid.png");
+			renderer->PreloadImage("Textures/WaterExpl.png");
+			renderer->PreloadImage("Gfx/White.tga");
 			audioDevice->RegisterSound("Sounds/Weapons/Block/Build.opus");
 			audioDevice->RegisterSound("Sounds/Weapons/Impacts/FleshLocal1.opus");
 			audioDevice->RegisterSound("Sounds/Weapons/Impacts/FleshLocal2.opus");
@@ -336,19 +369,19 @@ namespace spades {
 			audioDevice->RegisterSound("Sounds/Weapons/Restock.opus");
 			audioDevice->RegisterSound("Sounds/Weapons/RestockLocal.opus");
 			audioDevice->RegisterSound("Sounds/Weapons/AimDownSightLocal.opus");
-			renderer->RegisterImage("Gfx/Ball.png");
+			renderer->PreloadImage("Gfx/Ball.png");
 			renderer->RegisterModel("Models/Player/Dead.kv6");
-			renderer->RegisterImage("Gfx/Spotlight.png");
-			renderer->RegisterImage("Gfx/Glare.png");
-			renderer->RegisterImage("Gfx/Killfeed/a-Rifle.png");
-			renderer->RegisterImage("Gfx/Killfeed/b-SMG.png");
-			renderer->RegisterImage("Gfx/Killfeed/c-Shotgun.png");
-			renderer->RegisterImage("Gfx/Killfeed/d-Headshot.png");
-			renderer->RegisterImage("Gfx/Killfeed/e-Melee.png");
-			renderer->RegisterImage("Gfx/Killfeed/f-Grenade.png");
-			renderer->RegisterImage("Gfx/Killfeed/g-Falling.png");
-			renderer->RegisterImage("Gfx/Killfeed/h-Teamchange.png");
-			renderer->RegisterImage("Gfx/Killfeed/i-Classchange.png");
+			renderer->PreloadImage("Gfx/Spotlight.png");
+			renderer->PreloadImage("Gfx/Glare.png");
+			renderer->PreloadImage("Gfx/Killfeed/a-Rifle.png");
+			renderer->PreloadImage("Gfx/Killfeed/b-SMG.png");
+			renderer->PreloadImage("Gfx/Killfeed/c-Shotgun.png");
+			renderer->PreloadImage("Gfx/Killfeed/d-Headshot.png");
+			renderer->PreloadImage("Gfx/Killfeed/e-Melee.png");
+			renderer->PreloadImage("Gfx/Killfeed/f-Grenade.png");
+			renderer->PreloadImage("Gfx/Killfeed/g-Falling.png");
+			renderer->PreloadImage("Gfx/Killfeed/h-Teamchange.png");
+			renderer->PreloadImage("Gfx/Killfeed/i-Classchange.png");
 			renderer->RegisterModel("Models/Weapons/Spade/Spade.kv6");
 			renderer->RegisterModel("Models/Weapons/Block/Block2.kv6");
 			renderer->RegisterModel("Models/Weapons/Grenade/Grenade.kv6");
@@ -371,13 +404,13 @@ namespace spades {
 			renderer->RegisterModel("Models/Player/Head.kv6");
 			renderer->RegisterModel("Models/MapObjects/Intel.kv6");
 			renderer->RegisterModel("Models/MapObjects/CheckPoint.kv6");
-			renderer->RegisterImage("Gfx/Bullet/7.62mm.png");
-			renderer->RegisterImage("Gfx/Bullet/9mm.png");
-			renderer->RegisterImage("Gfx/Bullet/12gauge.png");
-			renderer->RegisterImage("Gfx/CircleGradient.png");
-			renderer->RegisterImage("Gfx/HurtSprite.png");
-			renderer->RegisterImage("Gfx/HurtRing2.png");
-			renderer->RegisterImage("Gfx/Intel.png");
+			renderer->PreloadImage("Gfx/Bullet/7.62mm.png");
+			renderer->PreloadImage("Gfx/Bullet/9mm.png");
+			renderer->PreloadImage("Gfx/Bullet/12gauge.png");
+			renderer->PreloadImage("Gfx/CircleGradient.png");
+			renderer->PreloadImage("Gfx/HurtSprite.png");
+			renderer->PreloadImage("Gfx/HurtRing2.png");
+			renderer->PreloadImage("Gfx/Intel.png");
 			audioDevice->RegisterSound("Sounds/Feedback/Chat.opus");
 
 			if (mumbleLink.init())
@@ -436,6 +469,7 @@ namespace spades {
 
 		void Client::RunFrame(float dt) {
 			SPADES_MARK_FUNCTION();
+			SPADES_TRACE_SCOPE("Client::RunFrame");
 
 			fpsCounter.MarkFrame();
 
@@ -496,6 +530,12 @@ namespace spades {
 			chatWindow->Update(dt);
 			killfeedWindow->Update(dt);
 			limbo->Update(dt);
+			UpdateScreenShots();
+
+			if (world && time - worldSetTime > 60.f) {
+				// the files needed for the first minute of play were all opened
+				FilePrefetcher::Finish();
+			}
 
 			// CreateSceneDefinition also can be used for sounds
 			SceneDefinition sceneDef = CreateSceneDefinition();
@@ -634,23 +674,20 @@ namespace spades {
 		void Client::TakeMapShot() {
 
 			try {
-				std::string name = MapShotPath();
-				{
-					std::unique_ptr<IStream> stream(FileManager::OpenForWriting(name.c_str()));
-					try {
-						GameMap *map = GetWorld()->GetMap();
-						if (map == nullptr) {
-							SPRaise("No map loaded");
-						}
-						map->Save(stream.get());
-					} catch (...) {
-						throw;
-					}
+				GameMap *map = GetWorld()->GetMap();
+				if (map == nullptr) {
+					SPRaise("No map loaded");
 				}
 
-				std::string msg;
-				msg = _Tr("Client", "Map saved: {0}", name);
-				ShowAlert(msg, AlertType::Notice);
+				std::string name = MapShotPath();
+
+				// the file isn't created until the snapshot is saved, so reserve
+				// the name for it
+				nextMapShotIndex = (nextMapShotIndex + 1) % 10000;
+
+				// the map is serialized and compressed in background
+				std::shared_ptr<GameMapSnapshot> snapshot(new GameMapSnapshot(*map));
+				screenShotWriter->SaveMap(std::move(snapshot), name, cg_mapshotCompression);
 			} catch (const Exception &ex) {
 				std::string msg;
 				msg = _Tr("Client", "Saving map failed: ");
@@ -668,16 +705,18 @@ namespace spades {
 
 		std::string Client::MapShotPath() {
 			char buf[256];
+			char bufCompressed[256];
 			for (int i = 0; i < 10000; i++) {
-				sprintf(buf, "Mapshots/shot%04d.vxl", nextScreenShotIndex);
-				if (FileManager::FileExists(buf)) {
-					nextScreenShotIndex++;
-					if (nextScreenShotIndex >= 10000)
-						nextScreenShotIndex = 0;
+				sprintf(buf, "Mapshots/shot%04d.vxl", nextMapShotIndex);
+				sprintf(bufCompressed, "Mapshots/shot%04d.vxl.zlib", nextMapShotIndex);
+				if (FileManager::FileExists(buf) || FileManager::FileExists(bufCompressed)) {
+					nextMapShotIndex++;
+					if (nextMapShotIndex >= 10000)
+						nextMapShotIndex = 0;
 					continue;
 				}
 
-				return buf;
+				return cg_mapshotCompression ? bufCompressed : buf;
 			}
 
 			SPRaise("No free file name");
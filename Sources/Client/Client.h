@@ -67,6 +67,7 @@ namespace spades {
 		class PaletteView;
 		class TCProgressView;
 		class ClientPlayer;
+		class ScreenShotWriter;
 
 		class ClientUI;
 
@@ -331,6 +332,9 @@ namespace spades {
 			void RemoveCorpseForPlayer(int playerId);
 
 			int nextScreenShotIndex;
+			// shared with the pending framebuffer reads, which may complete after
+			// the client is destroyed
+			std::shared_ptr<ScreenShotWriter> screenShotWriter;
 			int nextMapShotIndex;
 
 			Vector3 Project(Vector3);
@@ -383,6 +387,7 @@ namespace spades {
 			void DrawHitTestDebugger();
 
 			void DrawDemoProgress();
+			void DrawMapLoadingProgress();
 			struct {
 				bool uiActive;
 				float skipTo;
@@ -405,6 +410,9 @@ namespace spades {
 
 			std::string ScreenShotPath();
 			void TakeScreenShot(bool sceneOnly);
+			/** Shows the results of the screenshots and map snapshots saved in
+			 * background. */
+			void UpdateScreenShots();
 
 			std::string MapShotPath();
 			void TakeMapShot();
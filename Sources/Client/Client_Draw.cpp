@@ -48,6 +48,7 @@
 #include "PaletteView.h"
 #include "ParticleSpriteEntity.h"
 #include "ScoreboardView.h"
+#include "ScreenShotWriter.h"
 #include "SmokeSpriteEntity.h"
 #include "TCProgressView.h"
 #include "Tracer.h"
@@ -150,36 +151,63 @@ namespace spades {
 			// Well done!
 			renderer->FrameDone();
 
-			Handle<Bitmap> bmp(renderer->ReadBitmap(), false);
-			// force 100% opacity
-
-			uint32_t *pixels = bmp->GetPixels();
-			for (size_t i = bmp->GetWidth() * bmp->GetHeight(); i > 0; i--) {
-				*(pixels++) |= 0xff000000UL;
-			}
-
+			std::string name;
 			try {
-				std::string name = ScreenShotPath();
-				bmp->Save(name);
-
-				std::string msg;
-				if (sceneOnly)
-					msg = _Tr("Client", "Sceneshot saved: {0}", name);
-				else
-					msg = _Tr("Client", "Screenshot saved: {0}", name);
-				ShowAlert(msg, AlertType::Notice);
+				name = ScreenShotPath();
 			} catch (const Exception &ex) {
 				std::string msg;
 				msg = _Tr("Client", "Screenshot failed: ");
 				msg += ex.GetShortMessage();
 				ShowAlert(msg, AlertType::Error);
 				SPLog("Screenshot failed: %s", ex.what());
+				return;
 			} catch (const std::exception &ex) {
 				std::string msg;
 				msg = _Tr("Client", "Screenshot failed: ");
 				msg += ex.what();
 				ShowAlert(msg, AlertType::Error);
 				SPLog("Screenshot failed: %s", ex.what());
+				return;
+			}
+
+			// the file isn't created until the screenshot is encoded, so reserve
+			// the name for it
+			nextScreenShotIndex = (nextScreenShotIndex + 1) % 10000;
+
+			// the pixels are read, made opaque, and saved in background
+			std::weak_ptr<ScreenShotWriter> writerRef = screenShotWriter;
+			renderer->ReadBitmapAsync([writerRef, name, sceneOnly](Handle<Bitmap> bmp) {
+				if (auto writer = writerRef.lock()) {
+					writer->Save(std::move(bmp), name, sceneOnly);
+				}
+			});
+		}
+
+		void Client::UpdateScreenShots() {
+			for (const ScreenShotWriter::Result &result : screenShotWriter->Poll()) {
+				std::string msg;
+				if (!result.error.empty()) {
+					if (result.kind == ScreenShotWriter::Kind::Map)
+						msg = _Tr("Client", "Saving map failed: ");
+					else
+						msg = _Tr("Client", "Screenshot failed: ");
+					msg += result.error;
+					ShowAlert(msg, AlertType::Error);
+					continue;
+				}
+
+				switch (result.kind) {
+					case ScreenShotWriter::Kind::Screenshot:
+						msg = _Tr("Client", "Screenshot saved: {0}", result.path);
+						break;
+					case ScreenShotWriter::Kind::Sceneshot:
+						msg = _Tr("Client", "Sceneshot saved: {0}", result.path);
+						break;
+					case ScreenShotWriter::Kind::Map:
+						msg = _Tr("Client", "Map saved: {0}", result.path);
+						break;
+				}
+				ShowAlert(msg, AlertType::Notice);
 			}
 		}
 
@@ -1144,6 +1172,30 @@ namespace spades {
 			font->DrawShadow(str, pos, 1.f, numberColor, MakeVector4(0, 0, 0, (float)n_hudTransparency));
 		}
 
+		void Client::DrawMapLoadingProgress() {
+			// the distant parts of the map are still being built by the renderer
+			float progress = renderer->GetMapLoadingProgress();
+			if (progress >= 1.f)
+				return;
+
+			float scrWidth = renderer->ScreenWidth();
+			float scrHeight = renderer->ScreenHeight();
+			IFont *font = fontManager->GetGuiFont();
+
+			std::string msg = _Tr("Client", "Loading map: {0}%", (int)(progress * 100.f));
+			Vector2 textSize = font->Measure(msg);
+			font->DrawShadow(msg, MakeVector2(scrWidth - 16.f, scrHeight - 28.f) - textSize, 1.f,
+			                 MakeVector4(1, 1, 1, 0.95f), MakeVector4(0, 0, 0, 0.5f));
+
+			Handle<IImage> img = renderer->RegisterImage("Gfx/White.tga");
+			AABB2 bar(scrWidth - 236.f, scrHeight - 20.f, 220.f, 4.f);
+			renderer->SetColorAlphaPremultiplied(MakeVector4(0.f, 0.f, 0.f, 0.5f));
+			renderer->DrawImage(img, bar);
+			bar.max.x = bar.min.x + bar.GetWidth() * progress;
+			renderer->SetColorAlphaPremultiplied(MakeVector4(1.f, 1.f, 1.f, 0.95f));
+			renderer->DrawImage(img, bar);
+		}
+
 		void Client::Draw2DWithWorld() {
 			SPADES_MARK_FUNCTION();
 
@@ -1214,8 +1266,10 @@ namespace spades {
 				DrawAlert();
 			}
 
-			if (!cg_hideHud)
+			if (!cg_hideHud) {
 				centerMessageView->Draw();
+				DrawMapLoadingProgress();
+			}
 
 			if (scoreboardVisible || !p)
 				scoreboard->Draw();
@@ -24,6 +24,7 @@
 #include <Core/ConcurrentDispatch.h>
 #include <Core/Settings.h>
 #include <Core/Strings.h>
+#include <Core/TraceRecorder.h>
 
 #include "IAudioChunk.h"
 #include "IAudioDevice.h"
@@ -172,6 +173,7 @@ namespace spades {
 
 		void Client::UpdateWorld(float dt) {
 			SPADES_MARK_FUNCTION();
+			SPADES_TRACE_SCOPE("Client::UpdateWorld");
 
 			Player *player = world->GetLocalPlayer();
 
@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <list>
 
@@ -35,7 +36,11 @@
 namespace spades {
 	class IStream;
 	namespace client {
+		class GameMapSnapshot;
+
 		class GameMap : public RefCountedObject {
+			friend class GameMapSnapshot;
+
 		protected:
 			~GameMap();
 
@@ -76,6 +81,21 @@ namespace spades {
 				return colorMap[x][y][z];
 			}
 
+			/** @return 0xZZBBGGRR where ZZ is the Z coordinate of the topmost solid
+			 * voxel of the column (64 if there's none) and BBGGRR is its color */
+			inline uint32_t GetTopColor(int x, int y) {
+				SPAssert(x >= 0);
+				SPAssert(x < Width());
+				SPAssert(y >= 0);
+				SPAssert(y < Height());
+				uint64_t column = solidMap[x][y];
+				if (column == 0) {
+					return 64UL << 24;
+				}
+				int z = CountTrailingZeros(column);
+				return (colorMap[x][y][z] & 0xffffffUL) | ((uint32_t)z << 24);
+			}
+
 			inline uint64_t GetSolidMapWrapped(int x, int y) {
 				return solidMap[x & (Width() - 1)][y & (Height() - 1)];
 			}
@@ -113,6 +133,9 @@ namespace spades {
 				if (solid) {
 					if (color != colorMap[x][y][z]) {
 						changed = true;
+						if (numSnapshots.load(std::memory_order_relaxed) != 0) {
+							PreserveColumn(x, y);
+						}
 						colorMap[x][y][z] = color;
 					}
 				}
@@ -156,7 +179,13 @@ namespace spades {
 			std::list<IGameMapListener *> listeners;
 			Mutex listenersMutex;
 
-			bool IsSurface(int x, int y, int z);
+			std::list<GameMapSnapshot *> snapshots;
+			std::atomic<int> numSnapshots{0};
+			Mutex snapshotsMutex;
+
+			/** Makes the snapshots copy the colors of the column before they are
+			 * modified. */
+			void PreserveColumn(int x, int y);
 		};
 	}
 }
@@ -0,0 +1,175 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+
+#include <algorithm>
+#include <cstring>
+
+#include "GameMapSnapshot.h"
+#include <Core/AutoLocker.h>
+#include <Core/Debug.h>
+#include <Core/IStream.h>
+
+namespace spades {
+	namespace client {
+		namespace {
+			void WriteColor(std::vector<char> &buffer, uint32_t color) {
+				buffer.push_back((char)(color >> 16));
+				buffer.push_back((char)(color >> 8));
+				buffer.push_back((char)(color >> 0));
+				buffer.push_back((char)(color >> 24));
+			}
+		}
+
+		GameMapSnapshot::GameMapSnapshot(GameMap &m) : map(&m) {
+			SPADES_MARK_FUNCTION();
+
+			solidMap.resize(GameMap::DefaultWidth * GameMap::DefaultHeight);
+			std::memcpy(solidMap.data(), m.solidMap, solidMap.size() * sizeof(uint64_t));
+
+			AutoLocker guard(&m.snapshotsMutex);
+			m.snapshots.push_back(this);
+			m.numSnapshots++;
+		}
+
+		GameMapSnapshot::~GameMapSnapshot() {
+			SPADES_MARK_FUNCTION();
+
+			AutoLocker guard(&map->snapshotsMutex);
+			map->snapshots.remove(this);
+			map->numSnapshots--;
+		}
+
+		void GameMapSnapshot::PreserveColumn(int x, int y) {
+			AutoLocker guard(&mutex);
+			int key = x * GameMap::DefaultHeight + y;
+			if (preservedColumns.find(key) != preservedColumns.end()) {
+				return;
+			}
+			auto &column = preservedColumns[key];
+			std::copy(map->colorMap[x][y], map->colorMap[x][y] + GameMap::DefaultDepth,
+			          column.begin());
+		}
+
+		uint64_t GameMapSnapshot::GetSurfaceMap(int x, int y) {
+			const int w = GameMap::DefaultWidth;
+			const int h = GameMap::DefaultHeight;
+			const uint64_t all = ~0ULL;
+
+			// the voxels outside the map are solid horizontally, and the voxels
+			// above the top are empty
+			uint64_t column = GetSolidMap(x, y);
+			uint64_t covered = x > 0 ? GetSolidMap(x - 1, y) : all;
+			covered &= x < w - 1 ? GetSolidMap(x + 1, y) : all;
+			covered &= y > 0 ? GetSolidMap(x, y - 1) : all;
+			covered &= y < h - 1 ? GetSolidMap(x, y + 1) : all;
+			covered &= column << 1;
+			covered &= (column >> 1) | (1ULL << 63);
+			return column & ~covered;
+		}
+
+		// base on pysnip
+		void GameMapSnapshot::Save(IStream *stream) {
+			SPADES_MARK_FUNCTION();
+
+			const int w = GameMap::DefaultWidth;
+			const int h = GameMap::DefaultHeight;
+			const int d = GameMap::DefaultDepth;
+			static_assert(d == 64, "one column must fit in uint64_t");
+
+			std::vector<uint32_t> rowColors(w * d);
+			std::vector<char> buffer;
+			buffer.reserve(64 * 1024);
+
+			for (int y = 0; y < h; y++) {
+				// copy the colors of this row while the game is prevented from
+				// modifying them
+				{
+					AutoLocker guard(&mutex);
+					for (int x = 0; x < w; x++) {
+						const uint32_t *column = map->colorMap[x][y];
+						auto it = preservedColumns.find(x * h + y);
+						if (it != preservedColumns.end()) {
+							column = it->second.data();
+						}
+						std::copy(column, column + d, rowColors.begin() + x * d);
+					}
+				}
+
+				buffer.clear();
+				for (int x = 0; x < w; x++) {
+					const uint64_t solid = GetSolidMap(x, y);
+					const uint64_t surface = GetSurfaceMap(x, y);
+					auto IsSolid = [=](int z) { return z < d && ((solid >> z) & 1); };
+					auto IsSurface = [=](int z) { return z < d && ((surface >> z) & 1); };
+					const uint32_t *columnColors = rowColors.data() + x * d;
+
+					int k = 0;
+					while (k < d) {
+						int air_start = k;
+						while (k < d && !IsSolid(k))
+							++k;
+						int top_colors_start = k;
+						while (IsSurface(k))
+							++k;
+						int top_colors_end = k; // exclusive
+
+						while (IsSolid(k) && !IsSurface(k))
+							++k;
+
+						int bottom_colors_start = k;
+
+						int z = k;
+						while (IsSurface(z))
+							++z;
+
+						if (z != d) {
+							while (IsSurface(k))
+								++k;
+						}
+						int bottom_colors_end = k; // exclusive
+
+						int top_colors_len = top_colors_end - top_colors_start;
+						int bottom_colors_len = bottom_colors_end - bottom_colors_start;
+
+						int colors = top_colors_len + bottom_colors_len;
+
+						if (k == d) {
+							buffer.push_back(0);
+						} else {
+							buffer.push_back(colors + 1);
+						}
+						buffer.push_back(top_colors_start);
+						buffer.push_back(top_colors_end - 1);
+						buffer.push_back(air_start);
+
+						for (z = 0; z < top_colors_len; ++z) {
+							WriteColor(buffer, columnColors[top_colors_start + z]);
+						}
+						for (z = 0; z < bottom_colors_len; ++z) {
+							WriteColor(buffer, columnColors[bottom_colors_start + z]);
+						}
+					}
+				}
+				stream->Write(buffer.data(), buffer.size());
+			}
+		}
+	}
+}
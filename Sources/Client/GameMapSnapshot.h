@@ -0,0 +1,77 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "GameMap.h"
+#include <Core/Mutex.h>
+#include <Core/RefCountedObject.h>
+
+namespace spades {
+	class IStream;
+	namespace client {
+		/**
+		 * A copy-on-write snapshot of a `GameMap`.
+		 *
+		 * The solid voxels are copied when the snapshot is created. The colors
+		 * are read from the map itself, except the columns modified after the
+		 * snapshot was created, which are copied by `GameMap::Set` before being
+		 * modified. This allows the snapshot to be read on another thread while
+		 * the game continues to modify the map.
+		 *
+		 * Must be created on the thread that modifies the map.
+		 */
+		class GameMapSnapshot {
+			friend class GameMap;
+
+			Handle<GameMap> map;
+			std::vector<uint64_t> solidMap;
+
+			// guards `preservedColumns` and the reads of the map's colors
+			Mutex mutex;
+			std::unordered_map<int, std::array<uint32_t, GameMap::DefaultDepth>>
+			  preservedColumns;
+
+			/** Called by `GameMap` before the colors of the column are modified. */
+			void PreserveColumn(int x, int y);
+
+			uint64_t GetSolidMap(int x, int y) {
+				return solidMap[x * GameMap::DefaultHeight + y];
+			}
+
+			/** Computes the voxels exposed to air (the ones the VXL format stores
+			 * the colors of) in the given column. */
+			uint64_t GetSurfaceMap(int x, int y);
+
+		public:
+			GameMapSnapshot(GameMap &);
+			~GameMapSnapshot();
+
+			/** Writes the snapshot in the VXL format. Can be called on any thread. */
+			void Save(IStream *);
+		};
+	}
+}
@@ -19,7 +19,12 @@
  */
 
 #include "IRenderer.h"
+#include <Core/Bitmap.h>
 
 namespace spades {
-    namespace client {}
+	namespace client {
+		void IRenderer::ReadBitmapAsync(std::function<void(Handle<Bitmap>)> callback) {
+			callback(Handle<Bitmap>(ReadBitmap(), false));
+		}
+	}
 }
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <functional>
+
 #include <Core/Math.h>
 #include "IImage.h"
 #include "IModel.h"
@@ -86,12 +88,18 @@ namespace spades {
 			virtual void Shutdown() = 0;
 
 			virtual IImage *RegisterImage(const char *filename) = 0;
+			/** Starts loading an image in advance so that registering it later
+			 * doesn't stall. */
+			virtual void PreloadImage(const char *filename) { RegisterImage(filename)->Release(); }
 			virtual IModel *RegisterModel(const char *filename) = 0;
 
 			virtual IImage *CreateImage(Bitmap *) = 0;
 			virtual IModel *CreateModel(VoxelModel *) = 0;
 
 			virtual void SetGameMap(GameMap *) = 0;
+			/** Returns the fraction of the map around the camera that is ready
+			 * to be drawn since the last `SetGameMap`, between 0 and 1. */
+			virtual float GetMapLoadingProgress() { return 1.f; }
 
 			virtual void SetFogDistance(float) = 0;
 			virtual void SetFogColor(Vector3) = 0;
@@ -139,6 +147,12 @@ namespace spades {
 			/** get a rendered image. */
 			virtual Bitmap *ReadBitmap() = 0;
 
+			/** Reads a rendered image like `ReadBitmap` without waiting for the
+			 * GPU. `callback` is called with the image (or null on failure) in
+			 * a later `FrameDone`, or immediately if the renderer can't read
+			 * asynchronously. */
+			virtual void ReadBitmapAsync(std::function<void(Handle<Bitmap>)> callback);
+
 			virtual float ScreenWidth() = 0;
 			virtual float ScreenHeight() = 0;
 		};
@@ -0,0 +1,128 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+
+#include <atomic>
+#include <cstdint>
+
+#include "GameMapSnapshot.h"
+#include "ScreenShotWriter.h"
+#include <Core/Bitmap.h>
+#include <Core/Debug.h>
+#include <Core/DeflateStream.h>
+#include <Core/Exception.h>
+#include <Core/FileManager.h>
+#include <Core/IStream.h>
+
+namespace spades {
+	namespace client {
+		class ScreenShotWriter::Job : public Task {
+			std::function<void()> save;
+			std::atomic<bool> done{false};
+
+		protected:
+			void Execute() override {
+				SPADES_MARK_FUNCTION();
+				try {
+					save();
+				} catch (const Exception &ex) {
+					result.error = ex.GetShortMessage();
+					SPLog("Saving %s failed: %s", result.path.c_str(), ex.what());
+				} catch (const std::exception &ex) {
+					result.error = ex.what();
+					SPLog("Saving %s failed: %s", result.path.c_str(), ex.what());
+				}
+				// release the image or the snapshot
+				save = nullptr;
+				done.store(true, std::memory_order_release);
+			}
+
+		public:
+			Result result;
+
+			Job(std::function<void()> save, const std::string &path, Kind kind)
+			    : save(std::move(save)) {
+				result.path = path;
+				result.kind = kind;
+			}
+
+			bool IsDone() const { return done.load(std::memory_order_acquire); }
+		};
+
+		ScreenShotWriter::ScreenShotWriter() {}
+
+		ScreenShotWriter::~ScreenShotWriter() { tasks.Wait(); }
+
+		void ScreenShotWriter::Start(std::function<void()> save, const std::string &path,
+		                             Kind kind) {
+			std::unique_ptr<Job> job(new Job(std::move(save), path, kind));
+			tasks.Run(*job);
+			jobs.push_back(std::move(job));
+		}
+
+		void ScreenShotWriter::Save(Handle<Bitmap> bitmap, const std::string &path,
+		                            bool sceneOnly) {
+			SPADES_MARK_FUNCTION();
+
+			Start(
+			  [bitmap, path]() mutable {
+				  if (!bitmap) {
+					  SPRaise("Failed to read the framebuffer");
+				  }
+
+				  // force 100% opacity
+				  std::uint32_t *pixels = bitmap->GetPixels();
+				  for (std::size_t i = bitmap->GetWidth() * bitmap->GetHeight(); i > 0; i--) {
+					  *(pixels++) |= 0xff000000UL;
+				  }
+
+				  bitmap->Save(path);
+			  },
+			  path, sceneOnly ? Kind::Sceneshot : Kind::Screenshot);
+		}
+
+		void ScreenShotWriter::SaveMap(std::shared_ptr<GameMapSnapshot> snapshot,
+		                               const std::string &path, bool compress) {
+			SPADES_MARK_FUNCTION();
+
+			Start(
+			  [snapshot, path, compress]() {
+				  std::unique_ptr<IStream> stream(FileManager::OpenForWriting(path.c_str()));
+				  if (compress) {
+					  DeflateStream deflate(stream.get(), CompressModeCompress);
+					  snapshot->Save(&deflate);
+					  deflate.DeflateEnd();
+				  } else {
+					  snapshot->Save(stream.get());
+				  }
+			  },
+			  path, Kind::Map);
+		}
+
+		std::vector<ScreenShotWriter::Result> ScreenShotWriter::Poll() {
+			std::vector<Result> results;
+			while (!jobs.empty() && jobs.front()->IsDone()) {
+				results.push_back(std::move(jobs.front()->result));
+				jobs.pop_front();
+			}
+			return results;
+		}
+	}
+}
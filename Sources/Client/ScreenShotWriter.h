@@ -0,0 +1,80 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+
+#pragma once
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Core/RefCountedObject.h>
+#include <Core/TaskScheduler.h>
+
+namespace spades {
+	class Bitmap;
+
+	namespace client {
+		class GameMapSnapshot;
+
+		/**
+		 * Encodes and saves screenshots and map snapshots on worker threads so
+		 * that taking one doesn't stall the game.
+		 */
+		class ScreenShotWriter {
+		public:
+			enum class Kind { Screenshot, Sceneshot, Map };
+
+			struct Result {
+				std::string path;
+				Kind kind;
+				/** Empty if the file was saved successfully. */
+				std::string error;
+			};
+
+		private:
+			class Job;
+
+			TaskGroup tasks;
+			std::list<std::unique_ptr<Job>> jobs;
+
+			void Start(std::function<void()> save, const std::string &path, Kind);
+
+		public:
+			ScreenShotWriter();
+			/** Waits for the files being saved. */
+			~ScreenShotWriter();
+
+			/** Starts saving a screenshot. A null `bitmap` is reported as a failure. */
+			void Save(Handle<Bitmap> bitmap, const std::string &path, bool sceneOnly);
+
+			/** Starts saving a map snapshot in the VXL format, optionally
+			 * compressed by zlib. */
+			void SaveMap(std::shared_ptr<GameMapSnapshot>, const std::string &path,
+			             bool compress);
+
+			/** Returns the results of the finished files in the order they were
+			 * started. */
+			std::vector<Result> Poll();
+		};
+	}
+}
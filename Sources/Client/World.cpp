@@ -27,6 +27,7 @@
 #include <Core/Debug.h>
 #include <Core/FileManager.h>
 #include <Core/IStream.h>
+#include <Core/TraceRecorder.h>
 #include "GameMap.h"
 #include "GameMapWrapper.h"
 #include "GameProperties.h"
@@ -92,6 +93,7 @@ namespace spades {
 
 		void World::Advance(float dt) {
 			SPADES_MARK_FUNCTION();
+			SPADES_TRACE_SCOPE("World::Advance");
 
 			ApplyBlockActions();
 
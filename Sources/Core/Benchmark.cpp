@@ -0,0 +1,69 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+
+#include "Benchmark.h"
+#include "Debug.h"
+#include "Stopwatch.h"
+
+namespace spades {
+	namespace {
+		// function-local static so that the list head is initialized before any
+		// `Benchmark` defined in other translation units
+		Benchmark *&GetListHead() {
+			static Benchmark *head = nullptr;
+			return head;
+		}
+	}
+
+	Benchmark::Benchmark(const char *name, void (*function)())
+	    : name(name), function(function) {
+		next = GetListHead();
+		GetListHead() = this;
+	}
+
+	Benchmark *Benchmark::Find(const std::string &name) {
+		for (Benchmark *b = GetListHead(); b; b = b->next) {
+			if (name == b->name) {
+				return b;
+			}
+		}
+		return nullptr;
+	}
+
+	std::vector<std::string> Benchmark::GetAllNames() {
+		std::vector<std::string> names;
+		for (Benchmark *b = GetListHead(); b; b = b->next) {
+			names.push_back(b->name);
+		}
+		std::sort(names.begin(), names.end());
+		return names;
+	}
+
+	void Benchmark::Run() {
+		SPADES_MARK_FUNCTION();
+
+		SPLog("---- Benchmark '%s' started ----", name);
+		Stopwatch sw;
+		function();
+		SPLog("---- Benchmark '%s' done in %.3fs ----", name, sw.GetTime());
+	}
+}
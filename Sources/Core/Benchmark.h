@@ -0,0 +1,50 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace spades {
+	/**
+	 * A benchmark which can be run with `openspades --benchmark NAME`.
+	 *
+	 * Benchmarks are registered by defining a static `Benchmark` object. They
+	 * run after the file system and the settings are initialized, and report
+	 * their results through `SPLog`.
+	 */
+	class Benchmark {
+		const char *name;
+		void (*function)();
+		Benchmark *next;
+
+	public:
+		Benchmark(const char *name, void (*function)());
+
+		const char *GetName() const { return name; }
+
+		static Benchmark *Find(const std::string &name);
+		static std::vector<std::string> GetAllNames();
+
+		/** Runs the benchmark. Exceptions are propagated to the caller. */
+		void Run();
+	};
+}
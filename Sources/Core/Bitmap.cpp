@@ -115,6 +115,95 @@ namespace spades {
 		}
 	}
 
+	Bitmap *Bitmap::Load(IStream *stream, const std::string &filename) {
+		std::vector<IBitmapCodec *> codecs = IBitmapCodec::GetAllCodecs();
+		auto pos = stream->GetPosition();
+		std::string errMsg;
+		for (size_t i = 0; i < codecs.size(); i++) {
+			IBitmapCodec *codec = codecs[i];
+			if (codec->CanLoad() && codec->CheckExtension(filename)) {
+				try {
+					stream->SetPosition(pos);
+					return codec->Load(stream);
+				} catch (const std::exception &ex) {
+					errMsg += codec->GetName();
+					errMsg += ":\n";
+					errMsg += ex.what();
+					errMsg += "\n\n";
+				}
+			}
+		}
+
+		if (errMsg.empty()) {
+			SPRaise("Bitmap codec not found for filename: %s", filename.c_str());
+		} else {
+			SPRaise("No bitmap codec could load file successfully: %s\n%s\n", filename.c_str(),
+			        errMsg.c_str());
+		}
+	}
+
+	bool Bitmap::PeekSize(const std::string &filename, const std::string &data, int &width,
+	                      int &height) {
+		auto byteAt = [&](std::size_t i) -> int { return static_cast<unsigned char>(data[i]); };
+		auto bigShortAt = [&](std::size_t i) { return (byteAt(i) << 8) | byteAt(i + 1); };
+
+		if (data.size() >= 24 && data.compare(0, 8, "\x89PNG\r\n\x1a\n") == 0 &&
+		    data.compare(12, 4, "IHDR") == 0) {
+			// the dimensions are 32-bit big endian, but larger images aren't supported anyway
+			if (bigShortAt(16) != 0 || bigShortAt(20) != 0) {
+				return false;
+			}
+			width = bigShortAt(18);
+			height = bigShortAt(22);
+		} else if (data.size() >= 4 && byteAt(0) == 0xff && byteAt(1) == 0xd8) {
+			// find the SOFn marker of JPEG
+			std::size_t pos = 2;
+			while (true) {
+				if (pos + 4 > data.size() || byteAt(pos) != 0xff) {
+					return false;
+				}
+				int marker = byteAt(pos + 1);
+				if (marker == 0xff) {
+					// fill byte
+					pos++;
+					continue;
+				}
+				if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+					// markers without a payload
+					pos += 2;
+					continue;
+				}
+				if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 &&
+				    marker != 0xcc) {
+					if (pos + 9 > data.size()) {
+						return false;
+					}
+					height = bigShortAt(pos + 5);
+					width = bigShortAt(pos + 7);
+					break;
+				}
+				if (marker == 0xd9 || marker == 0xda) {
+					// reached the image data without a frame header
+					return false;
+				}
+				pos += 2 + bigShortAt(pos + 2);
+			}
+		} else if (IBitmapCodec::EndsWith(filename, ".tga") && data.size() >= 18) {
+			// Targa doesn't have a signature
+			int imageType = byteAt(2);
+			if (imageType != 1 && imageType != 2 && imageType != 3 && imageType != 9 &&
+			    imageType != 10 && imageType != 11) {
+				return false;
+			}
+			width = byteAt(12) | (byteAt(13) << 8);
+			height = byteAt(14) | (byteAt(15) << 8);
+		} else {
+			return false;
+		}
+
+		return width > 0 && height > 0;
+	}
+
 	void Bitmap::Save(const std::string &filename) {
 		std::vector<IBitmapCodec *> codecs = IBitmapCodec::GetAllCodecs();
 		for (size_t i = 0; i < codecs.size(); i++) {
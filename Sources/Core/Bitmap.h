@@ -42,6 +42,15 @@ namespace spades {
 
 		static Bitmap *Load(const std::string &);
 		static Bitmap *Load(IStream *); // must be seekable
+		/** Decodes `stream` (must be seekable) with the codecs supporting the
+		 * extension of `filename`. Safe to call on any thread. */
+		static Bitmap *Load(IStream *stream, const std::string &filename);
+
+		/** Reads the dimensions of a PNG, JPEG or Targa image from the header
+		 * of the file's content without decoding it.
+		 * @return `false` if the format is not supported or the header is broken. */
+		static bool PeekSize(const std::string &filename, const std::string &data, int &width,
+		                     int &height);
 		void Save(const std::string &);
 
 		uint32_t *GetPixels() { return pixels; }
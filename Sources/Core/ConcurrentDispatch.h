@@ -20,14 +20,14 @@
 
 #pragma once
 
+#include <atomic>
 #include <exception>
 #include <string>
 
 #include "IRunnable.h"
+#include "TaskScheduler.h"
 
 namespace spades {
-	struct SyncQueueEntry;
-	class DispatchThread;
 	class SynchronizedQueue;
 	class ConcurrentDispatch;
 
@@ -45,22 +45,27 @@ namespace spades {
 		void MarkSDLVideoThread();
 	};
 
-	class ConcurrentDispatch : public IRunnable {
-		friend class DispatchThread;
+	/**
+	 * Compatibility wrapper of `Task` which can be joined or released.
+	 * `Start` schedules the dispatch on the global `TaskScheduler`.
+	 */
+	class ConcurrentDispatch : public Task, public IRunnable {
 		friend class DispatchQueue;
-		friend struct SyncQueueEntry;
+
+		enum { StateStarted = 1, StateDone = 2, StateReleased = 4 };
 
 		std::string name;
-		SyncQueueEntry *volatile entry;
+		std::atomic<int> state;
 
 		IRunnable *runnable;
 
-		void Execute();
+		void Execute() override;
 		void ExecuteProtected() throw();
+		void MarkStarted();
 
 		// disable
-		ConcurrentDispatch(const ConcurrentDispatch &) {}
-		void operator=(const ConcurrentDispatch &disp) {}
+		ConcurrentDispatch(const ConcurrentDispatch &) = delete;
+		void operator=(const ConcurrentDispatch &disp) = delete;
 
 	public:
 		ConcurrentDispatch();
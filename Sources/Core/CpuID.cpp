@@ -24,6 +24,16 @@ namespace spades {
 		return regs;
 	}
 
+	static uint64_t xgetbv(uint32_t index) {
+#ifdef _MSC_VER
+		return _xgetbv(index);
+#else
+		uint32_t eax, edx;
+		asm volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+		return eax | (static_cast<uint64_t>(edx) << 32);
+#endif
+	}
+
 	CpuID::CpuID() {
 		uint32_t maxStdLevel;
 		{
@@ -39,6 +49,11 @@ namespace spades {
 			featureEcx = ar[2];
 			featureEdx = ar[3];
 		}
+		{
+			// AVX instructions are usable only if the OS saves the YMM registers
+			// (OSXSAVE is set and XCR0 has both the SSE and AVX state bits)
+			avxStateEnabled = (featureEcx & (1U << 27)) && (xgetbv(0) & 6) == 6;
+		}
 
 		{
 			if (cpuid(0x80000000U)[0] >= 0x80000004U) {
@@ -67,9 +82,9 @@ namespace spades {
 			case CpuFeature::SSE2: return featureEdx & (1U << 26);
 			case CpuFeature::SSE3: return featureEcx & (1U << 0);
 			case CpuFeature::SSSE3: return featureEcx & (1U << 9);
-			case CpuFeature::FMA: return featureEcx & (1U << 12);
-			case CpuFeature::AVX: return featureEcx & (1U << 28);
-			case CpuFeature::AVX2: return subfeature & (1U << 5);
+			case CpuFeature::FMA: return avxStateEnabled && (featureEcx & (1U << 12));
+			case CpuFeature::AVX: return avxStateEnabled && (featureEcx & (1U << 28));
+			case CpuFeature::AVX2: return avxStateEnabled && (subfeature & (1U << 5));
 			case CpuFeature::AVX512CD: return subfeature & (1U << 28);
 			case CpuFeature::AVX512ER: return subfeature & (1U << 27);
 			case CpuFeature::AVX512PF: return subfeature & (1U << 26);
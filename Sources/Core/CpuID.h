@@ -35,6 +35,7 @@ namespace spades {
 		uint32_t featureEcx;
 		uint32_t featureEdx;
 		uint32_t subfeature;
+		bool avxStateEnabled;
 		std::string info;
 
 	public:
@@ -115,6 +115,11 @@ namespace spades {
 			SPRaise("State is invalid");
 		}
 
+		// compress the data that haven't reached the buffer size
+		if (!buffer.empty()) {
+			CompressBuffer();
+		}
+
 		char outputBuffer[chunkSize];
 
 		zstream.avail_in = 0;
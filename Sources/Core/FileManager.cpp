@@ -24,6 +24,7 @@
 #include "Debug.h"
 #include "Exception.h"
 #include "FileManager.h"
+#include "FilePrefetcher.h"
 #include "IFileSystem.h"
 #include "IStream.h"
 
@@ -36,6 +37,16 @@ namespace spades {
 		if (fn[0] == 0)
 			SPFileNotFound(fn);
 
+		IStream *stream = FilePrefetcher::Open(fn);
+		if (!stream) {
+			stream = OpenFromFileSystems(fn);
+		}
+		FilePrefetcher::Record(fn);
+		return stream;
+	}
+	IStream *FileManager::OpenFromFileSystems(const char *fn) {
+		SPADES_MARK_FUNCTION();
+
 		// check each file system
 		for (auto *fs : g_fileSystems) {
 			if (fs->FileExists(fn))
@@ -57,6 +68,10 @@ namespace spades {
 			SPInvalidArgument("fn");
 		if (fn[0] == 0)
 			SPFileNotFound(fn);
+
+		// the prefetched data would be stale
+		FilePrefetcher::Invalidate(fn);
+
 		for (auto *fs : g_fileSystems) {
 			if (fs->FileExists(fn))
 				return fs->OpenForWriting(fn);
@@ -147,6 +162,7 @@ namespace spades {
 	}
 
 	void FileManager::Close() {
+		FilePrefetcher::Discard();
 		for (auto *fs: g_fileSystems) {
 			delete fs;
 		}
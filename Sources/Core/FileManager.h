@@ -27,8 +27,12 @@ namespace spades {
 	class IStream;
 	class IFileSystem;
 	class FileManager {
+		friend class FilePrefetcher;
+
 		FileManager() {}
 
+		static IStream *OpenFromFileSystems(const char *);
+
 	public:
 		static IStream *OpenForReading(const char *);
 		static IStream *OpenForWriting(const char *);
@@ -0,0 +1,261 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "Debug.h"
+#include "FileManager.h"
+#include "FilePrefetcher.h"
+#include "IStream.h"
+#include "MemoryStream.h"
+#include "Settings.h"
+#include "TaskScheduler.h"
+
+DEFINE_SPADES_SETTING(core_filePrefetch, "1");
+
+namespace spades {
+	namespace {
+		const char *ManifestFileName = "PrefetchManifest.txt";
+
+		// the data is kept until it's opened, so don't read too much
+		const uint64_t MaxPrefetchedBytes = 64 << 20;
+	}
+
+	class FilePrefetcher::PrefetchTask : public Task {
+		std::string name;
+		std::atomic<uint64_t> &numPrefetchedBytes;
+		std::shared_ptr<const std::string> data;
+		std::atomic<bool> done{false};
+
+	protected:
+		void Execute() override {
+			SPADES_MARK_FUNCTION();
+			try {
+				std::unique_ptr<IStream> stream(OpenFile(name));
+				uint64_t size = stream->GetLength();
+				if (numPrefetchedBytes.fetch_add(size) + size <= MaxPrefetchedBytes) {
+					data = std::make_shared<std::string>(stream->ReadAllBytes());
+				} else {
+					numPrefetchedBytes.fetch_sub(size);
+				}
+			} catch (const std::exception &ex) {
+				// the file might have been removed since the manifest was written
+				SPLog("Failed to prefetch '%s': %s", name.c_str(), ex.what());
+			}
+			done.store(true, std::memory_order_release);
+		}
+
+	public:
+		PrefetchTask(std::string name, std::atomic<uint64_t> &numPrefetchedBytes)
+		    : name(std::move(name)), numPrefetchedBytes(numPrefetchedBytes) {}
+
+		bool IsDone() const { return done.load(std::memory_order_acquire); }
+
+		std::shared_ptr<const std::string> TakeData() { return std::move(data); }
+	};
+
+	struct FilePrefetcher::State {
+		std::mutex mutex;
+
+		bool recording = false;
+		std::vector<std::string> recordedFiles;
+		std::unordered_set<std::string> recordedFileSet;
+
+		std::vector<std::string> prefetchedFiles;
+		std::vector<std::unique_ptr<PrefetchTask>> tasks;
+		/** The tasks whose data have not been taken yet. */
+		std::unordered_map<std::string, PrefetchTask *> pendingTasks;
+		TaskGroup taskGroup;
+		std::atomic<uint64_t> numPrefetchedBytes{0};
+	};
+
+	FilePrefetcher::State &FilePrefetcher::GetState() {
+		// never destroyed so that the tasks can't outlive it at exit
+		static State *state = new State();
+		return *state;
+	}
+
+	IStream *FilePrefetcher::OpenFile(const std::string &name) {
+		return FileManager::OpenFromFileSystems(name.c_str());
+	}
+
+	void FilePrefetcher::Release(State &state) {
+		SPADES_MARK_FUNCTION();
+
+		// the tasks don't lock the mutex, so it's safe to wait with it held
+		state.taskGroup.Wait();
+		state.pendingTasks.clear();
+		state.tasks.clear();
+		state.prefetchedFiles.clear();
+	}
+
+	void FilePrefetcher::Start() {
+		SPADES_MARK_FUNCTION();
+		SPADES_SETTING(core_filePrefetch);
+
+		State &state = GetState();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (!core_filePrefetch || state.recording) {
+			return;
+		}
+		state.recording = true;
+
+		std::string manifest;
+		try {
+			if (FileManager::FileExists(ManifestFileName)) {
+				std::unique_ptr<IStream> stream(OpenFile(ManifestFileName));
+				manifest = stream->ReadAllBytes();
+			}
+		} catch (const std::exception &ex) {
+			SPLog("Failed to read the prefetch manifest: %s", ex.what());
+		}
+
+		std::size_t pos = 0;
+		while (pos < manifest.size()) {
+			std::size_t end = manifest.find('\n', pos);
+			if (end == std::string::npos) {
+				end = manifest.size();
+			}
+			std::string name = manifest.substr(pos, end - pos);
+			pos = end + 1;
+
+			if (!name.empty() && name.back() == '\r') {
+				name.pop_back();
+			}
+			if (name.empty() || state.pendingTasks.find(name) != state.pendingTasks.end()) {
+				continue;
+			}
+
+			state.tasks.emplace_back(new PrefetchTask(name, state.numPrefetchedBytes));
+			state.pendingTasks[name] = state.tasks.back().get();
+			state.prefetchedFiles.push_back(name);
+		}
+
+		// the manifest is in the order of use, so schedule them in that order
+		for (const auto &task : state.tasks) {
+			state.taskGroup.Run(*task);
+		}
+
+		SPLog("Prefetching %d file(s)", static_cast<int>(state.tasks.size()));
+	}
+
+	void FilePrefetcher::Finish() {
+		SPADES_MARK_FUNCTION();
+
+		State &state = GetState();
+		std::vector<std::string> files;
+		{
+			std::lock_guard<std::mutex> lock(state.mutex);
+			if (!state.recording) {
+				return;
+			}
+			state.recording = false;
+			files.swap(state.recordedFiles);
+			state.recordedFileSet.clear();
+
+			Release(state);
+		}
+
+		std::string manifest;
+		for (const std::string &name : files) {
+			manifest += name;
+			manifest += '\n';
+		}
+
+		try {
+			std::unique_ptr<IStream> stream(FileManager::OpenForWriting(ManifestFileName));
+			stream->Write(manifest);
+			SPLog("Prefetch manifest written: %d file(s)", static_cast<int>(files.size()));
+		} catch (const std::exception &ex) {
+			SPLog("Failed to write the prefetch manifest: %s", ex.what());
+		}
+	}
+
+	void FilePrefetcher::Discard() {
+		SPADES_MARK_FUNCTION();
+
+		State &state = GetState();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		state.recording = false;
+		state.recordedFiles.clear();
+		state.recordedFileSet.clear();
+
+		Release(state);
+	}
+
+	std::vector<std::string> FilePrefetcher::GetPrefetchedFiles() {
+		State &state = GetState();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		return state.prefetchedFiles;
+	}
+
+	IStream *FilePrefetcher::Open(const char *fn) {
+		SPADES_MARK_FUNCTION();
+
+		State &state = GetState();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		auto it = state.pendingTasks.find(fn);
+		if (it == state.pendingTasks.end()) {
+			return nullptr;
+		}
+
+		// if the task hasn't completed, it might not even have started yet,
+		// so the caller reads the file by itself instead of waiting
+		PrefetchTask &task = *it->second;
+		if (!task.IsDone()) {
+			return nullptr;
+		}
+		state.pendingTasks.erase(it);
+
+		std::shared_ptr<const std::string> data = task.TakeData();
+		return data ? new SharedMemoryStream(std::move(data)) : nullptr;
+	}
+
+	void FilePrefetcher::Record(const char *fn) {
+		State &state = GetState();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (state.recording && state.recordedFileSet.insert(fn).second) {
+			state.recordedFiles.push_back(fn);
+		}
+	}
+
+	void FilePrefetcher::Invalidate(const char *fn) {
+		SPADES_MARK_FUNCTION();
+
+		State &state = GetState();
+		std::lock_guard<std::mutex> lock(state.mutex);
+		auto it = state.pendingTasks.find(fn);
+		if (it == state.pendingTasks.end()) {
+			return;
+		}
+
+		// a task still running is waited for by `Release`; its data is never
+		// returned since it's no longer pending
+		PrefetchTask &task = *it->second;
+		if (task.IsDone()) {
+			task.TakeData();
+		}
+		state.pendingTasks.erase(it);
+	}
+}
@@ -0,0 +1,75 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace spades {
+	class IStream;
+
+	/**
+	 * Reads the files needed at startup ahead of time (core_filePrefetch).
+	 *
+	 * The names of the files opened by `FileManager::OpenForReading` are
+	 * recorded into a manifest in the order they were first opened, from
+	 * `Start` until `Finish` (called after the first minute of play). On the
+	 * next launch, `Start` reads the files in the manifest in parallel on the
+	 * task scheduler, and opening one of them returns the prefetched data.
+	 */
+	class FilePrefetcher {
+		class PrefetchTask;
+		struct State;
+
+		FilePrefetcher() {}
+
+		static State &GetState();
+		/** Opens a file without recording it. */
+		static IStream *OpenFile(const std::string &);
+		static void Release(State &);
+
+	public:
+		/** Starts prefetching the files in the manifest and recording the
+		 * opened files. Must be called after the file systems are set up. */
+		static void Start();
+
+		/** Stops recording and writes the manifest. The prefetched data not
+		 * used so far is released. Does nothing if not recording. */
+		static void Finish();
+
+		/** Stops prefetching without writing the manifest. */
+		static void Discard();
+
+		/** Returns the names of the files being prefetched. */
+		static std::vector<std::string> GetPrefetchedFiles();
+
+		/** Returns a stream of the prefetched data of the file, or `nullptr`
+		 * if it's not (yet) available. The data can be taken only once. */
+		static IStream *Open(const char *);
+
+		/** Records that the file was opened. */
+		static void Record(const char *);
+
+		/** Drops the prefetched data of the file, which is about to be
+		 * modified. */
+		static void Invalidate(const char *);
+	};
+}
@@ -919,6 +919,20 @@ namespace spades {
 		vec.resize(vec.size() - 1);
 	}
 
+	/** Returns the number of the trailing zero bits of a non-zero value. */
+	static inline int CountTrailingZeros(uint64_t bits) {
+#if defined(__GNUC__)
+		return __builtin_ctzll(bits);
+#else
+		int count = 0;
+		while (!(bits & 1ULL)) {
+			bits >>= 1;
+			count++;
+		}
+		return count;
+#endif
+	}
+
 	float Mix(float a, float b, float frac);
 	Vector2 Mix(const Vector2 &a, const Vector2 &b, float frac);
 	Vector3 Mix(const Vector3 &a, const Vector3 &b, float frac);
@@ -20,6 +20,9 @@
 
 #pragma once
 
+#include <memory>
+#include <string>
+
 #include "IStream.h"
 
 namespace spades {
@@ -48,4 +51,13 @@ namespace spades {
 		/** prohibited */
 		void SetLength(uint64_t) override;
 	};
+
+	/** A read-only `MemoryStream` that shares the ownership of its buffer. */
+	class SharedMemoryStream : public MemoryStream {
+		std::shared_ptr<const std::string> data;
+
+	public:
+		SharedMemoryStream(std::shared_ptr<const std::string> data)
+		    : MemoryStream(data->data(), data->size()), data(std::move(data)) {}
+	};
 }
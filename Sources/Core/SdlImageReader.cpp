@@ -20,6 +20,7 @@
 
 #include <cstring>
 #include <memory>
+#include <mutex>
 
 #include <Imports/SDL.h>
 
@@ -104,15 +105,21 @@ namespace spades {
 	};
 
 	class SdlImageImageReader : public SdlImageReader {
+		std::mutex initMutex;
+
 	public:
 		std::string GetName() override { return "SDL_image Image Reader"; }
 
 		SDL_Surface *LoadSdlImage(const std::string &data) override {
 			StringSdlRWops ops(data);
 			int flags = IMG_INIT_PNG | IMG_INIT_JPG;
-			int initted = IMG_Init(flags);
-			if ((initted & flags) != flags) {
-				SPRaise("IMG_Init failed: %s", IMG_GetError());
+			{
+				// images are decoded by worker threads, but `IMG_Init` isn't thread-safe
+				std::lock_guard<std::mutex> lock(initMutex);
+				int initted = IMG_Init(flags);
+				if ((initted & flags) != flags) {
+					SPRaise("IMG_Init failed: %s", IMG_GetError());
+				}
 			}
 			auto *s = IMG_Load_RW(ops, 0);
 			if (s == nullptr) {
@@ -0,0 +1,488 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <sys/types.h>
+#include <thread>
+#include <vector>
+
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#else
+#if defined(WIN32)
+#include <windows.h>
+#else
+#ifndef _MSC_VER
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/sysinfo.h>
+#endif
+#endif
+#endif
+
+#include "Benchmark.h"
+#include "Debug.h"
+#include "Exception.h"
+#include "Settings.h"
+#include "Stopwatch.h"
+#include "TaskScheduler.h"
+#include "Thread.h"
+#include "ThreadLocalStorage.h"
+#include "TraceRecorder.h"
+
+DEFINE_SPADES_SETTING(core_numDispatchQueueThreads, "auto");
+
+static int GetNumCores() {
+#ifdef WIN32
+	SYSTEM_INFO sysinfo;
+	GetSystemInfo(&sysinfo);
+	return sysinfo.dwNumberOfProcessors;
+#elif defined(__APPLE__)
+	int nm[2];
+	size_t len = 4;
+	uint32_t count;
+
+	nm[0] = CTL_HW;
+	nm[1] = HW_AVAILCPU;
+	sysctl(nm, 2, &count, &len, NULL, 0);
+
+	if (count < 1) {
+		nm[1] = HW_NCPU;
+		sysctl(nm, 2, &count, &len, NULL, 0);
+		if (count < 1) {
+			count = 1;
+		}
+	}
+	return count;
+#elif defined(__linux__)
+	return get_nprocs();
+#else
+	return sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+namespace spades {
+
+	void TaskList::PushBack(Task &task) {
+		SPAssert(task.prev == nullptr && task.next == nullptr);
+		task.prev = tail;
+		if (tail) {
+			tail->next = &task;
+		} else {
+			head = &task;
+		}
+		tail = &task;
+	}
+
+	Task *TaskList::PopBack() {
+		Task *task = tail;
+		if (task) {
+			tail = task->prev;
+			if (tail) {
+				tail->next = nullptr;
+			} else {
+				head = nullptr;
+			}
+			task->prev = nullptr;
+		}
+		return task;
+	}
+
+	Task *TaskList::PopFront() {
+		Task *task = head;
+		if (task) {
+			head = task->next;
+			if (head) {
+				head->prev = nullptr;
+			} else {
+				tail = nullptr;
+			}
+			task->next = nullptr;
+		}
+		return task;
+	}
+
+	TaskGroup::~TaskGroup() { Wait(); }
+
+	void TaskGroup::Run(Task &task) {
+		task.group = this;
+		numPendingTasks.fetch_add(1);
+		TaskScheduler::GetInstance().Schedule(task);
+	}
+
+	void TaskGroup::Then(Task &task) {
+		{
+			std::lock_guard<std::mutex> lock(continuationMutex);
+			if (numPendingTasks.load() != 0) {
+				if (continuation) {
+					SPRaise("Task group already has a continuation");
+				}
+				continuation = &task;
+				return;
+			}
+		}
+		TaskScheduler::GetInstance().Schedule(task);
+	}
+
+	void TaskGroup::TaskDone() {
+		// the group may be destroyed as soon as `IsDone` returns `true`, which
+		// `numCompletingTasks` prevents until we are done with the group
+		numCompletingTasks.fetch_add(1);
+
+		Task *cont = nullptr;
+		bool last = numPendingTasks.fetch_sub(1) == 1;
+		if (last) {
+			std::lock_guard<std::mutex> lock(continuationMutex);
+			cont = continuation;
+			continuation = nullptr;
+		}
+
+		numCompletingTasks.fetch_sub(1); // the last access to `this`
+		if (!last) {
+			return;
+		}
+
+		auto &scheduler = TaskScheduler::GetInstance();
+		if (cont) {
+			scheduler.Schedule(*cont);
+		}
+		scheduler.NotifyCompletion();
+	}
+
+	void TaskGroup::Wait() {
+		auto &scheduler = TaskScheduler::GetInstance();
+		if (scheduler.IsWorkerThread()) {
+			// blocking a worker might starve the tasks we are waiting for
+			while (!IsDone()) {
+				if (!scheduler.RunPendingTask()) {
+					std::this_thread::yield();
+				}
+			}
+		} else {
+			scheduler.WaitUntil([this] { return numPendingTasks.load() == 0; });
+
+			// `TaskDone` is only a few instructions away from returning
+			while (numCompletingTasks.load() != 0) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	struct TaskScheduler::Worker {
+		std::mutex mutex;
+		TaskList tasks;
+		std::unique_ptr<WorkerThread> thread;
+		unsigned int index;
+		unsigned int randomState;
+	};
+
+	struct TaskScheduler::Internal {
+		std::vector<std::unique_ptr<Worker>> workers;
+		ThreadLocalStorage<Worker> currentWorker{"currentTaskSchedulerWorker"};
+
+		std::mutex injectionMutex;
+		TaskList injectionQueue;
+
+		// the number of tasks in `injectionQueue` and all workers' deques
+		std::atomic<int> numQueuedTasks{0};
+
+		std::mutex sleepMutex;
+		std::condition_variable sleepCond;
+		std::atomic<int> numSleepingWorkers{0};
+		bool quit = false; // guarded by `sleepMutex`
+
+		std::mutex completionMutex;
+		std::condition_variable completionCond;
+		std::atomic<int> numWaiters{0};
+	};
+
+	class TaskScheduler::WorkerThread : public Thread {
+		TaskScheduler &scheduler;
+		Worker &worker;
+
+	public:
+		WorkerThread(TaskScheduler &scheduler, Worker &worker)
+		    : scheduler(scheduler), worker(worker) {}
+		void Run() noexcept override {
+			SPADES_MARK_FUNCTION();
+			scheduler.WorkerMain(worker);
+		}
+	};
+
+	TaskScheduler::TaskScheduler() : internal(new Internal()) {
+		int cnt = GetNumCores();
+		if (!("auto" == core_numDispatchQueueThreads)) {
+			cnt = core_numDispatchQueueThreads;
+		}
+		cnt = std::max(cnt, 1);
+
+		SPLog("Creating %d dispatch thread(s)", cnt);
+		for (int i = 0; i < cnt; i++) {
+			auto *w = new Worker();
+			w->index = static_cast<unsigned int>(i);
+			w->randomState = static_cast<unsigned int>(i) * 0x9e3779b9U + 1U;
+			internal->workers.emplace_back(w);
+		}
+
+		// start the threads after all `Worker`s are ready because they
+		// steal tasks from each other
+		for (auto &w : internal->workers) {
+			w->thread.reset(new WorkerThread(*this, *w));
+			w->thread->Start();
+		}
+	}
+
+	TaskScheduler::~TaskScheduler() {
+		// From this point no more tasks are executed
+		{
+			std::lock_guard<std::mutex> lock(internal->sleepMutex);
+			internal->quit = true;
+		}
+		internal->sleepCond.notify_all();
+
+		// When `Thread`s' destructors are called, they'll wait until the execution of
+		// the thread is completed.
+		for (auto &w : internal->workers) {
+			w->thread.reset();
+		}
+
+		delete internal;
+	}
+
+	TaskScheduler &TaskScheduler::GetInstance() {
+		static TaskScheduler instance;
+		return instance;
+	}
+
+	int TaskScheduler::GetNumWorkers() { return static_cast<int>(internal->workers.size()); }
+
+	bool TaskScheduler::IsWorkerThread() { return internal->currentWorker.GetPointer() != nullptr; }
+
+	void TaskScheduler::Schedule(Task &task) {
+		Worker *self = internal->currentWorker;
+		if (self) {
+			std::lock_guard<std::mutex> lock(self->mutex);
+			self->tasks.PushBack(task);
+		} else {
+			std::lock_guard<std::mutex> lock(internal->injectionMutex);
+			internal->injectionQueue.PushBack(task);
+		}
+
+		internal->numQueuedTasks.fetch_add(1);
+		if (internal->numSleepingWorkers.load() > 0) {
+			std::lock_guard<std::mutex> lock(internal->sleepMutex);
+			internal->sleepCond.notify_one();
+		}
+	}
+
+	Task *TaskScheduler::FindTask(Worker *self) {
+		Task *task = nullptr;
+
+		if (internal->numQueuedTasks.load(std::memory_order_relaxed) == 0) {
+			return nullptr;
+		}
+
+		// newest task of our own deque (it's likely to be still in the cache)
+		if (self) {
+			std::lock_guard<std::mutex> lock(self->mutex);
+			task = self->tasks.PopBack();
+		}
+
+		if (!task) {
+			std::lock_guard<std::mutex> lock(internal->injectionMutex);
+			task = internal->injectionQueue.PopFront();
+		}
+
+		if (!task) {
+			// steal the oldest task of a random victim
+			auto &workers = internal->workers;
+			auto numWorkers = static_cast<unsigned int>(workers.size());
+			unsigned int start = 0;
+			if (self) {
+				self->randomState = self->randomState * 1103515245U + 12345U;
+				start = (self->randomState >> 16) % numWorkers;
+			}
+			for (unsigned int i = 0; i < numWorkers && !task; i++) {
+				Worker &victim = *workers[(start + i) % numWorkers];
+				if (&victim == self) {
+					continue;
+				}
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				task = victim.tasks.PopFront();
+			}
+		}
+
+		if (task) {
+			internal->numQueuedTasks.fetch_sub(1);
+		}
+		return task;
+	}
+
+	void TaskScheduler::RunTask(Task &task) {
+		// `task` might be deleted by `Execute`
+		TaskGroup *group = task.group;
+		task.group = nullptr;
+
+		try {
+			SPADES_TRACE_SCOPE("Task");
+			task.Execute();
+		} catch (const std::exception &ex) {
+			fprintf(stderr, "-- UNHANDLED CONCURRENT DISPATCH EXCEPTION ---\n");
+			fprintf(stderr, "%s\n", ex.what());
+		} catch (...) {
+			fprintf(stderr, "-- UNHANDLED CONCURRENT DISPATCH EXCEPTION ---\n");
+			fprintf(stderr, "(no information provided)\n");
+		}
+
+		if (group) {
+			group->TaskDone();
+		}
+	}
+
+	bool TaskScheduler::RunPendingTask() {
+		Task *task = FindTask(internal->currentWorker);
+		if (!task) {
+			return false;
+		}
+		RunTask(*task);
+		return true;
+	}
+
+	void TaskScheduler::WorkerMain(Worker &worker) {
+		internal->currentWorker = &worker;
+		TraceRecorder::SetThreadName("Worker " + std::to_string(worker.index));
+
+		while (true) {
+			if (Task *task = FindTask(&worker)) {
+				RunTask(*task);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(internal->sleepMutex);
+			internal->numSleepingWorkers.fetch_add(1);
+			while (internal->numQueuedTasks.load() == 0 && !internal->quit) {
+				internal->sleepCond.wait(lock);
+			}
+			internal->numSleepingWorkers.fetch_sub(1);
+			if (internal->quit) {
+				break;
+			}
+		}
+
+		internal->currentWorker = nullptr;
+	}
+
+	std::mutex &TaskScheduler::GetCompletionMutex() { return internal->completionMutex; }
+
+	void TaskScheduler::BeginWait() { internal->numWaiters.fetch_add(1); }
+
+	void TaskScheduler::EndWait() { internal->numWaiters.fetch_sub(1); }
+
+	void TaskScheduler::WaitForCompletion(std::unique_lock<std::mutex> &lock) {
+		internal->completionCond.wait(lock);
+	}
+
+	void TaskScheduler::NotifyCompletion() {
+		if (internal->numWaiters.load() > 0) {
+			std::lock_guard<std::mutex> lock(internal->completionMutex);
+			internal->completionCond.notify_all();
+		}
+	}
+
+	namespace {
+		class CountingTask : public Task {
+		public:
+			std::atomic<int> *counter;
+			void Execute() override { counter->fetch_add(1, std::memory_order_relaxed); }
+		};
+
+		class SpawningTask : public Task {
+		public:
+			TaskGroup *group;
+			std::vector<CountingTask> *children;
+			std::size_t first, count;
+			void Execute() override {
+				for (std::size_t i = 0; i < count; i++) {
+					group->Run((*children)[first + i]);
+				}
+			}
+		};
+
+		// Measures the scheduling overhead of tiny tasks, which is dominated by
+		// the contention on the queues.
+		void TaskSchedulerContentionBenchmark() {
+			auto &scheduler = TaskScheduler::GetInstance();
+			const std::size_t numTasks = 1 << 18;
+			const std::size_t numSpawners = 64;
+
+			std::atomic<int> counter{0};
+			std::vector<CountingTask> tasks(numTasks);
+			for (auto &t : tasks) {
+				t.counter = &counter;
+			}
+
+			SPLog("Worker threads: %d", scheduler.GetNumWorkers());
+
+			// every task is pushed from the main thread to the injection queue
+			{
+				Stopwatch sw;
+				TaskGroup group;
+				for (auto &t : tasks) {
+					group.Run(t);
+				}
+				group.Wait();
+				double dur = sw.GetTime();
+				SPLog("Injected:  %d tasks in %.3fms (%.1fns/task)", static_cast<int>(numTasks),
+				      dur * 1000.0, dur * 1.e+9 / numTasks);
+			}
+
+			// tasks are spawned by workers, which push them to their own deques
+			// and then steal them from each other
+			{
+				std::vector<SpawningTask> spawners(numSpawners);
+				Stopwatch sw;
+				TaskGroup group;
+				for (std::size_t i = 0; i < numSpawners; i++) {
+					auto &s = spawners[i];
+					s.group = &group;
+					s.children = &tasks;
+					s.first = numTasks * i / numSpawners;
+					s.count = numTasks * (i + 1) / numSpawners - s.first;
+					group.Run(s);
+				}
+				group.Wait();
+				double dur = sw.GetTime();
+				SPLog("Spawned:   %d tasks in %.3fms (%.1fns/task)", static_cast<int>(numTasks),
+				      dur * 1000.0, dur * 1.e+9 / numTasks);
+			}
+
+			if (counter.load() != static_cast<int>(numTasks * 2)) {
+				SPRaise("Expected %d task executions, got %d", static_cast<int>(numTasks * 2),
+				        counter.load());
+			}
+		}
+
+		Benchmark taskSchedulerBenchmark("tasks", TaskSchedulerContentionBenchmark);
+	}
+}
@@ -0,0 +1,176 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+namespace spades {
+	class TaskGroup;
+	class TaskScheduler;
+
+	/**
+	 * A unit of work executed by `TaskScheduler`.
+	 *
+	 * Tasks are linked into the scheduler's queues intrusively, so scheduling
+	 * a task never allocates memory. The owner must keep the task alive until
+	 * it has completed.
+	 */
+	class Task {
+		friend class TaskScheduler;
+		friend class TaskGroup;
+		friend class TaskList;
+
+		Task *prev = nullptr;
+		Task *next = nullptr;
+		TaskGroup *group = nullptr;
+
+		Task(const Task &) = delete;
+		void operator=(const Task &) = delete;
+
+	protected:
+		Task() = default;
+		virtual ~Task() {}
+
+		/** Called by the scheduler to run the task. Exceptions thrown by this
+		 * function are logged and discarded. */
+		virtual void Execute() = 0;
+	};
+
+	/** Intrusive doubly-linked list of `Task`s. Not thread-safe by itself. */
+	class TaskList {
+		Task *head = nullptr;
+		Task *tail = nullptr;
+
+	public:
+		bool IsEmpty() const { return head == nullptr; }
+		void PushBack(Task &);
+		Task *PopBack();
+		Task *PopFront();
+	};
+
+	/**
+	 * Tracks completion of a set of tasks.
+	 *
+	 * A continuation task can be registered with `Then`, which is scheduled
+	 * as soon as every task added to the group has completed.
+	 */
+	class TaskGroup {
+		friend class TaskScheduler;
+
+		std::atomic<int> numPendingTasks{0};
+		/** The number of `TaskDone` calls in progress. */
+		std::atomic<int> numCompletingTasks{0};
+		std::mutex continuationMutex;
+		Task *continuation = nullptr;
+
+		TaskGroup(const TaskGroup &) = delete;
+		void operator=(const TaskGroup &) = delete;
+
+		void TaskDone();
+
+	public:
+		TaskGroup() = default;
+		~TaskGroup();
+
+		/** Schedules a task as a member of this group. */
+		void Run(Task &);
+
+		/** Schedules the given task when all tasks of this group complete.
+		 * If the group is already idle, it's scheduled immediately. */
+		void Then(Task &);
+
+		bool IsDone() const {
+			// `TaskDone` increments the latter before decrementing the former,
+			// so the group isn't in use anymore if both are zero
+			return numPendingTasks.load() == 0 && numCompletingTasks.load() == 0;
+		}
+
+		/** Waits until all tasks of this group complete. When called on a worker
+		 * thread, the caller executes other pending tasks while waiting. */
+		void Wait();
+	};
+
+	/**
+	 * Work-stealing task scheduler backed by a fixed number of worker threads
+	 * (`core_numDispatchQueueThreads`).
+	 *
+	 * Each worker owns a deque; tasks scheduled by a worker are pushed to its
+	 * own deque and popped in LIFO order, while idle workers steal from the
+	 * other end of the others' deques. Tasks scheduled by other threads go to
+	 * a shared injection queue.
+	 */
+	class TaskScheduler {
+		struct Worker;
+		class WorkerThread;
+		struct Internal;
+
+		Internal *internal;
+
+		TaskScheduler();
+
+		Task *FindTask(Worker *self);
+		void RunTask(Task &);
+		void WorkerMain(Worker &);
+
+	public:
+		~TaskScheduler();
+
+		static TaskScheduler &GetInstance();
+
+		/** Schedules a task. */
+		void Schedule(Task &);
+
+		/** Executes one pending task on the calling thread.
+		 * @return `false` if there was no pending task. */
+		bool RunPendingTask();
+
+		/** Returns `true` if the calling thread is one of the scheduler's workers. */
+		bool IsWorkerThread();
+
+		int GetNumWorkers();
+
+		/** Blocks the calling thread until `pred()` returns `true`.
+		 * `pred` is re-evaluated each time a task group or a dispatch completes. */
+		template <class F> void WaitUntil(F pred) {
+			if (pred()) {
+				return;
+			}
+			BeginWait();
+			std::unique_lock<std::mutex> lock(GetCompletionMutex());
+			while (!pred()) {
+				WaitForCompletion(lock);
+			}
+			lock.unlock();
+			EndWait();
+		}
+
+		/** Wakes up the threads blocked in `WaitUntil`. Should be called after
+		 * a condition checked by `WaitUntil` became true. */
+		void NotifyCompletion();
+
+	private:
+		std::mutex &GetCompletionMutex();
+		void BeginWait();
+		void EndWait();
+		void WaitForCompletion(std::unique_lock<std::mutex> &);
+	};
+}
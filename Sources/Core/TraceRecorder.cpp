@@ -0,0 +1,219 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+#include "Debug.h"
+#include "IStream.h"
+#include "ThreadLocalStorage.h"
+#include "TraceRecorder.h"
+
+namespace spades {
+	namespace {
+		struct RawSpan {
+			const char *name;
+			std::int64_t start;
+			std::int64_t duration;
+		};
+
+		struct ThreadBuffer {
+			// only contended while the spans are being exported
+			std::mutex mutex;
+			int threadId;
+			std::string name;
+
+			// ring buffer of the latest `MaxSpansPerThread` spans
+			std::vector<RawSpan> spans;
+			std::size_t nextIndex = 0;
+		};
+
+		struct Registry {
+			std::mutex mutex;
+			// buffers outlive their threads because they might be exported later
+			std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+			std::vector<std::pair<int, std::string>> virtualThreads;
+			int nextThreadId = 1;
+			ThreadLocalStorage<ThreadBuffer> currentBuffer{"traceRecorderThreadBuffer"};
+			std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		};
+
+		Registry &GetRegistry() {
+			static Registry registry;
+			return registry;
+		}
+
+		ThreadBuffer &GetCurrentBuffer() {
+			Registry &registry = GetRegistry();
+			ThreadBuffer *buffer = registry.currentBuffer;
+			if (!buffer) {
+				buffer = new ThreadBuffer();
+
+				std::lock_guard<std::mutex> lock(registry.mutex);
+				buffer->threadId = registry.nextThreadId++;
+				buffer->name = "Thread " + std::to_string(buffer->threadId);
+				registry.buffers.emplace_back(buffer);
+				registry.currentBuffer = buffer;
+			}
+			return *buffer;
+		}
+
+		void AppendEscaped(std::string &out, const std::string &str) {
+			out += '"';
+			for (char c : str) {
+				if (c == '"' || c == '\\') {
+					out += '\\';
+					out += c;
+				} else if (static_cast<unsigned char>(c) < 0x20) {
+					char buf[8];
+					std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<int>(c));
+					out += buf;
+				} else {
+					out += c;
+				}
+			}
+			out += '"';
+		}
+
+		void AppendThreadName(std::string &out, int threadId, const std::string &name) {
+			out += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+			out += std::to_string(threadId);
+			out += ",\"args\":{\"name\":";
+			AppendEscaped(out, name);
+			out += "}},\n";
+		}
+	}
+
+	std::atomic<bool> TraceRecorder::capturing{false};
+
+	void TraceRecorder::SetCapturing(bool enable) {
+		Registry &registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		if (capturing.exchange(enable) == enable || enable) {
+			return;
+		}
+
+		for (auto &buffer : registry.buffers) {
+			std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+			std::vector<RawSpan>().swap(buffer->spans);
+			buffer->nextIndex = 0;
+		}
+	}
+
+	std::int64_t TraceRecorder::GetTimestamp() {
+		auto elapsed = std::chrono::steady_clock::now() - GetRegistry().epoch;
+		return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+	}
+
+	void TraceRecorder::SetThreadName(const std::string &name) {
+		ThreadBuffer &buffer = GetCurrentBuffer();
+		std::lock_guard<std::mutex> lock(buffer.mutex);
+		buffer.name = name;
+	}
+
+	int TraceRecorder::GetCurrentThreadId() { return GetCurrentBuffer().threadId; }
+
+	int TraceRecorder::AddVirtualThread(const std::string &name) {
+		Registry &registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		int threadId = registry.nextThreadId++;
+		registry.virtualThreads.emplace_back(threadId, name);
+		return threadId;
+	}
+
+	void TraceRecorder::AddSpan(const char *name, std::int64_t start, std::int64_t duration) {
+		ThreadBuffer &buffer = GetCurrentBuffer();
+		std::lock_guard<std::mutex> lock(buffer.mutex);
+
+		RawSpan span{name, start, duration};
+		if (buffer.spans.size() < MaxSpansPerThread) {
+			buffer.spans.push_back(span);
+		} else {
+			buffer.spans[buffer.nextIndex] = span;
+			buffer.nextIndex = (buffer.nextIndex + 1) % MaxSpansPerThread;
+		}
+	}
+
+	void TraceRecorder::WriteChromeTrace(IStream &stream, std::int64_t since,
+	                                     const std::vector<Span> &extraSpans) {
+		SPADES_MARK_FUNCTION();
+
+		std::vector<Span> spans;
+		std::vector<std::pair<int, std::string>> threadNames;
+		{
+			Registry &registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			threadNames = registry.virtualThreads;
+			for (auto &buffer : registry.buffers) {
+				std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+				threadNames.emplace_back(buffer->threadId, buffer->name);
+				for (const RawSpan &raw : buffer->spans) {
+					if (raw.start + raw.duration < since) {
+						continue;
+					}
+					spans.push_back(Span{raw.name, "cpu", buffer->threadId, raw.start,
+					                     raw.duration});
+				}
+			}
+		}
+		for (const Span &span : extraSpans) {
+			if (span.start + span.duration >= since) {
+				spans.push_back(span);
+			}
+		}
+
+		// make the timestamps small so they are easier to read in a viewer
+		std::int64_t origin = since;
+		for (const Span &span : spans) {
+			origin = std::min(origin, span.start);
+		}
+
+		std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		for (const auto &thread : threadNames) {
+			AppendThreadName(out, thread.first, thread.second);
+		}
+		for (const Span &span : spans) {
+			out += "{\"name\":";
+			AppendEscaped(out, span.name);
+			out += ",\"cat\":\"";
+			out += span.category;
+			out += "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+			out += std::to_string(span.threadId);
+			out += ",\"ts\":";
+			out += std::to_string(span.start - origin);
+			out += ",\"dur\":";
+			out += std::to_string(span.duration);
+			out += "},\n";
+
+			if (out.size() > 65536) {
+				stream.Write(out);
+				out.clear();
+			}
+		}
+
+		// the trailing comma is not allowed by JSON
+		out += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+		       "\"args\":{\"name\":\"OpenSpades\"}}\n]}\n";
+		stream.Write(out);
+	}
+}
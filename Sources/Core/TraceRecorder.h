@@ -0,0 +1,107 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace spades {
+	class IStream;
+
+	/**
+	 * Records the timings of CPU spans on every thread so that they can be
+	 * exported in the Chrome trace event format, which can be opened by
+	 * `chrome://tracing` and Perfetto.
+	 *
+	 * Spans are marked with `SPADES_TRACE_SCOPE` and are only recorded while
+	 * capturing is enabled. Otherwise the cost of a span is a single atomic
+	 * load. Each thread keeps a fixed number of its most recent spans.
+	 */
+	class TraceRecorder {
+	public:
+		/** The maximum number of spans retained by each thread. */
+		enum { MaxSpansPerThread = 65536 };
+
+		struct Span {
+			std::string name;
+			const char *category;
+			/** The thread ID used in the trace file. */
+			int threadId;
+			/** Microseconds since the epoch of `GetTimestamp`. */
+			std::int64_t start;
+			std::int64_t duration;
+		};
+
+		static bool IsCapturing() { return capturing.load(std::memory_order_relaxed); }
+
+		/** Enables or disables recording spans. Disabling discards the recorded
+		 * spans. */
+		static void SetCapturing(bool);
+
+		/** Returns the current time in microseconds since an arbitrary epoch. */
+		static std::int64_t GetTimestamp();
+
+		/** Names the calling thread in the trace file. */
+		static void SetThreadName(const std::string &);
+
+		/** Returns the trace file thread ID of the calling thread. */
+		static int GetCurrentThreadId();
+
+		/** Allocates a thread ID for a track not backed by a real thread
+		 * (e.g., GPU timings). */
+		static int AddVirtualThread(const std::string &name);
+
+		static void AddSpan(const char *name, std::int64_t start, std::int64_t duration);
+
+		/** Writes the spans that ended at or after `since` together with
+		 * `extraSpans` to `stream` in the JSON trace format. */
+		static void WriteChromeTrace(IStream &stream, std::int64_t since,
+		                             const std::vector<Span> &extraSpans);
+
+	private:
+		static std::atomic<bool> capturing;
+	};
+
+	namespace reflection {
+		class TraceScope {
+			const char *name;
+			std::int64_t start;
+
+		public:
+			TraceScope(const char *name) : name(TraceRecorder::IsCapturing() ? name : nullptr) {
+				if (this->name) {
+					start = TraceRecorder::GetTimestamp();
+				}
+			}
+			~TraceScope() {
+				if (name) {
+					TraceRecorder::AddSpan(name, start, TraceRecorder::GetTimestamp() - start);
+				}
+			}
+		};
+	}
+}
+
+/** Records the time until the end of the current scope as a span named `name`
+ * (a string literal) while a trace is being captured. */
+#define SPADES_TRACE_SCOPE(name) ::spades::reflection::TraceScope traceScope((name))
@@ -18,357 +18,343 @@
 
  */
 
+#include <algorithm>
 #include <cstring>
 
-#include <unzip/unzip.h>
-
-// ioapi.h must be included after unzip.h
-#include <unzip/ioapi.h>
+#include <zlib.h>
 
 #include <Core/Debug.h>
 #include <Core/Exception.h>
+#include <Core/Settings.h>
 
-#include "DynamicMemoryStream.h"
 #include "IStream.h"
+#include "MemoryStream.h"
 #include "ZipFileSystem.h"
 
+// the size of the cache of inflated files in MiB
+DEFINE_SPADES_SETTING(core_pakCacheSize, "16");
+
 namespace spades {
-	class ZipFileSystem::ZipFileInputStream : public IStream {
-		ZipFileSystem *fs;
-		unzFile zip;
-		uint64_t pos;
+	namespace {
+		enum {
+			EndOfCentralDirSignature = 0x06054b50,
+			CentralDirHeaderSignature = 0x02014b50,
+			LocalHeaderSignature = 0x04034b50,
 
-		bool streaming;
+			EndOfCentralDirSize = 22,
+			CentralDirHeaderSize = 46,
+			LocalHeaderSize = 30,
 
-		// unzip library doesn't support opening multiple
-		// file, but ZipFileSystem has to.
-		// so when second file is open, the contents of
-		// first file is read and is closed in unzip level.
-		// read contents are stored in remainingData.
-		// streaming becomes false.
-		std::vector<unsigned char> remainingData;
-		size_t remDataPos;
+			MethodStored = 0,
+			MethodDeflated = 8,
 
-	public:
-		ZipFileInputStream(ZipFileSystem *fs, unzFile zf) : fs(fs), zip(zf), streaming(true) {
-			SPADES_MARK_FUNCTION();
+			FlagEncrypted = 1,
+
+			// the values indicating the actual ones are in the ZIP64 extra fields
+			Zip64Sentinel16 = 0xffff,
+			Zip64Sentinel32 = 0xffffffffUL
+		};
+
+		uint16_t ReadLE16(const unsigned char *p) {
+			return static_cast<uint16_t>(p[0] | (p[1] << 8));
 		}
 
-		~ZipFileInputStream() {
-			SPADES_MARK_FUNCTION();
-			if (streaming) {
-				unzCloseCurrentFile(zip);
-				SPAssert(this == fs->currentStream);
-				fs->currentStream = NULL;
-			}
+		uint32_t ReadLE32(const unsigned char *p) {
+			return static_cast<uint32_t>(ReadLE16(p)) |
+			       (static_cast<uint32_t>(ReadLE16(p + 2)) << 16);
 		}
+	}
 
-		void ForceCloseUnzipFile() {
-			SPADES_MARK_FUNCTION();
-			if (streaming) {
-				streaming = false;
-				unsigned char buf[1024];
-				int bytes;
-				while ((bytes = unzReadCurrentFile(zip, buf, sizeof(buf))) > 0) {
-					remainingData.insert(remainingData.end(), buf, buf + bytes);
-				}
-				remDataPos = 0;
+	class ZipFileSystem::BaseStream {
+		IStream *stream;
+		bool autoClose;
 
-				int ret = unzCloseCurrentFile(zip);
-				if (ret != UNZ_OK) {
-					SPRaise("Zip file close error: 0x%08x", ret);
-				}
+	public:
+		/** Guards the position of the stream. */
+		std::mutex mutex;
+
+		BaseStream(IStream *stream, bool autoClose) : stream(stream), autoClose(autoClose) {}
 
-				SPAssert(this == fs->currentStream);
-				fs->currentStream = NULL;
+		~BaseStream() {
+			if (autoClose) {
+				delete stream;
 			}
 		}
 
-		int ReadByte() override {
-			SPADES_MARK_FUNCTION();
-			int byte;
-			if (streaming) {
-				unsigned char b;
-				int bytes = unzReadCurrentFile(zip, &b, 1);
-				if (bytes < 0) {
-					SPRaise("Unzip error: 0x%08x", bytes);
-				} else if (bytes == 0) {
-					byte = -1;
-				} else {
-					byte = b;
-					pos++;
-				}
-			} else {
-				if (remDataPos >= remainingData.size()) {
-					return -1;
-				} else {
-					pos++;
-					byte = remainingData[remDataPos];
-					remDataPos++;
-				}
+		uint64_t GetLength() { return stream->GetLength(); }
+
+		/** Reads the stream at the given offset. `mutex` must be held. */
+		void Read(uint64_t offset, void *buf, std::size_t bytes) {
+			stream->SetPosition(offset);
+			if (stream->Read(buf, bytes) != bytes) {
+				SPRaise("ZIP stream is truncated.");
 			}
-			return byte;
 		}
-		size_t Read(void *buf, size_t bytes) override {
-			SPADES_MARK_FUNCTION();
-			size_t outBytes;
-			if (streaming) {
-				int out = unzReadCurrentFile(zip, buf, (unsigned int)bytes);
-				if (out < 0) {
-					SPRaise("Unzip error: 0x%08x", bytes);
-				}
-				outBytes = (size_t)out;
-			} else {
-				outBytes = bytes;
-				size_t rem = remainingData.size() - remDataPos;
-				if (outBytes > rem)
-					outBytes = rem;
-				memcpy(buf, remainingData.data() + remDataPos, outBytes);
-
-				remDataPos += outBytes;
-			}
+	};
 
-			pos += outBytes;
-			return outBytes;
-		}
+	/** Reads a stored entry directly from the base stream. */
+	class ZipFileSystem::StoredFileStream : public IStream {
+		std::shared_ptr<BaseStream> base;
+		uint64_t offset;
+		uint64_t length;
+		uint64_t pos;
 
-		void WriteByte(int) override {
-			SPADES_MARK_FUNCTION();
-			SPUnsupported();
-		}
-		void Write(const void *, size_t bytes) override {
-			SPADES_MARK_FUNCTION();
-			SPUnsupported();
-		}
-		void Write(const std::string &) override {
-			SPADES_MARK_FUNCTION();
-			SPUnsupported();
-		}
+	public:
+		StoredFileStream(std::shared_ptr<BaseStream> base, uint64_t offset, uint64_t length)
+		    : base(std::move(base)), offset(offset), length(length), pos(0) {}
 
-		uint64_t GetPosition() override { return pos; }
-		void SetPosition(uint64_t) override {
-			SPADES_MARK_FUNCTION();
-			SPUnsupported();
+		int ReadByte() override {
+			unsigned char b;
+			return Read(&b, 1) ? b : -1;
 		}
 
-		uint64_t GetLength() override {
+		size_t Read(void *buf, size_t bytes) override {
 			SPADES_MARK_FUNCTION();
-			ForceCloseUnzipFile();
-			return pos + remainingData.size() - remDataPos;
+			if (pos >= length) {
+				return 0;
+			}
+			bytes = static_cast<size_t>(std::min<uint64_t>(bytes, length - pos));
+			{
+				std::lock_guard<std::mutex> lock(base->mutex);
+				base->Read(offset + pos, buf, bytes);
+			}
+			pos += bytes;
+			return bytes;
 		}
-		void SetLength(uint64_t) override {
+
+		std::string Read(size_t maxBytes) override {
 			SPADES_MARK_FUNCTION();
-			SPUnsupported();
+			std::string str;
+			if (pos < length) {
+				str.resize(static_cast<size_t>(std::min<uint64_t>(maxBytes, length - pos)));
+				str.resize(Read(&str[0], str.size()));
+			}
+			return str;
 		}
+
+		uint64_t GetPosition() override { return pos; }
+		void SetPosition(uint64_t p) override { pos = p; }
+		uint64_t GetLength() override { return length; }
 	};
 
-#pragma mark - Interface between ZipFileSystem and unzip
+	ZipFileSystem::ZipFileSystem(IStream *stream, bool autoClose)
+	    : baseStream(std::make_shared<BaseStream>(stream, autoClose)), cacheSize(0) {
+		SPADES_MARK_FUNCTION();
 
-	class ZipFileSystem::ZipFileHandle {
-		ZipFileSystem *fs;
-		uint64_t pos;
+		ReadCentralDirectory();
+	}
 
-		void ValidateCursor() {
-			SPADES_MARK_FUNCTION();
-			if (fs->cursorPos != pos) {
-				fs->cursorPos = pos;
-				fs->baseStream->SetPosition(pos);
-			}
-		}
+	ZipFileSystem::~ZipFileSystem() { SPADES_MARK_FUNCTION(); }
 
-	public:
-		ZipFileHandle(ZipFileSystem *fs) : fs(fs) { pos = 0; }
+	std::string ZipFileSystem::NormalizeName(const char *fn) {
+		std::string f = fn;
+		for (std::size_t i = 0; i < f.size(); i++) {
+			if (f[i] == '\\')
+				f[i] = '/';
+			else
+				f[i] = tolower(f[i]);
+		}
+		return f;
+	}
 
-		uint32_t Read(void *buf, uint32_t size) {
-			SPADES_MARK_FUNCTION();
-			ValidateCursor();
-			size_t ret = fs->baseStream->Read(buf, size);
-			pos += ret;
-			fs->cursorPos += ret;
-			return (uint32_t)ret;
+	uint64_t ZipFileSystem::GetDataOffset(Entry &entry) {
+		if (entry.dataOffset) {
+			return entry.dataOffset;
 		}
 
-		uint32_t Write(void *buf, uint32_t size) {
-			SPADES_MARK_FUNCTION();
-			ValidateCursor();
-			try {
-				fs->baseStream->Write(buf, size);
-			} catch (...) {
-				// how many bytes written?
-				size_t written = fs->baseStream->GetPosition() - pos;
-				fs->cursorPos += written;
-				pos += written;
-				return pos;
-			}
-			pos += size;
-			fs->cursorPos += size;
-			return (uint32_t)size;
+		unsigned char header[LocalHeaderSize];
+		baseStream->Read(entry.localHeaderOffset, header, LocalHeaderSize);
+		if (ReadLE32(header) != LocalHeaderSignature) {
+			SPRaise("Invalid local file header: %s", entry.name.c_str());
 		}
+		entry.dataOffset = entry.localHeaderOffset + LocalHeaderSize + ReadLE16(header + 26) +
+		                   ReadLE16(header + 28);
+		return entry.dataOffset;
+	}
 
-		long Tell() { return (long)pos; }
+	void ZipFileSystem::ReadCentralDirectory() {
+		SPADES_MARK_FUNCTION();
 
-		long Seek(int32_t offset, int origin) {
-			switch (origin) {
-				case ZLIB_FILEFUNC_SEEK_CUR: break;
-				case ZLIB_FILEFUNC_SEEK_END: pos = fs->baseStream->GetLength(); break;
-				case ZLIB_FILEFUNC_SEEK_SET: pos = 0; break;
+		// the end of central directory record is followed by a comment of
+		// up to 65535 bytes
+		uint64_t length = baseStream->GetLength();
+		std::size_t tailSize =
+		  static_cast<std::size_t>(std::min<uint64_t>(length, EndOfCentralDirSize + 65535));
+		std::vector<unsigned char> tail(tailSize);
+		baseStream->Read(length - tailSize, tail.data(), tailSize);
+
+		const unsigned char *eocd = nullptr;
+		for (std::size_t i = tailSize; i >= EndOfCentralDirSize; i--) {
+			if (ReadLE32(&tail[i - EndOfCentralDirSize]) == EndOfCentralDirSignature) {
+				eocd = &tail[i - EndOfCentralDirSize];
+				break;
 			}
-			pos += offset;
-			return 0; // (long)pos;
+		}
+		if (!eocd) {
+			SPRaise("Failed to open ZIP stream.");
 		}
 
-		int TestError() {
-			return 0; // ??
+		std::size_t numEntries = ReadLE16(eocd + 10);
+		uint32_t dirSize = ReadLE32(eocd + 12);
+		uint32_t dirOffset = ReadLE32(eocd + 16);
+		if (numEntries == Zip64Sentinel16 || dirSize == Zip64Sentinel32 ||
+		    dirOffset == Zip64Sentinel32) {
+			SPRaise("ZIP64 archives are not supported.");
 		}
-	};
 
-	ZipFileSystem::ZipFileHandle *ZipFileSystem::InternalOpen(spades::ZipFileSystem *fs,
-	                                                          const char *fn, int mode) {
-		SPADES_MARK_FUNCTION();
-		return new ZipFileHandle(fs);
-	}
+		std::vector<unsigned char> dir(dirSize);
+		baseStream->Read(dirOffset, dir.data(), dir.size());
 
-	uint32_t ZipFileSystem::InternalRead(spades::ZipFileSystem *fs,
-	                                     spades::ZipFileSystem::ZipFileHandle *h, void *buf,
-	                                     uint32_t size) {
-		SPADES_MARK_FUNCTION_DEBUG();
-		return h->Read(buf, size);
-	}
+		entries.reserve(numEntries);
+		index.reserve(numEntries);
+		std::size_t pos = 0;
+		for (std::size_t i = 0; i < numEntries; i++) {
+			if (pos + CentralDirHeaderSize > dir.size() ||
+			    ReadLE32(&dir[pos]) != CentralDirHeaderSignature) {
+				SPRaise("ZIP central directory is corrupted.");
+			}
+			const unsigned char *header = &dir[pos];
+			std::size_t nameLength = ReadLE16(header + 28);
+			std::size_t extraLength = ReadLE16(header + 30);
+			std::size_t commentLength = ReadLE16(header + 32);
+			if (pos + CentralDirHeaderSize + nameLength > dir.size()) {
+				SPRaise("ZIP central directory is corrupted.");
+			}
 
-	uint32_t ZipFileSystem::InternalWrite(spades::ZipFileSystem *fs,
-	                                      spades::ZipFileSystem::ZipFileHandle *h, void *buf,
-	                                      uint32_t size) {
-		SPADES_MARK_FUNCTION_DEBUG();
-		return h->Write(buf, size);
-	}
+			Entry entry;
+			entry.name.assign(reinterpret_cast<const char *>(header + CentralDirHeaderSize),
+			                  nameLength);
+			entry.flags = ReadLE16(header + 8);
+			entry.method = ReadLE16(header + 10);
+			entry.crc = ReadLE32(header + 16);
+			entry.compressedSize = ReadLE32(header + 20);
+			entry.uncompressedSize = ReadLE32(header + 24);
+			entry.localHeaderOffset = ReadLE32(header + 42);
+			entry.dataOffset = 0;
+			entry.cached = false;
+			if (entry.compressedSize == Zip64Sentinel32 ||
+			    entry.uncompressedSize == Zip64Sentinel32 ||
+			    entry.localHeaderOffset == Zip64Sentinel32 ||
+			    ReadLE16(header + 34) == Zip64Sentinel16) {
+				SPRaise("ZIP64 entries are not supported: %s", entry.name.c_str());
+			}
 
-	long ZipFileSystem::InternalTell(spades::ZipFileSystem *fs,
-	                                 spades::ZipFileSystem::ZipFileHandle *h) {
-		SPADES_MARK_FUNCTION_DEBUG();
-		return h->Tell();
-	}
+			index.insert(std::make_pair(NormalizeName(entry.name.c_str()), entries.size()));
+			entries.push_back(std::move(entry));
 
-	long ZipFileSystem::InternalSeek(spades::ZipFileSystem *fs,
-	                                 spades::ZipFileSystem::ZipFileHandle *h, int32_t offset,
-	                                 int origin) {
-		SPADES_MARK_FUNCTION_DEBUG();
-		return h->Seek(offset, origin);
+			pos += CentralDirHeaderSize + nameLength + extraLength + commentLength;
+		}
 	}
 
-	int ZipFileSystem::InternalClose(spades::ZipFileSystem *fs,
-	                                 spades::ZipFileSystem::ZipFileHandle *h) {
+	std::shared_ptr<const std::string> ZipFileSystem::Inflate(std::size_t entryIndex) {
 		SPADES_MARK_FUNCTION();
-		delete h;
-		return 0;
-	}
-
-	int ZipFileSystem::InternalTestError(spades::ZipFileSystem *fs,
-	                                     spades::ZipFileSystem::ZipFileHandle *h) {
-		SPADES_MARK_FUNCTION_DEBUG();
-		return h->TestError();
-	}
 
-	zlib_filefunc_def ZipFileSystem::CreateZLibFileFunc() {
-		zlib_filefunc_def def;
-		def.opaque = this;
-		def.zopen_file = (open_file_func)InternalOpen;
-		def.zclose_file = (close_file_func)InternalClose;
-		def.zread_file = (read_file_func)InternalRead;
-		def.zwrite_file = (write_file_func)InternalWrite;
-		def.ztell_file = (tell_file_func)InternalTell;
-		def.zseek_file = (seek_file_func)InternalSeek;
-		def.zerror_file = (testerror_file_func)InternalTestError;
-		return def;
-	}
+		if (auto data = FindCache(entryIndex)) {
+			return data;
+		}
 
-#pragma mark - Zip file
+		Entry &entry = entries[entryIndex];
+		std::vector<unsigned char> compressed(static_cast<std::size_t>(entry.compressedSize));
+		{
+			std::lock_guard<std::mutex> lock(baseStream->mutex);
+			baseStream->Read(GetDataOffset(entry), compressed.data(), compressed.size());
+		}
 
-	ZipFileSystem::ZipFileSystem(IStream *stream, bool autoClose)
-	    : baseStream(stream), autoClose(autoClose) {
-		SPADES_MARK_FUNCTION();
+		// inflate without holding the lock so that other threads can read
+		// the base stream meanwhile
+		auto data = std::make_shared<std::string>();
+		data->resize(static_cast<std::size_t>(entry.uncompressedSize));
+		if (!data->empty()) {
+			z_stream zs;
+			std::memset(&zs, 0, sizeof(zs));
+			if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+				SPRaise("Failed to initialize zlib inflator.");
+			}
+			zs.next_in = compressed.data();
+			zs.avail_in = static_cast<uInt>(compressed.size());
+			zs.next_out = reinterpret_cast<Bytef *>(&(*data)[0]);
+			zs.avail_out = static_cast<uInt>(data->size());
+			int ret = inflate(&zs, Z_FINISH);
+			uLong size = zs.total_out;
+			inflateEnd(&zs);
+			if (ret != Z_STREAM_END || size != data->size()) {
+				SPRaise("Failed to inflate '%s': %s", entry.name.c_str(), zError(ret));
+			}
+		}
 
-		cursorPos = stream->GetPosition();
-		zlib_filefunc_def def = CreateZLibFileFunc();
-		zip = unzOpen2("ZipFile.zip", &def);
-		if (!zip) {
-			SPRaise("Failed to open ZIP stream.");
+		uLong crc = crc32(0, reinterpret_cast<const Bytef *>(data->data()),
+		                  static_cast<uInt>(data->size()));
+		if (crc != entry.crc) {
+			SPRaise("CRC error in '%s'", entry.name.c_str());
 		}
 
-		currentStream = NULL;
+		AddCache(entryIndex, data);
+		return data;
+	}
 
-		if (unzGoToFirstFile(zip) != UNZ_OK) {
-			SPRaise("There was a problem while seeking the zip file to the first file.");
+	std::shared_ptr<const std::string> ZipFileSystem::FindCache(std::size_t entryIndex) {
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		Entry &entry = entries[entryIndex];
+		if (!entry.cached) {
+			return nullptr;
 		}
+		cache.splice(cache.begin(), cache, entry.cacheItem);
+		return entry.cacheItem->data;
+	}
 
-		// create list of files
-		do {
-			char buf[513];
-			buf[512] = 0;
-			unzGetCurrentFileInfo(zip, nullptr, buf, 512, nullptr, 0, nullptr, 0);
-
-			for (char *ptr = buf; *ptr; ptr++) {
-				if (*ptr == '\\')
-					*ptr = '/';
-				else
-					*ptr = tolower(*ptr);
-			}
+	void ZipFileSystem::AddCache(std::size_t entryIndex,
+	                             std::shared_ptr<const std::string> data) {
+		std::size_t budget = static_cast<std::size_t>(std::max((int)core_pakCacheSize, 0)) << 20;
 
-			unz_file_pos pos;
-			if (unzGetFilePos(zip, &pos) != UNZ_OK) {
-				SPRaise("unzGetFilePos failed");
-			}
-			files.insert(std::make_pair(buf, pos));
-		} while (unzGoToNextFile(zip) == UNZ_OK);
-	}
+		// a large file would evict everything else
+		if (data->size() > budget / 4) {
+			return;
+		}
 
-	ZipFileSystem::~ZipFileSystem() {
-		SPADES_MARK_FUNCTION();
-		if (currentStream) {
-			currentStream->ForceCloseUnzipFile();
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		Entry &entry = entries[entryIndex];
+		if (entry.cached) {
+			return;
 		}
 
-		unzClose(zip);
+		cacheSize += data->size();
+		cache.push_front(CacheItem{entryIndex, std::move(data)});
+		entry.cached = true;
+		entry.cacheItem = cache.begin();
+		while (cacheSize > budget) {
+			cacheSize -= cache.back().data->size();
+			entries[cache.back().entryIndex].cached = false;
+			cache.pop_back();
+		}
 	}
 
 	IStream *ZipFileSystem::OpenForReading(const char *fn) {
 		SPADES_MARK_FUNCTION();
 
-		if (currentStream) {
-			currentStream->ForceCloseUnzipFile();
+		auto it = index.find(NormalizeName(fn));
+		if (it == index.end()) {
+			SPFileNotFound(fn);
 		}
 
-		if (!MoveToFile(fn)) {
-			SPFileNotFound(fn);
+		Entry &entry = entries[it->second];
+		if (entry.flags & FlagEncrypted) {
+			SPRaise("Encrypted ZIP entries are not supported: %s", fn);
 		}
 
-		unzOpenCurrentFile(zip);
-		try {
-			currentStream = new ZipFileInputStream(this, zip);
-#if 0
-			return currentStream;
-#else
-			// load all data to allow seeking
-			DynamicMemoryStream *stream;
-			stream = new DynamicMemoryStream();
-			try {
-				char buf[4096];
-				size_t rd;
-				while ((rd = currentStream->Read(buf, 4096)) > 0) {
-					stream->Write(buf, rd);
+		switch (entry.method) {
+			case MethodStored: {
+				uint64_t offset;
+				{
+					std::lock_guard<std::mutex> lock(baseStream->mutex);
+					offset = GetDataOffset(entry);
 				}
-				currentStream->ForceCloseUnzipFile();
-				stream->SetPosition(0);
-				delete currentStream;
-				return stream;
-			} catch (...) {
-				delete stream;
-				delete currentStream;
-				throw;
+				return new StoredFileStream(baseStream, offset, entry.uncompressedSize);
 			}
-#endif
-		} catch (...) {
-			unzCloseCurrentFile(zip);
-			throw;
+			case MethodDeflated:
+				// the inflated data may be shared with the cache
+				return new SharedMemoryStream(Inflate(it->second));
+			default:
+				SPRaise("Unsupported ZIP compression method %d: %s", (int)entry.method, fn);
 		}
 	}
 
@@ -394,22 +380,10 @@ namespace spades {
 	}
 
 	std::vector<std::string> ZipFileSystem::EnumFiles(const char *path) {
-
-		if (currentStream) {
-			currentStream->ForceCloseUnzipFile();
-		}
-
-		if (unzGoToFirstFile(zip) != UNZ_OK) {
-			SPRaise("There was a problem while seeking the zip file to the first file.");
-		}
-
-		// FIXME: use `files` for faster search?
 		std::vector<std::string> lst;
 		size_t ln = strlen(path);
-		do {
-			char buf[513];
-			buf[512] = 0;
-			unzGetCurrentFileInfo(zip, nullptr, buf, 512, nullptr, 0, nullptr, 0);
+		for (const Entry &entry : entries) {
+			const char *buf = entry.name.c_str();
 
 			if (!MatchesZipFile(buf, path))
 				continue;
@@ -427,44 +401,14 @@ namespace spades {
 				continue;
 			}
 			lst.push_back(buf + ln + 1);
-		} while (unzGoToNextFile(zip) == UNZ_OK);
-
-		return lst;
-	}
-
-	bool ZipFileSystem::MoveToFile(const char *fn) {
-		SPADES_MARK_FUNCTION();
-
-		std::string f = fn;
-		for (std::size_t i = 0; i < f.size(); i++) {
-			if (f[i] == '\\')
-				f[i] = '/';
-			else
-				f[i] = tolower(f[i]);
 		}
 
-		auto it = files.find(f);
-		if (it == files.end()) {
-			return false;
-		}
-
-		if (unzGoToFilePos(zip, &it->second) != UNZ_OK) {
-			SPRaise("Failed to seek to the requested file.");
-		}
-		return true;
+		return lst;
 	}
 
 	bool ZipFileSystem::FileExists(const char *fn) {
 		SPADES_MARK_FUNCTION();
 
-		std::string f = fn;
-		for (std::size_t i = 0; i < f.size(); i++) {
-			if (f[i] == '\\')
-				f[i] = '/';
-			else
-				f[i] = tolower(f[i]);
-		}
-
-		return files.find(f) != files.end();
+		return index.find(NormalizeName(fn)) != index.end();
 	}
 }
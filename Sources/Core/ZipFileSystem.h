@@ -21,45 +21,78 @@
 #pragma once
 
 #include <cstdint>
-#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "IFileSystem.h"
 
-extern "C" {
-typedef void *unzFile;
-struct zlib_filefunc_def_s;
-typedef struct zlib_filefunc_def_s zlib_filefunc_def;
-struct unz_file_pos_s;
-}
-
 namespace spades {
+	/**
+	 * A read-only file system backed by a ZIP archive. ZIP64 archives are not
+	 * supported.
+	 *
+	 * The central directory is read once and indexed by a hash table. Files
+	 * can be opened by multiple threads at once; the base stream is locked
+	 * only while the data of an entry is read, and the data is inflated
+	 * without holding the lock. Stored (uncompressed) entries are read from
+	 * the base stream on demand instead of being loaded when opened.
+	 * Recently inflated entries are cached (`core_pakCacheSize`).
+	 */
 	class ZipFileSystem : public IFileSystem {
-		class ZipFileInputStream;
-		class ZipFileHandle;
-
-		IStream *baseStream;
-		bool autoClose;
-		unzFile zip;
-
-		std::map<std::string, unz_file_pos_s> files;
-
-		ZipFileInputStream *currentStream;
-
-		uint64_t cursorPos;
-
-		static ZipFileHandle *InternalOpen(ZipFileSystem *fs, const char *fn, int mode);
-
-		static uint32_t InternalRead(ZipFileSystem *fs, ZipFileHandle *h, void *buf, uint32_t size);
-		static uint32_t InternalWrite(ZipFileSystem *fs, ZipFileHandle *h, void *buf,
-		                              uint32_t size);
-		static long InternalTell(ZipFileSystem *fs, ZipFileHandle *h);
-		static long InternalSeek(ZipFileSystem *fs, ZipFileHandle *h, int32_t offset, int origin);
-		static int InternalClose(ZipFileSystem *fs, ZipFileHandle *h);
-		static int InternalTestError(ZipFileSystem *fs, ZipFileHandle *h);
-
-		zlib_filefunc_def CreateZLibFileFunc();
-		bool MoveToFile(const char *);
+		class BaseStream;
+		class StoredFileStream;
+
+		struct CacheItem {
+			std::size_t entryIndex;
+			std::shared_ptr<const std::string> data;
+		};
+
+		struct Entry {
+			/** The name as stored in the archive. */
+			std::string name;
+			uint16_t flags;
+			uint16_t method;
+			uint32_t crc;
+			uint64_t compressedSize;
+			uint64_t uncompressedSize;
+			uint64_t localHeaderOffset;
+			/** The offset of the data, found by the first open. Guarded by
+			 * the base stream's mutex. Zero if not found yet. */
+			uint64_t dataOffset;
+			/** Whether the inflated data is in `cache`. Guarded by `cacheMutex`. */
+			bool cached;
+			/** The item of `cache` holding the inflated data if `cached`. */
+			std::list<CacheItem>::iterator cacheItem;
+		};
+
+		/** Shared with the streams of the stored entries, which may outlive
+		 * this file system. */
+		std::shared_ptr<BaseStream> baseStream;
+
+		std::vector<Entry> entries;
+		/** Maps normalized names to indices into `entries`. */
+		std::unordered_map<std::string, std::size_t> index;
+
+		std::mutex cacheMutex;
+		/** The most recently used item comes first. */
+		std::list<CacheItem> cache;
+		std::size_t cacheSize;
+
+		static std::string NormalizeName(const char *);
+
+		/** Finds the offset of the data of an entry. The base stream's mutex
+		 * must be held. */
+		uint64_t GetDataOffset(Entry &);
+
+		void ReadCentralDirectory();
+		std::shared_ptr<const std::string> Inflate(std::size_t entryIndex);
+
+		std::shared_ptr<const std::string> FindCache(std::size_t entryIndex);
+		void AddCache(std::size_t entryIndex, std::shared_ptr<const std::string>);
 
 	public:
 		ZipFileSystem(IStream *, bool autoClose = true);
@@ -0,0 +1,168 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <regex>
+#include <vector>
+
+#include "GLAmbientShadowEvaluator.h"
+#include <Client/GameMap.h>
+#include <Core/Benchmark.h>
+#include <Core/Debug.h>
+#include <Core/Exception.h>
+#include <Core/FileManager.h>
+#include <Core/IStream.h>
+#include <Core/Stopwatch.h>
+#include <Core/TaskScheduler.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			enum { ChunkSize = 16 };
+
+			/** Evaluates the chunks of a slice of the map along X. */
+			class EvaluateSliceTask : public Task {
+				GLAmbientShadowEvaluator &evaluator;
+				int cx, numChunksY, numChunksZ;
+				float *values;
+				int pitchY, pitchZ;
+
+			protected:
+				void Execute() override {
+					for (int cy = 0; cy < numChunksY; cy++)
+						for (int cz = 0; cz < numChunksZ; cz++) {
+							IntVector3 minPos =
+							  IntVector3::Make(cx * ChunkSize, cy * ChunkSize, cz * ChunkSize);
+							IntVector3 maxPos = minPos + (ChunkSize - 1);
+							evaluator.EvaluateBox(minPos, maxPos,
+							                      values + minPos.x + minPos.y * pitchY +
+							                        minPos.z * pitchZ,
+							                      pitchY, pitchZ);
+						}
+				}
+
+			public:
+				EvaluateSliceTask(GLAmbientShadowEvaluator &evaluator, int cx, int numChunksY,
+				                  int numChunksZ, float *values, int pitchY, int pitchZ)
+				    : evaluator(evaluator),
+				      cx(cx),
+				      numChunksY(numChunksY),
+				      numChunksZ(numChunksZ),
+				      values(values),
+				      pitchY(pitchY),
+				      pitchZ(pitchZ) {}
+			};
+
+			// Computes the ambient occlusion of the whole bundled maps with the
+			// ray casting path and the bitmask path and compares the results.
+			void AmbientShadowBenchmark() {
+				static std::regex re(".*\\.vxl", std::regex::icase);
+				int numMismatches = 0;
+
+				for (const auto &name : FileManager::EnumFiles("Maps")) {
+					if (!std::regex_match(name, re)) {
+						continue;
+					}
+
+					Handle<client::GameMap> map;
+					{
+						std::unique_ptr<IStream> stream(
+						  FileManager::OpenForReading(("Maps/" + name).c_str()));
+						map.Set(client::GameMap::Load(stream.get()), false);
+					}
+
+					GLAmbientShadowEvaluator evaluator(map);
+					int w = map->Width(), h = map->Height(), d = map->Depth();
+					int pitchY = w, pitchZ = w * h;
+					std::vector<float> reference(static_cast<std::size_t>(w * h * d));
+					std::vector<float> values(reference.size());
+
+					Stopwatch sw;
+					for (int z = 0; z < d; z++)
+						for (int y = 0; y < h; y++)
+							for (int x = 0; x < w; x++) {
+								reference[x + y * pitchY + z * pitchZ] =
+								  evaluator.Evaluate(IntVector3::Make(x, y, z));
+							}
+					double referenceTime = sw.GetTime();
+
+					sw.Reset();
+					evaluator.EvaluateBox(IntVector3::Make(0, 0, 0),
+					                      IntVector3::Make(w - 1, h - 1, d - 1), values.data(),
+					                      pitchY, pitchZ);
+					double bitmaskTime = sw.GetTime();
+
+					// evaluate again on the worker threads like
+					// `GLAmbientShadowRenderer` does
+					std::vector<std::unique_ptr<EvaluateSliceTask>> tasks;
+					for (int cx = 0; cx < w / ChunkSize; cx++) {
+						tasks.emplace_back(new EvaluateSliceTask(evaluator, cx, h / ChunkSize,
+						                                         d / ChunkSize, values.data(),
+						                                         pitchY, pitchZ));
+					}
+					sw.Reset();
+					{
+						TaskGroup group;
+						for (const auto &task : tasks) {
+							group.Run(*task);
+						}
+						group.Wait();
+					}
+					double parallelTime = sw.GetTime();
+
+					double sumError = 0.0;
+					float maxError = 0.f;
+					std::size_t numBadVoxels = 0;
+					for (std::size_t i = 0; i < reference.size(); i++) {
+						float error = std::fabs(values[i] - reference[i]);
+						sumError += error;
+						maxError = std::max(maxError, error);
+						if (error > 1.e-3f) {
+							numBadVoxels++;
+						}
+					}
+
+					SPLog("[%s] ray casting: %.3fms", name.c_str(), referenceTime * 1000.0);
+					SPLog("[%s] bitmask: %.3fms, %.3fms with %d worker(s)", name.c_str(),
+					      bitmaskTime * 1000.0, parallelTime * 1000.0,
+					      TaskScheduler::GetInstance().GetNumWorkers());
+					SPLog("[%s] error: mean %g, max %g, %d voxel(s) differ by more than 1e-3",
+					      name.c_str(), sumError / reference.size(), maxError,
+					      (int)numBadVoxels);
+
+					// the rays of a voxel might take a different path due to
+					// rounding errors in rare cases
+					if (numBadVoxels * 1000 > reference.size()) {
+						numMismatches++;
+					}
+				}
+
+				if (numMismatches > 0) {
+					SPRaise("The bitmask path differs from the ray casting path in %d map(s)",
+					        numMismatches);
+				}
+			}
+
+			Benchmark ambientShadowBenchmark("ambientshadow", AmbientShadowBenchmark);
+		}
+	}
+}
@@ -0,0 +1,379 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "GLAmbientShadowEvaluator.h"
+#include <Client/GameMap.h>
+#include <Core/Debug.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			const float MuzzleDiff = 0.02f;
+
+			// the order in which `Evaluate` lists the octants of the empty
+			// voxels around a vertex
+			const int OctantOrder[8] = {7, 3, 5, 1, 6, 2, 4, 0};
+		}
+
+		GLAmbientShadowEvaluator::GLAmbientShadowEvaluator(client::GameMap *map) : map(map) {
+			SPADES_MARK_FUNCTION();
+
+			for (int i = 0; i < NumRays; i++) {
+				Vector3 dir =
+				  MakeVector3(SampleRandomFloat(), SampleRandomFloat(), SampleRandomFloat());
+				dir = dir.Normalize();
+				dir += 0.01f;
+				rays[i] = dir;
+			}
+
+			// Trace the rays from the origin in the same way as
+			// `GameMap::CastRay`, recording the visited cells instead of
+			// testing them.
+			for (int i = 0; i < NumRays; i++)
+				for (int octant = 0; octant < 8; octant++) {
+					Vector3 dir = rays[i];
+					if (octant & 1)
+						dir.x = -dir.x;
+					if (octant & 2)
+						dir.y = -dir.y;
+					if (octant & 4)
+						dir.z = -dir.z;
+
+					Vector3 v0 = dir * MuzzleDiff;
+					Vector3 v1 = v0 + dir * (float)MaxRaySteps;
+					Vector3 f, g;
+					IntVector3 a, c, d, p, inc;
+					long cnt = 0;
+
+					a = v0.Floor();
+					c = v1.Floor();
+
+					if (c.x < a.x) {
+						d.x = -1;
+						f.x = v0.x - a.x;
+						g.x = (v0.x - v1.x) * 1024;
+						cnt += a.x - c.x;
+					} else if (c.x != a.x) {
+						d.x = 1;
+						f.x = a.x + 1 - v0.x;
+						g.x = (v1.x - v0.x) * 1024;
+						cnt += c.x - a.x;
+					} else {
+						d.x = 0;
+						f.x = g.x = 0;
+					}
+					if (c.y < a.y) {
+						d.y = -1;
+						f.y = v0.y - a.y;
+						g.y = (v0.y - v1.y) * 1024;
+						cnt += a.y - c.y;
+					} else if (c.y != a.y) {
+						d.y = 1;
+						f.y = a.y + 1 - v0.y;
+						g.y = (v1.y - v0.y) * 1024;
+						cnt += c.y - a.y;
+					} else {
+						d.y = 0;
+						f.y = g.y = 0;
+					}
+					if (c.z < a.z) {
+						d.z = -1;
+						f.z = v0.z - a.z;
+						g.z = (v0.z - v1.z) * 1024;
+						cnt += a.z - c.z;
+					} else if (c.z != a.z) {
+						d.z = 1;
+						f.z = a.z + 1 - v0.z;
+						g.z = (v1.z - v0.z) * 1024;
+						cnt += c.z - a.z;
+					} else {
+						d.z = 0;
+						f.z = g.z = 0;
+					}
+
+					Vector3 pp = MakeVector3(f.x * g.z - f.z * g.x, f.y * g.z - f.z * g.y,
+					                         f.y * g.x - f.x * g.y);
+					p = pp.Floor();
+					inc = g.Floor();
+
+					if (cnt > (long)MaxRaySteps)
+						cnt = (long)MaxRaySteps;
+
+					RayPath &path = paths[i][octant];
+					path.numSteps = 0;
+					while (cnt > 0) {
+						if (((p.x | p.y) >= 0) && (a.z != c.z)) {
+							a.z += d.z;
+							p.x -= inc.x;
+							p.y -= inc.y;
+						} else if ((p.z >= 0) && (a.x != c.x)) {
+							a.x += d.x;
+							p.x += inc.z;
+							p.z -= inc.y;
+						} else {
+							a.y += d.y;
+							p.y += inc.z;
+							p.z += inc.x;
+						}
+
+						Vector3 centerPos = MakeVector3(a.x + .5f, a.y + .5f, a.z + .5f);
+						float dist = (centerPos - v0).GetPoweredLength();
+						path.cells[path.numSteps] = a;
+						path.brightness[path.numSteps] = std::min(dist * 0.02f, 1.f);
+						path.numSteps++;
+						cnt--;
+					}
+				}
+		}
+
+		GLAmbientShadowEvaluator::~GLAmbientShadowEvaluator() {}
+
+		uint64_t GLAmbientShadowEvaluator::GetColumnBits(int x, int y, int minZ) {
+			SPAssert(map->Depth() == 64);
+			if (minZ <= -64) {
+				return 0;
+			} else if (minZ >= 64) {
+				return ~0ULL;
+			}
+
+			uint64_t column = map->GetSolidMapWrapped(x, y);
+			if (minZ < 0) {
+				return column << -minZ;
+			} else if (minZ > 0) {
+				return (column >> minZ) | (~0ULL << (64 - minZ));
+			} else {
+				return column;
+			}
+		}
+
+		float GLAmbientShadowEvaluator::Evaluate(IntVector3 ipos) {
+			SPADES_MARK_FUNCTION_DEBUG();
+
+			float sum = 0;
+			Vector3 pos = MakeVector3((float)ipos.x, (float)ipos.y, (float)ipos.z);
+
+			// check allowed ray direction
+			uint8_t directions[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+			int numDirections = 0;
+			for (int x = -1; x <= 0; x++)
+				for (int y = -1; y <= 0; y++)
+					for (int z = -1; z <= 0; z++) {
+						if (!map->IsSolidWrapped(ipos.x + x, ipos.y + y, ipos.z + z)) {
+							unsigned int bits = 0;
+							if (x)
+								bits |= 1;
+							if (y)
+								bits |= 2;
+							if (z)
+								bits |= 4;
+							directions[numDirections++] = bits;
+						}
+					}
+			if (numDirections == 0)
+				numDirections = 8;
+
+			int dirId = 0;
+
+			for (int i = 0; i < NumRays; i++) {
+				Vector3 dir = rays[i];
+
+				unsigned int bits = directions[dirId];
+				if (bits & 1)
+					dir.x = -dir.x;
+				if (bits & 2)
+					dir.y = -dir.y;
+				if (bits & 4)
+					dir.z = -dir.z;
+
+				dirId++;
+				if (dirId >= numDirections)
+					dirId = 0;
+
+				Vector3 muzzle = pos + dir * MuzzleDiff;
+				IntVector3 hitBlock;
+
+				float brightness = 1.f;
+				if (map->IsSolidWrapped((int)floorf(muzzle.x), (int)floorf(muzzle.y),
+				                        (int)floorf(muzzle.z))) {
+					if (numDirections < 8)
+						SPAssert(false);
+					continue;
+				}
+				if (map->CastRay(muzzle, dir, (float)MaxRaySteps, hitBlock)) {
+					Vector3 centerPos =
+					  MakeVector3(hitBlock.x + .5f, hitBlock.y + .5f, hitBlock.z + .5f);
+					float dist = (centerPos - muzzle).GetPoweredLength();
+					brightness = dist * 0.02f; // 1/7/7
+					if (brightness > 1.f)
+						brightness = 1.f;
+				}
+
+				sum += brightness;
+			}
+
+			sum *= 1.f / (float)NumRays;
+			sum *= (float)numDirections / 4.f;
+
+			return sum;
+		}
+
+		void GLAmbientShadowEvaluator::EvaluateColumn(int x, int y, int minZ, int numVoxels,
+		                                              float *outValues) {
+			SPADES_MARK_FUNCTION_DEBUG();
+			SPAssert(numVoxels > 0 && numVoxels <= 64);
+
+			uint64_t voxels = numVoxels == 64 ? ~0ULL : (1ULL << numVoxels) - 1;
+
+			// the voxels whose vertex is touched by the empty cell of each octant
+			uint64_t emptyCells[8];
+			for (int octant = 0; octant < 8; octant++) {
+				emptyCells[octant] = ~GetColumnBits(x - (octant & 1), y - ((octant >> 1) & 1),
+				                                    minZ - ((octant >> 2) & 1)) &
+				                     voxels;
+			}
+
+			// the voxels casting each ray to each octant
+			uint64_t rayMasks[NumRays][8] = {};
+			int numDirections[64];
+			for (int i = 0; i < numVoxels; i++) {
+				uint64_t bit = 1ULL << i;
+				int directions[8];
+				int count = 0;
+				for (int octant : OctantOrder) {
+					if (emptyCells[octant] & bit) {
+						directions[count++] = octant;
+					}
+				}
+				numDirections[i] = count;
+
+				// rays from a voxel surrounded by solid voxels start inside
+				// them and contribute nothing
+				for (int ray = 0; count > 0 && ray < NumRays; ray++) {
+					rayMasks[ray][directions[ray % count]] |= bit;
+				}
+			}
+
+			float sums[64] = {};
+			for (int ray = 0; ray < NumRays; ray++)
+				for (int octant = 0; octant < 8; octant++) {
+					uint64_t remaining = rayMasks[ray][octant];
+					if (!remaining) {
+						continue;
+					}
+
+					const RayPath &path = paths[ray][octant];
+					for (int step = 0; step < path.numSteps && remaining; step++) {
+						const IntVector3 &cell = path.cells[step];
+						uint64_t hits =
+						  GetColumnBits(x + cell.x, y + cell.y, minZ + cell.z) & remaining;
+						remaining &= ~hits;
+						while (hits) {
+							int i = CountTrailingZeros(hits);
+							sums[i] += path.brightness[step];
+							hits &= hits - 1;
+						}
+					}
+
+					// not blocked at all
+					while (remaining) {
+						int i = CountTrailingZeros(remaining);
+						sums[i] += 1.f;
+						remaining &= remaining - 1;
+					}
+				}
+
+			for (int i = 0; i < numVoxels; i++) {
+				int count = numDirections[i] == 0 ? 8 : numDirections[i];
+				outValues[i] = sums[i] * (1.f / (float)NumRays) * ((float)count / 4.f);
+			}
+		}
+
+		void GLAmbientShadowEvaluator::EvaluateBox(IntVector3 minPos, IntVector3 maxPos,
+		                                           float *outValues, int pitchY, int pitchZ) {
+			SPADES_MARK_FUNCTION_DEBUG();
+
+			int numVoxels = maxPos.z - minPos.z + 1;
+			SPAssert(numVoxels > 0 && numVoxels <= 64);
+
+			float uniformValue = 0.f;
+			bool uniform = false;
+			if (IsEnclosed(minPos, maxPos)) {
+				uniform = true;
+			} else if (IsOpen(minPos, maxPos)) {
+				uniformValue = GetOpenValue();
+				uniform = true;
+			}
+
+			float values[64];
+			for (int y = minPos.y; y <= maxPos.y; y++)
+				for (int x = minPos.x; x <= maxPos.x; x++) {
+					float *out = outValues + (x - minPos.x) + (y - minPos.y) * pitchY;
+					if (uniform) {
+						for (int i = 0; i < numVoxels; i++)
+							out[i * pitchZ] = uniformValue;
+						continue;
+					}
+
+					EvaluateColumn(x, y, minPos.z, numVoxels, values);
+					for (int i = 0; i < numVoxels; i++)
+						out[i * pitchZ] = values[i];
+				}
+		}
+
+		bool GLAmbientShadowEvaluator::IsEnclosed(IntVector3 minPos, IntVector3 maxPos) {
+			// rays start from the cells touching the vertices
+			int numVoxels = maxPos.z - minPos.z + 2;
+			if (numVoxels > 64) {
+				return false;
+			}
+			uint64_t voxels = numVoxels == 64 ? ~0ULL : (1ULL << numVoxels) - 1;
+			for (int x = minPos.x - 1; x <= maxPos.x; x++)
+				for (int y = minPos.y - 1; y <= maxPos.y; y++) {
+					if ((GetColumnBits(x, y, minPos.z - 1) & voxels) != voxels) {
+						return false;
+					}
+				}
+			return true;
+		}
+
+		bool GLAmbientShadowEvaluator::IsOpen(IntVector3 minPos, IntVector3 maxPos) {
+			// every cell visited by the rays, which take one step along an axis
+			// at a time, is within this range
+			const int reach = MaxRaySteps + 1;
+			int minZ = minPos.z - reach;
+			int numVoxels = maxPos.z - minPos.z + 1 + reach * 2;
+			if (minZ + numVoxels > map->Depth() || numVoxels > 64) {
+				// the rays might hit the bottom of the map
+				return false;
+			}
+			uint64_t voxels = numVoxels == 64 ? ~0ULL : (1ULL << numVoxels) - 1;
+			for (int x = minPos.x - reach; x <= maxPos.x + reach; x++)
+				for (int y = minPos.y - reach; y <= maxPos.y + reach; y++) {
+					if (GetColumnBits(x, y, minZ) & voxels) {
+						return false;
+					}
+				}
+			return true;
+		}
+	}
+}
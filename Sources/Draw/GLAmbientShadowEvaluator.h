@@ -0,0 +1,103 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include <Core/Math.h>
+
+namespace spades {
+	namespace client {
+		class GameMap;
+	}
+	namespace draw {
+		/**
+		 * Computes the large-scale ambient occlusion of the map voxels, which
+		 * is the average brightness seen by `NumRays` rays cast from a voxel.
+		 *
+		 * Every ray cast from a voxel visits the same cells relative to the
+		 * voxel, so the cells are computed once in the constructor.
+		 * `EvaluateColumn` walks them for up to 64 voxels of a column at once
+		 * by testing the bits of the map's `solidMap` columns.
+		 *
+		 * This class doesn't use OpenGL and can be used on any thread as long
+		 * as the map isn't modified at the same time.
+		 */
+		class GLAmbientShadowEvaluator {
+		public:
+			enum { NumRays = 16, MaxRaySteps = 18 };
+
+			GLAmbientShadowEvaluator(client::GameMap *);
+			~GLAmbientShadowEvaluator();
+
+			/** Computes the value of a voxel by casting rays with
+			 * `GameMap::CastRay`. This is the reference implementation of
+			 * `EvaluateColumn`. */
+			float Evaluate(IntVector3);
+
+			/** Computes the values of the voxels `(x, y, minZ)` through
+			 * `(x, y, minZ + numVoxels - 1)`. `numVoxels` must be at most 64. */
+			void EvaluateColumn(int x, int y, int minZ, int numVoxels, float *outValues);
+
+			/**
+			 * Computes the values of the voxels in the box from `minPos` through
+			 * `maxPos`, skipping the test of rays if the box is entirely inside
+			 * or outside the terrain. The box must be at most 64 voxels tall.
+			 * @param outValues Receives the value of `minPos`. The value of
+			 *                  `minPos + (x, y, z)` is stored at
+			 *                  `outValues[x + y * pitchY + z * pitchZ]`.
+			 */
+			void EvaluateBox(IntVector3 minPos, IntVector3 maxPos, float *outValues, int pitchY,
+			                 int pitchZ);
+
+			/** Returns `true` if every voxel of the box from `minPos` through
+			 * `maxPos` evaluates to `0`. */
+			bool IsEnclosed(IntVector3 minPos, IntVector3 maxPos);
+
+			/** Returns `true` if every voxel of the box from `minPos` through
+			 * `maxPos` evaluates to `GetOpenValue()`. */
+			bool IsOpen(IntVector3 minPos, IntVector3 maxPos);
+
+			/** The value of the voxels that no ray is blocked. */
+			static float GetOpenValue() { return 2.f; }
+
+		private:
+			struct RayPath {
+				int numSteps;
+				// the cells visited by the ray, relative to the voxel
+				IntVector3 cells[MaxRaySteps];
+				float brightness[MaxRaySteps];
+			};
+
+			client::GameMap *map;
+			Vector3 rays[NumRays];
+
+			// indexed by the ray and the octant, the latter of which has bits
+			// 1, 2, and 4 set if the ray is flipped along X, Y, and Z
+			RayPath paths[NumRays][8];
+
+			/** Returns the solidness of the voxels `(x, y, minZ)` through
+			 * `(x, y, minZ + 63)` as bits. Voxels above the map are empty and
+			 * ones below the map are solid. */
+			uint64_t GetColumnBits(int x, int y, int minZ);
+		};
+	}
+}
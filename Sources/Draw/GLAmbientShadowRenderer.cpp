@@ -18,44 +18,22 @@
 
  */
 
-#include <atomic>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 
 #include <Client/GameMap.h>
 #include "GLAmbientShadowRenderer.h"
 #include "GLProfiler.h"
 #include "GLRenderer.h"
-
-#include <Core/ConcurrentDispatch.h>
+#include <Core/TraceRecorder.h>
 
 namespace spades {
 	namespace draw {
-		class GLAmbientShadowRenderer::UpdateDispatch : public ConcurrentDispatch {
-			GLAmbientShadowRenderer *renderer;
-
-		public:
-			std::atomic<bool> done {false};
-			UpdateDispatch(GLAmbientShadowRenderer *r) : renderer(r) { }
-			void Run() override {
-				SPADES_MARK_FUNCTION();
-
-				renderer->UpdateDirtyChunks();
-
-				done = true;
-			}
-		};
-
 		GLAmbientShadowRenderer::GLAmbientShadowRenderer(GLRenderer *r, client::GameMap *m)
-		    : renderer(r), device(r->GetGLDevice()), map(m) {
+		    : renderer(r), device(r->GetGLDevice()), map(m), evaluator(m) {
 			SPADES_MARK_FUNCTION();
 
-			for (int i = 0; i < NumRays; i++) {
-				Vector3 dir = MakeVector3(SampleRandomFloat(), SampleRandomFloat(), SampleRandomFloat());
-				dir = dir.Normalize();
-				dir += 0.01f;
-				rays[i] = dir;
-			}
-
 			w = map->Width();
 			h = map->Height();
 			d = map->Depth();
@@ -109,91 +87,16 @@ namespace spades {
 
 			SPLog("Chunk texture initialized");
 
-			dispatch = NULL;
+			scheduler.reset(new ChunkUpdateScheduler(*this, chunks, chunkW, chunkH, chunkD,
+			                                         ChunkSize));
 		}
 
 		GLAmbientShadowRenderer::~GLAmbientShadowRenderer() {
 			SPADES_MARK_FUNCTION();
-			if (dispatch) {
-				dispatch->Join();
-				delete dispatch;
-			}
+			scheduler.reset();
 			device->DeleteTexture(texture);
 		}
 
-		float GLAmbientShadowRenderer::Evaluate(IntVector3 ipos) {
-			SPADES_MARK_FUNCTION_DEBUG();
-
-			float sum = 0;
-			Vector3 pos = MakeVector3((float)ipos.x, (float)ipos.y, (float)ipos.z);
-
-			float muzzleDiff = 0.02f;
-
-			// check allowed ray direction
-			uint8_t directions[8] = {0, 1, 2, 3, 4, 5, 6, 7};
-			int numDirections = 0;
-			for (int x = -1; x <= 0; x++)
-				for (int y = -1; y <= 0; y++)
-					for (int z = -1; z <= 0; z++) {
-						if (!map->IsSolidWrapped(ipos.x + x, ipos.y + y, ipos.z + z)) {
-							unsigned int bits = 0;
-							if (x)
-								bits |= 1;
-							if (y)
-								bits |= 2;
-							if (z)
-								bits |= 4;
-							directions[numDirections++] = bits;
-						}
-					}
-			if (numDirections == 0)
-				numDirections = 8;
-
-			int dirId = 0;
-
-			for (int i = 0; i < NumRays; i++) {
-				Vector3 dir = rays[i];
-
-				unsigned int bits = directions[dirId];
-				if (bits & 1)
-					dir.x = -dir.x;
-				if (bits & 2)
-					dir.y = -dir.y;
-				if (bits & 4)
-					dir.z = -dir.z;
-
-				dirId++;
-				if (dirId >= numDirections)
-					dirId = 0;
-
-				Vector3 muzzle = pos + dir * muzzleDiff;
-				IntVector3 hitBlock;
-
-				float brightness = 1.f;
-				if (map->IsSolidWrapped((int)floorf(muzzle.x), (int)floorf(muzzle.y),
-				                        (int)floorf(muzzle.z))) {
-					if (numDirections < 8)
-						SPAssert(false);
-					continue;
-				}
-				if (map->CastRay(muzzle, dir, 18.f, hitBlock)) {
-					Vector3 centerPos =
-					  MakeVector3(hitBlock.x + .5f, hitBlock.y + .5f, hitBlock.z + .5f);
-					float dist = (centerPos - muzzle).GetPoweredLength();
-					brightness = dist * 0.02f; // 1/7/7
-					if (brightness > 1.f)
-						brightness = 1.f;
-				}
-
-				sum += brightness;
-			}
-
-			sum *= 1.f / (float)NumRays;
-			sum *= (float)numDirections / 4.f;
-
-			return sum;
-		}
-
 		void GLAmbientShadowRenderer::GameMapChanged(int x, int y, int z, client::GameMap *map) {
 			SPADES_MARK_FUNCTION_DEBUG();
 			if (map != this->map)
@@ -254,131 +157,42 @@ namespace spades {
 					}
 		}
 
-		int GLAmbientShadowRenderer::GetNumDirtyChunks() {
-			int cnt = 0;
-			for (size_t i = 0; i < chunks.size(); i++) {
-				Chunk &c = chunks[i];
-				if (c.dirty)
-					cnt++;
-			}
-			return cnt;
-		}
-
 		void GLAmbientShadowRenderer::Update() {
-			if (GetNumDirtyChunks() > 0 && (dispatch == NULL || dispatch->done)) {
-				if (dispatch) {
-					dispatch->Join();
-					delete dispatch;
-				}
-				dispatch = new UpdateDispatch(this);
-				dispatch->Start();
-			}
-
-			// Count the number of chunks that need to be uploaded to GPU.
-			// This value is approximate but it should be okay for profiling use
-			int cnt = 0;
-			for (size_t i = 0; i < chunks.size(); i++) {
-				if (!chunks[i].transferDone.load())
-					cnt++;
-			}
-			GLProfiler::Context profiler(renderer->GetGLProfiler(), "Large Ambient Occlusion [>= %d chunk(s)]", cnt);
+			scheduler->Update(renderer->GetSceneDef());
 
+			GLProfiler::Context profiler(renderer->GetGLProfiler(),
+			                             "Large Ambient Occlusion [>= %d chunk(s)]",
+			                             scheduler->GetNumPendingUploads());
 			device->BindTexture(IGLDevice::Texture3D, texture);
-			for (size_t i = 0; i < chunks.size(); i++) {
-				Chunk &c = chunks[i];
-				if (!c.transferDone.exchange(true)) {
-					device->TexSubImage3D(IGLDevice::Texture3D, 0, c.cx * ChunkSize,
-					                      c.cy * ChunkSize, c.cz * ChunkSize + 1, ChunkSize,
-					                      ChunkSize, ChunkSize, IGLDevice::Red,
-					                      IGLDevice::FloatType, c.data);
-				}
-			}
+			scheduler->Upload(MaxUploadsPerFrame);
 		}
 
-		void GLAmbientShadowRenderer::UpdateDirtyChunks() {
-			int dirtyChunkIds[256];
-			int numDirtyChunks = 0;
-			int nearDirtyChunks = 0;
-
-			// first, check only chunks in near range
-			Vector3 eyePos = renderer->GetSceneDef().viewOrigin;
-			int eyeX = (int)(eyePos.x) >> ChunkSizeBits;
-			int eyeY = (int)(eyePos.y) >> ChunkSizeBits;
-			int eyeZ = (int)(eyePos.z) >> ChunkSizeBits;
-
-			for (size_t i = 0; i < chunks.size(); i++) {
-				Chunk &c = chunks[i];
-				int dx = (c.cx - eyeX) & (chunkW - 1);
-				int dy = (c.cy - eyeY) & (chunkH - 1);
-				int dz = (c.cz - eyeZ);
-				if (dx >= 6 && dx <= chunkW - 6)
-					continue;
-				if (dy >= 6 && dy <= chunkW - 6)
-					continue;
-				if (dz >= 6 || dz <= -6)
-					continue;
-				if (c.dirty) {
-					dirtyChunkIds[numDirtyChunks++] = static_cast<int>(i);
-					nearDirtyChunks++;
-					if (numDirtyChunks >= 256)
-						break;
-				}
-			}
+		void GLAmbientShadowRenderer::UploadChunks(int cx, int cy, int minZ, int maxZ) {
+			SPADES_MARK_FUNCTION();
 
-			// far chunks
-			if (numDirtyChunks == 0) {
-				for (size_t i = 0; i < chunks.size(); i++) {
-					Chunk &c = chunks[i];
-					if (c.dirty) {
-						dirtyChunkIds[numDirtyChunks++] = static_cast<int>(i);
-						if (numDirtyChunks >= 256)
-							break;
-					}
-				}
+			const std::size_t chunkVoxels = ChunkSize * ChunkSize * ChunkSize;
+			int numMerged = maxZ - minZ + 1;
+			uploadBuffer.resize(chunkVoxels * numMerged);
+			for (int cz = minZ; cz <= maxZ; cz++) {
+				std::memcpy(uploadBuffer.data() + chunkVoxels * (cz - minZ),
+				            GetChunk(cx, cy, cz).data, chunkVoxels * sizeof(float));
 			}
 
-			// limit update count per frame
-			for (int i = 0; i < 8; i++) {
-				if (numDirtyChunks <= 0)
-					break;
-                int idx = SampleRandomInt(0, numDirtyChunks - 1);
-				Chunk &c = chunks[dirtyChunkIds[idx]];
-
-				// remove from list (fast)
-				if (idx < numDirtyChunks - 1) {
-					std::swap(dirtyChunkIds[idx], dirtyChunkIds[numDirtyChunks - 1]);
-				}
-				numDirtyChunks--;
-
-				UpdateChunk(c.cx, c.cy, c.cz);
-			}
-			/*
-			printf("%d (%d near) chunk update left\n",
-			       GetNumDirtyChunks(), nearDirtyChunks);*/
+			device->TexSubImage3D(IGLDevice::Texture3D, 0, cx * ChunkSize, cy * ChunkSize,
+			                      minZ * ChunkSize + 1, ChunkSize, ChunkSize,
+			                      ChunkSize * numMerged, IGLDevice::Red, IGLDevice::FloatType,
+			                      uploadBuffer.data());
 		}
 
-		void GLAmbientShadowRenderer::UpdateChunk(int cx, int cy, int cz) {
-			Chunk &c = GetChunk(cx, cy, cz);
-			if (!c.dirty)
-				return;
-
-			int originX = cx * ChunkSize;
-			int originY = cy * ChunkSize;
-			int originZ = cz * ChunkSize;
-
-			for (int z = c.dirtyMinZ; z <= c.dirtyMaxZ; z++)
-				for (int y = c.dirtyMinY; y <= c.dirtyMaxY; y++)
-					for (int x = c.dirtyMinX; x <= c.dirtyMaxX; x++) {
-						IntVector3 pos;
-						pos.x = (x + originX);
-						pos.y = (y + originY);
-						pos.z = (z + originZ);
-
-						c.data[z][y][x] = Evaluate(pos);
-					}
+		void GLAmbientShadowRenderer::UpdateChunk(Chunk &c, IntVector3 minPos, IntVector3 maxPos,
+		                                          std::vector<float> &) {
+			SPADES_MARK_FUNCTION();
+			SPADES_TRACE_SCOPE("GLAmbientShadowRenderer::UpdateChunk");
 
-			c.dirty = false;
-			c.transferDone = false;
+			IntVector3 origin = IntVector3::Make(c.cx, c.cy, c.cz) * ChunkSize;
+			evaluator.EvaluateBox(origin + minPos, origin + maxPos,
+			                      &c.data[minPos.z][minPos.y][minPos.x], ChunkSize,
+			                      ChunkSize * ChunkSize);
 		}
 	}
 }
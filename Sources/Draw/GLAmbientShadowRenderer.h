@@ -20,11 +20,13 @@
 
 #pragma once
 
+#include <memory>
 #include <vector>
-#include <atomic>
 
 #include <Core/Debug.h>
 #include <Core/Math.h>
+#include "GLAmbientShadowEvaluator.h"
+#include "GLChunkUpdateScheduler.h"
 #include "IGLDevice.h"
 
 namespace spades {
@@ -36,24 +38,28 @@ namespace spades {
 		class IGLDevice;
 		class GLAmbientShadowRenderer {
 
-			class UpdateDispatch;
-			enum { NumRays = 16, ChunkSize = 16, ChunkSizeBits = 4 };
+			enum { ChunkSize = 16, ChunkSizeBits = 4 };
+
+			// the maximum number of the regions uploaded per frame. each region
+			// is a run of chunks in a column and takes one `TexSubImage3D` call.
+			enum { MaxUploadsPerFrame = 8 };
 			GLRenderer *renderer;
 			IGLDevice *device;
 			client::GameMap *map;
-			Vector3 rays[NumRays];
+			GLAmbientShadowEvaluator evaluator;
 
-			struct Chunk {
+			struct Chunk : GLChunkUpdateState {
 				int cx, cy, cz;
 				float data[ChunkSize][ChunkSize][ChunkSize];
 				bool dirty = true;
 				int dirtyMinX = 0, dirtyMaxX = ChunkSize - 1;
 				int dirtyMinY = 0, dirtyMaxY = ChunkSize - 1;
 				int dirtyMinZ = 0, dirtyMaxZ = ChunkSize - 1;
-
-				std::atomic<bool> transferDone {true};
 			};
 
+			using ChunkUpdateScheduler = GLChunkUpdateScheduler<GLAmbientShadowRenderer, Chunk>;
+			friend ChunkUpdateScheduler;
+
 			IGLDevice::UInteger texture;
 
 			int w, h, d;
@@ -78,17 +84,20 @@ namespace spades {
 
 			void Invalidate(int minX, int minY, int minZ, int maxX, int maxY, int maxZ);
 
-			void UpdateChunk(int cx, int cy, int cz);
-			void UpdateDirtyChunks();
-			int GetNumDirtyChunks();
+			/** Recomputes the given region (chunk-local) of a chunk. Can be
+			 * called on any thread. */
+			void UpdateChunk(Chunk &, IntVector3 minPos, IntVector3 maxPos,
+			                 std::vector<float> &);
+			void UploadChunks(int cx, int cy, int minZ, int maxZ);
 
-			UpdateDispatch *dispatch;
+			std::unique_ptr<ChunkUpdateScheduler> scheduler;
+			std::vector<float> uploadBuffer;
 
 		public:
 			GLAmbientShadowRenderer(GLRenderer *renderer, client::GameMap *map);
 			~GLAmbientShadowRenderer();
 
-			float Evaluate(IntVector3);
+			float Evaluate(IntVector3 pos) { return evaluator.Evaluate(pos); }
 
 			void GameMapChanged(int x, int y, int z, client::GameMap *);
 
@@ -0,0 +1,137 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <atomic>
+#include <cstring>
+
+#include "GLAsyncReadback.h"
+#include <Core/Debug.h>
+#include <Core/Exception.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			const IGLDevice::UInteger64 FenceTimeout = 1000000000ULL; // 1 second
+		}
+
+		class GLAsyncReadback::CopyTask : public Task {
+			const void *source;
+			Bitmap &bitmap;
+			std::atomic<bool> done{false};
+
+		protected:
+			void Execute() override {
+				SPADES_MARK_FUNCTION();
+				std::size_t size = static_cast<std::size_t>(bitmap.GetWidth()) *
+				                   static_cast<std::size_t>(bitmap.GetHeight()) * 4;
+				std::memcpy(bitmap.GetPixels(), source, size);
+				done.store(true, std::memory_order_release);
+			}
+
+		public:
+			CopyTask(const void *source, Bitmap &bitmap) : source(source), bitmap(bitmap) {}
+
+			bool IsDone() const { return done.load(std::memory_order_acquire); }
+		};
+
+		GLAsyncReadback::GLAsyncReadback(IGLDevice *device) : device(device) {}
+
+		GLAsyncReadback::~GLAsyncReadback() {
+			SPADES_MARK_FUNCTION();
+			try {
+				Update(true);
+			} catch (const std::exception &ex) {
+				SPLog("Failed to complete the pending framebuffer reads: %s", ex.what());
+			}
+		}
+
+		void GLAsyncReadback::Read(int width, int height, Callback callback) {
+			SPADES_MARK_FUNCTION();
+
+			std::unique_ptr<Request> req(new Request());
+			req->bitmap.Set(new Bitmap(width, height), false);
+			req->callback = std::move(callback);
+
+			auto size = static_cast<IGLDevice::Sizei>(width * height * 4);
+			req->buffer = device->GenBuffer();
+			device->BindBuffer(IGLDevice::PixelPackBuffer, req->buffer);
+			device->BufferData(IGLDevice::PixelPackBuffer, size, nullptr, IGLDevice::StreamRead);
+
+			// with a pixel pack buffer bound, the pointer is an offset into it
+			device->ReadPixels(0, 0, width, height, IGLDevice::RGBA, IGLDevice::UnsignedByte,
+			                   nullptr);
+			device->BindBuffer(IGLDevice::PixelPackBuffer, 0);
+
+			req->fence = device->FenceSync();
+			requests.push_back(std::move(req));
+		}
+
+		void GLAsyncReadback::Update(bool wait) {
+			SPADES_MARK_FUNCTION();
+
+			while (!requests.empty()) {
+				Request &req = *requests.front();
+
+				if (!req.copyTask) {
+					IGLDevice::Enum result =
+					  wait ? device->ClientWaitSync(req.fence, IGLDevice::SyncFlushCommandsBit,
+					                                FenceTimeout)
+					       : device->ClientWaitSync(req.fence, static_cast<IGLDevice::Enum>(0), 0);
+					if (result == IGLDevice::TimeoutExpired && !wait) {
+						return;
+					}
+
+					// mapping the buffer waits for the GPU if the fence failed
+					device->BindBuffer(IGLDevice::PixelPackBuffer, req.buffer);
+					const void *data =
+					  device->MapBuffer(IGLDevice::PixelPackBuffer, IGLDevice::ReadOnly);
+					device->BindBuffer(IGLDevice::PixelPackBuffer, 0);
+
+					if (data) {
+						req.copyTask.reset(new CopyTask(data, *req.bitmap));
+						copyTasks.Run(*req.copyTask);
+					} else {
+						SPLog("Failed to map the pixel pack buffer");
+						req.bitmap = nullptr;
+					}
+				}
+
+				if (req.copyTask) {
+					if (wait) {
+						copyTasks.Wait();
+					} else if (!req.copyTask->IsDone()) {
+						return;
+					}
+
+					device->BindBuffer(IGLDevice::PixelPackBuffer, req.buffer);
+					device->UnmapBuffer(IGLDevice::PixelPackBuffer);
+					device->BindBuffer(IGLDevice::PixelPackBuffer, 0);
+				}
+				device->DeleteBuffer(req.buffer);
+				device->DeleteSync(req.fence);
+
+				Handle<Bitmap> bitmap = req.bitmap;
+				Callback callback = std::move(req.callback);
+				requests.pop_front();
+				callback(bitmap);
+			}
+		}
+	}
+}
@@ -0,0 +1,77 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include "IGLDevice.h"
+#include <Core/Bitmap.h>
+#include <Core/RefCountedObject.h>
+#include <Core/TaskScheduler.h>
+
+namespace spades {
+	namespace draw {
+		/**
+		 * Reads the framebuffer without stalling the pipeline (r_asyncReadback).
+		 *
+		 * The pixels are read into a pixel pack buffer, followed by a fence. Once
+		 * the fence is signaled, the buffer is mapped and copied to a `Bitmap`
+		 * by a worker thread. The callbacks are called on the GL thread in the
+		 * order of the requests, with a null bitmap if the read failed.
+		 */
+		class GLAsyncReadback {
+		public:
+			typedef std::function<void(Handle<Bitmap>)> Callback;
+
+		private:
+			class CopyTask;
+
+			struct Request {
+				IGLDevice::UInteger buffer;
+				IGLDevice::Sync fence;
+				Handle<Bitmap> bitmap;
+				Callback callback;
+
+				// started when the buffer is mapped
+				std::unique_ptr<CopyTask> copyTask;
+			};
+
+			IGLDevice *device;
+			std::deque<std::unique_ptr<Request>> requests;
+			TaskGroup copyTasks;
+
+			void Update(bool wait);
+
+		public:
+			GLAsyncReadback(IGLDevice *);
+			/** Completes the pending requests. */
+			~GLAsyncReadback();
+
+			/** Starts reading the current read framebuffer. */
+			void Read(int width, int height, Callback);
+
+			/** Completes the requests the GPU has finished. Called every frame. */
+			void Poll() { Update(false); }
+		};
+	}
+}
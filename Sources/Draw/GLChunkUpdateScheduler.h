@@ -0,0 +1,230 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <Client/SceneDefinition.h>
+#include <Core/Debug.h>
+#include <Core/Math.h>
+#include <Core/TaskScheduler.h>
+
+namespace spades {
+	namespace draw {
+		/** The scheduling state of a chunk managed by `GLChunkUpdateScheduler`. */
+		struct GLChunkUpdateState {
+			// being updated by a task
+			bool inFlight = false;
+			// updated but not uploaded to the texture yet
+			bool uploadPending = false;
+			// lower is more important. computed by `Update`
+			float priority = 0.f;
+		};
+
+		/**
+		 * Recomputes the dirty chunks of a 3D texture covering the map on the
+		 * task scheduler and uploads the recomputed ones, the chunks near the
+		 * eye first.
+		 *
+		 * `Chunk` derives from `GLChunkUpdateState` and has `cx`, `cy`, `cz`,
+		 * `dirty` and the dirty region (`dirtyMinX` ... `dirtyMaxZ`). `Owner`
+		 * implements the per-chunk steps:
+		 *
+		 *  - `void UpdateChunk(Chunk &, IntVector3 minPos, IntVector3 maxPos,
+		 *    std::vector<float> &scratch)` recomputes the given region
+		 *    (chunk-local) of a chunk on a worker thread. `scratch` is owned by
+		 *    the task and reused for the chunks it updates.
+		 *  - `void UploadChunks(int cx, int cy, int minZ, int maxZ)` uploads the
+		 *    chunks of a column in the given range.
+		 */
+		template <class Owner, class Chunk> class GLChunkUpdateScheduler {
+			class UpdateTask : public Task {
+				Owner &owner;
+				std::vector<float> scratch;
+
+			protected:
+				void Execute() override {
+					SPADES_MARK_FUNCTION();
+					owner.UpdateChunk(*chunk, minPos, maxPos, scratch);
+					done.store(true, std::memory_order_release);
+				}
+
+			public:
+				Chunk *chunk = nullptr;
+				IntVector3 minPos, maxPos;
+				std::atomic<bool> done{false};
+
+				UpdateTask(Owner &owner) : owner(owner) {}
+			};
+
+			Owner &owner;
+			// in the order of `(cx + cy * chunkW) * chunkD + cz`
+			std::vector<Chunk> &chunks;
+			int chunkW, chunkH, chunkD;
+			int chunkSize;
+
+			TaskGroup updateTasks;
+			std::vector<std::unique_ptr<UpdateTask>> tasks;
+			std::vector<UpdateTask *> freeTasks;
+			std::vector<Chunk *> sortedChunks;
+
+			Chunk &GetChunk(int cx, int cy, int cz) {
+				return chunks[(cx + cy * chunkW) * chunkD + cz];
+			}
+
+			void RetireFinishedTasks() {
+				for (const auto &task : tasks) {
+					if (task->chunk && task->done.load(std::memory_order_acquire)) {
+						task->chunk->inFlight = false;
+						task->chunk->uploadPending = true;
+						task->chunk = nullptr;
+						freeTasks.push_back(task.get());
+					}
+				}
+			}
+
+			void ComputePriorities(const client::SceneDefinition &sceneDef) {
+				SPADES_MARK_FUNCTION();
+
+				// chunks near the eye and in the view come first
+				Vector3 eye = sceneDef.viewOrigin;
+				Vector3 front = sceneDef.viewAxis[2];
+				float w = static_cast<float>(chunkW * chunkSize);
+				float h = static_cast<float>(chunkH * chunkSize);
+
+				sortedChunks.clear();
+				for (Chunk &c : chunks) {
+					if (!c.dirty && !c.uploadPending)
+						continue;
+
+					Vector3 diff = MakeVector3(c.cx, c.cy, c.cz) * (float)chunkSize +
+					               MakeVector3(.5f, .5f, .5f) * (float)chunkSize - eye;
+					diff.x -= std::floor(diff.x / w + .5f) * w;
+					diff.y -= std::floor(diff.y / h + .5f) * h;
+
+					float dist = diff.GetLength();
+					float facing = dist > 0.f ? Vector3::Dot(diff, front) / dist : 1.f;
+					c.priority = dist * (1.f - .5f * facing);
+					sortedChunks.push_back(&c);
+				}
+				std::sort(sortedChunks.begin(), sortedChunks.end(),
+				          [](const Chunk *a, const Chunk *b) { return a->priority < b->priority; });
+			}
+
+			void ScheduleUpdates() {
+				SPADES_MARK_FUNCTION();
+
+				for (Chunk *c : sortedChunks) {
+					if (freeTasks.empty())
+						break;
+
+					// a chunk waiting for upload isn't modified until it's uploaded
+					if (!c->dirty || c->inFlight || c->uploadPending)
+						continue;
+
+					UpdateTask *task = freeTasks.back();
+					freeTasks.pop_back();
+
+					task->chunk = c;
+					task->minPos = IntVector3::Make(c->dirtyMinX, c->dirtyMinY, c->dirtyMinZ);
+					task->maxPos = IntVector3::Make(c->dirtyMaxX, c->dirtyMaxY, c->dirtyMaxZ);
+					task->done.store(false, std::memory_order_relaxed);
+					c->dirty = false;
+					c->inFlight = true;
+
+					updateTasks.Run(*task);
+				}
+			}
+
+		public:
+			GLChunkUpdateScheduler(Owner &owner, std::vector<Chunk> &chunks, int chunkW,
+			                       int chunkH, int chunkD, int chunkSize)
+			    : owner(owner),
+			      chunks(chunks),
+			      chunkW(chunkW),
+			      chunkH(chunkH),
+			      chunkD(chunkD),
+			      chunkSize(chunkSize) {
+				int numTasks = std::max(TaskScheduler::GetInstance().GetNumWorkers() * 2, 4);
+				for (int i = 0; i < numTasks; i++) {
+					tasks.emplace_back(new UpdateTask(owner));
+					freeTasks.push_back(tasks.back().get());
+				}
+			}
+
+			~GLChunkUpdateScheduler() { Wait(); }
+
+			/** Waits until the chunks being updated are done. */
+			void Wait() { updateTasks.Wait(); }
+
+			/** Collects the updated chunks and starts updating the most important
+			 * dirty ones. */
+			void Update(const client::SceneDefinition &sceneDef) {
+				RetireFinishedTasks();
+				ComputePriorities(sceneDef);
+				ScheduleUpdates();
+			}
+
+			/** Returns the number of the chunks waiting for upload as of the
+			 * last `Update`. */
+			int GetNumPendingUploads() const {
+				int count = 0;
+				for (const Chunk *c : sortedChunks) {
+					if (c->uploadPending)
+						count++;
+				}
+				return count;
+			}
+
+			/** Uploads at most `maxUploads` runs of updated chunks in the order
+			 * of importance. */
+			void Upload(int maxUploads) {
+				SPADES_MARK_FUNCTION();
+
+				int numUploads = 0;
+				for (Chunk *c : sortedChunks) {
+					if (numUploads >= maxUploads)
+						break;
+					if (!c->uploadPending)
+						continue;
+
+					// merge with the adjacent chunks of the same column. their data
+					// are contiguous in the texture's layout
+					int minZ = c->cz, maxZ = c->cz;
+					while (minZ > 0 && GetChunk(c->cx, c->cy, minZ - 1).uploadPending)
+						minZ--;
+					while (maxZ < chunkD - 1 && GetChunk(c->cx, c->cy, maxZ + 1).uploadPending)
+						maxZ++;
+
+					owner.UploadChunks(c->cx, c->cy, minZ, maxZ);
+
+					for (int cz = minZ; cz <= maxZ; cz++)
+						GetChunk(c->cx, c->cy, cz).uploadPending = false;
+					numUploads++;
+				}
+			}
+		};
+	}
+}
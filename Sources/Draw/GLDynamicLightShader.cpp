@@ -21,6 +21,7 @@
 #include "GLDynamicLightShader.h"
 #include <Core/Settings.h>
 #include "GLImage.h"
+#include "GLImageManager.h"
 #include "GLProgramManager.h"
 #include "GLRenderer.h"
 
@@ -54,7 +55,7 @@ namespace spades {
 		int GLDynamicLightShader::operator()(GLRenderer *renderer, spades::draw::GLProgram *program,
 		                                     const GLDynamicLight &light, int texStage) {
 			if (lastRenderer != renderer) {
-				whiteImage = static_cast<GLImage *>(renderer->RegisterImage("Gfx/White.tga"));
+				whiteImage = renderer->GetImageManager()->RegisterImage("Gfx/White.tga");
 				lastRenderer = renderer;
 			}
 
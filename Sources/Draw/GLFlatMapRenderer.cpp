@@ -61,16 +61,8 @@ namespace spades {
 
 				for (int y = 0; y < h; y++) {
 					for (int x = 0; x < w; x++) {
-						int px = mx + x, py = my + y;
-						for (int z = 0; z < 64; z++) {
-							if (map->IsSolid(px, py, z)) {
-								uint32_t col = map->GetColor(px, py, z);
-								col |= 0xff000000UL;
-								*pixels = col;
-								break;
-							}
-						}
-						pixels++;
+						// replace the height with the alpha channel
+						*(pixels++) = (map->GetTopColor(mx + x, my + y) & 0xffffffUL) | 0xff000000UL;
 					}
 				}
 			} catch (...) {
@@ -53,21 +53,29 @@ namespace spades {
 			device->BindTexture(target, tex);
 		}
 
+		namespace {
+			IGLDevice::UInteger CreateTexture(spades::Bitmap *bmp, IGLDevice *dev) {
+				IGLDevice::UInteger tex;
+				tex = dev->GenTexture();
+				dev->BindTexture(IGLDevice::Texture2D, tex);
+				dev->TexImage2D(IGLDevice::Texture2D, 0, IGLDevice::RGBA, bmp->GetWidth(),
+				                bmp->GetHeight(), 0, IGLDevice::RGBA, IGLDevice::UnsignedByte,
+				                bmp->GetPixels());
+				dev->TexParamater(IGLDevice::Texture2D, IGLDevice::TextureMagFilter,
+				                  IGLDevice::Linear);
+				dev->TexParamater(IGLDevice::Texture2D, IGLDevice::TextureMinFilter,
+				                  IGLDevice::LinearMipmapNearest);
+				dev->TexParamater(IGLDevice::Texture2D, IGLDevice::TextureWrapS, IGLDevice::Repeat);
+				dev->TexParamater(IGLDevice::Texture2D, IGLDevice::TextureWrapT, IGLDevice::Repeat);
+				dev->GenerateMipmap(IGLDevice::Texture2D);
+				return tex;
+			}
+		}
+
 		GLImage *GLImage::FromBitmap(spades::Bitmap *bmp, spades::draw::IGLDevice *dev) {
 			SPADES_MARK_FUNCTION();
 
-			IGLDevice::UInteger tex;
-			tex = dev->GenTexture();
-			dev->BindTexture(IGLDevice::Texture2D, tex);
-			dev->TexImage2D(IGLDevice::Texture2D, 0, IGLDevice::RGBA, bmp->GetWidth(),
-			                bmp->GetHeight(), 0, IGLDevice::RGBA, IGLDevice::UnsignedByte,
-			                bmp->GetPixels());
-			dev->TexParamater(IGLDevice::Texture2D, IGLDevice::TextureMagFilter, IGLDevice::Linear);
-			dev->TexParamater(IGLDevice::Texture2D, IGLDevice::TextureMinFilter,
-			                  IGLDevice::LinearMipmapNearest);
-			dev->TexParamater(IGLDevice::Texture2D, IGLDevice::TextureWrapS, IGLDevice::Repeat);
-			dev->TexParamater(IGLDevice::Texture2D, IGLDevice::TextureWrapT, IGLDevice::Repeat);
-			dev->GenerateMipmap(IGLDevice::Texture2D);
+			IGLDevice::UInteger tex = CreateTexture(bmp, dev);
 			return new GLImage(tex, dev, bmp->GetWidth(), bmp->GetHeight());
 		}
 
@@ -78,6 +86,22 @@ namespace spades {
 			                      IGLDevice::RGBA, IGLDevice::UnsignedByte, bmp->GetPixels());
 		}
 
+		void GLImage::ReplaceTexture(spades::Bitmap *bmp) {
+			SPADES_MARK_FUNCTION();
+			MakeSureValid();
+
+			IGLDevice::UInteger newTex = CreateTexture(bmp, device);
+			if (autoDelete)
+				device->DeleteTexture(tex);
+
+			tex = newTex;
+			autoDelete = true;
+			width = bmp->GetWidth();
+			height = bmp->GetHeight();
+			invWidth = 1.f / width;
+			invHeight = 1.f / height;
+		}
+
 		void GLImage::Invalidate() {
 			SPADES_MARK_FUNCTION();
 			MakeSureValid();
@@ -52,6 +52,11 @@ namespace spades {
 			float GetInvHeight() { return invHeight; }
 
 			void SubImage(Bitmap *bmp, int x, int y);
+
+			/** Replaces the texture with a new one created from `bmp`. Used to
+			 * finish loading an image created with a stand-in texture. */
+			void ReplaceTexture(Bitmap *bmp);
+
 			void Invalidate();
 
 			void Update(Bitmap &bmp, int x, int y) override { SubImage(&bmp, x, y); }
@@ -18,23 +18,63 @@
 
  */
 
+#include <algorithm>
+#include <atomic>
+
 #include "GLImageManager.h"
 #include <Core/Bitmap.h>
 #include <Core/Debug.h>
 #include <Core/FileManager.h>
 #include <Core/IStream.h>
+#include <Core/MemoryStream.h>
+#include <Core/Stopwatch.h>
+#include <Core/TraceRecorder.h>
 #include "GLImage.h"
 #include "GLRenderer.h"
+#include "GLSettings.h"
 #include "IGLDevice.h"
 
 namespace spades {
 	namespace draw {
-		GLImageManager::GLImageManager(IGLDevice *dev) : device(dev), whiteImage(nullptr) {
+		class GLImageManager::DecodeTask : public Task {
+		protected:
+			void Execute() override {
+				SPADES_MARK_FUNCTION();
+				SPADES_TRACE_SCOPE("GLImageManager::Decode");
+
+				try {
+					MemoryStream stream(data.data(), data.size());
+					bitmap.Set(Bitmap::Load(&stream, name), false);
+				} catch (const std::exception &ex) {
+					error = ex.what();
+				}
+				std::string().swap(data);
+				done.store(true, std::memory_order_release);
+			}
+
+		public:
+			// owned by `GLImageManager::images`
+			GLImage *image;
+			std::string name;
+			std::string data;
+
+			Handle<Bitmap> bitmap;
+			std::string error;
+			std::atomic<bool> done{false};
+		};
+
+		GLImageManager::GLImageManager(IGLDevice *dev, GLSettings &settings)
+		    : device(dev), settings(settings), whiteImage(nullptr) {
 			SPADES_MARK_FUNCTION();
 		}
 
 		GLImageManager::~GLImageManager() {
 			SPADES_MARK_FUNCTION();
+
+			// the tasks refer to the images
+			decodeTaskGroup.Wait();
+			decodeTasks.clear();
+
 			if (whiteImage) {
 				whiteImage->Release();
 				whiteImage = nullptr;
@@ -46,17 +86,40 @@ namespace spades {
 			}
 		}
 
-		GLImage *GLImageManager::RegisterImage(const std::string &name) {
+		GLImage *GLImageManager::RegisterImage(const std::string &name, bool allowAsync) {
 			SPADES_MARK_FUNCTION();
 
 			std::map<std::string, GLImage *>::iterator it;
 			it = images.find(name);
 			if (it == images.end()) {
-				GLImage *img = CreateImage(name);
+				GLImage *img = CreateImage(name, allowAsync);
 				images[name] = img;
 				img->AddRef();
 				return img;
 			}
+
+			if (!allowAsync) {
+				GLImage *img = it->second;
+				auto taskIt = std::find_if(decodeTasks.begin(), decodeTasks.end(),
+				                           [=](const std::unique_ptr<DecodeTask> &task) {
+					                           return task->image == img;
+				                           });
+				if (taskIt != decodeTasks.end()) {
+					// the renderer can't use the stand-in texture
+					decodeTaskGroup.Wait();
+					std::unique_ptr<DecodeTask> task = std::move(*taskIt);
+					decodeTasks.erase(taskIt);
+					FinishDecoding(*task);
+					if (!task->bitmap) {
+						// fail like the synchronous loading does
+						it->second->Release();
+						images.erase(it);
+						SPRaise("Failed to load image '%s': %s", name.c_str(),
+						        task->error.c_str());
+					}
+				}
+			}
+
 			it->second->AddRef();
 			return it->second;
 		}
@@ -68,14 +131,116 @@ namespace spades {
 			return whiteImage;
 		}
 
-		GLImage *GLImageManager::CreateImage(const std::string &name) {
+		void GLImageManager::PreloadImage(const std::string &name) {
+			SPADES_MARK_FUNCTION();
+			RegisterImageAsync(name)->Release();
+		}
+
+		GLImage *GLImageManager::CreateImage(const std::string &name, bool allowAsync) {
 			SPADES_MARK_FUNCTION();
 
+			if (allowAsync && settings.r_imageAsyncLoading) {
+				if (GLImage *img = CreateImageAsync(name)) {
+					return img;
+				}
+			}
+
 			Handle<Bitmap> bmp(Bitmap::Load(name), false);
 
 			return GLImage::FromBitmap(bmp, device);
 		}
 
+		GLImage *GLImageManager::CreateImageAsync(const std::string &name) {
+			SPADES_MARK_FUNCTION();
+
+			// The size must be known now because it's used for the layout, so
+			// the file is read here. This is much faster than decoding it.
+			std::unique_ptr<DecodeTask> task(new DecodeTask());
+			{
+				std::unique_ptr<IStream> stream(FileManager::OpenForReading(name.c_str()));
+				task->data = stream->ReadAllBytes();
+			}
+
+			int width, height;
+			if (!Bitmap::PeekSize(name, task->data, width, height)) {
+				return nullptr;
+			}
+
+			// transparent so that unloaded images are just not visible. Every image
+			// has its own one because the texture parameters are set by the users.
+			uint32_t pixel = 0;
+			IGLDevice::UInteger standInTexture = device->GenTexture();
+			device->BindTexture(IGLDevice::Texture2D, standInTexture);
+			device->TexImage2D(IGLDevice::Texture2D, 0, IGLDevice::RGBA, 1, 1, 0, IGLDevice::RGBA,
+			                   IGLDevice::UnsignedByte, &pixel);
+			device->TexParamater(IGLDevice::Texture2D, IGLDevice::TextureMagFilter,
+			                     IGLDevice::Nearest);
+			device->TexParamater(IGLDevice::Texture2D, IGLDevice::TextureMinFilter,
+			                     IGLDevice::Nearest);
+
+			GLImage *img = new GLImage(standInTexture, device, (float)width, (float)height, true);
+			task->image = img;
+			task->name = name;
+			decodeTaskGroup.Run(*task);
+			decodeTasks.push_back(std::move(task));
+			return img;
+		}
+
+		void GLImageManager::UploadDecodedImages() {
+			SPADES_MARK_FUNCTION();
+
+			if (decodeTasks.empty()) {
+				return;
+			}
+
+			double budget = std::max((float)settings.r_imageUploadBudget, 0.f) / 1000.0;
+			Stopwatch stopwatch;
+			bool uploaded = false;
+
+			for (auto it = decodeTasks.begin(); it != decodeTasks.end();) {
+				DecodeTask &task = **it;
+				if (!task.done.load(std::memory_order_acquire)) {
+					++it;
+					continue;
+				}
+				if (uploaded && stopwatch.GetTime() > budget) {
+					break;
+				}
+
+				FinishDecoding(task);
+				it = decodeTasks.erase(it);
+				uploaded = true;
+			}
+		}
+
+		void GLImageManager::FinishDecoding(DecodeTask &task) {
+			SPADES_MARK_FUNCTION();
+			SPAssert(task.done.load(std::memory_order_acquire));
+
+			if (task.bitmap) {
+				GLImage &img = *task.image;
+				if (img.GetWidth() != task.bitmap->GetWidth() ||
+				    img.GetHeight() != task.bitmap->GetHeight()) {
+					SPLog("Image '%s' was decoded as %dx%d, but %dx%d was expected",
+					      task.name.c_str(), task.bitmap->GetWidth(), task.bitmap->GetHeight(),
+					      (int)img.GetWidth(), (int)img.GetHeight());
+				}
+				try {
+					img.ReplaceTexture(task.bitmap);
+					return;
+				} catch (const std::exception &ex) {
+					task.bitmap.Set(nullptr);
+					task.error = ex.what();
+				}
+			} else if (task.error.empty()) {
+				task.error = "unknown error";
+			}
+
+			// the transparent stand-in texture is used forever
+			SPLog("[!] Failed to load image '%s': %s; it stays invisible", task.name.c_str(),
+			      task.error.c_str());
+		}
+
 		// draw all imaegs so that all textures are resident
 		// TODO: call this after all images are loaded
 		void GLImageManager::DrawAllImages(GLRenderer *r) {
@@ -20,30 +20,76 @@
 
 #pragma once
 
+#include <list>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "IGLDevice.h"
+#include <Core/TaskScheduler.h>
+
 namespace spades {
 	namespace draw {
-		class IGLDevice;
 		class GLImage;
 		class GLRenderer;
+		class GLSettings;
 
+		/**
+		 * Loads and caches the images registered by their file names.
+		 *
+		 * When `r_imageAsyncLoading` is enabled, `RegisterImageAsync` only reads
+		 * the file and returns an image with its own stand-in texture. The image
+		 * is decoded by the task scheduler's workers and uploaded by
+		 * `UploadDecodedImages`. The images used by the renderer itself are
+		 * registered by `RegisterImage`, which always returns a loaded image.
+		 */
 		class GLImageManager {
+			class DecodeTask;
+
 			IGLDevice *device;
+			GLSettings &settings;
 			std::map<std::string, GLImage *> images;
 			GLImage *whiteImage;
 
-			GLImage *CreateImage(const std::string &);
+			// in the order of registration
+			std::list<std::unique_ptr<DecodeTask>> decodeTasks;
+			TaskGroup decodeTaskGroup;
+
+			GLImage *RegisterImage(const std::string &, bool allowAsync);
+			GLImage *CreateImage(const std::string &, bool allowAsync);
+
+			/** Returns `nullptr` if the image must be loaded synchronously. */
+			GLImage *CreateImageAsync(const std::string &);
+
+			/** Replaces the stand-in texture with the decoded image. */
+			void FinishDecoding(DecodeTask &);
 
 		public:
-			GLImageManager(IGLDevice *);
+			GLImageManager(IGLDevice *, GLSettings &);
 			~GLImageManager();
 
-			GLImage *RegisterImage(const std::string &);
+			/** Returns a loaded image. If the image is still being loaded
+			 * asynchronously, waits for it. */
+			GLImage *RegisterImage(const std::string &name) { return RegisterImage(name, false); }
+
+			/** Returns an image that might be loaded later. */
+			GLImage *RegisterImageAsync(const std::string &name) {
+				return RegisterImage(name, true);
+			}
+
 			GLImage *GetWhiteImage();
 
+			/** Starts loading an image so that it's ready when it's registered later. */
+			void PreloadImage(const std::string &);
+
+			/** Uploads the decoded images until `r_imageUploadBudget` milliseconds
+			 * elapse. At least one image is uploaded every call. */
+			void UploadDecodedImages();
+
+			/** Returns the number of images that are still being loaded. */
+			std::size_t GetNumPendingImages() { return decodeTasks.size(); }
+
 			void DrawAllImages(GLRenderer *);
 		};
 	}
@@ -23,6 +23,7 @@
 #include <Core/Debug.h>
 #include <Core/Math.h>
 #include "GLImage.h"
+#include "GLImageManager.h"
 #include "GLLensDustFilter.h"
 #include "GLProgram.h"
 #include "GLProgramAttribute.h"
@@ -38,7 +39,7 @@ namespace spades {
 			thru = renderer->RegisterProgram("Shaders/PostFilters/PassThroughConstAlpha.program");
 			gauss1d = renderer->RegisterProgram("Shaders/PostFilters/Gauss1D.program");
 			dust = renderer->RegisterProgram("Shaders/PostFilters/LensDust.program");
-			dustImg = (GLImage *)renderer->RegisterImage("Textures/LensDustTexture.jpg");
+			dustImg = renderer->GetImageManager()->RegisterImage("Textures/LensDustTexture.jpg");
 
 			IGLDevice *dev = renderer->GetGLDevice();
 			noiseTex = dev->GenTexture();
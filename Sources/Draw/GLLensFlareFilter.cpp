@@ -23,6 +23,7 @@
 #include <Core/Debug.h>
 #include <Core/Math.h>
 #include "GLImage.h"
+#include "GLImageManager.h"
 #include "GLLensFlareFilter.h"
 #include "GLMapShadowRenderer.h"
 #include "GLProfiler.h"
@@ -39,14 +40,14 @@ namespace spades {
 			blurProgram = renderer->RegisterProgram("Shaders/PostFilters/Gauss1D.program");
 			scannerProgram = renderer->RegisterProgram("Shaders/LensFlare/Scanner.program");
 			drawProgram = renderer->RegisterProgram("Shaders/LensFlare/Draw.program");
-			flare1 = (GLImage *)renderer->RegisterImage("Gfx/LensFlare/1.png");
-			flare2 = (GLImage *)renderer->RegisterImage("Gfx/LensFlare/2.png");
-			flare3 = (GLImage *)renderer->RegisterImage("Gfx/LensFlare/3.png");
-			flare4 = (GLImage *)renderer->RegisterImage("Gfx/LensFlare/4.jpg");
-			mask1 = (GLImage *)renderer->RegisterImage("Gfx/LensFlare/mask1.png");
-			mask2 = (GLImage *)renderer->RegisterImage("Gfx/LensFlare/mask2.png");
-			mask3 = (GLImage *)renderer->RegisterImage("Gfx/LensFlare/mask3.png");
-			white = (GLImage *)renderer->RegisterImage("Gfx/White.tga");
+			flare1 = renderer->GetImageManager()->RegisterImage("Gfx/LensFlare/1.png");
+			flare2 = renderer->GetImageManager()->RegisterImage("Gfx/LensFlare/2.png");
+			flare3 = renderer->GetImageManager()->RegisterImage("Gfx/LensFlare/3.png");
+			flare4 = renderer->GetImageManager()->RegisterImage("Gfx/LensFlare/4.jpg");
+			mask1 = renderer->GetImageManager()->RegisterImage("Gfx/LensFlare/mask1.png");
+			mask2 = renderer->GetImageManager()->RegisterImage("Gfx/LensFlare/mask2.png");
+			mask3 = renderer->GetImageManager()->RegisterImage("Gfx/LensFlare/mask3.png");
+			white = renderer->GetImageManager()->RegisterImage("Gfx/White.tga");
 		}
 
 		GLColorBuffer GLLensFlareFilter::Blur(GLColorBuffer buffer, float spread) {
@@ -19,6 +19,7 @@
  */
 
 #include <algorithm>
+#include <cmath>
 #include <cstddef>
 
 #include "GLDynamicLightShader.h"
@@ -32,6 +33,7 @@
 #include <Client/GameMap.h>
 #include <Core/Debug.h>
 #include <Core/Settings.h>
+#include <Core/TraceRecorder.h>
 
 // ADDED: Additional headers
 #include "../Client/PaletteView.h"
@@ -45,6 +47,847 @@ SPADES_SETTING(cg_multiTextures);
 
 namespace spades {
 	namespace draw {
+		namespace {
+			/** Describes the quad of a voxel face, in the order used by
+			 * `MeshBuilder::Build`. */
+			struct FaceInfo {
+				int nx, ny, nz; // normal
+				int ox, oy, oz; // first vertex relative to the voxel
+				int ux, uy, uz;
+				int vx, vy, vz;
+			};
+
+			const FaceInfo faceInfos[6] = {
+			  {0, 0, 1, 1, 0, 1, -1, 0, 0, 0, 1, 0}, {0, 0, -1, 0, 0, 0, 1, 0, 0, 0, 1, 0},
+			  {-1, 0, 0, 0, 1, 0, 0, 0, 1, 0, -1, 0}, {1, 0, 0, 1, 0, 0, 0, 0, 1, 0, 1, 0},
+			  {0, -1, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0}, {0, 1, 0, 1, 1, 0, 0, 0, 1, -1, 0, 0}};
+
+			int AxisOf(int x, int y, int) { return x != 0 ? 0 : y != 0 ? 1 : 2; }
+
+			static_assert(sizeof(GLMapChunk::CompactVertex) == 16, "Unexpected vertex size");
+
+			/** Offsets of the vertex attributes shared by both vertex formats. */
+			struct VertexFormat {
+				IGLDevice::Sizei stride;
+				std::size_t position, ambientOcclusionCoord, color, normal;
+				IGLDevice::Enum ambientOcclusionCoordType;
+
+				explicit VertexFormat(bool compact) {
+					if (compact) {
+						using V = GLMapChunk::CompactVertex;
+						stride = sizeof(V);
+						position = asOFFSET(V, x);
+						ambientOcclusionCoord = asOFFSET(V, aoX);
+						color = asOFFSET(V, colorRed);
+						normal = asOFFSET(V, nx);
+						ambientOcclusionCoordType = IGLDevice::UnsignedByte;
+					} else {
+						using V = GLMapChunk::Vertex;
+						stride = sizeof(V);
+						position = asOFFSET(V, x);
+						ambientOcclusionCoord = asOFFSET(V, aoX);
+						color = asOFFSET(V, colorRed);
+						normal = asOFFSET(V, nx);
+						ambientOcclusionCoordType = IGLDevice::UnsignedShort;
+					}
+				}
+			};
+
+			/** Generates one quad per visible voxel face. With greedy meshing,
+			 * adjacent coplanar faces that look identical are merged. */
+			struct MeshBuilder {
+				enum {
+					Size = GLMapChunk::Size,
+					ShadowCacheWidth = Size + 2,
+					ShadowCacheHeight = Size * 2 + 2
+				};
+
+				GLMapChunk::Mesh &mesh;
+				client::GameMap &map;
+				const GLMapChunk::MeshingParams &params;
+
+				// global coordinates of the chunk
+				int originX, originY, originZ;
+
+				// greedy meshing: the key of every face that can be merged (see
+				// `DeferFace`) or zero, stored by face direction and then slice.
+				// Allocated when the first face is recorded.
+				std::vector<uint32_t> faceKeys;
+				uint32_t usedSlices[6] = {};
+
+				// map shadow distances of the texels sampled by the chunk, or -1
+				// if not computed yet
+				int16_t shadowCache[ShadowCacheWidth * ShadowCacheHeight];
+
+				// level of detail: the cells of `lodScale` voxels cubed, indexed
+				// by (x * numCells + y) * numCells + z
+				int lodScale, numCells;
+				std::vector<bool> cellSolid;
+
+				MeshBuilder(GLMapChunk::Mesh &mesh, client::GameMap &map,
+				            const GLMapChunk::MeshingParams &params)
+				    : mesh(mesh), map(map), params(params) {}
+
+				bool IsSolid(int x, int y, int z) {
+					if (z < 0)
+						return false;
+					if (z >= 64)
+						return true;
+
+					// FIXME: variable map size
+					x &= 511;
+					y &= 511;
+
+					if (z == 63) {
+						if (params.water) {
+							return map.IsSolid(x, y, 62);
+						} else {
+							return map.IsSolid(x, y, 63);
+						}
+					} else {
+						return map.IsSolid(x, y, z);
+					}
+				}
+
+				uint8_t CalcAOID(int x, int y, int z, int ux, int uy, int uz, int vx, int vy,
+				                 int vz) {
+					return CalcAOID([this](int x, int y, int z) { return IsSolid(x, y, z); }, x,
+					                y, z, ux, uy, uz, vx, vy, vz);
+				}
+
+				template <class F>
+				static uint8_t CalcAOID(F IsSolid, int x, int y, int z, int ux, int uy, int uz,
+				                        int vx, int vy, int vz) {
+					int v = 0;
+					if (IsSolid(x - ux, y - uy, z - uz))
+						v |= 1;
+					if (IsSolid(x + ux, y + uy, z + uz))
+						v |= 1 << 1;
+					if (IsSolid(x - vx, y - vy, z - vz))
+						v |= 1 << 2;
+					if (IsSolid(x + vx, y + vy, z + vz))
+						v |= 1 << 3;
+					if (IsSolid(x - ux + vx, y - uy + vy, z - uz + vz))
+						v |= 1 << 4;
+					if (IsSolid(x - ux - vx, y - uy - vy, z - uz - vz))
+						v |= 1 << 5;
+					if (IsSolid(x + ux + vx, y + uy + vy, z + uz + vz))
+						v |= 1 << 6;
+					if (IsSolid(x + ux - vx, y + uy - vy, z + uz - vz))
+						v |= 1 << 7;
+					return (uint8_t)v;
+				}
+
+				/**
+				 * Appends a vertex in the format selected by `params`.
+				 * @param quadU Position of the vertex in the quad along `u`, in faces.
+				 * @param quadV Position of the vertex in the quad along `v`, in faces.
+				 * @param textureTile See `GLMapChunk::CompactVertex::textureTile`.
+				 */
+				void PushVertex(const GLMapChunk::Vertex &v, int quadU, int quadV,
+				                int textureTile) {
+					if (!params.compactVertices) {
+						mesh.vertices.push_back(v);
+						return;
+					}
+
+					GLMapChunk::CompactVertex cv;
+					cv.x = v.x;
+					cv.y = v.y;
+					cv.z = v.z;
+					cv.textureTile = (uint8_t)textureTile;
+					cv.aoX = (uint8_t)v.aoX;
+					cv.aoY = (uint8_t)v.aoY;
+					cv.quadU = (uint8_t)quadU;
+					cv.quadV = (uint8_t)quadV;
+					cv.colorRed = v.colorRed;
+					cv.colorGreen = v.colorGreen;
+					cv.colorBlue = v.colorBlue;
+					cv.shading = v.shading;
+					cv.nx = v.nx;
+					cv.ny = v.ny;
+					cv.nz = v.nz;
+					cv.pad = 0;
+					mesh.compactVertices.push_back(cv);
+				}
+
+				static uint8_t FaceShading(int nx, int ny, int nz) {
+					if (nz == 1 || ny == 1) {
+						return 0;
+					} else if (nx == 1 || nx == -1) {
+						return 0; // 50;
+					} else if (nz == -1) {
+						return 220;
+					} else {
+						return 255;
+					}
+				}
+
+				/**
+				 * @param aoX Global X coordinate of the cell to evaluate ambient occlusion.
+				 * @param aoY Global Y coordinate of the cell to evaluate ambient occlusion.
+				 * @param aoZ Global Z coordinate of the cell to evaluate ambient occlusion.
+				 * @param x Chunk local X coordinate
+				 * @param y Chunk local Y coordinate
+				 * @param z Chunk local Z coordinate
+				 */
+				void EmitVertex(int x, int y, int z, int aoX, int aoY, int aoZ, int ux, int uy,
+				                int vx, int vy, uint32_t color, int tNumX,
+				                int tNumY, // ADDED: multi-texture texture coords
+				                int nx, int ny, int nz) {
+					SPADES_MARK_FUNCTION_DEBUG();
+
+					int uz = (ux == 0 && uy == 0) ? 1 : 0;
+					int vz = (vx == 0 && vy == 0) ? 1 : 0;
+					GLMapChunk::Vertex inst;
+					// evaluate ambient occlusion
+					unsigned int aoID = CalcAOID(aoX, aoY, aoZ, ux, uy, uz, vx, vy, vz);
+
+					inst.shading = FaceShading(nx, ny, nz);
+
+					inst.x = x;
+					inst.y = y;
+					inst.z = z;
+					inst.colorRed = (uint8_t)(color);
+					inst.colorGreen = (uint8_t)(color >> 8);
+					inst.colorBlue = (uint8_t)(color >> 16);
+
+					inst.nx = nx;
+					inst.ny = ny;
+					inst.nz = nz;
+
+					// fixed position to avoid self-shadow glitch
+					inst.sx = (x << 1) + ux + vx;
+					inst.sy = (y << 1) + uy + vy;
+					inst.sz = (z << 1) + uz + vz;
+
+					unsigned int aoTexX = aoID & 15;
+					unsigned int aoTexY = aoID >> 4;
+					aoTexX *= 16;
+					aoTexY *= 16;
+
+					uint16_t idx = (uint16_t)mesh.GetNumVertices();
+					inst.x = x;
+					inst.y = y;
+					inst.z = z;
+					inst.aoX = aoTexX;
+					inst.aoY = aoTexY;
+
+					int textureTile = 0;
+					if (params.textures) {
+						textureTile = params.multiTextures
+						                ? tNumX + tNumY * 8
+						                : (int)GLMapChunk::CompactVertex::SingleTextureTile;
+					}
+
+					// MODIFIED: Add the vertices differently depending on texture mode
+					if (!params.textures) {
+						// don't bother with ux/uy
+						PushVertex(inst, 0, 0, textureTile);
+
+						inst.x = x + ux;
+						inst.y = y + uy;
+						inst.z = z + uz;
+						inst.aoX = aoTexX + 15;
+						inst.aoY = aoTexY;
+						PushVertex(inst, 1, 0, textureTile);
+
+						inst.x = x + vx;
+						inst.y = y + vy;
+						inst.z = z + vz;
+						inst.aoX = aoTexX;
+						inst.aoY = aoTexY + 15;
+						PushVertex(inst, 0, 1, textureTile);
+
+						inst.x = x + ux + vx;
+						inst.y = y + uy + vy;
+						inst.z = z + uz + vz;
+						inst.aoX = aoTexX + 15;
+						inst.aoY = aoTexY + 15;
+						PushVertex(inst, 1, 1, textureTile);
+					} else if (params.multiTextures) {
+
+						float ulen = 1.0f / 8.0f;
+
+						// add the vertices
+
+						inst.ux = (tNumX + 1) * ulen;
+						inst.uy = tNumY * ulen;
+						PushVertex(inst, 0, 0, textureTile);
+
+						inst.x = x + ux;
+						inst.y = y + uy;
+						inst.z = z + uz;
+						inst.aoX = aoTexX + 15;
+						inst.aoY = aoTexY;
+						inst.ux = (tNumX + 1) * ulen;
+						inst.uy = (tNumY + 1) * ulen;
+						PushVertex(inst, 1, 0, textureTile);
+
+						inst.x = x + vx;
+						inst.y = y + vy;
+						inst.z = z + vz;
+						inst.aoX = aoTexX;
+						inst.aoY = aoTexY + 15;
+						inst.ux = tNumX * ulen;
+						inst.uy = tNumY * ulen;
+						PushVertex(inst, 0, 1, textureTile);
+
+						inst.x = x + ux + vx;
+						inst.y = y + uy + vy;
+						inst.z = z + uz + vz;
+						inst.aoX = aoTexX + 15;
+						inst.aoY = aoTexY + 15;
+						inst.ux = tNumX * ulen;
+						inst.uy = (tNumY + 1) * ulen;
+						PushVertex(inst, 1, 1, textureTile);
+					} else { // i.e. single texture mode
+						inst.ux = 1;
+						inst.uy = 0;
+						PushVertex(inst, 0, 0, textureTile);
+
+						inst.x = x + ux;
+						inst.y = y + uy;
+						inst.z = z + uz;
+						inst.aoX = aoTexX + 15;
+						inst.aoY = aoTexY;
+						inst.ux = 1;
+						inst.uy = 1;
+						PushVertex(inst, 1, 0, textureTile);
+
+						inst.x = x + vx;
+						inst.y = y + vy;
+						inst.z = z + vz;
+						inst.aoX = aoTexX;
+						inst.aoY = aoTexY + 15;
+						inst.ux = 0;
+						inst.uy = 0;
+						PushVertex(inst, 0, 1, textureTile);
+
+						inst.x = x + ux + vx;
+						inst.y = y + uy + vy;
+						inst.z = z + uz + vz;
+						inst.aoX = aoTexX + 15;
+						inst.aoY = aoTexY + 15;
+						inst.ux = 0;
+						inst.uy = 1;
+						PushVertex(inst, 1, 1, textureTile);
+					}
+					// END OF MODIFIED
+
+					mesh.indices.push_back(idx);
+					mesh.indices.push_back(idx + 1);
+					mesh.indices.push_back(idx + 2);
+					mesh.indices.push_back(idx + 1);
+					mesh.indices.push_back(idx + 3);
+					mesh.indices.push_back(idx + 2);
+				}
+
+				/** Computes the value of a texel of the map shadow texture. Must
+				 * match `GLMapShadowRenderer::GeneratePixel`. */
+				int ComputeShadowDistance(int x, int y) {
+					// voxels at z = 63 are ignored
+					uint64_t column = map.GetSolidMapWrapped(x, y);
+					for (int z = 0; z < 63; z++) {
+						if ((column >> z) & 1)
+							return z;
+						column = map.GetSolidMapWrapped(x, ++y);
+						if ((column >> z) & 1)
+							return z + 1;
+					}
+					return 64;
+				}
+
+				int GetShadowDistance(int x, int y) {
+					int cx = x - (originX - 1);
+					int cy = y - (originY - originZ - Size - 1);
+					if (cx < 0 || cy < 0 || cx >= ShadowCacheWidth || cy >= ShadowCacheHeight) {
+						return ComputeShadowDistance(x, y);
+					}
+					int16_t &dist = shadowCache[cx + cy * ShadowCacheWidth];
+					if (dist < 0) {
+						dist = (int16_t)ComputeShadowDistance(x, y);
+					}
+					return dist;
+				}
+
+				/**
+				 * Evaluates the map shadow (Shadow/Map.vs and Map.fs) of a face
+				 * the same way as the GPU.
+				 * @param sx Chunk local fixed position (`Vertex::sx`)
+				 * @return 1 if lit, 0 if shadowed, and -1 if the sampled texel
+				 *         depends on the GPU's precision.
+				 */
+				int EvaluateMapShadow(int sx, int sy, int sz, const FaceInfo &face) {
+					float fx = (float)originX + sx * 0.5f + face.nx * 0.1f;
+					float fy = (float)originY + sy * 0.5f + face.ny * 0.1f;
+					float fz = (float)originZ + sz * 0.5f + face.nz * 0.1f;
+					float ty = fy - fz;
+					int tx = (int)std::floor(fx);
+					int ity = (int)std::floor(ty);
+					float depth = fz / 255.f - 0.0001f;
+
+					bool lit = !(GetShadowDistance(tx, ity) / 255.f < depth);
+					float frac = ty - (float)ity;
+					if (frac < 1.e-3f && !(GetShadowDistance(tx, ity - 1) / 255.f < depth) != lit) {
+						return -1;
+					}
+					if (frac > 1.f - 1.e-3f &&
+					    !(GetShadowDistance(tx, ity + 1) / 255.f < depth) != lit) {
+						return -1;
+					}
+					return lit ? 1 : 0;
+				}
+
+				/**
+				 * Records a face to be merged by `EmitMergedFaces`.
+				 * @return `false` if the face must be emitted by `EmitVertex`.
+				 */
+				bool DeferFace(int faceIndex, int x, int y, int z, int xx, int yy, int zz,
+				               uint32_t color) {
+					if (!params.greedy) {
+						return false;
+					}
+
+					const FaceInfo &face = faceInfos[faceIndex];
+
+					// only the first ambient occlusion tile is uniform
+					if (CalcAOID(xx + face.nx, yy + face.ny, zz + face.nz, face.ux, face.uy,
+					             face.uz, face.vx, face.vy, face.vz) != 0) {
+						return false;
+					}
+
+					if (faceKeys.empty()) {
+						faceKeys.resize(6 * Size * Size * Size, 0);
+						std::fill(std::begin(shadowCache), std::end(shadowCache), -1);
+					}
+
+					// the shadow is sampled at a single point of the merged face, so
+					// the merged faces must agree on it
+					int shadow = EvaluateMapShadow(((x + face.ox) << 1) + face.ux + face.vx,
+					                               ((y + face.oy) << 1) + face.uy + face.vy,
+					                               ((z + face.oz) << 1) + face.uz + face.vz, face);
+					if (shadow < 0) {
+						return false;
+					}
+
+					int pos[3] = {x, y, z};
+					int n = pos[AxisOf(face.nx, face.ny, face.nz)];
+					int i = pos[AxisOf(face.ux, face.uy, face.uz)];
+					int j = pos[AxisOf(face.vx, face.vy, face.vz)];
+					faceKeys[((faceIndex * Size + n) * Size + j) * Size + i] =
+					  (color & 0xffffff) | ((uint32_t)shadow << 24) | (1U << 25);
+					usedSlices[faceIndex] |= 1U << n;
+					return true;
+				}
+
+				/** Emits a quad covering `lenU` x `lenV` faces starting at the
+				 * face of the given voxel. */
+				void EmitMergedFace(const FaceInfo &face, int x, int y, int z, int lenU, int lenV,
+				                    uint32_t color, unsigned int aoID = 0) {
+					GLMapChunk::Vertex inst{};
+					inst.shading = FaceShading(face.nx, face.ny, face.nz);
+					inst.colorRed = (uint8_t)(color);
+					inst.colorGreen = (uint8_t)(color >> 8);
+					inst.colorBlue = (uint8_t)(color >> 16);
+					inst.nx = face.nx;
+					inst.ny = face.ny;
+					inst.nz = face.nz;
+
+					int ox = x + face.ox, oy = y + face.oy, oz = z + face.oz;
+
+					// the fixed position of the first face. The merged faces have
+					// the same shadow, so it's valid for all of them
+					inst.sx = (ox << 1) + face.ux + face.vx;
+					inst.sy = (oy << 1) + face.uy + face.vy;
+					inst.sz = (oz << 1) + face.uz + face.vz;
+
+					unsigned int aoTexX = (aoID & 15) * 16;
+					unsigned int aoTexY = (aoID >> 4) * 16;
+
+					uint16_t idx = (uint16_t)mesh.GetNumVertices();
+					for (int i = 0; i < 4; i++) {
+						int u = (i & 1) ? lenU : 0;
+						int v = (i & 2) ? lenV : 0;
+						inst.x = ox + face.ux * u + face.vx * v;
+						inst.y = oy + face.uy * u + face.vy * v;
+						inst.z = oz + face.uz * u + face.vz * v;
+						inst.aoX = aoTexX + ((i & 1) ? 15 : 0);
+						inst.aoY = aoTexY + ((i & 2) ? 15 : 0);
+						PushVertex(inst, u, v, 0);
+					}
+
+					mesh.indices.push_back(idx);
+					mesh.indices.push_back(idx + 1);
+					mesh.indices.push_back(idx + 2);
+					mesh.indices.push_back(idx + 1);
+					mesh.indices.push_back(idx + 3);
+					mesh.indices.push_back(idx + 2);
+				}
+
+				/** Merges the faces recorded by `DeferFace` into rectangles, one
+				 * slice at a time. */
+				void EmitMergedFaces() {
+					for (int f = 0; f < 6; f++) {
+						const FaceInfo &face = faceInfos[f];
+						int nAxis = AxisOf(face.nx, face.ny, face.nz);
+						int uAxis = AxisOf(face.ux, face.uy, face.uz);
+						int vAxis = AxisOf(face.vx, face.vy, face.vz);
+						bool uPositive = face.ux + face.uy + face.uz > 0;
+						bool vPositive = face.vx + face.vy + face.vz > 0;
+
+						for (int n = 0; n < Size; n++) {
+							if (!(usedSlices[f] & (1U << n))) {
+								continue;
+							}
+
+							// indexed by v * Size + u. Cleared while the faces are merged
+							uint32_t *keys = faceKeys.data() + (f * Size + n) * Size * Size;
+							int pos[3];
+							pos[nAxis] = n;
+
+							for (int j = 0; j < Size; j++) {
+								for (int i = 0; i < Size;) {
+									uint32_t key = keys[j * Size + i];
+									if (key == 0) {
+										i++;
+										continue;
+									}
+
+									int lenU = 1;
+									while (i + lenU < Size && keys[j * Size + i + lenU] == key) {
+										lenU++;
+									}
+
+									int lenV = 1;
+									for (; j + lenV < Size; lenV++) {
+										uint32_t *row = keys + (j + lenV) * Size;
+										if (std::any_of(row + i, row + i + lenU,
+										                [=](uint32_t k) { return k != key; })) {
+											break;
+										}
+									}
+
+									for (int k = 0; k < lenV; k++) {
+										uint32_t *row = keys + (j + k) * Size;
+										std::fill(row + i, row + i + lenU, 0U);
+									}
+
+									// the first face is at the origin of the quad
+									pos[uAxis] = uPositive ? i : i + lenU - 1;
+									pos[vAxis] = vPositive ? j : j + lenV - 1;
+									EmitMergedFace(face, pos[0], pos[1], pos[2], lenU, lenV, key);
+
+									i += lenU;
+								}
+							}
+						}
+					}
+				}
+
+				void Build(int chunkX, int chunkY, int chunkZ) {
+					int rchunkX = chunkX * Size;
+					int rchunkY = chunkY * Size;
+					int rchunkZ = chunkZ * Size;
+
+					originX = rchunkX;
+					originY = rchunkY;
+					originZ = rchunkZ;
+
+					int x, y, z;
+					for (x = 0; x < Size; x++) {
+						for (y = 0; y < Size; y++) {
+							for (z = 0; z < Size; z++) {
+								int xx = x + rchunkX;
+								int yy = y + rchunkY;
+								int zz = z + rchunkZ;
+
+								if (!IsSolid(xx, yy, zz))
+									continue;
+
+								uint32_t col = map.GetColor(xx, yy, zz);
+								// col = 0xffffffff;
+
+								// ADDED: do several things
+
+								// determine which faces are being added up here instead of
+								// below
+								bool nsolid1 = !IsSolid(xx, yy, zz + 1);
+								bool nsolid2 = !IsSolid(xx, yy, zz - 1);
+								bool nsolid3 = !IsSolid(xx - 1, yy, zz);
+								bool nsolid4 = !IsSolid(xx + 1, yy, zz);
+								bool nsolid5 = !IsSolid(xx, yy - 1, zz);
+								bool nsolid6 = !IsSolid(xx, yy + 1, zz);
+
+								// compute the texture coords for this block (perhaps)
+								int tNumX, tNumY;
+								// only do the computation if at least one face added
+								if (nsolid1 || nsolid2 || nsolid3 || nsolid4 || nsolid5 ||
+								    nsolid6) {
+									// only do the computation if in multi-texture mode
+									if (params.multiTextures && params.textures) {
+										int r = (int)((uint8_t)(col));
+										int g = (int)((uint8_t)(col >> 8));
+										int b = (int)((uint8_t)(col >> 16));
+										// determine the r,g,b coords of the color
+										int rCoord = r / 64;
+										int gCoord = g / 64;
+										int bCoord = b / 64;
+										// translate that into texture coords on the block
+										tNumX = rCoord;
+										tNumY = gCoord;
+										if (bCoord == 1 || bCoord == 3) {
+											tNumX += 4;
+										}
+										if (bCoord == 2 || bCoord == 3) {
+											tNumY += 4;
+										}
+									}
+								} else {
+									continue; // no faces being added
+								}
+								// END OF ADDED
+
+								// damaged block?
+								int health = col >> 24;
+								if (health < 100) {
+									col &= 0xffffff;
+									col &= 0xfefefe;
+									col >>= 1;
+								}
+
+								// MODIFIED: include multi-texture coords, use pre-calculated
+								// nsolid variables
+								if (nsolid1 && !DeferFace(0, x, y, z, xx, yy, zz, col)) {
+									EmitVertex(x + 1, y, z + 1, xx, yy, zz + 1, -1, 0, 0, 1, col,
+									           tNumX, tNumY, 0, 0, 1);
+								}
+								if (nsolid2 && !DeferFace(1, x, y, z, xx, yy, zz, col)) {
+									EmitVertex(x, y, z, xx, yy, zz - 1, 1, 0, 0, 1, col, tNumX,
+									           tNumY, 0, 0, -1);
+								}
+								if (nsolid3 && !DeferFace(2, x, y, z, xx, yy, zz, col)) {
+									EmitVertex(x, y + 1, z, xx - 1, yy, zz, 0, 0, 0, -1, col, tNumX,
+									           tNumY, -1, 0, 0);
+								}
+								if (nsolid4 && !DeferFace(3, x, y, z, xx, yy, zz, col)) {
+									EmitVertex(x + 1, y, z, xx + 1, yy, zz, 0, 0, 0, 1, col, tNumX,
+									           tNumY, 1, 0, 0);
+								}
+								if (nsolid5 && !DeferFace(4, x, y, z, xx, yy, zz, col)) {
+									EmitVertex(x, y, z, xx, yy - 1, zz, 0, 0, 1, 0, col, tNumX,
+									           tNumY, 0, -1, 0);
+								}
+								if (nsolid6 && !DeferFace(5, x, y, z, xx, yy, zz, col)) {
+									EmitVertex(x + 1, y + 1, z, xx, yy + 1, zz, 0, 0, -1, 0, col,
+									           tNumX, tNumY, 0, 1, 0);
+								}
+								// END OF MODIFIED
+							}
+						}
+					}
+
+					if (!faceKeys.empty()) {
+						EmitMergedFaces();
+					}
+				}
+
+				/** Returns `true` if the cell of the downsampled chunk is solid.
+				 * The cells outside the chunk are empty unless they are below
+				 * the map. */
+				bool IsCellSolid(int x, int y, int z) {
+					if (originZ + z * lodScale >= 64)
+						return true;
+					if (x < 0 || y < 0 || z < 0 || x >= numCells || y >= numCells ||
+					    z >= numCells)
+						return false;
+					return cellSolid[(x * numCells + y) * numCells + z];
+				}
+
+				/** Returns `true` if all voxels across a face of a cell are solid. */
+				bool IsCellFaceCovered(int x, int y, int z, const FaceInfo &face) {
+					int nAxis = AxisOf(face.nx, face.ny, face.nz);
+					bool positive = face.nx + face.ny + face.nz > 0;
+					for (int i = 0; i < lodScale; i++)
+						for (int j = 0; j < lodScale; j++) {
+							int pos[3];
+							pos[nAxis] = positive ? lodScale : -1;
+							pos[(nAxis + 1) % 3] = i;
+							pos[(nAxis + 2) % 3] = j;
+							if (!IsSolid(originX + x * lodScale + pos[0],
+							             originY + y * lodScale + pos[1],
+							             originZ + z * lodScale + pos[2]))
+								return false;
+						}
+					return true;
+				}
+
+				/** Returns the most common color of the surface voxels of a cell,
+				 * or of its solid voxels if none is on the surface. */
+				uint32_t GetCellColor(int x, int y, int z) {
+					// (color, number of surface voxels, number of voxels)
+					struct ColorCount {
+						uint32_t color;
+						int surface, all;
+					};
+					ColorCount counts[64];
+					int numColors = 0;
+
+					int x1 = originX + x * lodScale;
+					int y1 = originY + y * lodScale;
+					int z1 = originZ + z * lodScale;
+					for (int xx = x1; xx < x1 + lodScale; xx++)
+						for (int yy = y1; yy < y1 + lodScale; yy++)
+							for (int zz = z1; zz < z1 + lodScale; zz++) {
+								if (!IsSolid(xx, yy, zz))
+									continue;
+
+								// ignore the health of damaged blocks
+								uint32_t col = map.GetColor(xx & 511, yy & 511, zz) & 0xffffff;
+								bool surface = !IsSolid(xx, yy, zz + 1) ||
+								               !IsSolid(xx, yy, zz - 1) ||
+								               !IsSolid(xx - 1, yy, zz) ||
+								               !IsSolid(xx + 1, yy, zz) ||
+								               !IsSolid(xx, yy - 1, zz) || !IsSolid(xx, yy + 1, zz);
+
+								int i = 0;
+								while (i < numColors && counts[i].color != col)
+									i++;
+								if (i == numColors)
+									counts[numColors++] = ColorCount{col, 0, 0};
+								counts[i].surface += surface ? 1 : 0;
+								counts[i].all++;
+							}
+
+					SPAssert(numColors > 0);
+					auto best = std::max_element(
+					  counts, counts + numColors, [](const ColorCount &a, const ColorCount &b) {
+						  return a.surface != b.surface ? a.surface < b.surface : a.all < b.all;
+					  });
+					return best->color;
+				}
+
+				/**
+				 * Builds the downsampled mesh for `MeshingParams::lod`.
+				 *
+				 * The cells on the border of the chunk are solid if any of their
+				 * voxels is, and their faces on the border are always emitted.
+				 * These faces serve as skirts that hide the cracks between
+				 * chunks of different levels of detail. They are omitted where
+				 * the neighboring chunk is solid at any level of detail.
+				 */
+				void BuildLOD(int chunkX, int chunkY, int chunkZ) {
+					originX = chunkX * Size;
+					originY = chunkY * Size;
+					originZ = chunkZ * Size;
+					lodScale = 1 << params.lod;
+					numCells = Size >> params.lod;
+					cellSolid.assign(numCells * numCells * numCells, false);
+
+					int numVoxels = lodScale * lodScale * lodScale;
+					for (int x = 0; x < numCells; x++)
+						for (int y = 0; y < numCells; y++)
+							for (int z = 0; z < numCells; z++) {
+								int numSolid = 0;
+								for (int i = 0; i < numVoxels; i++) {
+									int xx = originX + x * lodScale + (i >> (params.lod * 2));
+									int yy = originY + y * lodScale +
+									         ((i >> params.lod) & (lodScale - 1));
+									int zz = originZ + z * lodScale + (i & (lodScale - 1));
+									numSolid += IsSolid(xx, yy, zz) ? 1 : 0;
+								}
+
+								bool border = x == 0 || y == 0 || z == 0 || x == numCells - 1 ||
+								              y == numCells - 1 || z == numCells - 1;
+								cellSolid[(x * numCells + y) * numCells + z] =
+								  border ? numSolid > 0 : numSolid * 2 >= numVoxels;
+							}
+
+					for (int x = 0; x < numCells; x++)
+						for (int y = 0; y < numCells; y++)
+							for (int z = 0; z < numCells; z++) {
+								if (!IsCellSolid(x, y, z))
+									continue;
+
+								uint32_t col = 0;
+								bool hasColor = false;
+								for (const FaceInfo &face : faceInfos) {
+									int nx = x + face.nx, ny = y + face.ny, nz = z + face.nz;
+									if (IsCellSolid(nx, ny, nz))
+										continue;
+									bool outside = nx < 0 || ny < 0 || nz < 0 || nx >= numCells ||
+									               ny >= numCells || nz >= numCells;
+									if (outside && IsCellFaceCovered(x, y, z, face))
+										continue;
+
+									if (!hasColor) {
+										col = GetCellColor(x, y, z);
+										hasColor = true;
+									}
+
+									unsigned int aoID = CalcAOID(
+									  [this](int x, int y, int z) { return IsCellSolid(x, y, z); },
+									  nx, ny, nz, face.ux, face.uy, face.uz, face.vx, face.vy,
+									  face.vz);
+
+									// the voxel whose face is at the origin of the cell's face
+									int last = lodScale - 1;
+									EmitMergedFace(face, x * lodScale + face.ox * last,
+									               y * lodScale + face.oy * last,
+									               z * lodScale + face.oz * last, lodScale,
+									               lodScale, col, aoID);
+								}
+							}
+				}
+			};
+
+			template <class T> void ExpandBounds(const std::vector<T> &vertices, IntVector3 &minPos,
+			                                     IntVector3 &maxPos) {
+				for (const T &v : vertices) {
+					minPos.x = std::min<int>(minPos.x, v.x);
+					minPos.y = std::min<int>(minPos.y, v.y);
+					minPos.z = std::min<int>(minPos.z, v.z);
+					maxPos.x = std::max<int>(maxPos.x, v.x);
+					maxPos.y = std::max<int>(maxPos.y, v.y);
+					maxPos.z = std::max<int>(maxPos.z, v.z);
+				}
+			}
+		} // namespace
+
+		GLMapChunk::MeshingTask::MeshingTask(client::GameMap *map, int cx, int cy, int cz,
+		                                     const MeshingParams &params)
+		    : map(map), chunkX(cx), chunkY(cy), chunkZ(cz), params(params) {}
+
+		void GLMapChunk::MeshingTask::Execute() {
+			SPADES_MARK_FUNCTION();
+			SPADES_TRACE_SCOPE("GLMapChunk::BuildMesh");
+
+			// the map might be modified meanwhile; see the class comment
+			BuildMesh(mesh, *map, chunkX, chunkY, chunkZ, params);
+			done.store(true, std::memory_order_release);
+		}
+
+		void GLMapChunk::BuildMesh(Mesh &mesh, client::GameMap &map, int cx, int cy, int cz,
+		                           const MeshingParams &params) {
+			mesh.vertices.clear();
+			mesh.compactVertices.clear();
+			mesh.indices.clear();
+
+			MeshBuilder builder(mesh, map, params);
+			if (params.lod > 0) {
+				builder.BuildLOD(cx, cy, cz);
+			} else {
+				builder.Build(cx, cy, cz);
+			}
+
+			IntVector3 minPos = IntVector3::Make(Size, Size, Size);
+			IntVector3 maxPos = IntVector3::Make(0, 0, 0);
+			ExpandBounds(mesh.vertices, minPos, maxPos);
+			ExpandBounds(mesh.compactVertices, minPos, maxPos);
+			mesh.bounds = AABB3(MakeVector3(minPos.x, minPos.y, minPos.z),
+			                    MakeVector3(maxPos.x, maxPos.y, maxPos.z));
+		}
+
 		GLMapChunk::GLMapChunk(spades::draw::GLMapRenderer *r, client::GameMap *mp, int cx, int cy,
 		                       int cz) {
 			SPADES_MARK_FUNCTION();
@@ -57,6 +900,7 @@ namespace spades {
 			chunkZ = cz;
 			needsUpdate = true;
 			realized = false;
+			lod = 0;
 
 			centerPos =
 			  MakeVector3(cx * Size + Size / 2, cy * Size + Size / 2, cz * Size + Size / 2);
@@ -65,8 +909,12 @@ namespace spades {
 
 			buffer = 0;
 			iBuffer = 0;
+			bufferSize = 0;
+			iBufferSize = 0;
+			numIndices = 0;
 		}
 
+		// `GLMapRenderer` waits for the meshing tasks before destroying chunks
 		GLMapChunk::~GLMapChunk() { SetRealized(false); }
 
 		void GLMapChunk::SetRealized(bool b) {
@@ -79,16 +927,17 @@ namespace spades {
 				if (buffer) {
 					device->DeleteBuffer(buffer);
 					buffer = 0;
+					bufferSize = 0;
 				}
 				if (iBuffer) {
 					device->DeleteBuffer(iBuffer);
 					iBuffer = 0;
+					iBufferSize = 0;
 				}
-				std::vector<Vertex> i;
-				i.swap(vertices);
+				numIndices = 0;
 
-				std::vector<uint16_t> i2;
-				i2.swap(indices);
+				// a mesh build in progress is discarded by `GLMapRenderer` when
+				// it completes
 			} else {
 				needsUpdate = true;
 			}
@@ -96,339 +945,119 @@ namespace spades {
 			realized = b;
 		}
 
-		uint8_t GLMapChunk::calcAOID(int x, int y, int z, int ux, int uy, int uz, int vx, int vy,
-		                             int vz) {
-			int v = 0;
-			if (IsSolid(x - ux, y - uy, z - uz))
-				v |= 1;
-			if (IsSolid(x + ux, y + uy, z + uz))
-				v |= 1 << 1;
-			if (IsSolid(x - vx, y - vy, z - vz))
-				v |= 1 << 2;
-			if (IsSolid(x + vx, y + vy, z + vz))
-				v |= 1 << 3;
-			if (IsSolid(x - ux + vx, y - uy + vy, z - uz + vz))
-				v |= 1 << 4;
-			if (IsSolid(x - ux - vx, y - uy - vy, z - uz - vz))
-				v |= 1 << 5;
-			if (IsSolid(x + ux + vx, y + uy + vy, z + uz + vz))
-				v |= 1 << 6;
-			if (IsSolid(x + ux - vx, y + uy - vy, z + uz - vz))
-				v |= 1 << 7;
-			return (uint8_t)v;
+		void GLMapChunk::SetLOD(int newLOD) {
+			SPAssert(newLOD >= 0 && newLOD <= MaxLOD);
+			if (newLOD != lod) {
+				lod = newLOD;
+				needsUpdate = true;
+			}
 		}
 
-		/**
-		 * @param aoX Global X coordinate of the cell to evaluate ambient occlusion.
-		 * @param aoY Global Y coordinate of the cell to evaluate ambient occlusion.
-		 * @param aoZ Global Z coordinate of the cell to evaluate ambient occlusion.
-		 * @param x Chunk local X coordinate
-		 * @param y Chunk local Y coordinate
-		 * @param z Chunk local Z coordinate
-		 */
-		void GLMapChunk::EmitVertex(int x, int y, int z, int aoX, int aoY, int aoZ, int ux, int uy,
-		                            int vx, int vy, uint32_t color, int tNumX,
-		                            int tNumY, // ADDED: multi-texture texture coords
-		                            int nx, int ny, int nz) {
-			SPADES_MARK_FUNCTION_DEBUG();
+		GLMapChunk::MeshingParams GLMapChunk::GetMeshingParams() {
+			MeshingParams params;
+			params.water = renderer->renderer->GetSettings().r_water;
+			params.textures = renderer->previous_cg_textures;
+			params.multiTextures = renderer->previous_cg_multiTextures;
+			params.greedy = renderer->greedyMeshing;
+			params.compactVertices = renderer->compactVertices;
+			params.lod = lod;
+			return params;
+		}
 
-			int uz = (ux == 0 && uy == 0) ? 1 : 0;
-			int vz = (vx == 0 && vy == 0) ? 1 : 0;
-			Vertex inst;
-			// evaluate ambient occlusion
-			unsigned int aoID = calcAOID(aoX, aoY, aoZ, ux, uy, uz, vx, vy, vz);
-
-			if (nz == 1 || ny == 1) {
-				inst.shading = 0;
-			} else if (nx == 1 || nx == -1) {
-				inst.shading = 0; // 50;
-			} else if (nz == -1) {
-				inst.shading = 220;
-			} else {
-				inst.shading = 255;
-			}
+		void GLMapChunk::Update() {
+			SPADES_MARK_FUNCTION();
 
-			inst.x = x;
-			inst.y = y;
-			inst.z = z;
-			inst.colorRed = (uint8_t)(color);
-			inst.colorGreen = (uint8_t)(color >> 8);
-			inst.colorBlue = (uint8_t)(color >> 16);
-
-			inst.nx = nx;
-			inst.ny = ny;
-			inst.nz = nz;
-
-			// fixed position to avoid self-shadow glitch
-			inst.sx = (x << 1) + ux + vx;
-			inst.sy = (y << 1) + uy + vy;
-			inst.sz = (z << 1) + uz + vz;
-
-			unsigned int aoTexX = aoID & 15;
-			unsigned int aoTexY = aoID >> 4;
-			aoTexX *= 16;
-			aoTexY *= 16;
-
-			uint16_t idx = (uint16_t)vertices.size();
-			inst.x = x;
-			inst.y = y;
-			inst.z = z;
-			inst.aoX = aoTexX;
-			inst.aoY = aoTexY;
-
-			// MODIFIED: Add the vertices differently depending on texture mode
-			if (!renderer->previous_cg_textures) {
-				// don't bother with ux/uy
-				vertices.push_back(inst);
-
-				inst.x = x + ux;
-				inst.y = y + uy;
-				inst.z = z + uz;
-				inst.aoX = aoTexX + 15;
-				inst.aoY = aoTexY;
-				vertices.push_back(inst);
-
-				inst.x = x + vx;
-				inst.y = y + vy;
-				inst.z = z + vz;
-				inst.aoX = aoTexX;
-				inst.aoY = aoTexY + 15;
-				vertices.push_back(inst);
-
-				inst.x = x + ux + vx;
-				inst.y = y + uy + vy;
-				inst.z = z + uz + vz;
-				inst.aoX = aoTexX + 15;
-				inst.aoY = aoTexY + 15;
-				vertices.push_back(inst);
-			} else if (renderer->previous_cg_multiTextures) {
-
-				float ulen = 1.0f / 8.0f;
-
-				// add the vertices
-
-				inst.ux = (tNumX + 1) * ulen;
-				inst.uy = tNumY * ulen;
-				vertices.push_back(inst);
-
-				inst.x = x + ux;
-				inst.y = y + uy;
-				inst.z = z + uz;
-				inst.aoX = aoTexX + 15;
-				inst.aoY = aoTexY;
-				inst.ux = (tNumX + 1) * ulen;
-				inst.uy = (tNumY + 1) * ulen;
-				vertices.push_back(inst);
-
-				inst.x = x + vx;
-				inst.y = y + vy;
-				inst.z = z + vz;
-				inst.aoX = aoTexX;
-				inst.aoY = aoTexY + 15;
-				inst.ux = tNumX * ulen;
-				inst.uy = tNumY * ulen;
-				vertices.push_back(inst);
-
-				inst.x = x + ux + vx;
-				inst.y = y + uy + vy;
-				inst.z = z + uz + vz;
-				inst.aoX = aoTexX + 15;
-				inst.aoY = aoTexY + 15;
-				inst.ux = tNumX * ulen;
-				inst.uy = (tNumY + 1) * ulen;
-				vertices.push_back(inst);
-			} else { // i.e. single texture mode
-				inst.ux = 1;
-				inst.uy = 0;
-				vertices.push_back(inst);
-
-				inst.x = x + ux;
-				inst.y = y + uy;
-				inst.z = z + uz;
-				inst.aoX = aoTexX + 15;
-				inst.aoY = aoTexY;
-				inst.ux = 1;
-				inst.uy = 1;
-				vertices.push_back(inst);
-
-				inst.x = x + vx;
-				inst.y = y + vy;
-				inst.z = z + vz;
-				inst.aoX = aoTexX;
-				inst.aoY = aoTexY + 15;
-				inst.ux = 0;
-				inst.uy = 0;
-				vertices.push_back(inst);
-
-				inst.x = x + ux + vx;
-				inst.y = y + uy + vy;
-				inst.z = z + uz + vz;
-				inst.aoX = aoTexX + 15;
-				inst.aoY = aoTexY + 15;
-				inst.ux = 0;
-				inst.uy = 1;
-				vertices.push_back(inst);
-			}
-			// END OF MODIFIED
-
-			indices.push_back(idx);
-			indices.push_back(idx + 1);
-			indices.push_back(idx + 2);
-			indices.push_back(idx + 1);
-			indices.push_back(idx + 3);
-			indices.push_back(idx + 2);
+			Mesh mesh;
+			BuildMesh(mesh, *map, chunkX, chunkY, chunkZ, GetMeshingParams());
+			Upload(mesh);
+			needsUpdate = false;
 		}
 
-		bool GLMapChunk::IsSolid(int x, int y, int z) {
-			if (z < 0)
-				return false;
-			if (z >= 64)
-				return true;
+		void GLMapChunk::Upload(const Mesh &mesh) {
+			SPADES_MARK_FUNCTION();
+			SPADES_TRACE_SCOPE("GLMapChunk::Upload");
+
+			const auto &indices = mesh.indices;
 
-			// FIXME: variable map size
-			x &= 511;
-			y &= 511;
-
-			if (z == 63) {
-				if (renderer->renderer->GetSettings().r_water) {
-					return map->IsSolid(x, y, 62);
-				} else {
-					return map->IsSolid(x, y, 63);
-				}
-			} else {
-				return map->IsSolid(x, y, z);
+			// the buffers are kept even if the chunk becomes empty
+			numIndices = indices.size();
+
+			if (mesh.GetNumVertices() == 0)
+				return;
+
+			Vector3 origin = MakeVector3(chunkX * Size, chunkY * Size, chunkZ * Size);
+			aabb = AABB3(origin + mesh.bounds.min, origin + mesh.bounds.max);
+
+			const void *vertexData = mesh.compactVertices.empty()
+			                           ? static_cast<const void *>(mesh.vertices.data())
+			                           : static_cast<const void *>(mesh.compactVertices.data());
+
+			UploadBuffer(buffer, bufferSize, vertexData, mesh.GetVertexDataSize());
+			if (!indices.empty()) {
+				UploadBuffer(iBuffer, iBufferSize, indices.data(),
+				             indices.size() * sizeof(uint16_t));
 			}
+			device->BindBuffer(IGLDevice::ArrayBuffer, 0);
 		}
 
-		void GLMapChunk::Update() {
-			SPADES_MARK_FUNCTION();
-
-			vertices.clear();
-			indices.clear();
-			if (buffer) {
-				device->DeleteBuffer(buffer);
-				buffer = 0;
+		void GLMapChunk::UploadBuffer(IGLDevice::UInteger &buf, std::size_t &bufSize,
+		                              const void *data, std::size_t size) {
+			if (!buf) {
+				buf = device->GenBuffer();
 			}
-			if (iBuffer) {
-				device->DeleteBuffer(iBuffer);
-				iBuffer = 0;
+			device->BindBuffer(IGLDevice::ArrayBuffer, buf);
+
+			// reallocate if the data don't fit, or if most of the buffer would
+			// be wasted (e.g., after the level of detail was lowered)
+			if (size > bufSize || size < bufSize / 4) {
+				device->BufferData(IGLDevice::ArrayBuffer, static_cast<IGLDevice::Sizei>(size),
+				                   data, IGLDevice::DynamicDraw);
+				bufSize = size;
+			} else {
+				device->BufferSubData(IGLDevice::ArrayBuffer, 0,
+				                      static_cast<IGLDevice::Sizei>(size), data);
 			}
+		}
 
-			int rchunkX = chunkX * Size;
-			int rchunkY = chunkY * Size;
-			int rchunkZ = chunkZ * Size;
-
-			int x, y, z;
-			for (x = 0; x < Size; x++) {
-				for (y = 0; y < Size; y++) {
-					for (z = 0; z < Size; z++) {
-						int xx = x + rchunkX;
-						int yy = y + rchunkY;
-						int zz = z + rchunkZ;
-
-						if (!IsSolid(xx, yy, zz))
-							continue;
-
-						uint32_t col = map->GetColor(xx, yy, zz);
-						// col = 0xffffffff;
-
-						// ADDED: do several things
-
-						// determine which faces are being added up here instead of below
-						bool nsolid1 = !IsSolid(xx, yy, zz + 1);
-						bool nsolid2 = !IsSolid(xx, yy, zz - 1);
-						bool nsolid3 = !IsSolid(xx - 1, yy, zz);
-						bool nsolid4 = !IsSolid(xx + 1, yy, zz);
-						bool nsolid5 = !IsSolid(xx, yy - 1, zz);
-						bool nsolid6 = !IsSolid(xx, yy + 1, zz);
-
-						// compute the texture coords for this block (perhaps)
-						int tNumX, tNumY;
-						// only do the computation if at least one face added
-						if (nsolid1 || nsolid2 || nsolid3 || nsolid4 || nsolid5 || nsolid6) {
-							// only do the computation if in multi-texture mode
-							if (renderer->previous_cg_multiTextures &&
-							    renderer->previous_cg_textures) {
-								int r = (int)((uint8_t)(col));
-								int g = (int)((uint8_t)(col >> 8));
-								int b = (int)((uint8_t)(col >> 16));
-								// determine the r,g,b coords of the color
-								int rCoord = r / 64;
-								int gCoord = g / 64;
-								int bCoord = b / 64;
-								// translate that into texture coords on the block
-								tNumX = rCoord;
-								tNumY = gCoord;
-								if (bCoord == 1 || bCoord == 3) {
-									tNumX += 4;
-								}
-								if (bCoord == 2 || bCoord == 3) {
-									tNumY += 4;
-								}
-							}
-						} else {
-							continue; // no faces being added
-						}
-						// END OF ADDED
-
-						// damaged block?
-						int health = col >> 24;
-						if (health < 100) {
-							col &= 0xffffff;
-							col &= 0xfefefe;
-							col >>= 1;
-						}
+		bool GLMapChunk::IsMeshUpToDate() const {
+			return realized && !needsUpdate && !meshingTask;
+		}
 
-						// MODIFIED: include multi-texture coords, use pre-calculated nsolid
-						// variables
-						if (nsolid1) {
-							EmitVertex(x + 1, y, z + 1, xx, yy, zz + 1, -1, 0, 0, 1, col, tNumX,
-							           tNumY, 0, 0, 1);
-						}
-						if (nsolid2) {
-							EmitVertex(x, y, z, xx, yy, zz - 1, 1, 0, 0, 1, col, tNumX, tNumY, 0, 0,
-							           -1);
-						}
-						if (nsolid3) {
-							EmitVertex(x, y + 1, z, xx - 1, yy, zz, 0, 0, 0, -1, col, tNumX, tNumY,
-							           -1, 0, 0);
-						}
-						if (nsolid4) {
-							EmitVertex(x + 1, y, z, xx + 1, yy, zz, 0, 0, 0, 1, col, tNumX, tNumY,
-							           1, 0, 0);
-						}
-						if (nsolid5) {
-							EmitVertex(x, y, z, xx, yy - 1, zz, 0, 0, 1, 0, col, tNumX, tNumY, 0,
-							           -1, 0);
-						}
-						if (nsolid6) {
-							EmitVertex(x + 1, y + 1, z, xx, yy + 1, zz, 0, 0, -1, 0, col, tNumX,
-							           tNumY, 0, 1, 0);
-						}
-						// END OF MODIFIED
-					}
-				}
-			}
+		void GLMapChunk::StartMeshing(TaskGroup &group) {
+			SPADES_MARK_FUNCTION_DEBUG();
 
-			if (vertices.size() == 0)
+			if (!realized || !needsUpdate || meshingTask) {
 				return;
+			}
 
-			buffer = device->GenBuffer();
-			device->BindBuffer(IGLDevice::ArrayBuffer, buffer);
+			meshingTask.reset(new MeshingTask(map, chunkX, chunkY, chunkZ, GetMeshingParams()));
+			needsUpdate = false;
+			group.Run(*meshingTask);
+		}
 
-			device->BufferData(IGLDevice::ArrayBuffer,
-			                   static_cast<IGLDevice::Sizei>(vertices.size() * sizeof(Vertex)),
-			                   vertices.data(), IGLDevice::DynamicDraw);
+		std::size_t GLMapChunk::GetPendingMeshSize() const {
+			SPAssert(HasPendingMesh());
+			const Mesh &mesh = meshingTask->GetMesh();
+			return mesh.GetVertexDataSize() + mesh.indices.size() * sizeof(uint16_t);
+		}
 
-			if (!indices.empty()) {
-				iBuffer = device->GenBuffer();
-				device->BindBuffer(IGLDevice::ArrayBuffer, iBuffer);
+		void GLMapChunk::UploadPendingMesh() {
+			SPADES_MARK_FUNCTION();
+			SPAssert(HasPendingMesh());
 
-				device->BufferData(IGLDevice::ArrayBuffer,
-				                   static_cast<IGLDevice::Sizei>(indices.size() * sizeof(uint16_t)),
-				                   indices.data(), IGLDevice::DynamicDraw);
+			if (realized) {
+				Upload(meshingTask->GetMesh());
 			}
-			device->BindBuffer(IGLDevice::ArrayBuffer, 0);
+			meshingTask.reset();
+		}
+
+		void GLMapChunk::DiscardPendingMesh() {
+			if (!meshingTask) {
+				return;
+			}
+			SPAssert(meshingTask->IsDone());
+			meshingTask.reset();
+			needsUpdate = true;
 		}
 
 		void GLMapChunk::RenderDepthPass() {
@@ -437,12 +1066,7 @@ namespace spades {
 
 			if (!realized)
 				return;
-			if (needsUpdate) {
-				Update();
-				needsUpdate = false;
-			}
-			if (!buffer) {
-				// empty chunk
+			if (IsEmpty()) {
 				return;
 			}
 			AABB3 bx = aabb;
@@ -479,14 +1103,15 @@ namespace spades {
 
 			positionAttribute(depthonlyProgram);
 
+			VertexFormat format(renderer->compactVertices);
 			device->BindBuffer(IGLDevice::ArrayBuffer, buffer);
 			device->VertexAttribPointer(positionAttribute(), 3, IGLDevice::UnsignedByte, false,
-			                            sizeof(Vertex), (void *)asOFFSET(Vertex, x));
+			                            format.stride, (void *)format.position);
 
 			device->BindBuffer(IGLDevice::ArrayBuffer, 0);
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, iBuffer);
 			device->DrawElements(IGLDevice::Triangles,
-			                     static_cast<IGLDevice::Sizei>(indices.size()),
+			                     static_cast<IGLDevice::Sizei>(numIndices),
 			                     IGLDevice::UnsignedShort, NULL);
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, 0);
 		}
@@ -496,12 +1121,7 @@ namespace spades {
 
 			if (!realized)
 				return;
-			if (needsUpdate) {
-				Update();
-				needsUpdate = false;
-			}
-			if (!buffer) {
-				// empty chunk
+			if (IsEmpty()) {
 				return;
 			}
 			AABB3 bx = aabb;
@@ -540,10 +1160,12 @@ namespace spades {
 			static GLProgramAttribute colorAttribute("colorAttribute");
 			static GLProgramAttribute normalAttribute("normalAttribute");
 			static GLProgramAttribute fixedPositionAttribute("fixedPositionAttribute");
+			static GLProgramAttribute quadCoordAttribute("quadCoordAttribute");
+			static GLProgramAttribute textureTileAttribute("textureTileAttribute");
 
 			// ADDED: Setup the texture coordinate attribute
 			static GLProgramAttribute blockTexCoordAttribute("blockTexCoordAttribute");
-			if (renderer->previous_cg_textures) {
+			if (renderer->previous_cg_textures && !renderer->compactVertices) {
 				blockTexCoordAttribute(basicProgram);
 			}
 			// END OF ADDED
@@ -552,35 +1174,52 @@ namespace spades {
 			ambientOcclusionCoordAttribute(basicProgram);
 			colorAttribute(basicProgram);
 			normalAttribute(basicProgram);
-			fixedPositionAttribute(basicProgram);
+			if (renderer->compactVertices) {
+				quadCoordAttribute(basicProgram);
+				textureTileAttribute(basicProgram);
+			} else {
+				fixedPositionAttribute(basicProgram);
+			}
 
+			VertexFormat format(renderer->compactVertices);
 			device->BindBuffer(IGLDevice::ArrayBuffer, buffer);
 			device->VertexAttribPointer(positionAttribute(), 3, IGLDevice::UnsignedByte, false,
-			                            sizeof(Vertex), (void *)asOFFSET(Vertex, x));
+			                            format.stride, (void *)format.position);
 			if (ambientOcclusionCoordAttribute() != -1)
 				device->VertexAttribPointer(ambientOcclusionCoordAttribute(), 2,
-				                            IGLDevice::UnsignedShort, false, sizeof(Vertex),
-				                            (void *)asOFFSET(Vertex, aoX));
+				                            format.ambientOcclusionCoordType, false,
+				                            format.stride, (void *)format.ambientOcclusionCoord);
 			device->VertexAttribPointer(colorAttribute(), 4, IGLDevice::UnsignedByte, true,
-			                            sizeof(Vertex), (void *)asOFFSET(Vertex, colorRed));
+			                            format.stride, (void *)format.color);
 			if (normalAttribute() != -1)
 				device->VertexAttribPointer(normalAttribute(), 3, IGLDevice::Byte, false,
-				                            sizeof(Vertex), (void *)asOFFSET(Vertex, nx));
-
-			device->VertexAttribPointer(fixedPositionAttribute(), 3, IGLDevice::Byte, false,
-			                            sizeof(Vertex), (void *)asOFFSET(Vertex, sx));
-
-			// ADDED: Bind the texture coordinates
-			if (renderer->previous_cg_textures) {
-				device->VertexAttribPointer(blockTexCoordAttribute(), 2, IGLDevice::FloatType,
-				                            false, sizeof(Vertex), (void *)asOFFSET(Vertex, ux));
+				                            format.stride, (void *)format.normal);
+
+			if (renderer->compactVertices) {
+				device->VertexAttribPointer(quadCoordAttribute(), 2, IGLDevice::UnsignedByte,
+				                            false, format.stride,
+				                            (void *)asOFFSET(CompactVertex, quadU));
+				if (textureTileAttribute() != -1)
+					device->VertexAttribPointer(textureTileAttribute(), 1,
+					                            IGLDevice::UnsignedByte, false, format.stride,
+					                            (void *)asOFFSET(CompactVertex, textureTile));
+			} else {
+				device->VertexAttribPointer(fixedPositionAttribute(), 3, IGLDevice::Byte, false,
+				                            format.stride, (void *)asOFFSET(Vertex, sx));
+
+				// ADDED: Bind the texture coordinates
+				if (renderer->previous_cg_textures) {
+					device->VertexAttribPointer(blockTexCoordAttribute(), 2,
+					                            IGLDevice::FloatType, false, format.stride,
+					                            (void *)asOFFSET(Vertex, ux));
+				}
+				// END OF ADDED
 			}
-			// END OF ADDED
 
 			device->BindBuffer(IGLDevice::ArrayBuffer, 0);
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, iBuffer);
 			device->DrawElements(IGLDevice::Triangles,
-			                     static_cast<IGLDevice::Sizei>(indices.size()),
+			                     static_cast<IGLDevice::Sizei>(numIndices),
 			                     IGLDevice::UnsignedShort, NULL);
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, 0);
 		}
@@ -591,12 +1230,7 @@ namespace spades {
 
 			if (!realized)
 				return;
-			if (needsUpdate) {
-				Update();
-				needsUpdate = false;
-			}
-			if (!buffer) {
-				// empty chunk
+			if (IsEmpty()) {
 				return;
 			}
 			AABB3 bx = aabb;
@@ -637,13 +1271,14 @@ namespace spades {
 			colorAttribute(program);
 			normalAttribute(program);
 
+			VertexFormat format(renderer->compactVertices);
 			device->BindBuffer(IGLDevice::ArrayBuffer, buffer);
 			device->VertexAttribPointer(positionAttribute(), 3, IGLDevice::UnsignedByte, false,
-			                            sizeof(Vertex), (void *)asOFFSET(Vertex, x));
+			                            format.stride, (void *)format.position);
 			device->VertexAttribPointer(colorAttribute(), 4, IGLDevice::UnsignedByte, true,
-			                            sizeof(Vertex), (void *)asOFFSET(Vertex, colorRed));
+			                            format.stride, (void *)format.color);
 			device->VertexAttribPointer(normalAttribute(), 3, IGLDevice::Byte, false,
-			                            sizeof(Vertex), (void *)asOFFSET(Vertex, nx));
+			                            format.stride, (void *)format.normal);
 
 			device->BindBuffer(IGLDevice::ArrayBuffer, 0);
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, iBuffer);
@@ -656,7 +1291,7 @@ namespace spades {
 					continue;
 
 				device->DrawElements(IGLDevice::Triangles,
-				                     static_cast<IGLDevice::Sizei>(indices.size()),
+				                     static_cast<IGLDevice::Sizei>(numIndices),
 				                     IGLDevice::UnsignedShort, NULL);
 			}
 
@@ -670,12 +1305,7 @@ namespace spades {
 
 			if (!realized)
 				return;
-			if (needsUpdate) {
-				Update();
-				needsUpdate = false;
-			}
-			if (!buffer) {
-				// empty chunk
+			if (IsEmpty()) {
 				return;
 			}
 			AABB3 bx = aabb;
@@ -711,18 +1341,41 @@ namespace spades {
 			static GLProgramAttribute positionAttribute("positionAttribute");
 			positionAttribute(outlinesProgram);
 
+			VertexFormat format(renderer->compactVertices);
 			device->BindBuffer(IGLDevice::ArrayBuffer, buffer);
 			device->VertexAttribPointer(positionAttribute(), 3, IGLDevice::UnsignedByte, false,
-			                            sizeof(Vertex), (void *)asOFFSET(Vertex, x));
+			                            format.stride, (void *)format.position);
 
 			device->BindBuffer(IGLDevice::ArrayBuffer, 0);
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, iBuffer);
-			device->DrawElements(IGLDevice::Triangles, indices.size(), IGLDevice::UnsignedShort,
-			                     NULL);
+			device->DrawElements(IGLDevice::Triangles, static_cast<IGLDevice::Sizei>(numIndices),
+			                     IGLDevice::UnsignedShort, NULL);
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, 0);
 		}
 		// END OF ADDED
 
+		AABB3 GLMapChunk::GetAABBNearEye(const Vector3 &eye) const {
+			AABB3 bx = aabb;
+
+			Vector3 diff = eye - centerPos;
+			float sx = 0.f, sy = 0.f;
+			// FIXME: variable map size?
+			if (diff.x > 256.f)
+				sx += 512.f;
+			if (diff.y > 256.f)
+				sy += 512.f;
+			if (diff.x < -256.f)
+				sx -= 512.f;
+			if (diff.y < -256.f)
+				sy -= 512.f;
+
+			bx.min.x += sx;
+			bx.min.y += sy;
+			bx.max.x += sx;
+			bx.max.y += sy;
+			return bx;
+		}
+
 		float GLMapChunk::DistanceFromEye(const Vector3 &eye) {
 			Vector3 diff = eye - centerPos;
 
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
 #include <vector>
 
 #include "GLDynamicLight.h"
@@ -27,12 +29,14 @@
 #include <Client/GameMap.h>
 #include <Client/IRenderer.h>
 #include <Core/Math.h>
+#include <Core/TaskScheduler.h>
 
 namespace spades {
 	namespace draw {
 		class GLMapRenderer;
 		class IGLDevice;
 		class GLMapChunk {
+		public:
 			struct Vertex {
 				uint8_t x, y, z;
 				uint8_t pad;
@@ -55,6 +59,99 @@ namespace spades {
 				// END OF ADDED
 			};
 
+			/** Packed vertex used with r_mapChunkCompactVertex. The shaders
+			 * derive the fixed position and the texture coordinates from the
+			 * position of the vertex in its quad (Shaders/MapChunkVertex.vs). */
+			struct CompactVertex {
+				uint8_t x, y, z;
+
+				// tNumX + tNumY * 8, or `SingleTextureTile`
+				uint8_t textureTile;
+
+				uint8_t aoX, aoY;
+
+				// position of the vertex in the quad, in faces
+				uint8_t quadU, quadV;
+
+				uint8_t colorRed;
+				uint8_t colorGreen;
+				uint8_t colorBlue;
+				uint8_t shading;
+
+				int8_t nx, ny, nz;
+				uint8_t pad;
+
+				enum { SingleTextureTile = 255 };
+			};
+
+			/** Settings that affect the generated mesh, captured on the GL thread
+			 * so the mesh can be built on another thread. */
+			struct MeshingParams {
+				bool water;
+				bool textures;
+				bool multiTextures;
+				/** Merges coplanar faces with identical attributes. Only valid
+				 * without textures. */
+				bool greedy;
+				/** Generates `CompactVertex` instead of `Vertex`. */
+				bool compactVertices;
+				/** The chunk is downsampled by `1 << lod` (see `GLMapChunk::SetLOD`).
+				 * Only valid without textures. */
+				int lod;
+			};
+
+			/** CPU-side mesh of a chunk. Only one of the vertex arrays is used,
+			 * depending on `MeshingParams::compactVertices`. */
+			struct Mesh {
+				std::vector<Vertex> vertices;
+				std::vector<CompactVertex> compactVertices;
+				std::vector<uint16_t> indices;
+
+				/** Bounding box of the vertices relative to the chunk. */
+				AABB3 bounds;
+
+				std::size_t GetNumVertices() const {
+					return vertices.size() + compactVertices.size();
+				}
+				std::size_t GetVertexDataSize() const {
+					return vertices.size() * sizeof(Vertex) +
+					       compactVertices.size() * sizeof(CompactVertex);
+				}
+			};
+
+			/**
+			 * Builds a chunk's mesh on a worker thread. The result is immutable
+			 * once `IsDone()` returns `true`.
+			 *
+			 * The map is read without synchronization while the main thread may
+			 * modify it. This is tolerated because every modification marks the
+			 * affected chunks for update (`GLMapRenderer::GameMapChanged`) after
+			 * the voxels are written, and `StartMeshing` clears the mark before
+			 * the task starts. A mesh built from a partially modified map is
+			 * thus always followed by another build of the same chunk.
+			 */
+			class MeshingTask : public Task {
+				Handle<client::GameMap> map;
+				int chunkX, chunkY, chunkZ;
+				MeshingParams params;
+				std::atomic<bool> done{false};
+				Mesh mesh;
+
+			protected:
+				void Execute() override;
+
+			public:
+				MeshingTask(client::GameMap *map, int cx, int cy, int cz,
+				            const MeshingParams &params);
+
+				bool IsDone() const { return done.load(std::memory_order_acquire); }
+				const Mesh &GetMesh() const { return mesh; }
+			};
+
+			static void BuildMesh(Mesh &, client::GameMap &, int cx, int cy, int cz,
+			                      const MeshingParams &);
+
+		private:
 			GLMapRenderer *renderer;
 			IGLDevice *device;
 			client::GameMap *map;
@@ -64,37 +161,82 @@ namespace spades {
 			Vector3 centerPos;
 			float radius;
 
-			std::vector<Vertex> vertices;
-			std::vector<uint16_t> indices;
+			// kept across uploads and reused while the new data fit
 			IGLDevice::UInteger buffer;
 			IGLDevice::UInteger iBuffer;
+			std::size_t bufferSize;
+			std::size_t iBufferSize;
+			std::size_t numIndices;
+
+			// in flight, or finished and waiting to be uploaded
+			std::unique_ptr<MeshingTask> meshingTask;
 
 			bool needsUpdate;
 			bool realized;
 
-			uint8_t calcAOID(int x, int y, int z, int ux, int uy, int uz, int vx, int vy, int vz);
+			// the level of detail of the next mesh
+			int lod;
 
-			void
-			EmitVertex(int aoX, int aoY, int aoZ, int x, int y, int z, int ux, int uy, int vx,
-			           int vy, uint32_t color, int tNumX,
-			           int tNumY, // ADDED: these texture-coords are used if in multi-texture mode
-			           int nx, int ny, int nz);
+			MeshingParams GetMeshingParams();
 
-			bool IsSolid(int x, int y, int z);
-
-			void Update();
+			void Upload(const Mesh &);
+			void UploadBuffer(IGLDevice::UInteger &, std::size_t &bufSize, const void *data,
+			                  std::size_t size);
 
 		public:
-			enum { Size = 16, SizeBits = 4 };
+			enum { Size = 16, SizeBits = 4, MaxLOD = 2 };
 			GLMapChunk(GLMapRenderer *, client::GameMap *mp, int cx, int cy, int cz);
 			~GLMapChunk();
 
 			void SetNeedsUpdate() { needsUpdate = true; }
 
+			/** Builds and uploads the mesh on the calling thread. Used when
+			 * `r_mapChunkAsyncMeshing` is disabled. */
+			void Update();
+
 			void SetRealized(bool);
+			bool IsRealized() const { return realized; }
+
+			/**
+			 * Selects the level of detail of the mesh. At level `n`, each cell of
+			 * `2^n` voxels cubed becomes a single block which is solid if the
+			 * majority of the voxels are, and has their most common color. The
+			 * mesh is rebuilt if the level changes.
+			 */
+			void SetLOD(int);
+			int GetLOD() const { return lod; }
+
+			/** Starts building the mesh on a worker if needed and no build is in
+			 * progress. */
+			void StartMeshing(TaskGroup &);
+
+			/** Returns `true` if a finished mesh is waiting to be uploaded. */
+			bool HasPendingMesh() const { return meshingTask && meshingTask->IsDone(); }
+
+			/** Returns the size of the finished mesh waiting to be uploaded in
+			 * bytes. */
+			std::size_t GetPendingMeshSize() const;
+
+			/** Uploads the finished mesh. The old buffers are used until then. */
+			void UploadPendingMesh();
+
+			/** Discards the result of the mesh build in progress. The caller must
+			 * make sure the build has completed. */
+			void DiscardPendingMesh();
 
 			float DistanceFromEye(const Vector3 &eye);
 
+			/** Returns `true` if the uploaded mesh reflects the current state
+			 * of the map. */
+			bool IsMeshUpToDate() const;
+
+			/** Returns `true` if there's nothing to draw. */
+			bool IsEmpty() const { return numIndices == 0; }
+
+			/** Returns the bounding box of the mesh, translated by a multiple of
+			 * the map size so that it's near `eye`. */
+			AABB3 GetAABBNearEye(const Vector3 &eye) const;
+
 			void RenderSunlightPass();
 			void RenderDepthPass();
 			void RenderDLightPass(std::vector<GLDynamicLight> lights);
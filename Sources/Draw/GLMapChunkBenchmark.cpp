@@ -0,0 +1,554 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <regex>
+#include <unordered_map>
+
+#include "GLMapChunk.h"
+#include "GLMapOcclusionCuller.h"
+#include <Client/GameMap.h>
+#include <Core/Benchmark.h>
+#include <Core/Debug.h>
+#include <Core/Exception.h>
+#include <Core/FileManager.h>
+#include <Core/IStream.h>
+#include <Core/Stopwatch.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			/** What the block shaders see at a unit face of a mesh. */
+			struct FaceSample {
+				uint32_t color;
+				int shading;
+				int aoID;
+				bool lit;
+				bool frontFacing;
+
+				bool operator==(const FaceSample &o) const {
+					return color == o.color && shading == o.shading && aoID == o.aoID &&
+					       lit == o.lit && frontFacing == o.frontFacing;
+				}
+				bool operator!=(const FaceSample &o) const { return !(*this == o); }
+			};
+
+			/** Unit faces keyed by their doubled center position and normal. */
+			using FaceSamples = std::unordered_map<uint32_t, FaceSample>;
+
+			/** Reference implementation of the map shadow (Shadow/Map.vs, Map.fs
+			 * and `GLMapShadowRenderer::GeneratePixel`). */
+			bool IsLitByMapShadow(client::GameMap &map, const Vector3 &fixedPos) {
+				int w = map.Width(), h = map.Height();
+				int x = (int)std::floor(fixedPos.x) & (w - 1);
+				int y = (int)std::floor(fixedPos.y - fixedPos.z) & (h - 1);
+				int dist = 64;
+				for (int z = 0; z < map.Depth(); z++) {
+					if (map.IsSolid(x, y, z) && z < 63) {
+						dist = z;
+						break;
+					}
+					y = (y + 1) & (h - 1);
+					if (map.IsSolid(x, y, z) && z < 63) {
+						dist = z + 1;
+						break;
+					}
+				}
+				return !(dist / 255.f < fixedPos.z / 255.f - 0.0001f);
+			}
+
+			/** Splits the quads of a mesh into unit faces. Returns the number of
+			 * malformed quads and overlapping faces. */
+			int SampleMesh(const GLMapChunk::Mesh &mesh, client::GameMap &map, int cx, int cy,
+			               int cz, FaceSamples &samples) {
+				const auto &verts = mesh.vertices;
+				const auto &indices = mesh.indices;
+				const int size = GLMapChunk::Size;
+				int numErrors = 0;
+
+				samples.clear();
+				for (std::size_t i = 0; i + 6 <= indices.size(); i += 6) {
+					const GLMapChunk::Vertex &v0 = verts[indices[i]];
+					const GLMapChunk::Vertex &v1 = verts[indices[i + 1]];
+					const GLMapChunk::Vertex &v2 = verts[indices[i + 2]];
+					const GLMapChunk::Vertex &v3 = verts[indices[i + 4]];
+
+					IntVector3 p0 = IntVector3::Make(v0.x, v0.y, v0.z);
+					IntVector3 du = IntVector3::Make(v1.x, v1.y, v1.z) - p0;
+					IntVector3 dv = IntVector3::Make(v2.x, v2.y, v2.z) - p0;
+					IntVector3 n = IntVector3::Make(v0.nx, v0.ny, v0.nz);
+					int lenU = std::abs(du.x) + std::abs(du.y) + std::abs(du.z);
+					int lenV = std::abs(dv.x) + std::abs(dv.y) + std::abs(dv.z);
+					if (lenU == 0 || lenV == 0 ||
+					    !(IntVector3::Make(v3.x, v3.y, v3.z) == p0 + du + dv) ||
+					    v1.aoX != v0.aoX + 15 || v2.aoY != v0.aoY + 15) {
+						numErrors++;
+						continue;
+					}
+					IntVector3 ud = du / lenU, vd = dv / lenV;
+
+					IntVector3 cross = IntVector3::Make(ud.y * vd.z - ud.z * vd.y,
+					                                    ud.z * vd.x - ud.x * vd.z,
+					                                    ud.x * vd.y - ud.y * vd.x);
+
+					FaceSample sample;
+					sample.color = v0.colorRed | (v0.colorGreen << 8) | (v0.colorBlue << 16);
+					sample.shading = v0.shading;
+					sample.aoID = (v0.aoX >> 4) | (v0.aoY & 0xf0);
+					sample.frontFacing = cross.x * n.x + cross.y * n.y + cross.z * n.z > 0;
+
+					Vector3 fixedPos = MakeVector3(cx * size, cy * size, cz * size);
+					fixedPos += MakeVector3(v0.sx, v0.sy, v0.sz) * 0.5f;
+					fixedPos += MakeVector3(n.x, n.y, n.z) * 0.1f;
+					sample.lit = IsLitByMapShadow(map, fixedPos);
+
+					int normalIndex = (n.x + 1) + (n.y + 1) * 3 + (n.z + 1) * 9;
+					for (int a = 0; a < lenU; a++) {
+						for (int b = 0; b < lenV; b++) {
+							IntVector3 c = p0 * 2 + ud * (a * 2 + 1) + vd * (b * 2 + 1);
+							uint32_t key = c.x | (c.y << 6) | (c.z << 12) | (normalIndex << 18);
+							if (!samples.emplace(key, sample).second) {
+								numErrors++;
+							}
+						}
+					}
+				}
+				return numErrors;
+			}
+
+			/** Decodes `compact` the way Shaders/MapChunkVertex.vs does and
+			 * compares it with `legacy`. Returns the number of mismatching
+			 * vertices. */
+			int CompareCompactMesh(const GLMapChunk::Mesh &legacy,
+			                       const GLMapChunk::Mesh &compact, bool textures) {
+				if (legacy.vertices.size() != compact.compactVertices.size() ||
+				    legacy.indices != compact.indices) {
+					return (int)std::max(legacy.vertices.size(), compact.compactVertices.size());
+				}
+
+				int numErrors = 0;
+				for (std::size_t i = 0; i < legacy.vertices.size(); i++) {
+					const GLMapChunk::Vertex &v = legacy.vertices[i];
+					const GLMapChunk::CompactVertex &cv = compact.compactVertices[i];
+
+					IntVector3 u, w;
+					if (cv.nz != 0) {
+						u = IntVector3::Make(-cv.nz, 0, 0);
+						w = IntVector3::Make(0, 1, 0);
+					} else {
+						u = IntVector3::Make(0, 0, 1);
+						w = IntVector3::Make(-cv.ny, cv.nx, 0);
+					}
+					IntVector3 origin =
+					  IntVector3::Make(cv.x, cv.y, cv.z) - u * cv.quadU - w * cv.quadV;
+					IntVector3 fixedPos = origin * 2 + u + w;
+
+					bool ok = fixedPos == IntVector3::Make(v.sx, v.sy, v.sz) && cv.x == v.x &&
+					          cv.y == v.y && cv.z == v.z && cv.aoX == v.aoX &&
+					          cv.aoY == v.aoY && cv.colorRed == v.colorRed &&
+					          cv.colorGreen == v.colorGreen && cv.colorBlue == v.colorBlue &&
+					          cv.shading == v.shading && cv.nx == v.nx && cv.ny == v.ny &&
+					          cv.nz == v.nz;
+
+					if (textures) {
+						float tu = 1.f - cv.quadV, tv = cv.quadU;
+						if (cv.textureTile != GLMapChunk::CompactVertex::SingleTextureTile) {
+							tu = ((cv.textureTile & 7) + tu) / 8.f;
+							tv = ((cv.textureTile >> 3) + tv) / 8.f;
+						}
+						ok = ok && std::fabs(tu - v.ux) < 1.e-5f && std::fabs(tv - v.uy) < 1.e-5f;
+					}
+
+					if (!ok) {
+						numErrors++;
+					}
+				}
+				return numErrors;
+			}
+
+			struct MeshingResult {
+				std::size_t numVertices = 0;
+				std::size_t numTriangles = 0;
+				double time = 0.0;
+			};
+
+			// Builds every chunk of the bundled maps with and without greedy
+			// meshing and checks that both meshes look the same. Also checks
+			// that the compact vertex format decodes to the same attributes,
+			// and measures the downsampled meshes.
+			void MapChunkMeshingBenchmark() {
+				static std::regex re(".*\\.vxl", std::regex::icase);
+				int numMismatches = 0;
+
+				for (const auto &name : FileManager::EnumFiles("Maps")) {
+					if (!std::regex_match(name, re)) {
+						continue;
+					}
+
+					Handle<client::GameMap> map;
+					{
+						std::unique_ptr<IStream> stream(
+						  FileManager::OpenForReading(("Maps/" + name).c_str()));
+						map.Set(client::GameMap::Load(stream.get()), false);
+					}
+
+					GLMapChunk::MeshingParams params;
+					params.water = true;
+					params.textures = false;
+					params.multiTextures = false;
+					params.compactVertices = false;
+					params.lod = 0;
+
+					int numChunkWidth = map->Width() / GLMapChunk::Size;
+					int numChunkHeight = map->Height() / GLMapChunk::Size;
+					int numChunkDepth = map->Depth() / GLMapChunk::Size;
+
+					MeshingResult results[2];
+					MeshingResult lodResults[GLMapChunk::MaxLOD];
+					GLMapChunk::Mesh meshes[2];
+					GLMapChunk::Mesh compactMesh;
+					FaceSamples samples[2];
+					int numBadQuads = 0;
+					int numBadFaces = 0;
+					int numBadVertices = 0;
+					std::size_t legacySize = 0, compactSize = 0;
+
+					for (int cx = 0; cx < numChunkWidth; cx++)
+						for (int cy = 0; cy < numChunkHeight; cy++)
+							for (int cz = 0; cz < numChunkDepth; cz++) {
+								for (int i = 0; i < 2; i++) {
+									params.greedy = i == 1;
+
+									Stopwatch sw;
+									GLMapChunk::BuildMesh(meshes[i], *map, cx, cy, cz, params);
+									results[i].time += sw.GetTime();
+									results[i].numVertices += meshes[i].vertices.size();
+									results[i].numTriangles += meshes[i].indices.size() / 3;
+
+									numBadQuads += SampleMesh(meshes[i], *map, cx, cy, cz,
+									                          samples[i]);
+
+									params.compactVertices = true;
+									GLMapChunk::BuildMesh(compactMesh, *map, cx, cy, cz, params);
+									params.compactVertices = false;
+									numBadVertices +=
+									  CompareCompactMesh(meshes[i], compactMesh, false);
+									if (i == 0) {
+										legacySize += meshes[i].GetVertexDataSize();
+										compactSize += compactMesh.GetVertexDataSize();
+									}
+								}
+
+								// textured modes can't be greedy-meshed
+								params.greedy = false;
+								for (int mode = 0; mode < 2; mode++) {
+									params.textures = true;
+									params.multiTextures = mode == 1;
+									GLMapChunk::BuildMesh(meshes[0], *map, cx, cy, cz, params);
+									params.compactVertices = true;
+									GLMapChunk::BuildMesh(compactMesh, *map, cx, cy, cz, params);
+									params.compactVertices = false;
+									numBadVertices +=
+									  CompareCompactMesh(meshes[0], compactMesh, true);
+								}
+								params.textures = false;
+								params.multiTextures = false;
+
+								// downsampled meshes must be well-formed, too
+								for (int lod = 1; lod <= GLMapChunk::MaxLOD; lod++) {
+									MeshingResult &result = lodResults[lod - 1];
+									params.lod = lod;
+
+									Stopwatch sw;
+									GLMapChunk::BuildMesh(meshes[0], *map, cx, cy, cz, params);
+									result.time += sw.GetTime();
+									result.numVertices += meshes[0].vertices.size();
+									result.numTriangles += meshes[0].indices.size() / 3;
+
+									FaceSamples lodSamples;
+									numBadQuads += SampleMesh(meshes[0], *map, cx, cy, cz,
+									                          lodSamples);
+
+									params.compactVertices = true;
+									GLMapChunk::BuildMesh(compactMesh, *map, cx, cy, cz, params);
+									params.compactVertices = false;
+									numBadVertices +=
+									  CompareCompactMesh(meshes[0], compactMesh, false);
+								}
+								params.lod = 0;
+
+								for (const auto &item : samples[0]) {
+									auto it = samples[1].find(item.first);
+									if (it == samples[1].end() || it->second != item.second) {
+										numBadFaces++;
+									}
+								}
+								for (const auto &item : samples[1]) {
+									if (samples[0].find(item.first) == samples[0].end()) {
+										numBadFaces++;
+									}
+								}
+							}
+
+					SPLog("[%s] per-face: %d vertices, %d triangles, %.3fms", name.c_str(),
+					      (int)results[0].numVertices, (int)results[0].numTriangles,
+					      results[0].time * 1000.0);
+					SPLog("[%s] greedy:   %d vertices, %d triangles, %.3fms (%.1f%% of triangles)",
+					      name.c_str(), (int)results[1].numVertices, (int)results[1].numTriangles,
+					      results[1].time * 1000.0,
+					      results[1].numTriangles * 100.0 /
+					        std::max<std::size_t>(results[0].numTriangles, 1));
+
+					for (int lod = 1; lod <= GLMapChunk::MaxLOD; lod++) {
+						const MeshingResult &result = lodResults[lod - 1];
+						SPLog("[%s] LOD %d:    %d vertices, %d triangles, %.3fms (%.1f%% of "
+						      "triangles)",
+						      name.c_str(), lod, (int)result.numVertices,
+						      (int)result.numTriangles, result.time * 1000.0,
+						      result.numTriangles * 100.0 /
+						        std::max<std::size_t>(results[0].numTriangles, 1));
+					}
+
+					SPLog("[%s] vertex data: %d bytes, %d bytes compact", name.c_str(),
+					      (int)legacySize, (int)compactSize);
+
+					if (numBadQuads > 0 || numBadFaces > 0 || numBadVertices > 0) {
+						SPLog("[%s] MISMATCH: %d malformed quad(s), %d face(s) differ, "
+						      "%d compact vertex(es) differ",
+						      name.c_str(), numBadQuads, numBadFaces, numBadVertices);
+						numMismatches++;
+					} else {
+						SPLog("[%s] meshes match", name.c_str());
+					}
+				}
+
+				if (numMismatches > 0) {
+					SPRaise("Meshing options changed the appearance of %d map(s)", numMismatches);
+				}
+			}
+
+			Benchmark mapChunkMeshingBenchmark("mapmesh", MapChunkMeshingBenchmark);
+
+			/** Returns `true` if the segment between `from` and `to` doesn't
+			 * pass through any solid voxel. */
+			bool IsLineOfSightClear(client::GameMap &map, const Vector3 &from, const Vector3 &to) {
+				Vector3 dir = to - from;
+				IntVector3 cell = IntVector3::Make((int)std::floor(from.x), (int)std::floor(from.y),
+				                                   (int)std::floor(from.z));
+				IntVector3 last = IntVector3::Make((int)std::floor(to.x), (int)std::floor(to.y),
+				                                   (int)std::floor(to.z));
+				IntVector3 step;
+				Vector3 next, delta;
+				for (int i = 0; i < 3; i++) {
+					float d = (&dir.x)[i], p = (&from.x)[i];
+					int c = (&cell.x)[i];
+					(&step.x)[i] = d > 0.f ? 1 : -1;
+					(&delta.x)[i] = d != 0.f ? std::fabs(1.f / d) : 1.e+30f;
+					(&next.x)[i] = d != 0.f ? ((d > 0.f ? c + 1 : c) - p) / d : 1.e+30f;
+				}
+
+				while (!(cell == last)) {
+					if (map.IsSolidWrapped(cell.x, cell.y, cell.z)) {
+						return false;
+					}
+					int axis =
+					  next.x < next.y ? (next.x < next.z ? 0 : 2) : (next.y < next.z ? 1 : 2);
+					if ((&next.x)[axis] > 1.f) {
+						break;
+					}
+					(&cell.x)[axis] += (&step.x)[axis];
+					(&next.x)[axis] += (&delta.x)[axis];
+				}
+				return !map.IsSolidWrapped(cell.x, cell.y, cell.z);
+			}
+
+			/** Culls the chunks around random viewpoints and checks that no face
+			 * of the culled chunks is actually visible. Returns the number of
+			 * culled visible faces. */
+			int TestOcclusionCulling(const std::string &name, client::GameMap &map) {
+				const float range = 128.f;
+				const int numEyes = 32;
+				int numViolations = 0;
+
+				GLMapChunk::MeshingParams params;
+				params.water = true;
+				params.textures = false;
+				params.multiTextures = false;
+				params.greedy = false;
+				params.compactVertices = false;
+				params.lod = 0;
+
+				int numChunkWidth = map.Width() / GLMapChunk::Size;
+				int numChunkHeight = map.Height() / GLMapChunk::Size;
+				int numChunkDepth = map.Depth() / GLMapChunk::Size;
+				std::vector<GLMapChunk::Mesh> meshes(numChunkWidth * numChunkHeight *
+				                                     numChunkDepth);
+				for (int cx = 0; cx < numChunkWidth; cx++)
+					for (int cy = 0; cy < numChunkHeight; cy++)
+						for (int cz = 0; cz < numChunkDepth; cz++) {
+							GLMapChunk::BuildMesh(
+							  meshes[(cx * numChunkHeight + cy) * numChunkDepth + cz], map, cx,
+							  cy, cz, params);
+						}
+
+				GLMapOcclusionCuller culler(&map);
+				std::mt19937 random(1);
+				std::size_t numCandidates = 0, numCulled = 0;
+				double time = 0.0;
+				std::vector<std::pair<float, int>> candidates;
+				std::vector<AABB3> boxes(meshes.size());
+				std::vector<int> culled;
+
+				for (int eyeIndex = 0; eyeIndex < numEyes; eyeIndex++) {
+					// stand on the ground, or fly above it
+					int x = (int)(random() % (unsigned int)map.Width());
+					int y = (int)(random() % (unsigned int)map.Height());
+					int ground = 0;
+					while (ground < map.Depth() - 1 && !map.IsSolid(x, y, ground))
+						ground++;
+					float height = (eyeIndex % 4 == 3) ? 20.f : 2.5f;
+					Vector3 eye = MakeVector3(x + .5f, y + .5f, ground - height);
+
+					Stopwatch sw;
+					culler.Begin(eye, range, [](int, int) { return true; });
+
+					candidates.clear();
+					for (std::size_t i = 0; i < meshes.size(); i++) {
+						const GLMapChunk::Mesh &mesh = meshes[i];
+						if (mesh.vertices.empty())
+							continue;
+
+						// same as `GLMapChunk::GetAABBNearEye`
+						int cx = (int)(i / numChunkDepth / numChunkHeight);
+						int cy = (int)((i / numChunkDepth) % numChunkHeight);
+						int cz = (int)(i % numChunkDepth);
+						Vector3 origin = MakeVector3(cx, cy, cz) * (float)GLMapChunk::Size;
+						Vector3 diff = eye - (origin + MakeVector3(8.f, 8.f, 8.f));
+						origin.x += diff.x > 256.f ? 512.f : diff.x < -256.f ? -512.f : 0.f;
+						origin.y += diff.y > 256.f ? 512.f : diff.y < -256.f ? -512.f : 0.f;
+						boxes[i] = AABB3(origin + mesh.bounds.min, origin + mesh.bounds.max);
+
+						// same as `GLMapRenderer::RealizeChunks`
+						diff = eye - (origin + MakeVector3(8.f, 8.f, 8.f));
+						if (std::max(std::fabs(diff.x), std::fabs(diff.y)) - 8.f >= range)
+							continue;
+
+						candidates.emplace_back(culler.GetMinDistance(boxes[i]), (int)i);
+					}
+					std::sort(candidates.begin(), candidates.end());
+
+					culled.clear();
+					for (const auto &item : candidates) {
+						if (culler.IsOccluded(boxes[item.second]))
+							culled.push_back(item.second);
+					}
+					time += sw.GetTime();
+					numCandidates += candidates.size();
+					numCulled += culled.size();
+
+					// look for the front faces of the culled chunks visible from the eye
+					for (int i : culled) {
+						const auto &verts = meshes[i].vertices;
+						Vector3 offset = boxes[i].min - meshes[i].bounds.min;
+						for (std::size_t j = 0; j + 4 <= verts.size(); j += 4) {
+							Vector3 corners[4];
+							for (int k = 0; k < 4; k++) {
+								const GLMapChunk::Vertex &v = verts[j + k];
+								corners[k] = offset + MakeVector3(v.x, v.y, v.z);
+							}
+							Vector3 normal = MakeVector3(verts[j].nx, verts[j].ny, verts[j].nz);
+							Vector3 center =
+							  (corners[0] + corners[1] + corners[2] + corners[3]) * .25f;
+							if (Vector3::Dot(center - eye, normal) >= 0.f)
+								continue;
+
+							for (int k = 0; k < 5; k++) {
+								Vector3 p =
+								  k < 4 ? corners[k] + (center - corners[k]) * .1f : center;
+								if (IsLineOfSightClear(map, eye, p + normal * .01f)) {
+									numViolations++;
+									break;
+								}
+							}
+						}
+					}
+				}
+
+				SPLog("[%s] %d of %d chunk(s) culled (%.1f%%), %.3fms per view", name.c_str(),
+				      (int)numCulled, (int)numCandidates,
+				      numCulled * 100.0 / std::max<std::size_t>(numCandidates, 1),
+				      time * 1000.0 / numEyes);
+				return numViolations;
+			}
+
+			/** Creates rolling hills with some towers on them, which the bundled
+			 * maps don't have much of. */
+			client::GameMap *CreateHillsMap() {
+				auto *map = new client::GameMap();
+				for (int x = 0; x < map->Width(); x++)
+					for (int y = 0; y < map->Height(); y++) {
+						float fx = x * (float)M_PI / 64.f, fy = y * (float)M_PI / 64.f;
+						float height = 14.f * std::sin(fx) * std::cos(fy * .75f) +
+						               5.f * std::sin(fx * 3.f + fy * 2.f);
+						int ground = std::max(std::min(36 - (int)height, 63), 2);
+						if ((x & 31) < 3 && (y & 31) < 3) {
+							ground = std::max(ground - 16, 0);
+						}
+						for (int z = 0; z < map->Depth(); z++) {
+							map->Set(x, y, z, z >= ground, 0x406080 + (uint32_t)(z * 2), true);
+						}
+					}
+				return map;
+			}
+
+			void MapOcclusionCullingBenchmark() {
+				static std::regex re(".*\\.vxl", std::regex::icase);
+				int numViolations = 0;
+
+				for (const auto &name : FileManager::EnumFiles("Maps")) {
+					if (!std::regex_match(name, re)) {
+						continue;
+					}
+
+					Handle<client::GameMap> map;
+					{
+						std::unique_ptr<IStream> stream(
+						  FileManager::OpenForReading(("Maps/" + name).c_str()));
+						map.Set(client::GameMap::Load(stream.get()), false);
+					}
+					numViolations += TestOcclusionCulling(name, *map);
+				}
+
+				Handle<client::GameMap> hills(CreateHillsMap(), false);
+				numViolations += TestOcclusionCulling("Hills", *hills);
+
+				if (numViolations > 0) {
+					SPRaise("%d visible face(s) were culled", numViolations);
+				}
+			}
+
+			Benchmark mapOcclusionCullingBenchmark("mapocclusion", MapOcclusionCullingBenchmark);
+		}
+	}
+}
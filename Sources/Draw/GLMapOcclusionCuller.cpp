@@ -0,0 +1,229 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "GLMapOcclusionCuller.h"
+#include <Client/GameMap.h>
+#include <Core/Debug.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			// occluders nearer than this might be clipped by the near clip plane
+			const float MinOccluderDistance = 1.f;
+
+			// absorbs the rounding errors of the horizon test
+			const float HorizonMargin = 1.e-4f;
+
+			/** Returns a value in `[0, 4)` that increases monotonically with
+			 * `atan2(dy, dx)`, which is much cheaper to compute. */
+			float PseudoAngle(float dx, float dy) {
+				float p = dx / (std::fabs(dx) + std::fabs(dy));
+				return dy >= 0.f ? 1.f - p : 3.f + p;
+			}
+		}
+
+		GLMapOcclusionCuller::GLMapOcclusionCuller(client::GameMap *map)
+		    : map(map), active(false), numInsertedOccluders(0) {
+			SPADES_MARK_FUNCTION();
+
+			numCellsX = map->Width() >> CellSizeBits;
+			numCellsY = map->Height() >> CellSizeBits;
+
+			groundLevels.resize(numCellsX * numCellsY);
+			for (int y = 0; y < numCellsY; y++)
+				for (int x = 0; x < numCellsX; x++)
+					groundLevels[x + y * numCellsX] = (uint8_t)ComputeGroundLevel(x, y);
+
+			horizon.resize(NumAzimuthBins);
+		}
+
+		GLMapOcclusionCuller::~GLMapOcclusionCuller() {}
+
+		int GLMapOcclusionCuller::ComputeGroundLevel(int cellX, int cellY) {
+			int depth = map->Depth();
+			int level = 0;
+			for (int y = 0; y < CellSize; y++)
+				for (int x = 0; x < CellSize; x++) {
+					uint64_t column = map->GetSolidMapWrapped((cellX << CellSizeBits) + x,
+					                                          (cellY << CellSizeBits) + y);
+					// only the part above the current level matters
+					int z = depth - 1;
+					while (z >= level && ((column >> z) & 1ULL))
+						z--;
+					level = std::max(level, z + 1);
+				}
+			return level;
+		}
+
+		void GLMapOcclusionCuller::GameMapChanged(int x, int y, int, client::GameMap *) {
+			int cellX = x >> CellSizeBits;
+			int cellY = y >> CellSizeBits;
+			groundLevels[cellX + cellY * numCellsX] = (uint8_t)ComputeGroundLevel(cellX, cellY);
+		}
+
+		bool GLMapOcclusionCuller::GetAngularSpan(float minX, float minY, float maxX, float maxY,
+		                                          float &minAngle, float &maxAngle) const {
+			minX -= eye.x;
+			maxX -= eye.x;
+			minY -= eye.y;
+			maxY -= eye.y;
+			if (minX <= 0.f && maxX >= 0.f && minY <= 0.f && maxY >= 0.f) {
+				return false;
+			}
+
+			float center = PseudoAngle(minX + maxX, minY + maxY);
+			minAngle = maxAngle = 0.f;
+			for (int i = 0; i < 4; i++) {
+				float angle = PseudoAngle((i & 1) ? maxX : minX, (i & 2) ? maxY : minY) - center;
+				// the span is less than a half turn (2 in the pseudo-angle)
+				if (angle > 2.f)
+					angle -= 4.f;
+				else if (angle < -2.f)
+					angle += 4.f;
+				minAngle = std::min(minAngle, angle);
+				maxAngle = std::max(maxAngle, angle);
+			}
+			minAngle += center;
+			maxAngle += center;
+			return true;
+		}
+
+		float GLMapOcclusionCuller::GetMinDistance(const AABB3 &box) const {
+			float dx = std::max(std::max(box.min.x - eye.x, eye.x - box.max.x), 0.f);
+			float dy = std::max(std::max(box.min.y - eye.y, eye.y - box.max.y), 0.f);
+			return std::sqrt(dx * dx + dy * dy);
+		}
+
+		void GLMapOcclusionCuller::Begin(const Vector3 &eye, float range,
+		                                 const OccluderFilter &filter) {
+			SPADES_MARK_FUNCTION();
+
+			this->eye = eye;
+			occluders.clear();
+			numInsertedOccluders = 0;
+			std::fill(horizon.begin(), horizon.end(), -std::numeric_limits<float>::infinity());
+
+			// rays from below the bottom of the map could pass under the occluders
+			active = eye.z < (float)(map->Depth() - 1);
+			if (!active) {
+				return;
+			}
+
+			const float binsPerAngle = NumAzimuthBins / 4.f;
+			int minCellX = (int)std::ceil((eye.x - range) / CellSize);
+			int maxCellX = (int)std::floor((eye.x + range) / CellSize) - 1;
+			int minCellY = (int)std::ceil((eye.y - range) / CellSize);
+			int maxCellY = (int)std::floor((eye.y + range) / CellSize) - 1;
+
+			for (int cy = minCellY; cy <= maxCellY; cy++)
+				for (int cx = minCellX; cx <= maxCellX; cx++) {
+					int wrappedX = cx & (numCellsX - 1);
+					int wrappedY = cy & (numCellsY - 1);
+					int level = groundLevels[wrappedX + wrappedY * numCellsX];
+					if (level >= map->Depth()) {
+						continue;
+					}
+
+					float minX = (float)(cx * CellSize), maxX = minX + CellSize;
+					float minY = (float)(cy * CellSize), maxY = minY + CellSize;
+					float minAngle, maxAngle;
+					if (!GetAngularSpan(minX, minY, maxX, maxY, minAngle, maxAngle)) {
+						continue;
+					}
+
+					float minDist = GetMinDistance(AABB3(minX, minY, 0.f, CellSize, CellSize, 0.f));
+					if (minDist < MinOccluderDistance) {
+						continue;
+					}
+					float farX = std::max(eye.x - minX, maxX - eye.x);
+					float farY = std::max(eye.y - minY, maxY - eye.y);
+					float maxDist = std::sqrt(farX * farX + farY * farY);
+
+					// only the bins entirely covered by the cell are blocked
+					Occluder occluder;
+					occluder.firstBin = (int)std::ceil(minAngle * binsPerAngle);
+					occluder.lastBin = (int)std::floor(maxAngle * binsPerAngle) - 1;
+					if (occluder.lastBin < occluder.firstBin) {
+						continue;
+					}
+
+					if (!filter(wrappedX << CellSizeBits, wrappedY << CellSizeBits)) {
+						continue;
+					}
+
+					// A ray is blocked if it is below the top of the cell somewhere
+					// in the cell. Take the distance where that is hardest.
+					float height = eye.z - (float)level;
+					occluder.tangent = height / (height >= 0.f ? maxDist : minDist);
+					occluder.maxDistance = maxDist;
+					occluders.push_back(occluder);
+				}
+
+			std::sort(occluders.begin(), occluders.end(),
+			          [](const Occluder &a, const Occluder &b) {
+				          return a.maxDistance < b.maxDistance;
+				      });
+		}
+
+		bool GLMapOcclusionCuller::IsOccluded(const AABB3 &box) {
+			if (!active) {
+				return false;
+			}
+
+			float minAngle, maxAngle;
+			if (!GetAngularSpan(box.min.x, box.min.y, box.max.x, box.max.y, minAngle, maxAngle)) {
+				return false;
+			}
+
+			// an occluder only blocks the boxes behind it
+			float minDist = GetMinDistance(box);
+			while (numInsertedOccluders < occluders.size() &&
+			       occluders[numInsertedOccluders].maxDistance <= minDist) {
+				const Occluder &occluder = occluders[numInsertedOccluders++];
+				for (int i = occluder.firstBin; i <= occluder.lastBin; i++) {
+					float &value = horizon[i & (NumAzimuthBins - 1)];
+					value = std::max(value, occluder.tangent);
+				}
+			}
+
+			float farX = std::max(eye.x - box.min.x, box.max.x - eye.x);
+			float farY = std::max(eye.y - box.min.y, box.max.y - eye.y);
+			float maxDist = std::sqrt(farX * farX + farY * farY);
+
+			// the steepest ray reaching the box goes to the top of it
+			float height = eye.z - box.min.z;
+			float tangent = height / (height >= 0.f ? minDist : maxDist);
+
+			const float binsPerAngle = NumAzimuthBins / 4.f;
+			int firstBin = (int)std::floor(minAngle * binsPerAngle);
+			int lastBin = (int)std::floor(maxAngle * binsPerAngle);
+			for (int i = firstBin; i <= lastBin; i++) {
+				if (!(horizon[i & (NumAzimuthBins - 1)] > tangent + HorizonMargin)) {
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+}
@@ -0,0 +1,114 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <Core/Math.h>
+
+namespace spades {
+	namespace client {
+		class GameMap;
+	}
+	namespace draw {
+		/**
+		 * Conservative CPU occlusion culling of map chunks by horizon culling.
+		 *
+		 * The map is divided into cells of `CellSize` x `CellSize` columns. Each
+		 * cell is solid from its ground level down to the bottom of the map,
+		 * which makes the cells a height field that can be used as occluders.
+		 * For every azimuth bin around the eye, the culler tracks the highest
+		 * elevation that is guaranteed to be blocked by the cells inserted so
+		 * far. A box is occluded if every ray from the eye to the box goes below
+		 * that horizon.
+		 *
+		 * This class doesn't use OpenGL and can be used on any thread.
+		 */
+		class GLMapOcclusionCuller {
+		public:
+			enum { CellSize = 4, CellSizeBits = 2, NumAzimuthBins = 1024 };
+
+			/** Returns `true` if the voxels of the cell containing the column
+			 * `(x, y)` (wrapped) are actually rendered. */
+			using OccluderFilter = std::function<bool(int x, int y)>;
+
+			GLMapOcclusionCuller(client::GameMap *);
+			~GLMapOcclusionCuller();
+
+			void GameMapChanged(int x, int y, int z, client::GameMap *);
+
+			/**
+			 * Starts culling for the given eye position.
+			 * @param range Cells with a point whose horizontal Chebyshev distance
+			 *              from `eye` is greater than this are not used as
+			 *              occluders.
+			 * @param filter Excludes cells whose voxels might not be visible
+			 *               on the screen.
+			 */
+			void Begin(const Vector3 &eye, float range, const OccluderFilter &filter);
+
+			/** Returns the horizontal distance between the eye and the nearest
+			 * point of `box`. */
+			float GetMinDistance(const AABB3 &box) const;
+
+			/**
+			 * Returns `true` if `box` is proven to be hidden by the terrain.
+			 * `box` is given in the unwrapped coordinate around the eye.
+			 * Boxes must be tested in the ascending order of `GetMinDistance`.
+			 */
+			bool IsOccluded(const AABB3 &box);
+
+		private:
+			struct Occluder {
+				float maxDistance;
+				// the maximum tangent of the elevation of the rays blocked by
+				// this occluder
+				float tangent;
+				int firstBin, lastBin;
+			};
+
+			client::GameMap *map;
+			int numCellsX, numCellsY;
+
+			// the Z coordinate of the top of the solid region of each cell.
+			// `Depth()` if the bottom voxel of a column is missing.
+			std::vector<uint8_t> groundLevels;
+
+			Vector3 eye;
+			bool active;
+
+			std::vector<Occluder> occluders;
+			std::size_t numInsertedOccluders;
+
+			std::vector<float> horizon;
+
+			int ComputeGroundLevel(int cellX, int cellY);
+
+			/** Computes the range of the pseudo-angles of the box's corners
+			 * as seen from the eye, or returns `false` if the eye is inside
+			 * the box horizontally. */
+			bool GetAngularSpan(float minX, float minY, float maxX, float maxY, float &minAngle,
+			                    float &maxAngle) const;
+		};
+	}
+}
@@ -18,13 +18,19 @@
 
  */
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include "GLMapRenderer.h"
 #include <Client/GameMap.h>
 #include <Core/Debug.h>
 #include <Core/Settings.h>
 #include "GLDynamicLightShader.h"
 #include "GLImage.h"
+#include "GLImageManager.h"
 #include "GLMapChunk.h"
+#include "GLMapOcclusionCuller.h"
 #include "GLMapShadowRenderer.h"
 #include "GLProfiler.h"
 #include "GLProgram.h"
@@ -40,9 +46,23 @@ SPADES_SETTING(cg_textures);
 SPADES_SETTING(cg_multiTextures);
 SPADES_SETTING(cg_textureStrength);
 // END OF ADDED
+SPADES_SETTING(cg_outlines);
 
 namespace spades {
 	namespace draw {
+		namespace {
+			/** Estimates the size in pixels of the artifacts of a chunk drawn at
+			 * the given level of detail. The surface moves by up to half a
+			 * cell, and the fog (Shaders/Fog.vs) hides most of it. */
+			float GetChunkLODError(int lod, float distance, float pixelsPerBlock) {
+				if (distance <= 0.f)
+					return std::numeric_limits<float>::infinity();
+				float error = (float)(1 << lod) * .5f * pixelsPerBlock / distance;
+				float fog = std::min(distance * distance * (1.f / 128.f / 128.f), 1.f);
+				return error * (1.f - fog);
+			}
+		}
+
 		void GLMapRenderer::PreloadShaders(spades::draw::GLRenderer *renderer) {
 			if (renderer->GetSettings().r_physicalLighting)
 				renderer->RegisterProgram("Shaders/BasicBlockPhys.program");
@@ -51,13 +71,19 @@ namespace spades {
 			renderer->RegisterProgram("Shaders/BasicBlockDepthOnly.program");
 			renderer->RegisterProgram("Shaders/BasicBlockDynamicLit.program");
 			renderer->RegisterProgram("Shaders/BackFaceBlock.program");
-			renderer->RegisterImage("Gfx/AmbientOcclusion.png");
+			renderer->GetImageManager()->RegisterImage("Gfx/AmbientOcclusion.png");
 		}
 
 		GLMapRenderer::GLMapRenderer(client::GameMap *m, GLRenderer *r) : renderer(r), gameMap(m) {
 			SPADES_MARK_FUNCTION();
 
 			device = renderer->GetGLDevice();
+			asyncMeshing = r->GetSettings().r_mapChunkAsyncMeshing;
+			loadingProgress = 0.f;
+			nearChunksLoaded = false;
+			greedyMeshing = false;
+			chunkLOD = false;
+			compactVertices = r->GetSettings().r_mapChunkCompactVertex;
 
 			numChunkWidth = gameMap->Width() / GLMapChunk::Size;
 			numChunkHeight = gameMap->Height() / GLMapChunk::Size;
@@ -68,9 +94,14 @@ namespace spades {
 			chunks = new GLMapChunk *[numChunks];
 			chunkInfos = new ChunkRenderInfo[numChunks];
 
-			for (int i = 0; i < numChunks; i++)
+			for (int i = 0; i < numChunks; i++) {
 				chunks[i] = new GLMapChunk(this, gameMap, i / numChunkDepth / numChunkHeight,
 				                           (i / numChunkDepth) % numChunkHeight, i % numChunkDepth);
+				chunkInfos[i].occluded = false;
+			}
+
+			occlusionCuller.reset(new GLMapOcclusionCuller(gameMap));
+			numOccludedChunks = 0;
 
 			if (r->GetSettings().r_physicalLighting)
 				basicProgram = renderer->RegisterProgram("Shaders/BasicBlockPhys.program");
@@ -93,11 +124,12 @@ namespace spades {
 			depthonlyProgram = renderer->RegisterProgram("Shaders/BasicBlockDepthOnly.program");
 			dlightProgram = renderer->RegisterProgram("Shaders/BasicBlockDynamicLit.program");
 			backfaceProgram = renderer->RegisterProgram("Shaders/BackFaceBlock.program");
-			aoImage = (GLImage *)renderer->RegisterImage("Gfx/AmbientOcclusion.png");
+			aoImage = renderer->GetImageManager()->RegisterImage("Gfx/AmbientOcclusion.png");
 
 			// ADDED: Load the map block images, init previous things
-			mapBlockImage = (GLImage *)renderer->RegisterImage("Textures/MapBlock.png");
-			multiMapBlockImage = (GLImage *)renderer->RegisterImage("Textures/MultiMapBlock.png");
+			mapBlockImage = renderer->GetImageManager()->RegisterImage("Textures/MapBlock.png");
+			multiMapBlockImage =
+			  renderer->GetImageManager()->RegisterImage("Textures/MultiMapBlock.png");
 			previous_cg_textures = cg_textures;
 			previous_cg_multiTextures = cg_multiTextures;
 			// END OF ADDED
@@ -114,6 +146,10 @@ namespace spades {
 			SPADES_MARK_FUNCTION();
 
 			device->DeleteBuffer(squareVertexBuffer);
+
+			// meshing tasks are owned by the chunks
+			meshingTasks.Wait();
+
 			for (int i = 0; i < numChunks; i++)
 				delete chunks[i];
 			delete[] chunks;
@@ -148,6 +184,27 @@ namespace spades {
 							GetChunk(xx, yy, zz)->SetNeedsUpdate();
 						}
 					}
+
+			occlusionCuller->GameMapChanged(x, y, z, map);
+
+			if (greedyMeshing) {
+				// A merged face bakes the map shadow of its texel into the mesh.
+				// The voxel changes the shadow texels (x, y - z - 1) and (x, y - z),
+				// which are sampled by the faces of the voxels in the columns x - 1
+				// to x + 1 whose Y - Z is between y - z - 1 and y - z + 1.
+				int diag = y - z;
+				for (int cx = (x - 1) >> GLMapChunk::SizeBits;
+				     cx <= (x + 1) >> GLMapChunk::SizeBits; cx++)
+					for (int cz = 0; cz < numChunkDepth; cz++) {
+						int minY = (cz << GLMapChunk::SizeBits) + diag - 1;
+						int maxY = (cz << GLMapChunk::SizeBits) + GLMapChunk::Size - 1 + diag + 1;
+						for (int cy = minY >> GLMapChunk::SizeBits;
+						     cy <= maxY >> GLMapChunk::SizeBits; cy++) {
+							GetChunk(cx & (numChunkWidth - 1), cy & (numChunkHeight - 1), cz)
+							  ->SetNeedsUpdate();
+						}
+					}
+			}
 		}
 
 		// ADDED: UpdateTextureMode
@@ -164,6 +221,22 @@ namespace spades {
 				previous_cg_textures = cg_textures;
 				previous_cg_multiTextures = cg_multiTextures;
 			}
+
+			// merged faces can't have per-face texture coordinates and would
+			// show up in the wireframe outlines
+			bool greedy = renderer->GetSettings().r_mapChunkGreedyMeshing &&
+			              !previous_cg_textures && !cg_outlines;
+			if (greedy != greedyMeshing) {
+				for (int i = 0; i < numChunks; i++) {
+					chunks[i]->SetNeedsUpdate();
+				}
+				greedyMeshing = greedy;
+			}
+
+			// the same applies to downsampled meshes. `SelectChunkLODs` rebuilds
+			// the chunks if needed
+			chunkLOD = renderer->GetSettings().r_mapChunkLOD && !previous_cg_textures &&
+			           !cg_outlines;
 		};
 		// END OF ADDED
 
@@ -182,11 +255,227 @@ namespace spades {
 			}
 		}
 
+		void GLMapRenderer::SelectChunkLODs() {
+			SPADES_MARK_FUNCTION();
+
+			float maxError = renderer->GetSettings().r_mapChunkLODError;
+			bool enabled = chunkLOD && maxError > 0.f;
+
+			const client::SceneDefinition &def = renderer->GetSceneDef();
+			float pixelsPerBlock = renderer->ScreenHeight() * .5f / tanf(def.fovY * .5f);
+
+			// keeps chunks near the threshold from switching back and forth
+			const float hysteresis = 2.f;
+
+			for (int i = 0; i < numChunks; i++) {
+				GLMapChunk *chunk = chunks[i];
+				if (!chunk->IsRealized())
+					continue;
+
+				int lod = 0;
+				for (int l = enabled ? GLMapChunk::MaxLOD : 0; l > 0; l--) {
+					float dist = chunkInfos[i].distance;
+					if (l > chunk->GetLOD())
+						dist -= hysteresis;
+					if (GetChunkLODError(l, dist, pixelsPerBlock) <= maxError) {
+						lod = l;
+						break;
+					}
+				}
+				chunk->SetLOD(lod);
+			}
+		}
+
+		void GLMapRenderer::SortChunkQueue() {
+			std::sort(chunkQueue.begin(), chunkQueue.end(),
+			          [](const std::pair<float, GLMapChunk *> &a,
+			             const std::pair<float, GLMapChunk *> &b) { return a.first < b.first; });
+		}
+
+		void GLMapRenderer::UpdateChunkMeshes() {
+			SPADES_MARK_FUNCTION();
+
+			// the time the main thread may spend on chunks every frame
+			double timeBudget =
+			  std::max((float)renderer->GetSettings().r_mapChunkTimeBudget, 0.f) / 1000.0;
+			Stopwatch sw;
+
+			bool async = renderer->GetSettings().r_mapChunkAsyncMeshing;
+			if (!async && asyncMeshing) {
+				// chunks are updated synchronously from now on; the results of the
+				// remaining tasks might be older than that
+				meshingTasks.Wait();
+				for (int i = 0; i < numChunks; i++)
+					chunks[i]->DiscardPendingMesh();
+			}
+			asyncMeshing = async;
+
+			if (!asyncMeshing) {
+				// build the outdated meshes, nearest first. The remaining chunks
+				// are drawn with their old meshes until later frames.
+				chunkQueue.clear();
+				for (int i = 0; i < numChunks; i++) {
+					if (chunks[i]->IsRealized() && !chunks[i]->IsMeshUpToDate())
+						chunkQueue.emplace_back(chunkInfos[i].distance, chunks[i]);
+				}
+				SortChunkQueue();
+
+				bool updated = false;
+				for (const auto &item : chunkQueue) {
+					// at least one chunk is updated every frame
+					if (updated && sw.GetTime() > timeBudget)
+						break;
+					item.second->Update();
+					updated = true;
+				}
+
+				UpdateLoadingProgress();
+				return;
+			}
+
+			// upload finished meshes, nearest first. The old buffers of the
+			// remaining chunks are used until they are uploaded in later frames.
+			chunkQueue.clear();
+			for (int i = 0; i < numChunks; i++) {
+				if (chunks[i]->HasPendingMesh())
+					chunkQueue.emplace_back(chunkInfos[i].distance, chunks[i]);
+			}
+			SortChunkQueue();
+
+			int budgetKB = std::max((int)renderer->GetSettings().r_mapChunkUploadBudget, 0);
+			std::size_t budget = static_cast<std::size_t>(budgetKB) * 1024;
+			std::size_t uploaded = 0;
+			for (const auto &item : chunkQueue) {
+				GLMapChunk *chunk = item.second;
+				std::size_t size = chunk->GetPendingMeshSize();
+				// at least one chunk is uploaded every frame
+				if (uploaded > 0 && (uploaded + size > budget || sw.GetTime() > timeBudget))
+					break;
+				chunk->UploadPendingMesh();
+				uploaded += size;
+			}
+
+			// start building the meshes of the modified chunks. The tasks are
+			// started in the order of distance so the nearest ones finish first.
+			chunkQueue.clear();
+			for (int i = 0; i < numChunks; i++) {
+				if (chunks[i]->IsRealized() && !chunks[i]->IsMeshUpToDate())
+					chunkQueue.emplace_back(chunkInfos[i].distance, chunks[i]);
+			}
+			SortChunkQueue();
+			for (const auto &item : chunkQueue)
+				item.second->StartMeshing(meshingTasks);
+
+			UpdateLoadingProgress();
+		}
+
+		void GLMapRenderer::UpdateLoadingProgress() {
+			if (loadingProgress >= 1.f) {
+				return;
+			}
+
+			// the camera is usually surrounded by these chunks when the map
+			// becomes playable
+			const float nearDistance = 32.f;
+
+			int numRealized = 0, numReady = 0;
+			int numNear = 0, numNearReady = 0;
+			for (int i = 0; i < numChunks; i++) {
+				GLMapChunk *chunk = chunks[i];
+				if (!chunk->IsRealized())
+					continue;
+				bool ready = chunk->IsMeshUpToDate();
+				numRealized++;
+				numReady += ready ? 1 : 0;
+				if (chunkInfos[i].distance < nearDistance) {
+					numNear++;
+					numNearReady += ready ? 1 : 0;
+				}
+			}
+
+			double time = loadingStopwatch.GetTime() * 1000.0;
+			if (!nearChunksLoaded && numNearReady == numNear) {
+				SPLog("Map chunks around the camera were ready %.1fms after the map was "
+				      "loaded (%d chunk(s))",
+				      time, numNear);
+				nearChunksLoaded = true;
+			}
+
+			if (numRealized == 0) {
+				return;
+			}
+			loadingProgress = (float)numReady / (float)numRealized;
+			if (loadingProgress >= 1.f) {
+				SPLog("All map chunks were ready %.1fms after the map was loaded (%d chunk(s))",
+				      time, numRealized);
+			}
+		}
+
+		void GLMapRenderer::CullOccludedChunks(spades::Vector3 eye) {
+			SPADES_MARK_FUNCTION();
+
+			for (int i = 0; i < numChunks; i++)
+				chunkInfos[i].occluded = false;
+			numOccludedChunks = 0;
+
+			if (!renderer->GetSettings().r_mapChunkOcclusionCulling) {
+				return;
+			}
+
+			GLProfiler::Context profiler(renderer->GetGLProfiler(), "Occlusion Culling");
+
+			// Only the cells whose chunks are drawn with the current map can
+			// hide other chunks. `RealizeChunks` realizes every chunk within
+			// 128 blocks, but their meshes might not be built yet.
+			float range = 128.f;
+			occlusionCuller->Begin(eye, range, [this](int x, int y) {
+				int cx = x >> GLMapChunk::SizeBits;
+				int cy = y >> GLMapChunk::SizeBits;
+				for (int cz = 0; cz < numChunkDepth; cz++) {
+					GLMapChunk *chunk = GetChunk(cx, cy, cz);
+					if (!chunk->IsMeshUpToDate())
+						return false;
+					// a downsampled mesh might have holes the map doesn't have
+					if (chunk->GetLOD() > 0)
+						return false;
+				}
+				return true;
+			});
+
+			// the culler needs the chunks ordered by their distance
+			occlusionCandidates.clear();
+			for (int i = 0; i < numChunks; i++) {
+				GLMapChunk *chunk = chunks[i];
+				// the bounding box of an outdated mesh might be too small
+				if (!chunk->IsMeshUpToDate() || chunk->IsEmpty())
+					continue;
+				float dist = occlusionCuller->GetMinDistance(chunk->GetAABBNearEye(eye));
+				occlusionCandidates.emplace_back(dist, i);
+			}
+			std::sort(occlusionCandidates.begin(), occlusionCandidates.end());
+
+			for (const auto &item : occlusionCandidates) {
+				int i = item.second;
+				if (occlusionCuller->IsOccluded(chunks[i]->GetAABBNearEye(eye))) {
+					chunkInfos[i].occluded = true;
+					numOccludedChunks++;
+				}
+			}
+		}
+
+		bool GLMapRenderer::IsChunkVisible(int index) {
+			// the mirrored scene is seen from another position
+			return !chunkInfos[index].occluded || renderer->IsRenderingMirror();
+		}
+
 		void GLMapRenderer::Realize() {
 			GLProfiler::Context profiler(renderer->GetGLProfiler(), "Map Chunks");
 
 			Vector3 eye = renderer->GetSceneDef().viewOrigin;
 			RealizeChunks(eye);
+			SelectChunkLODs();
+			UpdateChunkMeshes();
+			CullOccludedChunks(eye);
 		}
 
 		void GLMapRenderer::Prerender() {
@@ -233,7 +522,8 @@ namespace spades {
 		void GLMapRenderer::RenderSunlightPass() {
 			SPADES_MARK_FUNCTION();
 
-			GLProfiler::Context profiler(renderer->GetGLProfiler(), "Map");
+			GLProfiler::Context profiler(renderer->GetGLProfiler(), "Map [%d chunk(s) occluded]",
+			                             renderer->IsRenderingMirror() ? 0 : numOccludedChunks);
 
 			// ADDED: Determine if texturing this frame, set the program to use
 			if (previous_cg_textures) {
@@ -332,11 +622,25 @@ namespace spades {
 			static GLProgramAttribute normalAttribute("normalAttribute");
 			static GLProgramAttribute fixedPositionAttribute("fixedPositionAttribute");
 
+			// the compact vertex format replaces the fixed position and the
+			// texture coordinates with these
+			static GLProgramAttribute quadCoordAttribute("quadCoordAttribute");
+			static GLProgramAttribute textureTileAttribute("textureTileAttribute");
+
+			// the attributes that vary between the vertex formats
+			GLProgramAttribute *formatAttributes[2];
+			if (compactVertices) {
+				formatAttributes[0] = &quadCoordAttribute;
+				formatAttributes[1] = &textureTileAttribute;
+			} else {
+				formatAttributes[0] = &fixedPositionAttribute;
+				formatAttributes[1] = nullptr;
+			}
+
 			// ADDED: Setup the texture coordinate attribute
 			static GLProgramAttribute blockTexCoordAttribute("blockTexCoordAttribute");
-			if (previous_cg_textures) {
-				blockTexCoordAttribute(basicProgram);
-				device->EnableVertexAttribArray(blockTexCoordAttribute(), true);
+			if (previous_cg_textures && !compactVertices) {
+				formatAttributes[1] = &blockTexCoordAttribute;
 			}
 			// END OF ADDED
 
@@ -344,7 +648,6 @@ namespace spades {
 			ambientOcclusionCoordAttribute(basicProgram);
 			colorAttribute(basicProgram);
 			normalAttribute(basicProgram);
-			fixedPositionAttribute(basicProgram);
 
 			device->EnableVertexAttribArray(positionAttribute(), true);
 			if (ambientOcclusionCoordAttribute() != -1)
@@ -352,7 +655,10 @@ namespace spades {
 			device->EnableVertexAttribArray(colorAttribute(), true);
 			if (normalAttribute() != -1)
 				device->EnableVertexAttribArray(normalAttribute(), true);
-			device->EnableVertexAttribArray(fixedPositionAttribute(), true);
+			for (GLProgramAttribute *attribute : formatAttributes) {
+				if (attribute && (*attribute)(basicProgram) != -1)
+					device->EnableVertexAttribArray((*attribute)(), true);
+			}
 
 			static GLProgramUniform projectionViewMatrix("projectionViewMatrix");
 			projectionViewMatrix(basicProgram);
@@ -392,11 +698,13 @@ namespace spades {
 			device->EnableVertexAttribArray(colorAttribute(), false);
 			if (normalAttribute() != -1)
 				device->EnableVertexAttribArray(normalAttribute(), false);
-			device->EnableVertexAttribArray(fixedPositionAttribute(), false);
+			for (GLProgramAttribute *attribute : formatAttributes) {
+				if (attribute && (*attribute)() != -1)
+					device->EnableVertexAttribArray((*attribute)(), false);
+			}
 
 			// ADDED: Clean up texture stuff
 			if (previous_cg_textures) {
-				device->EnableVertexAttribArray(blockTexCoordAttribute(), false);
 
 				device->ActiveTexture(8);
 				device->BindTexture(IGLDevice::Texture2D, 0);
@@ -498,17 +806,21 @@ namespace spades {
 			cx &= numChunkWidth - 1;
 			cy &= numChunkHeight - 1;
 			for (int z = std::max(cz, 0); z < numChunkDepth; z++)
-				GetChunk(cx, cy, z)->RenderDepthPass();
+				if (IsChunkVisible(GetChunkIndex(cx, cy, z)))
+					GetChunk(cx, cy, z)->RenderDepthPass();
 			for (int z = std::min(cz - 1, 63); z >= 0; z--)
-				GetChunk(cx, cy, z)->RenderDepthPass();
+				if (IsChunkVisible(GetChunkIndex(cx, cy, z)))
+					GetChunk(cx, cy, z)->RenderDepthPass();
 		}
 		void GLMapRenderer::DrawColumnSunlight(int cx, int cy, int cz, spades::Vector3 eye) {
 			cx &= numChunkWidth - 1;
 			cy &= numChunkHeight - 1;
 			for (int z = std::max(cz, 0); z < numChunkDepth; z++)
-				GetChunk(cx, cy, z)->RenderSunlightPass();
+				if (IsChunkVisible(GetChunkIndex(cx, cy, z)))
+					GetChunk(cx, cy, z)->RenderSunlightPass();
 			for (int z = std::min(cz - 1, 63); z >= 0; z--)
-				GetChunk(cx, cy, z)->RenderSunlightPass();
+				if (IsChunkVisible(GetChunkIndex(cx, cy, z)))
+					GetChunk(cx, cy, z)->RenderSunlightPass();
 		}
 
 		// ADDED: RenderOutlinePass definition
@@ -577,9 +889,11 @@ namespace spades {
 			cx &= numChunkWidth - 1;
 			cy &= numChunkHeight - 1;
 			for (int z = std::max(cz, 0); z < numChunkDepth; z++)
-				GetChunk(cx, cy, z)->RenderDLightPass(lights);
+				if (IsChunkVisible(GetChunkIndex(cx, cy, z)))
+					GetChunk(cx, cy, z)->RenderDLightPass(lights);
 			for (int z = std::min(cz - 1, 63); z >= 0; z--)
-				GetChunk(cx, cy, z)->RenderDLightPass(lights);
+				if (IsChunkVisible(GetChunkIndex(cx, cy, z)))
+					GetChunk(cx, cy, z)->RenderDLightPass(lights);
 		}
 
 		// ADDED: DrawColumnOutlines definition
@@ -587,9 +901,11 @@ namespace spades {
 			cx &= numChunkWidth - 1;
 			cy &= numChunkHeight - 1;
 			for (int z = std::max(cz, 0); z < numChunkDepth; z++)
-				GetChunk(cx, cy, z)->RenderOutlinesPass();
+				if (IsChunkVisible(GetChunkIndex(cx, cy, z)))
+					GetChunk(cx, cy, z)->RenderOutlinesPass();
 			for (int z = std::min(cz - 1, 63); z >= 0; z--)
-				GetChunk(cx, cy, z)->RenderOutlinesPass();
+				if (IsChunkVisible(GetChunkIndex(cx, cy, z)))
+					GetChunk(cx, cy, z)->RenderOutlinesPass();
 		}
 		// END OF ADDED
 
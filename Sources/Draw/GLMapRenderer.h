@@ -20,9 +20,13 @@
 
 #pragma once
 
+#include <memory>
+
 #include <Client/IGameMapListener.h>
 #include <Client/IRenderer.h>
 #include <Core/Math.h>
+#include <Core/Stopwatch.h>
+#include <Core/TaskScheduler.h>
 #include "GLDynamicLight.h"
 #include "IGLDevice.h"
 
@@ -32,6 +36,7 @@ namespace spades {
 		class GLMapChunk;
 		class GLProgram;
 		class GLImage;
+		class GLMapOcclusionCuller;
 		class GLMapRenderer {
 
 			friend class GLMapChunk;
@@ -62,12 +67,42 @@ namespace spades {
 			struct ChunkRenderInfo {
 				bool rendered;
 				float distance;
+				// hidden by the terrain (r_mapChunkOcclusionCulling)
+				bool occluded;
 			};
 			GLMapChunk **chunks;
 			ChunkRenderInfo *chunkInfos;
 
 			client::GameMap *gameMap;
 
+			// chunk meshes are built by worker tasks (r_mapChunkAsyncMeshing)
+			bool asyncMeshing;
+			TaskGroup meshingTasks;
+
+			// chunks sorted by their distance, reused every frame
+			std::vector<std::pair<float, GLMapChunk *>> chunkQueue;
+
+			// the chunks realized after the map was loaded (see
+			// `UpdateLoadingProgress`)
+			Stopwatch loadingStopwatch;
+			float loadingProgress;
+			bool nearChunksLoaded;
+
+			// coplanar faces are merged (r_mapChunkGreedyMeshing); only used
+			// when no per-face attributes are needed
+			bool greedyMeshing;
+
+			// chunks use `GLMapChunk::CompactVertex` (r_mapChunkCompactVertex)
+			bool compactVertices;
+
+			// distant chunks are downsampled (r_mapChunkLOD); only used when
+			// no per-face attributes are needed
+			bool chunkLOD;
+
+			std::unique_ptr<GLMapOcclusionCuller> occlusionCuller;
+			std::vector<std::pair<float, int>> occlusionCandidates;
+			int numOccludedChunks;
+
 			int numChunkWidth, numChunkHeight;
 			int numChunkDepth, numChunks;
 
@@ -80,6 +115,15 @@ namespace spades {
 			}
 
 			void RealizeChunks(Vector3 eye);
+			void SelectChunkLODs();
+			void UpdateChunkMeshes();
+			void SortChunkQueue();
+			void UpdateLoadingProgress();
+			void CullOccludedChunks(Vector3 eye);
+
+			/** Returns `false` if the chunk was found to be hidden by
+			 * `CullOccludedChunks`. */
+			bool IsChunkVisible(int index);
 
 			void DrawColumnDepth(int cx, int cy, int cz, Vector3 eye);
 			void DrawColumnSunlight(int cx, int cy, int cz, Vector3 eye);
@@ -107,6 +151,11 @@ namespace spades {
 			// END OF ADDED
 
 			void Realize();
+
+			/** Returns the fraction of the chunks around the camera that had
+			 * their first mesh built since the map was loaded. Stays at 1 once
+			 * all of them are built. */
+			float GetLoadingProgress() { return loadingProgress; }
 			void Prerender();
 			void RenderSunlightPass();
 			void RenderDynamicLightPass(std::vector<GLDynamicLight> lights);
@@ -18,9 +18,12 @@
 
  */
 
+#include <algorithm>
+
 #include "GLMapShadowRenderer.h"
 #include <Client/GameMap.h>
 #include <Core/Debug.h>
+#include <Core/TraceRecorder.h>
 #include "GLProfiler.h"
 #include "GLRadiosityRenderer.h"
 #include "GLRenderer.h"
@@ -28,6 +31,24 @@
 
 namespace spades {
 	namespace draw {
+		class GLMapShadowRenderer::UpdateTask : public Task {
+			GLMapShadowRenderer &renderer;
+
+		protected:
+			void Execute() override {
+				SPADES_MARK_FUNCTION();
+				SPADES_TRACE_SCOPE("GLMapShadowRenderer::UpdateBand");
+
+				renderer.UpdateBand(band, changes);
+			}
+
+		public:
+			int band;
+			std::vector<Change> changes;
+
+			UpdateTask(GLMapShadowRenderer &r, int band) : renderer(r), band(band) {}
+		};
+
 		GLMapShadowRenderer::GLMapShadowRenderer(GLRenderer *renderer, client::GameMap *map)
 		    : renderer(renderer), device(renderer->GetGLDevice()), map(map) {
 			SPADES_MARK_FUNCTION();
@@ -62,10 +83,16 @@ namespace spades {
 			updateBitmap.resize(updateBitmapPitch * h);
 
 			coarseBitmap.resize((w * h) >> (CoarseBits * 2));
+			coarseUpdateBitmap.resize(coarseBitmap.size());
 
 			bitmap.resize(w * h);
 			std::fill(updateBitmap.begin(), updateBitmap.end(), 0xffffffffUL);
 			std::fill(bitmap.begin(), bitmap.end(), 0xffffffffUL);
+
+			SPAssert(h % BandSize == 0);
+			for (int i = 0; i < h / BandSize; i++) {
+				tasks.emplace_back(new UpdateTask(*this, i));
+			}
 		}
 
 		GLMapShadowRenderer::~GLMapShadowRenderer() {
@@ -81,48 +108,61 @@ namespace spades {
 			GLProfiler::Context profiler(renderer->GetGLProfiler(), "Terrain Shadow Map");
 			GLRadiosityRenderer *radiosity = renderer->GetRadiosityRenderer();
 
-			std::vector<uint8_t> coarseUpdateBitmap;
-			coarseUpdateBitmap.resize(coarseBitmap.size());
 			std::fill(coarseUpdateBitmap.begin(), coarseUpdateBitmap.end(), 0);
 
-			device->BindTexture(IGLDevice::Texture2D, texture);
-			for (size_t i = 0; i < updateBitmap.size(); i++) {
-				int y = static_cast<int>(i / updateBitmapPitch);
-				int x = static_cast<int>((i - y * updateBitmapPitch) * 32);
-				if (updateBitmap[i] == 0)
-					continue;
-
-				size_t bitmapPixelPosBase = i * 32;
-
-				uint32_t pixels[32];
-				bool modified = false;
-				for (int j = 0; j < 32; j++) {
-					pixels[j] = GeneratePixel(x + j, y);
-					if (bitmap[bitmapPixelPosBase + j] != pixels[j]) {
-						if (radiosity) {
-							int dist = pixels[j] >> 24;
-							radiosity->GameMapChanged(x + j, (y + dist) & (h - 1), dist, map);
+			// update the bands with a marked column on the worker threads
+			TaskGroup group;
+			std::size_t bandWords = updateBitmapPitch * BandSize;
+			for (const auto &task : tasks) {
+				task->changes.clear();
 
-							dist = bitmap[bitmapPixelPosBase + j] >> 24;
-							radiosity->GameMapChanged(x + j, (y + dist) & (h - 1), dist, map);
-						}
-						bitmap[bitmapPixelPosBase + j] = pixels[j];
-						modified = true;
+				const uint32_t *words = updateBitmap.data() + bandWords * task->band;
+				if (std::any_of(words, words + bandWords, [](uint32_t word) { return word != 0; }))
+					group.Run(*task);
+			}
+			group.Wait();
+
+			// the rows with a modified pixel and the modified range of each row
+			std::vector<int> modifiedMinX(h, w), modifiedMaxX(h, -1);
+			for (const auto &task : tasks) {
+				for (const Change &change : task->changes) {
+					int x = static_cast<int>(change.index % w);
+					int y = static_cast<int>(change.index / w);
+					if (radiosity) {
+						int dist = change.newPixel >> 24;
+						radiosity->GameMapChanged(x, (y + dist) & (h - 1), dist, map);
+
+						dist = change.oldPixel >> 24;
+						radiosity->GameMapChanged(x, (y + dist) & (h - 1), dist, map);
 					}
+					coarseUpdateBitmap[(x >> CoarseBits) + (y >> CoarseBits) * (w >> CoarseBits)] =
+					  1;
+					modifiedMinX[y] = std::min(modifiedMinX[y], x);
+					modifiedMaxX[y] = std::max(modifiedMaxX[y], x);
 				}
+			}
 
-				if (modified) {
-					if (!coarseUpdateBitmap[(x >> CoarseBits) +
-					                        (y >> CoarseBits) * (w >> CoarseBits)])
-						for (int j = 0; j < 32; j += CoarseSize)
-							coarseUpdateBitmap[((x + j) >> CoarseBits) +
-							                   (y >> CoarseBits) * (w >> CoarseBits)] = 1;
-
-					device->TexSubImage2D(IGLDevice::Texture2D, 0, x, y, 32, 1, IGLDevice::RGBA,
-					                      IGLDevice::UnsignedByte, pixels);
+			// upload the modified rows. consecutive rows are uploaded at once.
+			device->BindTexture(IGLDevice::Texture2D, texture);
+			for (int y = 0; y < h;) {
+				if (modifiedMaxX[y] < 0) {
+					y++;
+					continue;
 				}
 
-				updateBitmap[i] = 0;
+				int numRows = 1;
+				while (y + numRows < h && modifiedMaxX[y + numRows] >= 0)
+					numRows++;
+
+				int minX = 0, width = w;
+				if (numRows == 1) {
+					minX = modifiedMinX[y];
+					width = modifiedMaxX[y] - minX + 1;
+				}
+				device->TexSubImage2D(IGLDevice::Texture2D, 0, minX, y, width, numRows,
+				                      IGLDevice::RGBA, IGLDevice::UnsignedByte,
+				                      bitmap.data() + minX + y * w);
+				y += numRows;
 			}
 
 			{
@@ -195,25 +235,76 @@ namespace spades {
 			       (ex3 << 23);
 		}
 
-		uint32_t GLMapShadowRenderer::GeneratePixel(int x, int y) {
-			for (int z = 0; z < d; z++) {
-				// z-plane hit
-				if (map->IsSolid(x, y, z) && z < 63) {
-					return BuildPixel(z, map->GetColor(x, y, z), false);
-					// return (uint8_t)z;
+		void GLMapShadowRenderer::UpdateBand(int band, std::vector<Change> &changes) {
+			SPADES_MARK_FUNCTION();
+
+			// The pixel (x, y) is the first voxel hit by the ray going through
+			// (x, y + z, z) and (x, y + z + 1, z) for each z. Gather these voxels
+			// as "diagonal" bit masks so they can be found with bit scans.
+			// diagonals[i] has bit z set if the voxel (x, minY + i + z, z) is
+			// solid. Voxels at z = 63 are never hit.
+			const int numDiagonals = BandSize + 1;
+			const int numColumns = numDiagonals + 63;
+			const uint64_t hitMask = (1ULL << 63) - 1;
+			uint64_t diagonals[numColumns];
+
+			SPAssert(d == 64);
+
+			int minY = band * BandSize;
+			for (std::size_t wx = 0; wx < updateBitmapPitch; wx++) {
+				uint32_t markedColumns = 0;
+				for (int y = minY; y < minY + BandSize; y++) {
+					uint32_t &word = updateBitmap[wx + y * updateBitmapPitch];
+					markedColumns |= word;
+					word = 0;
 				}
 
-				y = y + 1;
-				if (y == h)
-					y = 0;
+				while (markedColumns) {
+					int x = static_cast<int>(wx * 32) + CountTrailingZeros(markedColumns);
+					markedColumns &= markedColumns - 1;
 
-				// y-plane hit
-				if (map->IsSolid(x, y, z) && z < 63) {
-					return BuildPixel(z + 1, map->GetColor(x, y, z), true);
-					// return (uint8_t)z + 1;
+					for (int i = 0; i < numColumns; i++)
+						diagonals[i] = map->GetSolidMapWrapped(x, minY + i);
+
+					// shift the bit z of each column by z columns, one bit of z at a time
+					for (int bit = 0; bit < 6; bit++) {
+						int shift = 1 << bit;
+						uint64_t mask = 0;
+						for (int z = 0; z < 64; z++) {
+							if (z & shift)
+								mask |= 1ULL << z;
+						}
+						for (int i = 0; i + shift < numColumns; i++)
+							diagonals[i] = (diagonals[i] & ~mask) | (diagonals[i + shift] & mask);
+					}
+
+					for (int i = 0; i < BandSize; i++) {
+						int y = minY + i;
+						uint64_t zPlaneHits = diagonals[i] & hitMask;
+						uint64_t yPlaneHits = diagonals[i + 1] & hitMask;
+						int zPlaneHit = zPlaneHits ? CountTrailingZeros(zPlaneHits) : 64;
+						int yPlaneHit = yPlaneHits ? CountTrailingZeros(yPlaneHits) : 64;
+
+						uint32_t pixel;
+						if (zPlaneHit < 64 && zPlaneHit <= yPlaneHit) {
+							int z = zPlaneHit;
+							pixel = BuildPixel(z, map->GetColorWrapped(x, y + z, z), false);
+						} else if (yPlaneHit < 64) {
+							int z = yPlaneHit;
+							pixel =
+							  BuildPixel(z + 1, map->GetColorWrapped(x, y + z + 1, z), true);
+						} else {
+							pixel = BuildPixel(64, map->GetColorWrapped(x, y + 64, 63), false);
+						}
+
+						std::size_t index = static_cast<std::size_t>(x + y * w);
+						if (bitmap[index] != pixel) {
+							changes.push_back(Change{index, bitmap[index], pixel});
+							bitmap[index] = pixel;
+						}
+					}
 				}
 			}
-			return BuildPixel(64, map->GetColor(x, y == h ? 0 : y, 63), false);
 		}
 
 		void GLMapShadowRenderer::MarkUpdate(int x, int y) {
@@ -21,8 +21,10 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
+#include <Core/TaskScheduler.h>
 #include "IGLDevice.h"
 
 namespace spades {
@@ -36,8 +38,18 @@ namespace spades {
 		class GLMapShadowRenderer {
 			friend class GLRadiosityRenderer;
 
+			class UpdateTask;
 			enum { CoarseSize = 8, CoarseBits = 3 };
 
+			// the number of the rows updated by an `UpdateTask`
+			enum { BandSize = 32 };
+
+			struct Change {
+				std::size_t index;
+				uint32_t oldPixel;
+				uint32_t newPixel;
+			};
+
 			GLRenderer *renderer;
 			IGLDevice *device;
 			client::GameMap *map;
@@ -51,8 +63,18 @@ namespace spades {
 
 			std::vector<uint32_t> bitmap;
 			std::vector<uint32_t> coarseBitmap;
-
-			uint32_t GeneratePixel(int x, int y);
+			std::vector<uint8_t> coarseUpdateBitmap;
+
+			std::vector<std::unique_ptr<UpdateTask>> tasks;
+
+			/**
+			 * Recomputes the pixels of the marked columns in the rows
+			 * `[band * BandSize, (band + 1) * BandSize)` and clears the marks.
+			 * Can be called on any thread as long as no other band is being
+			 * updated by the calling thread.
+			 * @param changes Receives the modified pixels.
+			 */
+			void UpdateBand(int band, std::vector<Change> &changes);
 			void MarkUpdate(int x, int y);
 
 		public:
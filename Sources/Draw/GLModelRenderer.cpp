@@ -164,17 +164,25 @@ namespace spades {
 			// set up the occlusion query
 			device->ColorMask(false, false, false, false);
 			device->DepthMask(false);
+			// group the instances by player first so that each query only
+			// renders the models the player actually has, each of them by a
+			// single (instanced) draw
+			std::vector<std::vector<client::ModelRenderParam>> playerParams(models.size() * 32);
+			for (size_t j = 0; j < models.size(); ++j) {
+				for (const client::ModelRenderParam &p : models[j].params) {
+					if (p.playerID >= 0 && p.playerID < 32) {
+						playerParams[p.playerID * models.size() + j].push_back(p);
+					}
+				}
+			}
 			// iterate every player and get the new occlusion query going
 			for (int i = 0; i < 32; ++i) {
 				device->BeginQuery(IGLDevice::SamplesPassed, playerVisibilityQueries[i]);
-				for (RenderModel &m : models) {
-					std::vector<client::ModelRenderParam> playerParams;
-					for (client::ModelRenderParam p : m.params) {
-						if (p.playerID == i) {
-							playerParams.push_back(p);
-						}
+				for (size_t j = 0; j < models.size(); ++j) {
+					const auto &params = playerParams[i * models.size() + j];
+					if (!params.empty()) {
+						models[j].model->RenderOcclusionTestPass(params, false);
 					}
-					m.model->RenderOcclusionTestPass(playerParams, false);
 				}
 				device->EndQuery(IGLDevice::SamplesPassed);
 			}
@@ -18,6 +18,7 @@
 
  */
 
+#include <cstddef>
 #include <set>
 
 #include <Core/Bitmap.h>
@@ -27,22 +28,39 @@
 #include "CellToTriangle.h"
 #include "GLDynamicLightShader.h"
 #include "GLImage.h"
+#include "GLImageManager.h"
 #include "GLOptimizedVoxelModel.h"
 #include "GLProgram.h"
 #include "GLProgramAttribute.h"
 #include "GLProgramUniform.h"
 #include "GLRenderer.h"
+#include "GLSettings.h"
 #include "GLShadowMapShader.h"
 #include "GLShadowShader.h"
 #include "IGLShadowMapRenderer.h"
 
 namespace spades {
 	namespace draw {
+		namespace {
+			std::string GetProgramName(const char *name, bool instancing) {
+				return std::string("Shaders/OptimizedVoxelModel") + name +
+				       (instancing ? "Instanced.program" : ".program");
+			}
+		}
+
+		GLOptimizedVoxelModel::InstanceAttributes::InstanceAttributes(bool useCustomColor)
+		    : modelMatrixRows{GLProgramAttribute("modelMatrixRow0Attribute"),
+		                      GLProgramAttribute("modelMatrixRow1Attribute"),
+		                      GLProgramAttribute("modelMatrixRow2Attribute")},
+		      customColor("customColorAttribute"),
+		      useCustomColor(useCustomColor) {}
+
 		void GLOptimizedVoxelModel::PreloadShaders(spades::draw::GLRenderer *renderer) {
-			renderer->RegisterProgram("Shaders/OptimizedVoxelModel.program");
-			renderer->RegisterProgram("Shaders/OptimizedVoxelModelDynamicLit.program");
-			renderer->RegisterProgram("Shaders/OptimizedVoxelModelShadowMap.program");
-			renderer->RegisterImage("Gfx/AmbientOcclusion.png");
+			bool instancing = renderer->GetSettings().r_modelInstancing;
+			renderer->RegisterProgram(GetProgramName("", instancing));
+			renderer->RegisterProgram(GetProgramName("DynamicLit", instancing));
+			renderer->RegisterProgram(GetProgramName("ShadowMap", instancing));
+			renderer->GetImageManager()->RegisterImage("Gfx/AmbientOcclusion.png");
 		}
 		GLOptimizedVoxelModel::GLOptimizedVoxelModel(VoxelModel *m, GLRenderer *r) {
 			SPADES_MARK_FUNCTION();
@@ -53,20 +71,21 @@ namespace spades {
 			BuildVertices(m);
 			GenerateTexture();
 
-			program = renderer->RegisterProgram("Shaders/OptimizedVoxelModel.program");
-			dlightProgram =
-			  renderer->RegisterProgram("Shaders/OptimizedVoxelModelDynamicLit.program");
+			useInstancing = renderer->GetSettings().r_modelInstancing;
+
+			program = renderer->RegisterProgram(GetProgramName("", useInstancing));
+			dlightProgram = renderer->RegisterProgram(GetProgramName("DynamicLit", useInstancing));
 			shadowMapProgram =
-			  renderer->RegisterProgram("Shaders/OptimizedVoxelModelShadowMap.program");
-			aoImage = (GLImage *)renderer->RegisterImage("Gfx/AmbientOcclusion.png");
+			  renderer->RegisterProgram(GetProgramName("ShadowMap", useInstancing));
+			aoImage = renderer->GetImageManager()->RegisterImage("Gfx/AmbientOcclusion.png");
 
 			// ADDED: Load the outlines/occluded program
 			optimizedVoxelModelOutlinesProgram =
-			  renderer->RegisterProgram("Shaders/OptimizedVoxelModelOutlines.program");
+			  renderer->RegisterProgram(GetProgramName("Outlines", useInstancing));
 			optimizedVoxelModelOccludedProgram =
-			  renderer->RegisterProgram("Shaders/OptimizedVoxelModelOccluded.program");
+			  renderer->RegisterProgram(GetProgramName("Occluded", useInstancing));
 			optimizedVoxelModelOcclusionTestProgram =
-			  renderer->RegisterProgram("Shaders/OptimizedVoxelModelOcclusionTest.program");
+			  renderer->RegisterProgram(GetProgramName("OcclusionTest", useInstancing));
 			// END OF ADDED
 
 			buffer = device->GenBuffer();
@@ -82,6 +101,8 @@ namespace spades {
 			                   indices.data(), IGLDevice::StaticDraw);
 			device->BindBuffer(IGLDevice::ArrayBuffer, 0);
 
+			instanceBuffer = useInstancing ? device->GenBuffer() : 0;
+
 			origin = m->GetOrigin();
 			origin -= .5f; // (0,0,0) is center of voxel (0,0,0)
 
@@ -108,6 +129,9 @@ namespace spades {
 			image->Release();
 			device->DeleteBuffer(idxBuffer);
 			device->DeleteBuffer(buffer);
+			if (instanceBuffer) {
+				device->DeleteBuffer(instanceBuffer);
+			}
 		}
 
 		void GLOptimizedVoxelModel::GenerateTexture() {
@@ -520,6 +544,97 @@ namespace spades {
 			printf("%d vertices emit\n", (int)indices.size());
 		}
 
+		bool GLOptimizedVoxelModel::IsInstanceVisible(const client::ModelRenderParam &param,
+		                                              bool farRender) {
+			if (param.depthHack && renderer->IsRenderingMirror()) {
+				return false;
+			}
+			if (farRender) {
+				return true;
+			}
+			float rad = radius * param.matrix.GetAxis(0).GetLength();
+			return renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad);
+		}
+
+		template <class Filter>
+		void GLOptimizedVoxelModel::RenderInstances(
+		  GLProgram *program, InstanceAttributes &attributes,
+		  const std::vector<client::ModelRenderParam> &params, Filter filter) {
+			SPADES_MARK_FUNCTION();
+
+			int locations[4];
+			for (int i = 0; i < 3; i++) {
+				locations[i] = attributes.modelMatrixRows[i](program);
+			}
+			locations[3] = attributes.useCustomColor ? attributes.customColor(program) : -1;
+
+			for (int depthHack = 0; depthHack < 2; depthHack++) {
+				instances.clear();
+				for (const client::ModelRenderParam &param : params) {
+					if (param.depthHack != (depthHack != 0) || !filter(param)) {
+						continue;
+					}
+
+					const Matrix4 &matrix = param.matrix;
+					Instance instance;
+					for (int row = 0; row < 3; row++) {
+						for (int col = 0; col < 4; col++) {
+							instance.modelMatrix[row * 4 + col] = matrix.m[col * 4 + row];
+						}
+					}
+					instance.customColor[0] = param.customColor.x;
+					instance.customColor[1] = param.customColor.y;
+					instance.customColor[2] = param.customColor.z;
+					instance.customColor[3] = 0.f;
+					instances.push_back(instance);
+				}
+				if (instances.empty()) {
+					continue;
+				}
+
+				device->BindBuffer(IGLDevice::ArrayBuffer, instanceBuffer);
+				device->BufferData(
+				  IGLDevice::ArrayBuffer,
+				  static_cast<IGLDevice::Sizei>(instances.size() * sizeof(Instance)),
+				  instances.data(), IGLDevice::StreamDraw);
+				for (int i = 0; i < 4; i++) {
+					if (locations[i] == -1) {
+						continue;
+					}
+					if (i < 3) {
+						device->VertexAttribPointer(locations[i], 4, IGLDevice::FloatType, false,
+						                            sizeof(Instance),
+						                            (void *)(sizeof(float) * 4 * i));
+					} else {
+						device->VertexAttribPointer(locations[i], 3, IGLDevice::FloatType, false,
+						                            sizeof(Instance),
+						                            (void *)offsetof(Instance, customColor));
+					}
+					device->EnableVertexAttribArray(locations[i], true);
+					device->VertexAttribDivisor(locations[i], 1);
+				}
+				device->BindBuffer(IGLDevice::ArrayBuffer, 0);
+
+				if (depthHack) {
+					device->DepthRange(0.f, 0.1f);
+				}
+				device->DrawElementsInstanced(IGLDevice::Triangles, numIndices,
+				                              IGLDevice::UnsignedInt, (void *)0,
+				                              static_cast<IGLDevice::Sizei>(instances.size()));
+				if (depthHack) {
+					device->DepthRange(0.f, 1.f);
+				}
+
+				// the attribute slots are shared with other programs
+				for (int i = 0; i < 4; i++) {
+					if (locations[i] != -1) {
+						device->VertexAttribDivisor(locations[i], 0);
+						device->EnableVertexAttribArray(locations[i], false);
+					}
+				}
+			}
+		}
+
 		void GLOptimizedVoxelModel::Prerender(std::vector<client::ModelRenderParam> params) {
 			SPADES_MARK_FUNCTION();
 
@@ -564,35 +679,47 @@ namespace spades {
 
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, idxBuffer);
 
-			for (size_t i = 0; i < params.size(); i++) {
-				const client::ModelRenderParam &param = params[i];
-
-				// frustrum cull
-				float rad = radius;
-				rad *= param.matrix.GetAxis(0).GetLength();
+			if (useInstancing) {
+				static InstanceAttributes instanceAttributes(false);
+				IGLShadowMapRenderer *shadowMapRenderer = renderer->GetShadowMapRenderer();
+				auto filter = [&](const client::ModelRenderParam &param) {
+					float rad = radius * param.matrix.GetAxis(0).GetLength();
+					return !param.depthHack &&
+					       shadowMapRenderer->SphereCull(param.matrix.GetOrigin(), rad);
+				};
+				RenderInstances(shadowMapProgram, instanceAttributes, params, filter);
+			} else {
+				for (size_t i = 0; i < params.size(); i++) {
+					const client::ModelRenderParam &param = params[i];
+
+					// frustrum cull
+					float rad = radius;
+					rad *= param.matrix.GetAxis(0).GetLength();
 
-				if (param.depthHack)
-					continue;
+					if (param.depthHack)
+						continue;
 
-				if (!renderer->GetShadowMapRenderer()->SphereCull(param.matrix.GetOrigin(), rad)) {
-					continue;
-				}
+					if (!renderer->GetShadowMapRenderer()->SphereCull(param.matrix.GetOrigin(),
+					                                                   rad)) {
+						continue;
+					}
 
-				Matrix4 modelMatrix = param.matrix;
+					Matrix4 modelMatrix = param.matrix;
 
-				static GLProgramUniform modelMatrixU("modelMatrix");
-				modelMatrixU(shadowMapProgram);
-				modelMatrixU.SetValue(modelMatrix);
+					static GLProgramUniform modelMatrixU("modelMatrix");
+					modelMatrixU(shadowMapProgram);
+					modelMatrixU.SetValue(modelMatrix);
 
-				modelMatrix.m[12] = 0.f;
-				modelMatrix.m[13] = 0.f;
-				modelMatrix.m[14] = 0.f;
-				static GLProgramUniform modelNormalMatrix("modelNormalMatrix");
-				modelNormalMatrix(shadowMapProgram);
-				modelNormalMatrix.SetValue(modelMatrix);
+					modelMatrix.m[12] = 0.f;
+					modelMatrix.m[13] = 0.f;
+					modelMatrix.m[14] = 0.f;
+					static GLProgramUniform modelNormalMatrix("modelNormalMatrix");
+					modelNormalMatrix(shadowMapProgram);
+					modelNormalMatrix.SetValue(modelMatrix);
 
-				device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
-				                     (void *)0);
+					device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
+					                     (void *)0);
+				}
 			}
 
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, 0);
@@ -693,56 +820,66 @@ namespace spades {
 
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, idxBuffer);
 
-			for (size_t i = 0; i < params.size(); i++) {
-				const client::ModelRenderParam &param = params[i];
-
-				if (mirror && param.depthHack)
-					continue;
-
-				// frustrum cull
-				float rad = radius;
-				if (!farRender) {
-					rad *= param.matrix.GetAxis(0).GetLength();
-					if (!renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad)) {
+			if (useInstancing) {
+				static InstanceAttributes instanceAttributes(true);
+				static GLProgramUniform projectionViewMatrix("projectionViewMatrix");
+				projectionViewMatrix(program);
+				projectionViewMatrix.SetValue(farRender ? renderer->farProjectionViewMatrix
+				                                        : renderer->GetProjectionViewMatrix());
+
+				auto filter = [&](const client::ModelRenderParam &param) {
+					return IsInstanceVisible(param, farRender);
+				};
+				RenderInstances(program, instanceAttributes, params, filter);
+			} else {
+				for (size_t i = 0; i < params.size(); i++) {
+					const client::ModelRenderParam &param = params[i];
+
+					if (mirror && param.depthHack)
 						continue;
+
+					// frustrum cull
+					float rad = radius;
+					if (!farRender) {
+						rad *= param.matrix.GetAxis(0).GetLength();
+						if (!renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad)) {
+							continue;
+						}
 					}
-				}
 
-				static GLProgramUniform customColor("customColor");
-				customColor(program);
-				customColor.SetValue(param.customColor.x, param.customColor.y, param.customColor.z);
-
-				Matrix4 modelMatrix = param.matrix;
-				static GLProgramUniform projectionViewModelMatrix("projectionViewModelMatrix");
-				projectionViewModelMatrix(program);
-				projectionViewModelMatrix.SetValue((farRender
-				                                      ? renderer->farProjectionViewMatrix
-				                                      : renderer->GetProjectionViewMatrix()) *
-				                                   modelMatrix);
-
-				static GLProgramUniform viewModelMatrix("viewModelMatrix");
-				viewModelMatrix(program);
-				viewModelMatrix.SetValue(renderer->GetViewMatrix() * modelMatrix);
-
-				static GLProgramUniform modelMatrixU("modelMatrix");
-				modelMatrixU(program);
-				modelMatrixU.SetValue(modelMatrix);
-
-				modelMatrix.m[12] = 0.f;
-				modelMatrix.m[13] = 0.f;
-				modelMatrix.m[14] = 0.f;
-				static GLProgramUniform modelNormalMatrix("modelNormalMatrix");
-				modelNormalMatrix(program);
-				modelNormalMatrix.SetValue(modelMatrix);
-
-				if (param.depthHack) {
-					device->DepthRange(0.f, 0.1f);
-				}
+					static GLProgramUniform customColor("customColor");
+					customColor(program);
+					customColor.SetValue(param.customColor.x, param.customColor.y,
+					                     param.customColor.z);
+
+					Matrix4 modelMatrix = param.matrix;
+					static GLProgramUniform projectionViewModelMatrix("projectionViewModelMatrix");
+					projectionViewModelMatrix(program);
+					projectionViewModelMatrix.SetValue((farRender
+					                                      ? renderer->farProjectionViewMatrix
+					                                      : renderer->GetProjectionViewMatrix()) *
+					                                   modelMatrix);
+
+					static GLProgramUniform modelMatrixU("modelMatrix");
+					modelMatrixU(program);
+					modelMatrixU.SetValue(modelMatrix);
+
+					modelMatrix.m[12] = 0.f;
+					modelMatrix.m[13] = 0.f;
+					modelMatrix.m[14] = 0.f;
+					static GLProgramUniform modelNormalMatrix("modelNormalMatrix");
+					modelNormalMatrix(program);
+					modelNormalMatrix.SetValue(modelMatrix);
+
+					if (param.depthHack) {
+						device->DepthRange(0.f, 0.1f);
+					}
 
-				device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
-				                     (void *)0);
-				if (param.depthHack) {
-					device->DepthRange(0.f, 1.f);
+					device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
+					                     (void *)0);
+					if (param.depthHack) {
+						device->DepthRange(0.f, 1.f);
+					}
 				}
 			}
 
@@ -830,62 +967,79 @@ namespace spades {
 
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, idxBuffer);
 
-			for (size_t i = 0; i < params.size(); i++) {
-				const client::ModelRenderParam &param = params[i];
-
-				if (mirror && param.depthHack)
-					continue;
+			if (useInstancing) {
+				static InstanceAttributes instanceAttributes(true);
+				static GLProgramUniform projectionViewMatrix("projectionViewMatrix");
+				projectionViewMatrix(dlightProgram);
+				projectionViewMatrix.SetValue(farRender ? renderer->farProjectionViewMatrix
+				                                        : renderer->GetProjectionViewMatrix());
+
+				for (const GLDynamicLight &light : lights) {
+					auto filter = [&](const client::ModelRenderParam &param) {
+						float rad = radius * param.matrix.GetAxis(0).GetLength();
+						return IsInstanceVisible(param, farRender) &&
+						       GLDynamicLightShader::SphereCull(light, param.matrix.GetOrigin(),
+						                                        rad);
+					};
+					dlightShader(renderer, dlightProgram, light, 2);
+					RenderInstances(dlightProgram, instanceAttributes, params, filter);
+				}
+			} else {
+				for (size_t i = 0; i < params.size(); i++) {
+					const client::ModelRenderParam &param = params[i];
 
-				// frustrum cull
-				float rad = radius;
-				if (!farRender) {
-					rad *= param.matrix.GetAxis(0).GetLength();
-					if (!renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad)) {
+					if (mirror && param.depthHack)
 						continue;
+
+					// frustrum cull
+					float rad = radius;
+					if (!farRender) {
+						rad *= param.matrix.GetAxis(0).GetLength();
+						if (!renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad)) {
+							continue;
+						}
 					}
-				}
 
-				static GLProgramUniform customColor("customColor");
-				customColor(dlightProgram);
-				customColor.SetValue(param.customColor.x, param.customColor.y, param.customColor.z);
-
-				Matrix4 modelMatrix = param.matrix;
-				static GLProgramUniform projectionViewModelMatrix("projectionViewModelMatrix");
-				projectionViewModelMatrix(dlightProgram);
-				projectionViewModelMatrix.SetValue((farRender
-				                                      ? renderer->farProjectionViewMatrix
-				                                      : renderer->GetProjectionViewMatrix()) *
-				                                   modelMatrix);
-
-				static GLProgramUniform viewModelMatrix("viewModelMatrix");
-				viewModelMatrix(dlightProgram);
-				viewModelMatrix.SetValue(renderer->GetViewMatrix() * modelMatrix);
-
-				static GLProgramUniform modelMatrixU("modelMatrix");
-				modelMatrixU(dlightProgram);
-				modelMatrixU.SetValue(modelMatrix);
-
-				modelMatrix.m[12] = 0.f;
-				modelMatrix.m[13] = 0.f;
-				modelMatrix.m[14] = 0.f;
-				static GLProgramUniform modelNormalMatrix("modelNormalMatrix");
-				modelNormalMatrix(dlightProgram);
-				modelNormalMatrix.SetValue(modelMatrix);
-
-				if (param.depthHack) {
-					device->DepthRange(0.f, 0.1f);
-				}
-				for (size_t i = 0; i < lights.size(); i++) {
-					if (!GLDynamicLightShader::SphereCull(lights[i], param.matrix.GetOrigin(), rad))
-						continue;
+					static GLProgramUniform customColor("customColor");
+					customColor(dlightProgram);
+					customColor.SetValue(param.customColor.x, param.customColor.y,
+					                     param.customColor.z);
+
+					Matrix4 modelMatrix = param.matrix;
+					static GLProgramUniform projectionViewModelMatrix("projectionViewModelMatrix");
+					projectionViewModelMatrix(dlightProgram);
+					projectionViewModelMatrix.SetValue((farRender
+					                                      ? renderer->farProjectionViewMatrix
+					                                      : renderer->GetProjectionViewMatrix()) *
+					                                   modelMatrix);
+
+					static GLProgramUniform modelMatrixU("modelMatrix");
+					modelMatrixU(dlightProgram);
+					modelMatrixU.SetValue(modelMatrix);
+
+					modelMatrix.m[12] = 0.f;
+					modelMatrix.m[13] = 0.f;
+					modelMatrix.m[14] = 0.f;
+					static GLProgramUniform modelNormalMatrix("modelNormalMatrix");
+					modelNormalMatrix(dlightProgram);
+					modelNormalMatrix.SetValue(modelMatrix);
+
+					if (param.depthHack) {
+						device->DepthRange(0.f, 0.1f);
+					}
+					for (size_t i = 0; i < lights.size(); i++) {
+						if (!GLDynamicLightShader::SphereCull(lights[i], param.matrix.GetOrigin(),
+						                                      rad))
+							continue;
 
-					dlightShader(renderer, dlightProgram, lights[i], 2);
+						dlightShader(renderer, dlightProgram, lights[i], 2);
 
-					device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
-					                     (void *)0);
-				}
-				if (param.depthHack) {
-					device->DepthRange(0.f, 1.f);
+						device->DrawElements(IGLDevice::Triangles, numIndices,
+						                     IGLDevice::UnsignedInt, (void *)0);
+					}
+					if (param.depthHack) {
+						device->DepthRange(0.f, 1.f);
+					}
 				}
 			}
 
@@ -958,46 +1112,56 @@ namespace spades {
 			device->EnableVertexAttribArray(positionAttribute(), true);
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, idxBuffer);
 
-			for (size_t i = 0; i < params.size(); i++) {
-				const client::ModelRenderParam &param = params[i];
-
-				if (mirror && param.depthHack)
-					continue;
-
-				// frustrum cull
-				if (!farRender) {
-					float rad = radius;
-					rad *= param.matrix.GetAxis(0).GetLength();
-					if (!renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad)) {
+			if (useInstancing) {
+				static InstanceAttributes instanceAttributes(false);
+				static GLProgramUniform projectionViewMatrix("projectionViewMatrix");
+				projectionViewMatrix(optimizedVoxelModelOutlinesProgram);
+				projectionViewMatrix.SetValue(farRender ? renderer->farProjectionViewMatrix
+				                                        : renderer->GetProjectionViewMatrix());
+
+				auto filter = [&](const client::ModelRenderParam &param) {
+					return IsInstanceVisible(param, farRender);
+				};
+				RenderInstances(optimizedVoxelModelOutlinesProgram, instanceAttributes, params,
+				                filter);
+			} else {
+				for (size_t i = 0; i < params.size(); i++) {
+					const client::ModelRenderParam &param = params[i];
+
+					if (mirror && param.depthHack)
 						continue;
-					}
-				}
 
-				Matrix4 modelMatrix = param.matrix;
+					// frustrum cull
+					if (!farRender) {
+						float rad = radius;
+						rad *= param.matrix.GetAxis(0).GetLength();
+						if (!renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad)) {
+							continue;
+						}
+					}
 
-				static GLProgramUniform modelMatrixU("modelMatrix");
-				modelMatrixU(optimizedVoxelModelOutlinesProgram);
-				modelMatrixU.SetValue(modelMatrix);
+					Matrix4 modelMatrix = param.matrix;
 
-				static GLProgramUniform projectionViewModelMatrix("projectionViewModelMatrix");
-				projectionViewModelMatrix(optimizedVoxelModelOutlinesProgram);
-				const Matrix4 &pvMat = (farRender ? renderer->farProjectionViewMatrix
-				                                  : renderer->GetProjectionViewMatrix());
-				projectionViewModelMatrix.SetValue(pvMat * modelMatrix);
+					static GLProgramUniform modelMatrixU("modelMatrix");
+					modelMatrixU(optimizedVoxelModelOutlinesProgram);
+					modelMatrixU.SetValue(modelMatrix);
 
-				static GLProgramUniform viewModelMatrix("viewModelMatrix");
-				viewModelMatrix(optimizedVoxelModelOutlinesProgram);
-				viewModelMatrix.SetValue(renderer->GetViewMatrix() * modelMatrix);
+					static GLProgramUniform projectionViewModelMatrix("projectionViewModelMatrix");
+					projectionViewModelMatrix(optimizedVoxelModelOutlinesProgram);
+					const Matrix4 &pvMat = (farRender ? renderer->farProjectionViewMatrix
+					                                  : renderer->GetProjectionViewMatrix());
+					projectionViewModelMatrix.SetValue(pvMat * modelMatrix);
 
-				if (param.depthHack) {
-					device->DepthRange(0.f, 0.1f);
-				}
+					if (param.depthHack) {
+						device->DepthRange(0.f, 0.1f);
+					}
 
-				device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
-				                     (void *)0);
+					device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
+					                     (void *)0);
 
-				if (param.depthHack) {
-					device->DepthRange(0.f, 1.f);
+					if (param.depthHack) {
+						device->DepthRange(0.f, 1.f);
+					}
 				}
 			}
 
@@ -1049,36 +1213,50 @@ namespace spades {
 			device->EnableVertexAttribArray(positionAttribute(), true);
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, idxBuffer);
 
-			for (size_t i = 0; i < params.size(); i++) {
-				const client::ModelRenderParam &param = params[i];
-
-				if (mirror && param.depthHack)
-					continue;
-
-				// frustrum cull
-				if (!farRender) {
-					float rad = radius;
-					rad *= param.matrix.GetAxis(0).GetLength();
-					if (!renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad)) {
+			if (useInstancing) {
+				static InstanceAttributes instanceAttributes(false);
+				static GLProgramUniform projectionViewMatrix("projectionViewMatrix");
+				projectionViewMatrix(optimizedVoxelModelOccludedProgram);
+				projectionViewMatrix.SetValue(farRender ? renderer->farProjectionViewMatrix
+				                                        : renderer->GetProjectionViewMatrix());
+
+				auto filter = [&](const client::ModelRenderParam &param) {
+					return IsInstanceVisible(param, farRender);
+				};
+				RenderInstances(optimizedVoxelModelOccludedProgram, instanceAttributes, params,
+				                filter);
+			} else {
+				for (size_t i = 0; i < params.size(); i++) {
+					const client::ModelRenderParam &param = params[i];
+
+					if (mirror && param.depthHack)
 						continue;
+
+					// frustrum cull
+					if (!farRender) {
+						float rad = radius;
+						rad *= param.matrix.GetAxis(0).GetLength();
+						if (!renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad)) {
+							continue;
+						}
 					}
-				}
 
-				Matrix4 modelMatrix = param.matrix;
-				static GLProgramUniform projectionViewModelMatrix("projectionViewModelMatrix");
-				projectionViewModelMatrix(optimizedVoxelModelOccludedProgram);
-				const Matrix4 &pvMat = (farRender ? renderer->farProjectionViewMatrix
-				                                  : renderer->GetProjectionViewMatrix());
-				projectionViewModelMatrix.SetValue(pvMat * modelMatrix);
+					Matrix4 modelMatrix = param.matrix;
+					static GLProgramUniform projectionViewModelMatrix("projectionViewModelMatrix");
+					projectionViewModelMatrix(optimizedVoxelModelOccludedProgram);
+					const Matrix4 &pvMat = (farRender ? renderer->farProjectionViewMatrix
+					                                  : renderer->GetProjectionViewMatrix());
+					projectionViewModelMatrix.SetValue(pvMat * modelMatrix);
 
-				if (param.depthHack) {
-					device->DepthRange(0.f, 0.1f);
-				}
+					if (param.depthHack) {
+						device->DepthRange(0.f, 0.1f);
+					}
 
-				device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
-				                     (void *)0);
-				if (param.depthHack) {
-					device->DepthRange(0.f, 1.f);
+					device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
+					                     (void *)0);
+					if (param.depthHack) {
+						device->DepthRange(0.f, 1.f);
+					}
 				}
 			}
 
@@ -1136,41 +1314,55 @@ namespace spades {
 			device->EnableVertexAttribArray(positionAttribute(), true);
 			device->BindBuffer(IGLDevice::ElementArrayBuffer, idxBuffer);
 
-			for (size_t i = 0; i < params.size(); i++) {
-				const client::ModelRenderParam &param = params[i];
-
-				if (mirror && param.depthHack)
-					continue;
-
-				// frustrum cull
-				if (!farRender) {
-					float rad = radius;
-					rad *= param.matrix.GetAxis(0).GetLength();
-					if (!renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad)) {
+			if (useInstancing) {
+				static InstanceAttributes instanceAttributes(false);
+				static GLProgramUniform projectionViewMatrix("projectionViewMatrix");
+				projectionViewMatrix(optimizedVoxelModelOcclusionTestProgram);
+				projectionViewMatrix.SetValue(farRender ? renderer->farProjectionViewMatrix
+				                                        : renderer->GetProjectionViewMatrix());
+
+				auto filter = [&](const client::ModelRenderParam &param) {
+					return IsInstanceVisible(param, farRender);
+				};
+				RenderInstances(optimizedVoxelModelOcclusionTestProgram, instanceAttributes, params,
+				                filter);
+			} else {
+				for (size_t i = 0; i < params.size(); i++) {
+					const client::ModelRenderParam &param = params[i];
+
+					if (mirror && param.depthHack)
 						continue;
+
+					// frustrum cull
+					if (!farRender) {
+						float rad = radius;
+						rad *= param.matrix.GetAxis(0).GetLength();
+						if (!renderer->SphereFrustrumCull(param.matrix.GetOrigin(), rad)) {
+							continue;
+						}
 					}
-				}
 
-				Matrix4 modelMatrix = param.matrix;
+					Matrix4 modelMatrix = param.matrix;
 
-				static GLProgramUniform modelMatrixU("modelMatrix");
-				modelMatrixU(optimizedVoxelModelOcclusionTestProgram);
-				modelMatrixU.SetValue(modelMatrix);
+					static GLProgramUniform modelMatrixU("modelMatrix");
+					modelMatrixU(optimizedVoxelModelOcclusionTestProgram);
+					modelMatrixU.SetValue(modelMatrix);
 
-				static GLProgramUniform projectionViewModelMatrix("projectionViewModelMatrix");
-				projectionViewModelMatrix(optimizedVoxelModelOcclusionTestProgram);
-				const Matrix4 &pvMat = (farRender ? renderer->farProjectionViewMatrix
-				                                  : renderer->GetProjectionViewMatrix());
-				projectionViewModelMatrix.SetValue(pvMat * modelMatrix);
+					static GLProgramUniform projectionViewModelMatrix("projectionViewModelMatrix");
+					projectionViewModelMatrix(optimizedVoxelModelOcclusionTestProgram);
+					const Matrix4 &pvMat = (farRender ? renderer->farProjectionViewMatrix
+					                                  : renderer->GetProjectionViewMatrix());
+					projectionViewModelMatrix.SetValue(pvMat * modelMatrix);
 
-				if (param.depthHack) {
-					device->DepthRange(0.f, 0.1f);
-				}
+					if (param.depthHack) {
+						device->DepthRange(0.f, 0.1f);
+					}
 
-				device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
-				                     (void *)0);
-				if (param.depthHack) {
-					device->DepthRange(0.f, 1.f);
+					device->DrawElements(IGLDevice::Triangles, numIndices, IGLDevice::UnsignedInt,
+					                     (void *)0);
+					if (param.depthHack) {
+						device->DepthRange(0.f, 1.f);
+					}
 				}
 			}
 
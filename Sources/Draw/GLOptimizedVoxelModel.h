@@ -23,6 +23,7 @@
 #include <vector>
 
 #include "GLModel.h"
+#include "GLProgramAttribute.h"
 #include "IGLDevice.h"
 #include <Core/VoxelModel.h>
 
@@ -46,6 +47,23 @@ namespace spades {
 				uint8_t padding2;
 			};
 
+			/** The per-instance attributes used when `r_modelInstancing` is enabled
+			 * (Shaders/ModelTransformInstanced.vs). */
+			struct Instance {
+				// the first three rows of the model matrix
+				float modelMatrix[12];
+				float customColor[4];
+			};
+
+			/** The locations of the attributes of `Instance` in a program. */
+			struct InstanceAttributes {
+				GLProgramAttribute modelMatrixRows[3];
+				GLProgramAttribute customColor;
+				bool useCustomColor;
+
+				InstanceAttributes(bool useCustomColor);
+			};
+
 			GLRenderer *renderer;
 			IGLDevice *device;
 			GLProgram *program;
@@ -62,6 +80,11 @@ namespace spades {
 
 			IGLDevice::UInteger buffer;
 			IGLDevice::UInteger idxBuffer;
+
+			// the programs above are the instanced versions if this is set
+			bool useInstancing;
+			IGLDevice::UInteger instanceBuffer;
+			std::vector<Instance> instances;
 			std::vector<Vertex> vertices;
 			std::vector<uint32_t> indices;
 			std::vector<uint16_t> bmpIndex; // bmp id for vertex (not index)
@@ -84,6 +107,19 @@ namespace spades {
 			void BuildVertices(VoxelModel *);
 			void GenerateTexture();
 
+			/** Returns `false` if the instance is culled by the view frustum. */
+			bool IsInstanceVisible(const client::ModelRenderParam &, bool farRender);
+
+			/**
+			 * Draws the instances in `params` accepted by `filter` with
+			 * `program`, which must be an instanced program that is in use.
+			 * Instances with `depthHack` are drawn by a separate draw call.
+			 */
+			template <class Filter>
+			void RenderInstances(GLProgram *program, InstanceAttributes &attributes,
+			                     const std::vector<client::ModelRenderParam> &params,
+			                     Filter filter);
+
 		protected:
 			~GLOptimizedVoxelModel();
 
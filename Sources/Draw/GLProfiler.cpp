@@ -35,6 +35,8 @@
 #include "GLSettings.h"
 #include "IGLDevice.h"
 #include <Core/Debug.h>
+#include <Core/FileManager.h>
+#include <Core/IStream.h>
 #include <Core/Settings.h>
 #include <Core/TMPUtils.h>
 
@@ -54,6 +56,10 @@ namespace spades {
 				         .count() /
 				       1000000.0;
 			}
+
+			std::int64_t ToMicroseconds(double seconds) {
+				return static_cast<std::int64_t>(seconds * 1000000.0);
+			}
 		}
 
 		struct GLProfiler::Measurement {
@@ -90,7 +96,11 @@ namespace spades {
 		      m_active{false},
 		      m_lastSaveTime{0.0},
 		      m_shouldSaveThisFrame{false},
-		      m_waitingTimerQueryResult{false} {
+		      m_waitingTimerQueryResult{false},
+		      m_frameStartTimestamp{0},
+		      m_numTraceFramesSinceSave{0},
+		      m_traceThreadId{TraceRecorder::GetCurrentThreadId()},
+		      m_gpuTraceThreadId{-1} {
 			SPADES_MARK_FUNCTION();
 
 			m_font = m_renderer.RegisterImage("Gfx/Fonts/Debug.png");
@@ -99,6 +109,11 @@ namespace spades {
 
 		GLProfiler::~GLProfiler() {
 			SPADES_MARK_FUNCTION();
+
+			// the last frames before the shutdown can be captured by leaving the game
+			SaveTrace();
+			TraceRecorder::SetCapturing(false);
+
 			for (IGLDevice::UInteger timerQueryObject : m_timerQueryObjects) {
 				m_device.DeleteQuery(timerQueryObject);
 			}
@@ -107,7 +122,15 @@ namespace spades {
 		void GLProfiler::BeginFrame() {
 			SPADES_MARK_FUNCTION();
 
-			if (!m_settings.r_debugTiming) {
+			bool tracing = m_settings.r_debugTimingTrace > 0;
+			if (TraceRecorder::IsCapturing() != tracing) {
+				TraceRecorder::SetCapturing(tracing);
+			}
+			if (!tracing) {
+				m_traceFrames.clear();
+			}
+
+			if (!m_settings.r_debugTiming && !tracing) {
 				// Clear history
 				m_root.reset();
 				m_waitingTimerQueryResult = false;
@@ -135,6 +158,7 @@ namespace spades {
 			}
 
 			ResetTimes();
+			m_frameStartTimestamp = TraceRecorder::GetTimestamp();
 
 			if (m_settings.r_debugTimingGPUTime) {
 				m_currentTimerQueryObjectIndex = 0;
@@ -274,6 +298,10 @@ namespace spades {
 				m_waitingTimerQueryResult = false;
 			}
 
+			if (m_settings.r_debugTimingTrace > 0) {
+				RecordTraceFrame(root);
+			}
+
 			if (m_shouldSaveThisFrame) {
 				struct Traverser {
 					GLProfiler &self;
@@ -297,6 +325,114 @@ namespace spades {
 			}
 		}
 
+		void GLProfiler::RecordTraceFrame(Phase &root) {
+			SPADES_MARK_FUNCTION();
+
+			if (m_gpuTraceThreadId < 0) {
+				m_gpuTraceThreadId = TraceRecorder::AddVirtualThread("GPU");
+			}
+
+			TraceFrame frame;
+			frame.startTimestamp = m_frameStartTimestamp;
+
+			struct Traverser {
+				GLProfiler &self;
+				Phase &root;
+				TraceFrame &frame;
+				Traverser(GLProfiler &self, Phase &root, TraceFrame &frame)
+				    : self{self}, root{root}, frame{frame} {}
+				void Traverse(Phase &phase) {
+					// skip the phases not executed in this frame
+					if (&phase != &root && !phase.measured) {
+						return;
+					}
+
+					std::int64_t start =
+					  frame.startTimestamp + ToMicroseconds(phase.startWallClockTime);
+					std::int64_t end = frame.startTimestamp + ToMicroseconds(phase.endWallClockTime);
+					frame.spans.push_back(TraceRecorder::Span{phase.description, "gl",
+					                                          self.m_traceThreadId, start,
+					                                          end - start});
+
+					// The GPU times are measured from the first timer query of the frame.
+					// The actual execution on the GPU is later than the wall clock time.
+					auto &times = self.m_timerQueryTimes;
+					if (self.m_settings.r_debugTimingGPUTime && phase.queryObjectIndices &&
+					    (*phase.queryObjectIndices).second < times.size()) {
+						auto indices = *phase.queryObjectIndices;
+						double time1 = times[indices.first];
+						double time2 = times[indices.second];
+						frame.spans.push_back(TraceRecorder::Span{
+						  phase.description, "gpu", self.m_gpuTraceThreadId,
+						  frame.startTimestamp + ToMicroseconds(time1),
+						  ToMicroseconds(time2 - time1)});
+					}
+
+					for (Phase &subphase : phase.subphases) {
+						Traverse(subphase);
+					}
+				}
+			};
+			Traverser{*this, root, frame}.Traverse(root);
+
+			// the interval between the starts of frames also covers the time spent
+			// outside the renderer
+			double interval = 0.0;
+			if (!m_traceFrames.empty()) {
+				interval = (frame.startTimestamp - m_traceFrames.back().startTimestamp) / 1000.0;
+			}
+
+			std::size_t maxNumFrames = static_cast<std::size_t>((int)m_settings.r_debugTimingTrace);
+			m_traceFrames.push_back(std::move(frame));
+			while (m_traceFrames.size() > maxNumFrames) {
+				m_traceFrames.pop_front();
+			}
+			++m_numTraceFramesSinceSave;
+
+			// wait for the window to be filled with new frames so that a series of hitches
+			// doesn't produce lots of files
+			float threshold = m_settings.r_debugTimingTraceHitch;
+			if (threshold > 0.f && interval > threshold &&
+			    m_numTraceFramesSinceSave >= maxNumFrames) {
+				SPLog("Frame took %.1fms (r_debugTimingTraceHitch = %.1fms)", interval,
+				      threshold);
+				SaveTrace();
+			}
+		}
+
+		void GLProfiler::SaveTrace() {
+			SPADES_MARK_FUNCTION();
+
+			if (m_traceFrames.empty()) {
+				return;
+			}
+
+			std::vector<TraceRecorder::Span> spans;
+			for (const TraceFrame &frame : m_traceFrames) {
+				spans.insert(spans.end(), frame.spans.begin(), frame.spans.end());
+			}
+
+			char fileName[256];
+			for (int i = 0; i < 10000; i++) {
+				std::snprintf(fileName, sizeof(fileName), "Traces/trace%04d.json", i);
+				if (!FileManager::FileExists(fileName)) {
+					break;
+				}
+			}
+
+			try {
+				std::unique_ptr<IStream> stream(FileManager::OpenForWriting(fileName));
+				TraceRecorder::WriteChromeTrace(*stream, m_traceFrames.front().startTimestamp,
+				                                spans);
+				SPLog("Trace of the last %d frame(s) saved: %s",
+				      static_cast<int>(m_traceFrames.size()), fileName);
+			} catch (const std::exception &ex) {
+				SPLog("Failed to save the trace: %s", ex.what());
+			}
+
+			m_numTraceFramesSinceSave = 0;
+		}
+
 		void GLProfiler::NewTimerQuery() {
 			SPADES_MARK_FUNCTION_DEBUG();
 
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -27,6 +29,7 @@
 
 #include "IGLDevice.h"
 #include <Core/Stopwatch.h>
+#include <Core/TraceRecorder.h>
 
 namespace spades {
 	namespace client {
@@ -61,6 +64,18 @@ namespace spades {
 			std::vector<double> m_timerQueryTimes;
 			std::size_t m_currentTimerQueryObjectIndex;
 
+			/** The phases of a frame converted for the trace export. */
+			struct TraceFrame {
+				std::int64_t startTimestamp;
+				std::vector<TraceRecorder::Span> spans;
+			};
+
+			std::int64_t m_frameStartTimestamp;
+			std::deque<TraceFrame> m_traceFrames;
+			std::size_t m_numTraceFramesSinceSave;
+			int m_traceThreadId;
+			int m_gpuTraceThreadId;
+
 			Phase &GetCurrentPhase() { return m_stack.back(); }
 
 			void BeginPhase(const std::string &name, const std::string &description);
@@ -77,6 +92,10 @@ namespace spades {
 
 			void FinalizeMeasurement();
 
+			void RecordTraceFrame(Phase &root);
+			/** Writes the spans of the frames in `m_traceFrames` to a new file. */
+			void SaveTrace();
+
 		public:
 			GLProfiler(GLRenderer &);
 			~GLProfiler();
@@ -18,6 +18,7 @@
 
  */
 
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 
@@ -74,6 +75,33 @@ namespace spades {
 			linked = true;
 		}
 
+		bool GLProgram::LoadBinary(IGLDevice::UInteger format, const void *data,
+		                           std::size_t length) {
+			SPADES_MARK_FUNCTION();
+			device->ProgramBinary(handle, format, data, static_cast<IGLDevice::Sizei>(length));
+			if (device->GetProgramInteger(handle, IGLDevice::LinkStatus) == 0) {
+				return false;
+			}
+
+			linked = true;
+			return true;
+		}
+
+		bool GLProgram::GetBinary(std::vector<char> &data, IGLDevice::UInteger &format) {
+			SPADES_MARK_FUNCTION();
+			IGLDevice::Integer length =
+			  device->GetProgramInteger(handle, IGLDevice::ProgramBinaryLength);
+			if (length <= 0) {
+				return false;
+			}
+
+			data.resize(length);
+			IGLDevice::Sizei outLen = 0;
+			device->GetProgramBinary(handle, length, &outLen, &format, data.data());
+			data.resize(std::max<IGLDevice::Sizei>(outLen, 0));
+			return !data.empty();
+		}
+
 		void GLProgram::Validate() {
 			SPADES_MARK_FUNCTION();
 			device->ValidateProgram(handle);
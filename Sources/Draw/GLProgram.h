@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "IGLDevice.h"
 
 namespace spades {
@@ -42,10 +44,19 @@ namespace spades {
 			void Link();
 			void Validate();
 
+			/** Links the program from a binary returned by `GetBinary`.
+			 * @return `false` if the binary was rejected by the driver. */
+			bool LoadBinary(IGLDevice::UInteger format, const void *data, std::size_t length);
+
+			/** Retrieves the binary of the linked program.
+			 * @return `false` if the driver didn't provide one. */
+			bool GetBinary(std::vector<char> &data, IGLDevice::UInteger &format);
+
 			bool IsLinked() const { return linked; }
 			void Use();
 
 			IGLDevice::UInteger GetHandle() const { return handle; }
+			const std::string &GetName() const { return name; }
 
 			IGLDevice *GetDevice() const { return device; }
 		};
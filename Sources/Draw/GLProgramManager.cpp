@@ -18,10 +18,17 @@
 
  */
 
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include <zlib.h>
+
 #include "GLProgramManager.h"
 #include <Core/Debug.h>
 #include <Core/Exception.h>
 #include <Core/FileManager.h>
+#include <Core/IStream.h>
 #include <Core/Math.h>
 #include <Core/Stopwatch.h>
 #include "GLDynamicLightShader.h"
@@ -34,9 +41,64 @@
 
 namespace spades {
 	namespace draw {
+		namespace {
+			/** The header of a file in the program binary cache. The cache
+			 * is never shared between machines, so the native layout is used. */
+			struct BinaryCacheHeader {
+				char magic[4];
+				uint32_t version;
+				uint64_t key;
+				uint32_t binaryFormat;
+				uint32_t binaryLength;
+				uint32_t binaryChecksum;
+				// the time it took to build the program from the source
+				float buildTime;
+			};
+
+			const char BinaryCacheMagic[4] = {'S', 'P', 'P', 'B'};
+			const uint32_t BinaryCacheVersion = 1;
+
+			// FNV-1a
+			uint64_t HashBytes(uint64_t hash, const void *data, std::size_t length) {
+				const unsigned char *bytes = static_cast<const unsigned char *>(data);
+				for (std::size_t i = 0; i < length; i++) {
+					hash ^= bytes[i];
+					hash *= 1099511628211ULL;
+				}
+				return hash;
+			}
+
+			uint64_t HashString(uint64_t hash, const char *str) {
+				if (!str) {
+					str = "";
+				}
+				// includes the null terminator to separate the strings
+				return HashBytes(hash, str, std::strlen(str) + 1);
+			}
+
+			uint32_t ComputeChecksum(const void *data, std::size_t length) {
+				uLong crc = crc32(0L, Z_NULL, 0);
+				return static_cast<uint32_t>(
+				  crc32(crc, reinterpret_cast<const Bytef *>(data), static_cast<uInt>(length)));
+			}
+
+			std::string GetBinaryCacheFileName(uint64_t key) {
+				char buf[64];
+				std::snprintf(buf, sizeof(buf), "Cache/Programs/%016llx.bin",
+				              static_cast<unsigned long long>(key));
+				return buf;
+			}
+		}
+
 		GLProgramManager::GLProgramManager(IGLDevice *d, IGLShadowMapRenderer *smr,
 		                                   GLSettings &settings)
-		    : device(d), shadowMapRenderer(smr), settings(settings) {
+		    : device(d),
+		      shadowMapRenderer(smr),
+		      settings(settings),
+		      numCacheHits(0),
+		      numCacheMisses(0),
+		      cacheLoadTime(0.),
+		      cacheSourceBuildTime(0.) {
 			SPADES_MARK_FUNCTION();
 		}
 
@@ -89,6 +151,7 @@ namespace spades {
 			std::vector<std::string> lines = SplitIntoLines(text);
 
 			GLProgram *p = new GLProgram(device, name);
+			std::vector<GLShader *> programShaders;
 
 			for (size_t i = 0; i < lines.size(); i++) {
 				std::string text = TrimSpaces(lines[i]);
@@ -98,30 +161,25 @@ namespace spades {
 				if (text == "*shadow*") {
 					std::vector<GLShader *> shaders =
 					  GLShadowShader::RegisterShader(this, settings, false);
-					for (size_t i = 0; i < shaders.size(); i++)
-						p->Attach(shaders[i]);
+					programShaders.insert(programShaders.end(), shaders.begin(), shaders.end());
 					continue;
 				} else if (text == "*shadow-lite*") {
 					std::vector<GLShader *> shaders =
 					  GLShadowShader::RegisterShader(this, settings, false, true);
-					for (size_t i = 0; i < shaders.size(); i++)
-						p->Attach(shaders[i]);
+					programShaders.insert(programShaders.end(), shaders.begin(), shaders.end());
 					continue;
 				} else if (text == "*shadow-variance*") {
 					std::vector<GLShader *> shaders =
 					  GLShadowShader::RegisterShader(this, settings, true);
-					for (size_t i = 0; i < shaders.size(); i++)
-						p->Attach(shaders[i]);
+					programShaders.insert(programShaders.end(), shaders.begin(), shaders.end());
 					continue;
 				} else if (text == "*dlight*") {
 					std::vector<GLShader *> shaders = GLDynamicLightShader::RegisterShader(this);
-					for (size_t i = 0; i < shaders.size(); i++)
-						p->Attach(shaders[i]);
+					programShaders.insert(programShaders.end(), shaders.begin(), shaders.end());
 					continue;
 				} else if (text == "*shadowmap*") {
 					std::vector<GLShader *> shaders = GLShadowMapShader::RegisterShader(this);
-					for (size_t i = 0; i < shaders.size(); i++)
-						p->Attach(shaders[i]);
+					programShaders.insert(programShaders.end(), shaders.begin(), shaders.end());
 					continue;
 				} else if (text[0] == '*') {
 					SPRaise("Unknown special shader: %s", text.c_str());
@@ -130,17 +188,152 @@ namespace spades {
 				}
 				GLShader *s = CreateShader(text);
 
+				programShaders.push_back(s);
+			}
+
+			for (GLShader *s : programShaders) {
 				p->Attach(s);
 			}
 
+			bool useCache = settings.r_programBinaryCache;
+			uint64_t cacheKey = 0;
+			if (useCache) {
+				cacheKey = GetBinaryCacheKey(name, programShaders);
+				if (LoadProgramBinary(p, cacheKey)) {
+					return p;
+				}
+			}
+
+			// the shaders are compiled only when they are needed by a program
+			// that couldn't be loaded from the cache
 			Stopwatch sw;
+			for (GLShader *s : programShaders) {
+				if (!s->IsCompiled()) {
+					s->Compile();
+				}
+			}
+			if (useCache) {
+				device->ProgramParameter(p->GetHandle(),
+				                         IGLDevice::ProgramBinaryRetrievableHint, 1);
+			}
 			p->Link();
+			double buildTime = sw.GetTime();
 			SPLog("Successfully linked GLSL program '%s' in %.3fms", name.c_str(),
-			      sw.GetTime() * 1000.);
+			      buildTime * 1000.);
 			// p->Validate();
+
+			if (useCache) {
+				SaveProgramBinary(p, cacheKey, buildTime);
+			}
 			return p;
 		}
 
+		uint64_t
+		GLProgramManager::GetBinaryCacheKey(const std::string &name,
+		                                    const std::vector<GLShader *> &programShaders) {
+			uint64_t hash = 14695981039346656037ULL;
+			hash = HashString(hash, device->GetString(IGLDevice::Vendor));
+			hash = HashString(hash, device->GetString(IGLDevice::Renderer));
+			hash = HashString(hash, device->GetString(IGLDevice::Version));
+			hash = HashString(hash, name.c_str());
+			for (GLShader *s : programShaders) {
+				for (const std::string &source : s->GetSources()) {
+					hash = HashString(hash, source.c_str());
+				}
+			}
+			return hash;
+		}
+
+		bool GLProgramManager::LoadProgramBinary(GLProgram *p, uint64_t key) {
+			SPADES_MARK_FUNCTION();
+
+			std::string fileName = GetBinaryCacheFileName(key);
+			if (!FileManager::FileExists(fileName.c_str())) {
+				numCacheMisses++;
+				return false;
+			}
+
+			try {
+				Stopwatch sw;
+				std::string data = FileManager::ReadAllBytes(fileName.c_str());
+
+				BinaryCacheHeader header;
+				if (data.size() < sizeof(header)) {
+					SPRaise("File is truncated");
+				}
+				std::memcpy(&header, data.data(), sizeof(header));
+				if (std::memcmp(header.magic, BinaryCacheMagic, sizeof(header.magic)) != 0 ||
+				    header.version != BinaryCacheVersion || header.key != key) {
+					SPRaise("Header is invalid");
+				}
+				if (data.size() - sizeof(header) != header.binaryLength) {
+					SPRaise("File is truncated");
+				}
+				const char *binary = data.data() + sizeof(header);
+				if (ComputeChecksum(binary, header.binaryLength) != header.binaryChecksum) {
+					SPRaise("Checksum mismatch");
+				}
+				if (!p->LoadBinary(header.binaryFormat, binary, header.binaryLength)) {
+					SPRaise("Binary was rejected by the driver");
+				}
+
+				double loadTime = sw.GetTime();
+				SPLog("Loaded GLSL program '%s' from the binary cache in %.3fms "
+				      "(%.3fms from the source)",
+				      p->GetName().c_str(), loadTime * 1000., header.buildTime * 1000.);
+				numCacheHits++;
+				cacheLoadTime += loadTime;
+				cacheSourceBuildTime += header.buildTime;
+				return true;
+			} catch (const std::exception &ex) {
+				SPLog("Ignoring the binary cache '%s' of GLSL program '%s': %s",
+				      fileName.c_str(), p->GetName().c_str(), ex.what());
+				numCacheMisses++;
+				return false;
+			}
+		}
+
+		void GLProgramManager::SaveProgramBinary(GLProgram *p, uint64_t key, double buildTime) {
+			SPADES_MARK_FUNCTION();
+
+			std::string fileName = GetBinaryCacheFileName(key);
+			try {
+				std::vector<char> binary;
+				IGLDevice::UInteger format;
+				if (!p->GetBinary(binary, format)) {
+					SPLog("Driver didn't provide the binary of GLSL program '%s'",
+					      p->GetName().c_str());
+					return;
+				}
+
+				BinaryCacheHeader header;
+				std::memcpy(header.magic, BinaryCacheMagic, sizeof(header.magic));
+				header.version = BinaryCacheVersion;
+				header.key = key;
+				header.binaryFormat = format;
+				header.binaryLength = static_cast<uint32_t>(binary.size());
+				header.binaryChecksum = ComputeChecksum(binary.data(), binary.size());
+				header.buildTime = static_cast<float>(buildTime);
+
+				std::unique_ptr<IStream> stream(FileManager::OpenForWriting(fileName.c_str()));
+				stream->Write(&header, sizeof(header));
+				stream->Write(binary.data(), binary.size());
+			} catch (const std::exception &ex) {
+				SPLog("Failed to save the binary cache '%s' of GLSL program '%s': %s",
+				      fileName.c_str(), p->GetName().c_str(), ex.what());
+			}
+		}
+
+		void GLProgramManager::ReportBinaryCacheStatistics() {
+			if (!settings.r_programBinaryCache) {
+				return;
+			}
+			SPLog("Program binary cache: %d hit(s), %d miss(es), %.3fms spent loading binaries "
+			      "that took %.3fms to build from the source",
+			      numCacheHits, numCacheMisses, cacheLoadTime * 1000.,
+			      cacheSourceBuildTime * 1000.);
+		}
+
 		GLShader *GLProgramManager::CreateShader(const std::string &name) {
 			SPADES_MARK_FUNCTION();
 
@@ -180,14 +373,16 @@ namespace spades {
 				finalSource += "#define USE_SSAO 0\n";
 			}
 
+			if (settings.r_mapChunkCompactVertex) {
+				finalSource += "#define COMPACT_MAP_VERTEX 1\n";
+			} else {
+				finalSource += "#define COMPACT_MAP_VERTEX 0\n";
+			}
+
 			finalSource += text;
 
+			// compiled by `CreateProgram` if needed
 			s->AddSource(finalSource);
-
-			Stopwatch sw;
-			s->Compile();
-			SPLog("Successfully compiled GLSL program '%s' in %.3fms", name.c_str(), // should this be "program" or "shader"?
-			      sw.GetTime() * 1000.);
 			return s;
 		}
 	}
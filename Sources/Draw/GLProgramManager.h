@@ -19,8 +19,10 @@
  */
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <string>
+#include <vector>
 
 namespace spades {
 	namespace draw {
@@ -37,9 +39,20 @@ namespace spades {
 			std::map<std::string, GLProgram *> programs;
 			std::map<std::string, GLShader *> shaders;
 
+			// statistics of the program binary cache (r_programBinaryCache)
+			int numCacheHits, numCacheMisses;
+			double cacheLoadTime, cacheSourceBuildTime;
+
 			GLProgram *CreateProgram(const std::string &name);
 			GLShader *CreateShader(const std::string &name);
 
+			/** Computes the key of the program binary cache, which covers the
+			 * shader sources and the driver. */
+			uint64_t GetBinaryCacheKey(const std::string &name,
+			                           const std::vector<GLShader *> &programShaders);
+			bool LoadProgramBinary(GLProgram *, uint64_t key);
+			void SaveProgramBinary(GLProgram *, uint64_t key, double buildTime);
+
 		public:
 			GLProgramManager(IGLDevice *, IGLShadowMapRenderer *shadowMapRenderer,
 			                 GLSettings &settings);
@@ -47,6 +60,9 @@ namespace spades {
 
 			GLProgram *RegisterProgram(const std::string &name);
 			GLShader *RegisterShader(const std::string &name);
+
+			/** Logs how much time the program binary cache has saved so far. */
+			void ReportBinaryCacheStatistics();
 		};
 	}
 }
@@ -18,16 +18,18 @@
 
  */
 
-#include <atomic>
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
 
 #include <Client/GameMap.h>
 #include "GLMapShadowRenderer.h"
 #include "GLRadiosityRenderer.h"
 #include "GLRenderer.h"
+#include "SWFeatureLevel.h"
 
-#include <Core/ConcurrentDispatch.h>
 #include <Core/Settings.h>
+#include <Core/TraceRecorder.h>
 #ifdef __APPLE__
 #include <xmmintrin.h>
 #endif
@@ -36,20 +38,130 @@
 
 namespace spades {
 	namespace draw {
-		class GLRadiosityRenderer::UpdateDispatch : public ConcurrentDispatch {
-			GLRadiosityRenderer *renderer;
+		namespace {
+			/** The faces of the map shadow around a chunk, decoded into
+			 * structure of arrays. See `GLRadiosityRenderer::Evaluate` for the
+			 * meaning of the values. */
+			struct FaceTable {
+				const float *centerX, *centerY, *centerZ;
+				// `diffDot` is `(center - pos) . (0, normalY, normalZ)`
+				const float *normalY, *normalZ;
+				const float *red, *green, *blue;
+				int pitch;
+			};
+
+			enum { WindowSize = 13 }; // Envelope * 2 + 1
+
+			/** Accumulates the light from the `WindowSize` x `WindowSize` faces
+			 * starting at (`windowX`, `windowY`) in `table` to `result`. */
+			void AccumulateRadiosity(const FaceTable &table, int windowX, int windowY,
+			                         const Vector3 &pos, GLRadiosityRenderer::Result &result) {
+#if ENABLE_SSE
+				// process a row in groups of 4 faces. `FaceTable::pitch` has
+				// room for the excess lanes of the last group, which are masked.
+				const int numGroups = (WindowSize + 3) / 4;
+				__m128 laneIndex = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+				__m128 groupMasks[numGroups];
+				for (int i = 0; i < numGroups; i++) {
+					groupMasks[i] =
+					  _mm_cmplt_ps(laneIndex, _mm_set1_ps(static_cast<float>(WindowSize - i * 4)));
+				}
 
-		public:
-			std::atomic<bool> done {false};
-			UpdateDispatch(GLRadiosityRenderer *r) : renderer(r) { }
-			void Run() override {
-				SPADES_MARK_FUNCTION();
+				__m128 posX = _mm_set1_ps(pos.x);
+				__m128 posY = _mm_set1_ps(pos.y);
+				__m128 posZ = _mm_set1_ps(pos.z);
+				__m128 zero = _mm_setzero_ps();
+				__m128 one = _mm_set1_ps(1.f);
+				__m128 smoothing = _mm_set1_ps(.4f);
+
+				__m128 baseR = zero, baseG = zero, baseB = zero;
+				__m128 xR = zero, xG = zero, xB = zero;
+				__m128 yR = zero, yG = zero, yB = zero;
+				__m128 zR = zero, zG = zero, zB = zero;
+
+				for (int row = 0; row < WindowSize; row++) {
+					int offset = (windowY + row) * table.pitch + windowX;
+					for (int group = 0; group < numGroups; group++, offset += 4) {
+						__m128 dx = _mm_sub_ps(_mm_loadu_ps(table.centerX + offset), posX);
+						__m128 dy = _mm_sub_ps(_mm_loadu_ps(table.centerY + offset), posY);
+						__m128 dz = _mm_sub_ps(_mm_loadu_ps(table.centerZ + offset), posZ);
+						__m128 diffDot =
+						  _mm_add_ps(_mm_mul_ps(dy, _mm_loadu_ps(table.normalY + offset)),
+						             _mm_mul_ps(dz, _mm_loadu_ps(table.normalZ + offset)));
+
+						__m128 len = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+						len = _mm_sqrt_ps(_mm_add_ps(len, _mm_mul_ps(dz, dz)));
+						__m128 invLen = _mm_div_ps(one, len);
+						__m128 invLenSmooth = _mm_div_ps(one, _mm_add_ps(len, smoothing));
+
+						// faces behind the voxel are culled
+						__m128 intensity = _mm_mul_ps(diffDot, invLen);
+						intensity = _mm_mul_ps(intensity, _mm_mul_ps(invLenSmooth, invLenSmooth));
+						intensity = _mm_and_ps(intensity, _mm_cmpgt_ps(diffDot, zero));
+						intensity = _mm_and_ps(intensity, groupMasks[group]);
+
+						__m128 dirX = _mm_mul_ps(intensity, _mm_mul_ps(dx, invLen));
+						__m128 dirY = _mm_mul_ps(intensity, _mm_mul_ps(dy, invLen));
+						__m128 dirZ = _mm_mul_ps(intensity, _mm_mul_ps(dz, invLen));
+
+						__m128 red = _mm_loadu_ps(table.red + offset);
+						__m128 green = _mm_loadu_ps(table.green + offset);
+						__m128 blue = _mm_loadu_ps(table.blue + offset);
+
+						baseR = _mm_add_ps(baseR, _mm_mul_ps(red, intensity));
+						baseG = _mm_add_ps(baseG, _mm_mul_ps(green, intensity));
+						baseB = _mm_add_ps(baseB, _mm_mul_ps(blue, intensity));
+						xR = _mm_add_ps(xR, _mm_mul_ps(red, dirX));
+						xG = _mm_add_ps(xG, _mm_mul_ps(green, dirX));
+						xB = _mm_add_ps(xB, _mm_mul_ps(blue, dirX));
+						yR = _mm_add_ps(yR, _mm_mul_ps(red, dirY));
+						yG = _mm_add_ps(yG, _mm_mul_ps(green, dirY));
+						yB = _mm_add_ps(yB, _mm_mul_ps(blue, dirY));
+						zR = _mm_add_ps(zR, _mm_mul_ps(red, dirZ));
+						zG = _mm_add_ps(zG, _mm_mul_ps(green, dirZ));
+						zB = _mm_add_ps(zB, _mm_mul_ps(blue, dirZ));
+					}
+				}
 
-				renderer->UpdateDirtyChunks();
+				auto sum = [](__m128 v) {
+					float lanes[4];
+					_mm_storeu_ps(lanes, v);
+					return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+				};
+				result.base = MakeVector3(sum(baseR), sum(baseG), sum(baseB));
+				result.x = MakeVector3(sum(xR), sum(xG), sum(xB));
+				result.y = MakeVector3(sum(yR), sum(yG), sum(yB));
+				result.z = MakeVector3(sum(zR), sum(zG), sum(zB));
+#else
+				result.base = result.x = result.y = result.z = MakeVector3(0, 0, 0);
+				for (int row = 0; row < WindowSize; row++) {
+					int offset = (windowY + row) * table.pitch + windowX;
+					for (int i = 0; i < WindowSize; i++, offset++) {
+						Vector3 diff = MakeVector3(table.centerX[offset], table.centerY[offset],
+						                           table.centerZ[offset]) -
+						               pos;
+						float diffDot =
+						  diff.y * table.normalY[offset] + diff.z * table.normalZ[offset];
+						if (diffDot <= 0.f)
+							continue;
 
-				done = true;
+						float len = diff.GetLength();
+						float invLen = 1.f / len;
+						float invLenSmooth = 1.f / (len + .4f);
+						float intensity = diffDot * invLen * invLenSmooth * invLenSmooth;
+
+						Vector3 color = MakeVector3(table.red[offset], table.green[offset],
+						                            table.blue[offset]);
+						color *= intensity;
+						result.base += color;
+						result.x += color * (diff.x * invLen);
+						result.y += color * (diff.y * invLen);
+						result.z += color * (diff.z * invLen);
+					}
+				}
+#endif
 			}
-		};
+		}
 
 		GLRadiosityRenderer::GLRadiosityRenderer(GLRenderer *r, client::GameMap *m)
 		    : renderer(r), device(r->GetGLDevice()), settings(r->GetSettings()), map(m) {
@@ -136,17 +248,15 @@ namespace spades {
 					                      v.data());
 				}
 			}
-			dispatch = NULL;
-
 			SPLog("Chunk texture initialized");
+
+			scheduler.reset(new ChunkUpdateScheduler(*this, chunks, chunkW, chunkH, chunkD,
+			                                         ChunkSize));
 		}
 
 		GLRadiosityRenderer::~GLRadiosityRenderer() {
 			SPADES_MARK_FUNCTION();
-			if (dispatch) {
-				dispatch->Join();
-				delete dispatch;
-			}
+			scheduler.reset();
 			SPLog("Releasing textures");
 
 			device->DeleteTexture(textureFlat);
@@ -331,121 +441,39 @@ namespace spades {
 					}
 		}
 
-		int GLRadiosityRenderer::GetNumDirtyChunks() {
-			int cnt = 0;
-			for (size_t i = 0; i < chunks.size(); i++) {
-				Chunk &c = chunks[i];
-				if (c.dirty)
-					cnt++;
-			}
-			return cnt;
-		}
-
 		void GLRadiosityRenderer::Update() {
-			if (GetNumDirtyChunks() > 0 && (dispatch == NULL || dispatch->done.load())) {
-				if (dispatch) {
-					dispatch->Join();
-					delete dispatch;
-				}
-				dispatch = new UpdateDispatch(this);
-				dispatch->Start();
-			}
-			int cnt = 0;
-			for (size_t i = 0; i < chunks.size(); i++) {
-				if (!chunks[i].transferDone.load())
-					cnt++;
-			}
-			GLProfiler::Context profiler(renderer->GetGLProfiler(), "Radiosity [>= %d chunk(s)]", cnt);
-			for (size_t i = 0; i < chunks.size(); i++) {
-				Chunk &c = chunks[i];
-				if (!c.transferDone.exchange(true)) {
-					device->BindTexture(IGLDevice::Texture3D, textureFlat);
-					device->TexSubImage3D(IGLDevice::Texture3D, 0, c.cx * ChunkSize,
-					                      c.cy * ChunkSize, c.cz * ChunkSize, ChunkSize, ChunkSize,
-					                      ChunkSize, IGLDevice::BGRA,
-					                      IGLDevice::UnsignedInt2101010Rev, c.dataFlat);
-
-					device->BindTexture(IGLDevice::Texture3D, textureX);
-					device->TexSubImage3D(IGLDevice::Texture3D, 0, c.cx * ChunkSize,
-					                      c.cy * ChunkSize, c.cz * ChunkSize, ChunkSize, ChunkSize,
-					                      ChunkSize, IGLDevice::BGRA,
-					                      IGLDevice::UnsignedInt2101010Rev, c.dataX);
-
-					device->BindTexture(IGLDevice::Texture3D, textureY);
-					device->TexSubImage3D(IGLDevice::Texture3D, 0, c.cx * ChunkSize,
-					                      c.cy * ChunkSize, c.cz * ChunkSize, ChunkSize, ChunkSize,
-					                      ChunkSize, IGLDevice::BGRA,
-					                      IGLDevice::UnsignedInt2101010Rev, c.dataY);
-
-					device->BindTexture(IGLDevice::Texture3D, textureZ);
-					device->TexSubImage3D(IGLDevice::Texture3D, 0, c.cx * ChunkSize,
-					                      c.cy * ChunkSize, c.cz * ChunkSize, ChunkSize, ChunkSize,
-					                      ChunkSize, IGLDevice::BGRA,
-					                      IGLDevice::UnsignedInt2101010Rev, c.dataZ);
-				}
-			}
-		}
+			scheduler->Update(renderer->GetSceneDef());
 
-		void GLRadiosityRenderer::UpdateDirtyChunks() {
-			int dirtyChunkIds[256];
-			int numDirtyChunks = 0;
-			int nearDirtyChunks = 0;
-
-			// first, check only chunks in near range
-			Vector3 eyePos = renderer->GetSceneDef().viewOrigin;
-			int eyeX = (int)(eyePos.x) >> ChunkSizeBits;
-			int eyeY = (int)(eyePos.y) >> ChunkSizeBits;
-			int eyeZ = (int)(eyePos.z) >> ChunkSizeBits;
-
-			for (size_t i = 0; i < chunks.size(); i++) {
-				Chunk &c = chunks[i];
-				int dx = (c.cx - eyeX) & (chunkW - 1);
-				int dy = (c.cy - eyeY) & (chunkH - 1);
-				int dz = (c.cz - eyeZ);
-				if (dx >= 6 && dx <= chunkW - 6)
-					continue;
-				if (dy >= 6 && dy <= chunkW - 6)
-					continue;
-				if (dz >= 6 || dz <= -6)
-					continue;
-				if (c.dirty) {
-					dirtyChunkIds[numDirtyChunks++] = static_cast<int>(i);
-					nearDirtyChunks++;
-					if (numDirtyChunks >= 256)
-						break;
-				}
-			}
+			GLProfiler::Context profiler(renderer->GetGLProfiler(), "Radiosity [>= %d chunk(s)]",
+			                             scheduler->GetNumPendingUploads());
+			scheduler->Upload(MaxUploadsPerFrame);
+		}
 
-			// far chunks
-			if (numDirtyChunks == 0) {
-				for (size_t i = 0; i < chunks.size(); i++) {
-					Chunk &c = chunks[i];
-					if (c.dirty) {
-						dirtyChunkIds[numDirtyChunks++] = static_cast<int>(i);
-						if (numDirtyChunks >= 256)
-							break;
-					}
-				}
-			}
+		void GLRadiosityRenderer::UploadChunks(int cx, int cy, int minZ, int maxZ) {
+			SPADES_MARK_FUNCTION();
 
-			// limit update count per frame
-			for (int i = 0; i < 8; i++) {
-				if (numDirtyChunks <= 0)
-					break;
-				int idx = SampleRandomInt(0, numDirtyChunks - 1);
-				Chunk &c = chunks[dirtyChunkIds[idx]];
+			const std::size_t chunkVoxels = ChunkSize * ChunkSize * ChunkSize;
+			IGLDevice::UInteger textures[] = {textureFlat, textureX, textureY, textureZ};
 
-				// remove from list (fast)
-				if (idx < numDirtyChunks - 1) {
-					std::swap(dirtyChunkIds[idx], dirtyChunkIds[numDirtyChunks - 1]);
+			int numMerged = maxZ - minZ + 1;
+			uploadBuffer.resize(chunkVoxels * numMerged);
+			for (int i = 0; i < 4; i++) {
+				for (int cz = minZ; cz <= maxZ; cz++) {
+					Chunk &c = GetChunk(cx, cy, cz);
+					VoxelType *data = i == 0 ? &c.dataFlat[0][0][0]
+					                         : i == 1 ? &c.dataX[0][0][0]
+					                                  : i == 2 ? &c.dataY[0][0][0]
+					                                           : &c.dataZ[0][0][0];
+					std::memcpy(uploadBuffer.data() + chunkVoxels * (cz - minZ), data,
+					            chunkVoxels * sizeof(VoxelType));
 				}
-				numDirtyChunks--;
 
-				UpdateChunk(c.cx, c.cy, c.cz);
+				device->BindTexture(IGLDevice::Texture3D, textures[i]);
+				device->TexSubImage3D(IGLDevice::Texture3D, 0, cx * ChunkSize, cy * ChunkSize,
+				                      minZ * ChunkSize, ChunkSize, ChunkSize,
+				                      ChunkSize * numMerged, IGLDevice::BGRA,
+				                      IGLDevice::UnsignedInt2101010Rev, uploadBuffer.data());
 			}
-			/*
-			printf("%d (%d near) chunk update left\n",
-			       GetNumDirtyChunks(), nearDirtyChunks);*/
 		}
 
 		float GLRadiosityRenderer::CompressDynamicRange(float v) {
@@ -509,32 +537,81 @@ namespace spades {
 			return (uint32_t)out;
 		}
 
-		void GLRadiosityRenderer::UpdateChunk(int cx, int cy, int cz) {
-			Chunk &c = GetChunk(cx, cy, cz);
-			if (!c.dirty)
-				return;
-
-			int originX = cx * ChunkSize;
-			int originY = cy * ChunkSize;
-			int originZ = cz * ChunkSize;
-
-			for (int z = c.dirtyMinZ; z <= c.dirtyMaxZ; z++)
-				for (int y = c.dirtyMinY; y <= c.dirtyMaxY; y++)
-					for (int x = c.dirtyMinX; x <= c.dirtyMaxX; x++) {
-						IntVector3 pos;
-						pos.x = (x + originX);
-						pos.y = (y + originY);
-						pos.z = (z + originZ);
-
-						Result res = Evaluate(pos);
-						c.dataFlat[z][y][x] = EncodeValue(res.base);
-						c.dataX[z][y][x] = EncodeValue(res.x);
-						c.dataY[z][y][x] = EncodeValue(res.y);
-						c.dataZ[z][y][x] = EncodeValue(res.z);
+		void GLRadiosityRenderer::UpdateChunk(Chunk &c, IntVector3 minPos, IntVector3 maxPos,
+		                                      std::vector<float> &faceTable) {
+			SPADES_MARK_FUNCTION();
+			SPADES_TRACE_SCOPE("GLRadiosityRenderer::UpdateChunk");
+
+			int originX = c.cx * ChunkSize;
+			int originY = c.cy * ChunkSize;
+			int originZ = c.cz * ChunkSize;
+
+			// Decode the shadow map pixels seen by the region once instead of
+			// doing so for every voxel like `Evaluate` does.
+			int tableX = originX + minPos.x - Envelope;
+			int tableY = (originY + minPos.y) - (originZ + maxPos.z) - Envelope;
+			int tableWidth = maxPos.x - minPos.x + 1 + Envelope * 2;
+			int tableHeight = (maxPos.y - minPos.y) + (maxPos.z - minPos.z) + 1 + Envelope * 2;
+			int pitch = tableWidth + 3; // see `AccumulateRadiosity`
+			std::size_t planeSize = static_cast<std::size_t>(pitch * tableHeight);
+			faceTable.resize(planeSize * 8);
+
+			float *centerX = faceTable.data();
+			float *centerY = centerX + planeSize;
+			float *centerZ = centerY + planeSize;
+			float *normalY = centerZ + planeSize;
+			float *normalZ = normalY + planeSize;
+			float *red = normalZ + planeSize;
+			float *green = red + planeSize;
+			float *blue = green + planeSize;
+
+			const uint32_t *bitmap = renderer->mapShadowRenderer->bitmap.data();
+			for (int y = 0; y < tableHeight; y++) {
+				for (int x = 0; x < pitch; x++) {
+					std::size_t i = static_cast<std::size_t>(x + y * pitch);
+					int px = tableX + x;
+					int py = tableY + y;
+					uint32_t pixel = 0;
+					if (x < tableWidth) {
+						pixel = bitmap[(px & (w - 1)) + (py & (h - 1)) * w];
 					}
+					int depth = pixel >> 24;
+
+					// if true, this is negative-y faced plane
+					// if false, this is negative-z faced plane
+					bool isSide = (pixel & 0x80) != 0;
+
+					centerX[i] = px + .5f;
+					centerY[i] = (py + depth) + (isSide ? 0.f : .5f);
+					centerZ[i] = depth - (isSide ? .5f : 0.f);
+					normalY[i] = isSide ? 1.f : 0.f;
+					normalZ[i] = isSide ? 0.f : 1.f;
+					red[i] = static_cast<float>((pixel)&0x3f);
+					green[i] = static_cast<float>((pixel >> 8) & 0x3f);
+					blue[i] = static_cast<float>((pixel >> 16) & 0x3f);
+				}
+			}
 
-			c.dirty = false;
-			c.transferDone = false;
+			FaceTable table = {centerX, centerY, centerZ, normalY, normalZ,
+			                   red,     green,   blue,    pitch};
+			const float scale = 0.1f / 64.f;
+
+			for (int z = minPos.z; z <= maxPos.z; z++)
+				for (int y = minPos.y; y <= maxPos.y; y++)
+					for (int x = minPos.x; x <= maxPos.x; x++) {
+						Vector3 pos = MakeVector3(x + originX, y + originY, z + originZ);
+						pos += .5f;
+
+						int windowX = (originX + x - Envelope) - tableX;
+						int windowY = (originY + y) - (originZ + z) - Envelope - tableY;
+
+						Result res;
+						AccumulateRadiosity(table, windowX, windowY, pos, res);
+						c.dataFlat[z][y][x] = EncodeValue(res.base * scale);
+						c.dataX[z][y][x] = EncodeValue(res.x * scale);
+						c.dataY[z][y][x] = EncodeValue(res.y * scale);
+						c.dataZ[z][y][x] = EncodeValue(res.z * scale);
+					}
 		}
 	}
 }
@@ -21,11 +21,12 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <vector>
-#include <atomic>
 
 #include <Core/Debug.h>
 #include <Core/Math.h>
+#include "GLChunkUpdateScheduler.h"
 #include "IGLDevice.h"
 
 namespace spades {
@@ -40,14 +41,18 @@ namespace spades {
 
 			typedef uint32_t VoxelType;
 
-			class UpdateDispatch;
 			enum { ChunkSize = 16, ChunkSizeBits = 4, Envelope = 6 };
+
+			// the maximum number of the regions uploaded per frame. each region
+			// is a run of chunks in a column and takes one `TexSubImage3D` call
+			// per texture.
+			enum { MaxUploadsPerFrame = 8 };
 			GLRenderer *renderer;
 			IGLDevice *device;
 			GLSettings &settings;
 			client::GameMap *map;
 
-			struct Chunk {
+			struct Chunk : GLChunkUpdateState {
 				int cx, cy, cz;
 				VoxelType dataFlat[ChunkSize][ChunkSize][ChunkSize];
 				VoxelType dataX[ChunkSize][ChunkSize][ChunkSize];
@@ -57,10 +62,11 @@ namespace spades {
 				int dirtyMinX = 0, dirtyMaxX = ChunkSize - 1;
 				int dirtyMinY = 0, dirtyMaxY = ChunkSize - 1;
 				int dirtyMinZ = 0, dirtyMaxZ = ChunkSize - 1;
-
-				std::atomic<bool> transferDone { true };
 			};
 
+			using ChunkUpdateScheduler = GLChunkUpdateScheduler<GLRadiosityRenderer, Chunk>;
+			friend ChunkUpdateScheduler;
+
 			IGLDevice::UInteger textureFlat;
 			IGLDevice::UInteger textureX;
 			IGLDevice::UInteger textureY;
@@ -88,14 +94,20 @@ namespace spades {
 
 			void Invalidate(int minX, int minY, int minZ, int maxX, int maxY, int maxZ);
 
-			void UpdateChunk(int cx, int cy, int cz);
-			void UpdateDirtyChunks();
-			int GetNumDirtyChunks();
+			/**
+			 * Recomputes the given region (chunk-local) of a chunk. Can be
+			 * called on any thread.
+			 * @param faceTable Scratch buffer.
+			 */
+			void UpdateChunk(Chunk &, IntVector3 minPos, IntVector3 maxPos,
+			                 std::vector<float> &faceTable);
+			void UploadChunks(int cx, int cy, int minZ, int maxZ);
 
 			uint32_t EncodeValue(Vector3 vec);
 			float CompressDynamicRange(float v);
 
-			UpdateDispatch *dispatch;
+			std::unique_ptr<ChunkUpdateScheduler> scheduler;
+			std::vector<uint32_t> uploadBuffer;
 
 		public:
 			struct Result {
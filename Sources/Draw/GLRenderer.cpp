@@ -22,6 +22,7 @@
 #include <cstdlib>
 
 #include "GLAmbientShadowRenderer.h"
+#include "GLAsyncReadback.h"
 #include "GLAutoExposureFilter.h"
 #include "GLBloomFilter.h"
 #include "GLColorCorrectionFilter.h"
@@ -116,9 +117,12 @@ namespace spades {
 			fbManager = new GLFramebufferManager(_device, settings);
 
 			programManager = new GLProgramManager(_device, shadowMapRenderer, settings);
-			imageManager = new GLImageManager(_device);
+			imageManager = new GLImageManager(_device, settings);
 			imageRenderer = new GLImageRenderer(this);
 			profiler.reset(new GLProfiler(*this));
+			if (settings.r_asyncReadback) {
+				asyncReadback.reset(new GLAsyncReadback(device));
+			}
 
 			smoothedFogColor = MakeVector3(-1.f, -1.f, -1.f);
 
@@ -199,6 +203,7 @@ namespace spades {
 			}
 
 			device->Finish();
+			programManager->ReportBinaryCacheStatistics();
 			SPLog("GLRenderer initialized");
 		}
 
@@ -207,6 +212,7 @@ namespace spades {
 
 			SPLog("GLRender finalizing");
 			SetGameMap(nullptr);
+			asyncReadback.reset();
 			delete autoExposureFilter;
 			autoExposureFilter = NULL;
 			delete lensDustFilter;
@@ -253,7 +259,12 @@ namespace spades {
 
 		client::IImage *GLRenderer::RegisterImage(const char *filename) {
 			SPADES_MARK_FUNCTION();
-			return imageManager->RegisterImage(filename);
+			return imageManager->RegisterImageAsync(filename);
+		}
+
+		void GLRenderer::PreloadImage(const char *filename) {
+			SPADES_MARK_FUNCTION();
+			imageManager->PreloadImage(filename);
 		}
 
 		client::IModel *GLRenderer::RegisterModel(const char *filename) {
@@ -287,6 +298,10 @@ namespace spades {
 			}
 		}
 
+		float GLRenderer::GetMapLoadingProgress() {
+			return mapRenderer ? mapRenderer->GetLoadingProgress() : 1.f;
+		}
+
 		void GLRenderer::SetGameMap(client::GameMap *mp) {
 			SPADES_MARK_FUNCTION();
 
@@ -1466,6 +1481,16 @@ namespace spades {
 
 			lastTime = sceneDef.time;
 
+			{
+				GLProfiler::Context p(*profiler, "Upload Decoded Images");
+				imageManager->UploadDecodedImages();
+			}
+
+			if (asyncReadback) {
+				GLProfiler::Context p(*profiler, "Complete Framebuffer Reads");
+				asyncReadback->Poll();
+			}
+
 			// ready for 2d draw of next frame
 			device->BlendFunc(IGLDevice::One, IGLDevice::OneMinusSrcAlpha, IGLDevice::Zero,
 			                  IGLDevice::One);
@@ -1492,6 +1517,17 @@ namespace spades {
 			return bmp;
 		}
 
+		void GLRenderer::ReadBitmapAsync(std::function<void(Handle<Bitmap>)> callback) {
+			SPADES_MARK_FUNCTION();
+			EnsureSceneNotStarted();
+			if (!asyncReadback) {
+				callback(Handle<Bitmap>(ReadBitmap(), false));
+				return;
+			}
+			asyncReadback->Read(device->ScreenWidth(), device->ScreenHeight(),
+			                    std::move(callback));
+		}
+
 		void GLRenderer::GameMapChanged(int x, int y, int z, client::GameMap *map) {
 			if (mapRenderer)
 				mapRenderer->GameMapChanged(x, y, z, map);
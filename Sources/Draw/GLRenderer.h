@@ -61,6 +61,7 @@ namespace spades {
 		class GLSoftLitSpriteRenderer;
 		class GLAutoExposureFilter;
 		class GLProfiler;
+		class GLAsyncReadback;
 
 		class GLRenderer : public client::IRenderer, public client::IGameMapListener {
 			friend class GLShadowShader;
@@ -80,6 +81,9 @@ namespace spades {
 
 			std::unique_ptr<GLProfiler> profiler;
 
+			// used when r_asyncReadback = 1
+			std::unique_ptr<GLAsyncReadback> asyncReadback;
+
 			bool inited;
 			bool sceneUsedInThisFrame;
 
@@ -155,6 +159,7 @@ namespace spades {
 			void Shutdown() override;
 
 			client::IImage *RegisterImage(const char *filename) override;
+			void PreloadImage(const char *filename) override;
 			client::IModel *RegisterModel(const char *filename) override;
 
 			client::IImage *CreateImage(Bitmap *) override;
@@ -165,6 +170,7 @@ namespace spades {
 			GLShader *RegisterShader(const std::string &name);
 
 			void SetGameMap(client::GameMap *) override;
+			float GetMapLoadingProgress() override;
 			void SetFogColor(Vector3 v) override;
 			void SetFogDistance(float f) override { fogDistance = f; }
 
@@ -203,6 +209,7 @@ namespace spades {
 			void FrameDone() override;
 			void Flip() override;
 			Bitmap *ReadBitmap() override;
+			void ReadBitmapAsync(std::function<void(Handle<Bitmap>)>) override;
 
 			float ScreenWidth() override;
 			float ScreenHeight() override;
@@ -211,6 +218,7 @@ namespace spades {
 			IGLDevice *GetGLDevice() { return device; }
 			GLProfiler &GetGLProfiler() { return *profiler; }
 			GLFramebufferManager *GetFramebufferManager() { return fbManager; }
+			GLImageManager *GetImageManager() { return imageManager; }
 			IGLShadowMapRenderer *GetShadowMapRenderer() { return shadowMapRenderer; }
 			GLAmbientShadowRenderer *GetAmbientShadowRenderer() { return ambientShadowRenderer; }
 			GLMapShadowRenderer *GetMapShadowRenderer() { return mapShadowRenderer; }
@@ -29,6 +29,7 @@
 #include "GLRenderer.h"
 #include "GLSSAOFilter.h"
 #include "GLImage.h"
+#include "GLImageManager.h"
 #include "IGLDevice.h"
 #include <Core/Debug.h>
 #include <Core/Math.h>
@@ -42,7 +43,7 @@ namespace spades {
 			bilateralProgram =
 			  renderer->RegisterProgram("Shaders/PostFilters/BilateralFilter.program");
 
-			ditherPattern = static_cast<GLImage *>(renderer->RegisterImage("Gfx/DitherPattern4x4.png"));
+			ditherPattern = renderer->GetImageManager()->RegisterImage("Gfx/DitherPattern4x4.png");
 		}
 
 		GLColorBuffer GLSSAOFilter::GenerateRawSSAOImage(int width, int height) {
@@ -20,8 +20,10 @@
 
 #include "GLSettings.h"
 
+DEFINE_SPADES_SETTING(r_asyncReadback, "0");
 DEFINE_SPADES_SETTING(r_blitFramebuffer, "1");
 DEFINE_SPADES_SETTING(r_bloom, "1");
+DEFINE_SPADES_SETTING(r_bufferStorage, "0");
 DEFINE_SPADES_SETTING(r_cameraBlur, "1");
 DEFINE_SPADES_SETTING(r_colorCorrection, "1");
 DEFINE_SPADES_SETTING(r_debugTiming, "0");
@@ -32,6 +34,8 @@ DEFINE_SPADES_SETTING(r_debugTimingGPUTime, "1");
 DEFINE_SPADES_SETTING(r_debugTimingOutputBarScale, "2");
 DEFINE_SPADES_SETTING(r_debugTimingFlush, "0");
 DEFINE_SPADES_SETTING(r_debugTimingFillGap, "0");
+DEFINE_SPADES_SETTING(r_debugTimingTrace, "0");
+DEFINE_SPADES_SETTING(r_debugTimingTraceHitch, "100");
 DEFINE_SPADES_SETTING(r_depthOfField, "0");
 DEFINE_SPADES_SETTING(r_depthOfFieldMaxCoc, "0.01");
 DEFINE_SPADES_SETTING(r_depthPrepass, "1");
@@ -45,21 +49,35 @@ DEFINE_SPADES_SETTING(r_hdrAutoExposureMax, "0.5");
 DEFINE_SPADES_SETTING(r_hdrAutoExposureSpeed, "1");
 DEFINE_SPADES_SETTING(r_hdrGamma, "2.2");
 DEFINE_SPADES_SETTING(r_highPrec, "1");
+DEFINE_SPADES_SETTING(r_imageAsyncLoading, "0");
+DEFINE_SPADES_SETTING(r_imageUploadBudget, "2");
 DEFINE_SPADES_SETTING(r_lens, "1");
 DEFINE_SPADES_SETTING(r_lensFlare, "1");
 DEFINE_SPADES_SETTING(r_lensFlareDynamic, "1");
+DEFINE_SPADES_SETTING(r_mapChunkAsyncMeshing, "1");
+DEFINE_SPADES_SETTING(r_mapChunkCompactVertex, "0");
+DEFINE_SPADES_SETTING(r_mapChunkGreedyMeshing, "0");
+DEFINE_SPADES_SETTING(r_mapChunkLOD, "0");
+DEFINE_SPADES_SETTING(r_mapChunkLODError, "2");
+DEFINE_SPADES_SETTING(r_mapChunkOcclusionCulling, "0");
+DEFINE_SPADES_SETTING(r_mapChunkTimeBudget, "4");
+DEFINE_SPADES_SETTING(r_mapChunkUploadBudget, "1024");
 DEFINE_SPADES_SETTING(r_mapSoftShadow, "0");
 DEFINE_SPADES_SETTING(r_maxAnisotropy, "8");
+DEFINE_SPADES_SETTING(r_modelInstancing, "0");
 DEFINE_SPADES_SETTING(r_modelShadows, "1");
 DEFINE_SPADES_SETTING(r_multisamples, "0");
 DEFINE_SPADES_SETTING(r_occlusionQuery, "0");
 DEFINE_SPADES_SETTING(r_optimizedVoxelModel, "1");
 DEFINE_SPADES_SETTING(r_physicalLighting, "0");
+DEFINE_SPADES_SETTING(r_programBinaryCache, "1");
 DEFINE_SPADES_SETTING(r_radiosity, "0");
 DEFINE_SPADES_SETTING(r_saturation, "1");
 DEFINE_SPADES_SETTING(r_shadowMapSize, "2048");
 DEFINE_SPADES_SETTING(r_softParticles, "1");
 DEFINE_SPADES_SETTING(r_sparseShadowMaps, "1");
+DEFINE_SPADES_SETTING(r_spriteInstancing, "0");
+DEFINE_SPADES_SETTING(r_spriteSorting, "0");
 DEFINE_SPADES_SETTING(r_srgb, "0");
 DEFINE_SPADES_SETTING(r_srgb2D, "1");
 DEFINE_SPADES_SETTING(r_ssao, "0");
@@ -27,8 +27,10 @@ namespace spades {
 		public:
 			GLSettings();
 
+			TypedItemHandle<bool> r_asyncReadback       { *this, "r_asyncReadback", ItemFlags::Latch };
 			TypedItemHandle<bool> r_blitFramebuffer     { *this, "r_blitFramebuffer" };
 			TypedItemHandle<bool> r_bloom               { *this, "r_bloom" };
+			TypedItemHandle<bool> r_bufferStorage       { *this, "r_bufferStorage", ItemFlags::Latch };
 			TypedItemHandle<bool> r_cameraBlur          { *this, "r_cameraBlur", ItemFlags::Latch };
 			TypedItemHandle<bool> r_colorCorrection     { *this, "r_colorCorrection" };
 			TypedItemHandle<bool> r_debugTiming         { *this, "r_debugTiming" };
@@ -39,6 +41,8 @@ namespace spades {
 			TypedItemHandle<float> r_debugTimingOutputBarScale { *this, "r_debugTimingOutputBarScale" };
 			TypedItemHandle<bool> r_debugTimingFlush    { *this, "r_debugTimingFlush" };
 			TypedItemHandle<bool> r_debugTimingFillGap  { *this, "r_debugTimingFillGap" };
+			TypedItemHandle<int> r_debugTimingTrace     { *this, "r_debugTimingTrace" };
+			TypedItemHandle<float> r_debugTimingTraceHitch { *this, "r_debugTimingTraceHitch" };
 			TypedItemHandle<int> r_depthOfField         { *this, "r_depthOfField" };
 			TypedItemHandle<float> r_depthOfFieldMaxCoc { *this, "r_depthOfFieldMaxCoc" };
 			TypedItemHandle<bool> r_depthPrepass        { *this, "r_depthPrepass" };
@@ -52,21 +56,35 @@ namespace spades {
 			TypedItemHandle<float> r_hdrAutoExposureSpeed{ *this, "r_hdrAutoExposureSpeed" };
 			TypedItemHandle<float> r_hdrGamma           { *this, "r_hdrGamma" };
 			TypedItemHandle<bool> r_highPrec            { *this, "r_highPrec", ItemFlags::Latch };
+			TypedItemHandle<bool> r_imageAsyncLoading   { *this, "r_imageAsyncLoading" };
+			TypedItemHandle<float> r_imageUploadBudget  { *this, "r_imageUploadBudget" };
 			TypedItemHandle<bool> r_lens                { *this, "r_lens" };
 			TypedItemHandle<bool> r_lensFlare           { *this, "r_lensFlare" };
 			TypedItemHandle<bool> r_lensFlareDynamic    { *this, "r_lensFlareDynamic" };
+			TypedItemHandle<bool> r_mapChunkAsyncMeshing { *this, "r_mapChunkAsyncMeshing" };
+			TypedItemHandle<bool> r_mapChunkCompactVertex { *this, "r_mapChunkCompactVertex", ItemFlags::Latch };
+			TypedItemHandle<bool> r_mapChunkGreedyMeshing { *this, "r_mapChunkGreedyMeshing" };
+			TypedItemHandle<bool> r_mapChunkLOD         { *this, "r_mapChunkLOD" };
+			TypedItemHandle<float> r_mapChunkLODError  { *this, "r_mapChunkLODError" };
+			TypedItemHandle<bool> r_mapChunkOcclusionCulling { *this, "r_mapChunkOcclusionCulling" };
+			TypedItemHandle<float> r_mapChunkTimeBudget { *this, "r_mapChunkTimeBudget" };
+			TypedItemHandle<int> r_mapChunkUploadBudget { *this, "r_mapChunkUploadBudget" };
 			TypedItemHandle<bool> r_mapSoftShadow       { *this, "r_mapSoftShadow", ItemFlags::Latch };
 			TypedItemHandle<float> r_maxAnisotropy      { *this, "r_maxAnisotropy", ItemFlags::Latch };
+			TypedItemHandle<bool> r_modelInstancing     { *this, "r_modelInstancing", ItemFlags::Latch };
 			TypedItemHandle<bool> r_modelShadows        { *this, "r_modelShadows", ItemFlags::Latch };
 			TypedItemHandle<int> r_multisamples         { *this, "r_multisamples", ItemFlags::Latch };
 			TypedItemHandle<bool> r_occlusionQuery      { *this, "r_occlusionQuery" };
 			TypedItemHandle<bool> r_optimizedVoxelModel { *this, "r_optimizedVoxelModel", ItemFlags::Latch };
 			TypedItemHandle<bool> r_physicalLighting    { *this, "r_physicalLighting", ItemFlags::Latch };
+			TypedItemHandle<bool> r_programBinaryCache  { *this, "r_programBinaryCache" };
 			TypedItemHandle<int> r_radiosity            { *this, "r_radiosity", ItemFlags::Latch };
 			TypedItemHandle<float> r_saturation         { *this, "r_saturation" };
 			TypedItemHandle<int> r_shadowMapSize        { *this, "r_shadowMapSize", ItemFlags::Latch };
 			TypedItemHandle<bool> r_softParticles       { *this, "r_softParticles" };
 			TypedItemHandle<bool> r_sparseShadowMaps    { *this, "r_sparseShadowMaps", ItemFlags::Latch };
+			TypedItemHandle<bool> r_spriteInstancing    { *this, "r_spriteInstancing", ItemFlags::Latch };
+			TypedItemHandle<bool> r_spriteSorting       { *this, "r_spriteSorting" };
 			TypedItemHandle<bool> r_srgb                { *this, "r_srgb", ItemFlags::Latch };
 			TypedItemHandle<bool> r_srgb2D              { *this, "r_srgb2D", ItemFlags::Latch };
 			TypedItemHandle<int> r_ssao                 { *this, "r_ssao", ItemFlags::Latch };
@@ -39,6 +39,7 @@ namespace spades {
 			~GLShader();
 
 			void AddSource(const std::string &);
+			const std::vector<std::string> &GetSources() const { return sources; }
 
 			void Compile();
 			IGLDevice::UInteger GetHandle() const { return handle; }
@@ -22,6 +22,7 @@
 #include "GLAmbientShadowRenderer.h"
 #include "GLBasicShadowMapRenderer.h"
 #include "GLImage.h"
+#include "GLImageManager.h"
 #include "GLMapShadowRenderer.h"
 #include "GLProgramManager.h"
 #include "GLRadiosityRenderer.h"
@@ -131,7 +132,7 @@ namespace spades {
 				dev->BindTexture(IGLDevice::Texture2D, renderer->mapShadowRenderer->GetTexture());
 			} else {
 				// TODO: do this case properly
-				GLImage *img = (GLImage *)renderer->RegisterImage("Gfx/White.tga");
+				GLImage *img = renderer->GetImageManager()->RegisterImage("Gfx/White.tga");
 				img->Bind(IGLDevice::Texture2D);
 			}
 			mapShadowTexture.SetValue(texStage);
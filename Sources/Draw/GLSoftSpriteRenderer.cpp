@@ -36,6 +36,7 @@ namespace spades {
 		    : renderer(renderer),
 		      device(renderer->GetGLDevice()),
 		      settings(renderer->GetSettings()),
+		      instancer(renderer),
 		      projectionViewMatrix("projectionViewMatrix"),
 		      rightVector("rightVector"),
 		      upVector("upVector"),
@@ -46,10 +47,7 @@ namespace spades {
 		      viewMatrix("viewMatrix"),
 		      fogDistance("fogDistance"),
 		      fogColor("fogColor"),
-		      zNearFar("zNearFar"),
-		      positionAttribute("positionAttribute"),
-		      spritePosAttribute("spritePosAttribute"),
-		      colorAttribute("colorAttribute") {
+		      zNearFar("zNearFar") {
 			SPADES_MARK_FUNCTION();
 
 			program = renderer->RegisterProgram("Shaders/SoftSprite.program");
@@ -82,14 +80,30 @@ namespace spades {
 				}
 			}
 			spr.color = color;
-			spr.area = rad * rad * 4.f /
-			           std::max(Vector3::Dot(center - def.viewOrigin, def.viewAxis[2]), 0.01f);
+			float depth = Vector3::Dot(center - def.viewOrigin, def.viewAxis[2]);
+			spr.area = rad * rad * 4.f / std::max(depth, 0.01f);
 			sprites.push_back(spr);
+			sorter.Add(img, depth);
 		}
 
 		void GLSoftSpriteRenderer::Clear() {
 			SPADES_MARK_FUNCTION();
 			sprites.clear();
+			sorter.Clear();
+		}
+
+		void GLSoftSpriteRenderer::AddInstance(const Sprite &spr, float fade) {
+			GLSpriteInstancer::Instance instance;
+			instance.x = spr.center.x;
+			instance.y = spr.center.y;
+			instance.z = spr.center.z;
+			instance.radius = spr.radius;
+			instance.angle = spr.angle;
+			instance.r = spr.color.x * fade;
+			instance.g = spr.color.y * fade;
+			instance.b = spr.color.z * fade;
+			instance.a = spr.color.w * fade;
+			instancer.Add(spr.image, instance);
 		}
 
 		float GLSoftSpriteRenderer::LayerForSprite(const Sprite &spr) {
@@ -103,7 +117,6 @@ namespace spades {
 
 		void GLSoftSpriteRenderer::Render() {
 			SPADES_MARK_FUNCTION();
-			lastImage = NULL;
 			program->Use();
 
 			device->Enable(IGLDevice::Blend, true);
@@ -121,10 +134,6 @@ namespace spades {
 			fogColor(program);
 			zNearFar(program);
 
-			positionAttribute(program);
-			spritePosAttribute(program);
-			colorAttribute(program);
-
 			projectionViewMatrix.SetValue(renderer->GetProjectionViewMatrix());
 			viewMatrix.SetValue(renderer->GetViewMatrix());
 
@@ -149,9 +158,12 @@ namespace spades {
 			                    renderer->GetFramebufferManager()->GetDepthTexture());
 			device->ActiveTexture(0);
 
-			device->EnableVertexAttribArray(positionAttribute(), true);
-			device->EnableVertexAttribArray(spritePosAttribute(), true);
-			device->EnableVertexAttribArray(colorAttribute(), true);
+			// grouping the sprites by image changes the blending order of the
+			// sprites of different images, so it's opt-in
+			if (settings.r_spriteSorting) {
+				sorter.Sort();
+			}
+			instancer.Begin(program);
 
 			thresLow = tanf(def.fovX * .5f) * tanf(def.fovY * .5f) * 1.8f;
 			thresRange = thresLow * .5f;
@@ -159,57 +171,15 @@ namespace spades {
 			// full-resolution sprites
 			{
 				GLProfiler::Context measure(renderer->GetGLProfiler(), "Full Resolution");
-				for (size_t i = 0; i < sprites.size(); i++) {
-					Sprite &spr = sprites[i];
+				for (std::size_t i = 0; i < sorter.GetNumSprites(); i++) {
+					const Sprite &spr = sprites[sorter.GetSpriteIndex(i)];
 					float layer = LayerForSprite(spr);
 					if (layer == 1.f)
 						continue;
-					if (spr.image != lastImage) {
-						Flush();
-						lastImage = spr.image;
-						SPAssert(vertices.empty());
-					}
-
-					Vertex v;
-					v.x = spr.center.x;
-					v.y = spr.center.y;
-					v.z = spr.center.z;
-					v.radius = spr.radius;
-					v.angle = spr.angle;
-					v.r = spr.color.x;
-					v.g = spr.color.y;
-					v.b = spr.color.z;
-					v.a = spr.color.w;
-
-					float fade = 1.f - layer;
-					v.r *= fade;
-					v.g *= fade;
-					v.b *= fade;
-					v.a *= fade;
-
-					uint32_t idx = (uint32_t)vertices.size();
-					v.sx = -1;
-					v.sy = -1;
-					vertices.push_back(v);
-					v.sx = 1;
-					v.sy = -1;
-					vertices.push_back(v);
-					v.sx = -1;
-					v.sy = 1;
-					vertices.push_back(v);
-					v.sx = 1;
-					v.sy = 1;
-					vertices.push_back(v);
-
-					indices.push_back(idx);
-					indices.push_back(idx + 1);
-					indices.push_back(idx + 2);
-					indices.push_back(idx + 1);
-					indices.push_back(idx + 3);
-					indices.push_back(idx + 2);
+					AddInstance(spr, 1.f - layer);
 				}
 
-				Flush();
+				instancer.Flush();
 			}
 
 			// low-res sprites
@@ -225,58 +195,15 @@ namespace spades {
 			device->Viewport(0, 0, lW, lH);
 			{
 				GLProfiler::Context measure(renderer->GetGLProfiler(), "Low Resolution");
-				for (size_t i = 0; i < sprites.size(); i++) {
-					Sprite &spr = sprites[i];
+				for (std::size_t i = 0; i < sorter.GetNumSprites(); i++) {
+					const Sprite &spr = sprites[sorter.GetSpriteIndex(i)];
 					float layer = LayerForSprite(spr);
 					if (layer == 0.f)
 						continue;
-					if (spr.image != lastImage) {
-						Flush();
-						lastImage = spr.image;
-						SPAssert(vertices.empty());
-					}
-
 					numLowResSprites++;
-
-					Vertex v;
-					v.x = spr.center.x;
-					v.y = spr.center.y;
-					v.z = spr.center.z;
-					v.radius = spr.radius;
-					v.angle = spr.angle;
-					v.r = spr.color.x;
-					v.g = spr.color.y;
-					v.b = spr.color.z;
-					v.a = spr.color.w;
-
-					float fade = layer;
-					v.r *= fade;
-					v.g *= fade;
-					v.b *= fade;
-					v.a *= fade;
-
-					uint32_t idx = (uint32_t)vertices.size();
-					v.sx = -1;
-					v.sy = -1;
-					vertices.push_back(v);
-					v.sx = 1;
-					v.sy = -1;
-					vertices.push_back(v);
-					v.sx = -1;
-					v.sy = 1;
-					vertices.push_back(v);
-					v.sx = 1;
-					v.sy = 1;
-					vertices.push_back(v);
-
-					indices.push_back(idx);
-					indices.push_back(idx + 1);
-					indices.push_back(idx + 2);
-					indices.push_back(idx + 1);
-					indices.push_back(idx + 3);
-					indices.push_back(idx + 2);
+					AddInstance(spr, layer);
 				}
-				Flush();
+				instancer.Flush();
 			}
 
 			// finalize
@@ -285,9 +212,7 @@ namespace spades {
 			device->BindTexture(IGLDevice::Texture2D, 0);
 			device->ActiveTexture(0);
 			device->BindTexture(IGLDevice::Texture2D, 0);
-			device->EnableVertexAttribArray(positionAttribute(), false);
-			device->EnableVertexAttribArray(spritePosAttribute(), false);
-			device->EnableVertexAttribArray(colorAttribute(), false);
+			instancer.End();
 
 			// composite downsampled sprite
 			device->BlendFunc(IGLDevice::One, IGLDevice::OneMinusSrcAlpha);
@@ -365,29 +290,5 @@ namespace spades {
 
 			buf.Release();
 		}
-
-		void GLSoftSpriteRenderer::Flush() {
-			SPADES_MARK_FUNCTION_DEBUG();
-
-			if (vertices.empty())
-				return;
-
-			device->VertexAttribPointer(positionAttribute(), 4, IGLDevice::FloatType, false,
-			                            sizeof(Vertex), &(vertices[0].x));
-			device->VertexAttribPointer(spritePosAttribute(), 4, IGLDevice::FloatType, false,
-			                            sizeof(Vertex), &(vertices[0].sx));
-			device->VertexAttribPointer(colorAttribute(), 4, IGLDevice::FloatType, false,
-			                            sizeof(Vertex), &(vertices[0].r));
-
-			SPAssert(lastImage);
-			lastImage->Bind(IGLDevice::Texture2D);
-
-			device->DrawElements(IGLDevice::Triangles,
-			                     static_cast<IGLDevice::Sizei>(indices.size()),
-			                     IGLDevice::UnsignedInt, indices.data());
-
-			vertices.clear();
-			indices.clear();
-		}
 	}
 }
@@ -20,12 +20,12 @@
 
 #pragma once
 
-#include <cstdint>
 #include <vector>
 
 #include <Core/Math.h>
-#include "GLProgramAttribute.h"
 #include "GLProgramUniform.h"
+#include "GLSpriteInstancer.h"
+#include "GLSpriteSorter.h"
 #include "IGLSpriteRenderer.h"
 
 namespace spades {
@@ -44,28 +44,12 @@ namespace spades {
 				float area;
 			};
 
-			struct Vertex {
-				// center position
-				float x, y, z;
-				float radius;
-
-				// point coord
-				float sx, sy;
-				float angle;
-
-				// color
-				float r, g, b, a;
-			};
-
 			GLRenderer *renderer;
 			IGLDevice *device;
 			GLSettings &settings;
 			std::vector<Sprite> sprites;
-
-			GLImage *lastImage;
-
-			std::vector<Vertex> vertices;
-			std::vector<uint32_t> indices;
+			GLSpriteSorter sorter;
+			GLSpriteInstancer instancer;
 
 			GLProgram *program;
 			GLProgramUniform projectionViewMatrix;
@@ -80,14 +64,10 @@ namespace spades {
 			GLProgramUniform fogColor;
 			GLProgramUniform zNearFar;
 
-			GLProgramAttribute positionAttribute;
-			GLProgramAttribute spritePosAttribute;
-			GLProgramAttribute colorAttribute;
-
 			float thresLow, thresRange;
 
-			void Flush();
 			float LayerForSprite(const Sprite &);
+			void AddInstance(const Sprite &, float fade);
 
 		public:
 			GLSoftSpriteRenderer(GLRenderer *);
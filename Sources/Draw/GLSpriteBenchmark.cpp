@@ -0,0 +1,227 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <cstdint>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+#include "GLSpriteInstancer.h"
+#include "GLSpriteSorter.h"
+#include <Core/Benchmark.h>
+#include <Core/Debug.h>
+#include <Core/Exception.h>
+#include <Core/Math.h>
+#include <Core/Stopwatch.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			struct Sprite {
+				GLImage *image;
+				Vector3 center;
+				float radius;
+				float angle;
+				Vector4 color;
+			};
+
+			/** The vertex format of the sprite renderers before instancing. */
+			struct LegacyVertex {
+				float x, y, z;
+				float radius;
+				float sx, sy;
+				float angle;
+				float r, g, b, a;
+			};
+
+			/** Emulates a firefight: bursts of smoke, blood and debris particles
+			 * from several effects are interleaved in the submission order. */
+			std::vector<Sprite> MakeSpriteStorm(std::size_t count) {
+				std::mt19937 random(1);
+				std::uniform_real_distribution<float> unit(0.f, 1.f);
+				std::vector<Sprite> sprites;
+				while (sprites.size() < count) {
+					auto image = reinterpret_cast<GLImage *>(std::uintptr_t(1 + random() % 8));
+					Vector3 origin =
+					  MakeVector3(unit(random) * 100.f - 50.f, unit(random) * 100.f + 1.f,
+					              unit(random) * 20.f + 30.f);
+					std::size_t burst = 1 + random() % 16;
+					for (std::size_t i = 0; i < burst && sprites.size() < count; i++) {
+						Sprite spr;
+						spr.image = image;
+						spr.center = origin + MakeVector3(unit(random), unit(random),
+						                                  unit(random)) * 4.f;
+						spr.radius = unit(random) + .1f;
+						spr.angle = unit(random) * 6.28f;
+						spr.color = MakeVector4(unit(random), unit(random), unit(random), 1.f);
+						sprites.push_back(spr);
+					}
+				}
+				return sprites;
+			}
+
+			/** The CPU work of the sprite renderers before instancing. */
+			std::size_t ExpandLegacy(const std::vector<Sprite> &sprites,
+			                         std::vector<LegacyVertex> &vertices,
+			                         std::vector<std::uint32_t> &indices) {
+				std::size_t numDrawCalls = 0;
+				GLImage *lastImage = nullptr;
+				vertices.clear();
+				indices.clear();
+				for (const Sprite &spr : sprites) {
+					if (spr.image != lastImage) {
+						numDrawCalls += vertices.empty() ? 0 : 1;
+						vertices.clear();
+						indices.clear();
+						lastImage = spr.image;
+					}
+
+					LegacyVertex v;
+					v.x = spr.center.x;
+					v.y = spr.center.y;
+					v.z = spr.center.z;
+					v.radius = spr.radius;
+					v.angle = spr.angle;
+					v.r = spr.color.x;
+					v.g = spr.color.y;
+					v.b = spr.color.z;
+					v.a = spr.color.w;
+
+					auto idx = static_cast<std::uint32_t>(vertices.size());
+					for (int i = 0; i < 4; i++) {
+						v.sx = (i & 1) ? 1.f : -1.f;
+						v.sy = (i & 2) ? 1.f : -1.f;
+						vertices.push_back(v);
+					}
+					indices.push_back(idx);
+					indices.push_back(idx + 1);
+					indices.push_back(idx + 2);
+					indices.push_back(idx + 1);
+					indices.push_back(idx + 3);
+					indices.push_back(idx + 2);
+				}
+				return numDrawCalls + (vertices.empty() ? 0 : 1);
+			}
+
+			/** The CPU work of the sprite renderers with `GLSpriteInstancer`. `sort`
+			 * corresponds to `r_spriteSorting`. */
+			std::size_t SortAndPack(const std::vector<Sprite> &sprites, GLSpriteSorter &sorter,
+			                        std::vector<GLSpriteInstancer::Instance> &instances,
+			                        bool sort) {
+				const Vector3 viewOrigin = MakeVector3(0.f, 0.f, 40.f);
+				const Vector3 viewFront = MakeVector3(0.f, 1.f, 0.f);
+
+				sorter.Clear();
+				for (const Sprite &spr : sprites) {
+					sorter.Add(spr.image, Vector3::Dot(spr.center - viewOrigin, viewFront));
+				}
+				if (sort) {
+					sorter.Sort();
+				}
+
+				std::size_t numDrawCalls = 0;
+				GLImage *lastImage = nullptr;
+				instances.clear();
+				for (std::size_t i = 0; i < sorter.GetNumSprites(); i++) {
+					const Sprite &spr = sprites[sorter.GetSpriteIndex(i)];
+					if (spr.image != lastImage) {
+						numDrawCalls++;
+						lastImage = spr.image;
+					}
+
+					GLSpriteInstancer::Instance instance;
+					instance.x = spr.center.x;
+					instance.y = spr.center.y;
+					instance.z = spr.center.z;
+					instance.radius = spr.radius;
+					instance.angle = spr.angle;
+					instance.r = spr.color.x;
+					instance.g = spr.color.y;
+					instance.b = spr.color.z;
+					instance.a = spr.color.w;
+					instances.push_back(instance);
+				}
+				return numDrawCalls;
+			}
+
+			void SpriteBenchmark() {
+				const std::size_t numSprites = 10000;
+				const int numFrames = 200;
+
+				std::vector<Sprite> sprites = MakeSpriteStorm(numSprites);
+
+				std::vector<LegacyVertex> vertices;
+				std::vector<std::uint32_t> indices;
+				std::size_t legacyDrawCalls = ExpandLegacy(sprites, vertices, indices);
+				Stopwatch sw;
+				for (int i = 0; i < numFrames; i++) {
+					ExpandLegacy(sprites, vertices, indices);
+				}
+				double legacyTime = sw.GetTime() / numFrames;
+
+				GLSpriteSorter sorter;
+				std::vector<GLSpriteInstancer::Instance> instances;
+				std::size_t unsortedDrawCalls = SortAndPack(sprites, sorter, instances, false);
+				sw.Reset();
+				for (int i = 0; i < numFrames; i++) {
+					SortAndPack(sprites, sorter, instances, false);
+				}
+				double unsortedTime = sw.GetTime() / numFrames;
+
+				std::size_t drawCalls = SortAndPack(sprites, sorter, instances, true);
+				sw.Reset();
+				for (int i = 0; i < numFrames; i++) {
+					SortAndPack(sprites, sorter, instances, true);
+				}
+				double time = sw.GetTime() / numFrames;
+
+				// every image must form a single run ordered back to front (up to the
+				// precision of the depth key, which has 8 bits of mantissa)
+				for (std::size_t i = 1; i < sorter.GetNumSprites(); i++) {
+					const Sprite &prev = sprites[sorter.GetSpriteIndex(i - 1)];
+					const Sprite &spr = sprites[sorter.GetSpriteIndex(i)];
+					if (prev.image == spr.image &&
+					    prev.center.y < spr.center.y * (1.f - 1.f / 128.f)) {
+						SPRaise("Sprites of an image are not ordered back to front");
+					}
+				}
+				std::unordered_set<GLImage *> images;
+				for (const Sprite &spr : sprites) {
+					images.insert(spr.image);
+				}
+				if (drawCalls != images.size()) {
+					SPRaise("Sprites of an image are split into multiple draw calls");
+				}
+
+				SPLog("%d sprites, %d frames", (int)numSprites, numFrames);
+				SPLog("vertex expansion: %.3fms/frame, %d draw calls, %d bytes",
+				      legacyTime * 1000.0, (int)legacyDrawCalls,
+				      (int)(numSprites * (sizeof(LegacyVertex) * 4 + sizeof(std::uint32_t) * 6)));
+				SPLog("unsorted instances: %.3fms/frame, %d draw calls, %d bytes",
+				      unsortedTime * 1000.0, (int)unsortedDrawCalls,
+				      (int)(instances.size() * sizeof(instances[0])));
+				SPLog("sorted instances: %.3fms/frame, %d draw calls, %d bytes", time * 1000.0,
+				      (int)drawCalls, (int)(instances.size() * sizeof(instances[0])));
+			}
+
+			Benchmark spriteBenchmark("sprites", SpriteBenchmark);
+		}
+	}
+}
@@ -0,0 +1,193 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cstddef>
+
+#include "GLImage.h"
+#include "GLProgram.h"
+#include "GLRenderer.h"
+#include "GLSettings.h"
+#include "GLSpriteInstancer.h"
+#include <Core/Debug.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			// in the order of a triangle strip
+			const float QuadCorners[] = {-1.f, -1.f, 1.f, -1.f, -1.f, 1.f, 1.f, 1.f};
+		}
+
+		GLSpriteInstancer::GLSpriteInstancer(GLRenderer *renderer)
+		    : device(renderer->GetGLDevice()),
+		      useInstancing(renderer->GetSettings().r_spriteInstancing),
+		      buffer(device, renderer->GetSettings().r_bufferStorage),
+		      cornerBuffer(0),
+		      positionAttribute("positionAttribute"),
+		      colorAttribute("colorAttribute"),
+		      angleAttribute("angleAttribute"),
+		      cornerAttribute("cornerAttribute") {
+			SPADES_MARK_FUNCTION();
+
+			if (useInstancing) {
+				cornerBuffer = device->GenBuffer();
+				device->BindBuffer(IGLDevice::ArrayBuffer, cornerBuffer);
+				device->BufferData(IGLDevice::ArrayBuffer, sizeof(QuadCorners), QuadCorners,
+				                   IGLDevice::StaticDraw);
+				device->BindBuffer(IGLDevice::ArrayBuffer, 0);
+			}
+		}
+
+		GLSpriteInstancer::~GLSpriteInstancer() {
+			SPADES_MARK_FUNCTION();
+			if (cornerBuffer) {
+				device->DeleteBuffer(cornerBuffer);
+			}
+		}
+
+		void GLSpriteInstancer::Begin(GLProgram *program) {
+			SPADES_MARK_FUNCTION();
+
+			positionAttribute(program);
+			colorAttribute(program);
+			angleAttribute(program);
+			cornerAttribute(program);
+
+			device->EnableVertexAttribArray(positionAttribute(), true);
+			device->EnableVertexAttribArray(colorAttribute(), true);
+			device->EnableVertexAttribArray(angleAttribute(), true);
+			device->EnableVertexAttribArray(cornerAttribute(), true);
+
+			if (useInstancing) {
+				device->BindBuffer(IGLDevice::ArrayBuffer, cornerBuffer);
+				device->VertexAttribPointer(cornerAttribute(), 2, IGLDevice::FloatType, false,
+				                            sizeof(float) * 2, nullptr);
+				device->BindBuffer(IGLDevice::ArrayBuffer, 0);
+
+				device->VertexAttribDivisor(positionAttribute(), 1);
+				device->VertexAttribDivisor(colorAttribute(), 1);
+				device->VertexAttribDivisor(angleAttribute(), 1);
+			}
+		}
+
+		void GLSpriteInstancer::End() {
+			SPADES_MARK_FUNCTION();
+
+			// the attribute slots are shared with other programs
+			if (useInstancing) {
+				device->VertexAttribDivisor(positionAttribute(), 0);
+				device->VertexAttribDivisor(colorAttribute(), 0);
+				device->VertexAttribDivisor(angleAttribute(), 0);
+			}
+
+			device->EnableVertexAttribArray(positionAttribute(), false);
+			device->EnableVertexAttribArray(colorAttribute(), false);
+			device->EnableVertexAttribArray(angleAttribute(), false);
+			device->EnableVertexAttribArray(cornerAttribute(), false);
+		}
+
+		void GLSpriteInstancer::SetInstanceAttributes(std::size_t offset, std::size_t stride) {
+			auto pointer = [&](std::size_t memberOffset) {
+				return reinterpret_cast<const void *>(offset + memberOffset);
+			};
+			auto sz = static_cast<IGLDevice::Sizei>(stride);
+			device->VertexAttribPointer(positionAttribute(), 4, IGLDevice::FloatType, false, sz,
+			                            pointer(offsetof(Instance, x)));
+			device->VertexAttribPointer(colorAttribute(), 4, IGLDevice::FloatType, false, sz,
+			                            pointer(offsetof(Instance, r)));
+			device->VertexAttribPointer(angleAttribute(), 1, IGLDevice::FloatType, false, sz,
+			                            pointer(offsetof(Instance, angle)));
+		}
+
+		void GLSpriteInstancer::Flush() {
+			SPADES_MARK_FUNCTION();
+
+			if (instances.empty()) {
+				return;
+			}
+
+			auto batchEnd = [&](std::size_t i) {
+				return i + 1 < batches.size() ? batches[i + 1].second : instances.size();
+			};
+
+			if (useInstancing) {
+				std::size_t base =
+				  buffer.Upload(instances.data(), instances.size() * sizeof(Instance));
+
+				for (std::size_t i = 0; i < batches.size(); i++) {
+					std::size_t first = batches[i].second;
+					std::size_t last = batchEnd(i);
+
+					SetInstanceAttributes(base + first * sizeof(Instance), sizeof(Instance));
+					batches[i].first->Bind(IGLDevice::Texture2D);
+					device->DrawArraysInstanced(IGLDevice::TriangleStrip, 0, 4,
+					                            static_cast<IGLDevice::Sizei>(last - first));
+				}
+			} else {
+				vertices.resize(instances.size() * 4);
+				for (std::size_t i = 0; i < instances.size(); i++) {
+					for (int j = 0; j < 4; j++) {
+						Vertex &v = vertices[i * 4 + j];
+						v.instance = instances[i];
+						v.sx = QuadCorners[j * 2];
+						v.sy = QuadCorners[j * 2 + 1];
+					}
+				}
+
+				// the indices are relative to the first vertex of a draw call
+				std::size_t maxCount = 0;
+				for (std::size_t i = 0; i < batches.size(); i++) {
+					maxCount = std::max(maxCount, batchEnd(i) - batches[i].second);
+				}
+				for (auto idx = static_cast<std::uint32_t>(indices.size() / 6 * 4);
+				     indices.size() < maxCount * 6; idx += 4) {
+					indices.push_back(idx);
+					indices.push_back(idx + 1);
+					indices.push_back(idx + 2);
+					indices.push_back(idx + 1);
+					indices.push_back(idx + 3);
+					indices.push_back(idx + 2);
+				}
+
+				std::size_t base =
+				  buffer.Upload(vertices.data(), vertices.size() * sizeof(Vertex));
+
+				for (std::size_t i = 0; i < batches.size(); i++) {
+					std::size_t first = batches[i].second;
+					std::size_t last = batchEnd(i);
+					std::size_t offset = base + first * 4 * sizeof(Vertex);
+
+					SetInstanceAttributes(offset, sizeof(Vertex));
+					device->VertexAttribPointer(
+					  cornerAttribute(), 2, IGLDevice::FloatType, false, sizeof(Vertex),
+					  reinterpret_cast<const void *>(offset + offsetof(Vertex, sx)));
+					batches[i].first->Bind(IGLDevice::Texture2D);
+					device->DrawElements(IGLDevice::Triangles,
+					                     static_cast<IGLDevice::Sizei>((last - first) * 6),
+					                     IGLDevice::UnsignedInt, indices.data());
+				}
+			}
+
+			device->BindBuffer(IGLDevice::ArrayBuffer, 0);
+			instances.clear();
+			batches.clear();
+		}
+	}
+}
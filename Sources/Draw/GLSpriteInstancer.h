@@ -0,0 +1,111 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "GLProgramAttribute.h"
+#include "GLStreamBuffer.h"
+#include "IGLDevice.h"
+
+namespace spades {
+	namespace draw {
+		class GLImage;
+		class GLProgram;
+		class GLRenderer;
+
+		/**
+		 * Draws camera-facing sprites with Shaders/Sprite.vs or SoftSprite.vs.
+		 *
+		 * Each sprite is a single instance, and its quad is expanded by the vertex
+		 * shader from a static corner buffer. Consecutive sprites sharing an image
+		 * are drawn by one draw call. Without `r_spriteInstancing`, the instances
+		 * are duplicated to the four corners on the CPU instead.
+		 */
+		class GLSpriteInstancer {
+		public:
+			/** The per-instance attributes. */
+			struct Instance {
+				// center position
+				float x, y, z;
+				float radius;
+
+				// color
+				float r, g, b, a;
+
+				float angle;
+			};
+
+		private:
+			struct Vertex {
+				Instance instance;
+
+				// corner of the quad
+				float sx, sy;
+			};
+
+			IGLDevice *device;
+			bool useInstancing;
+			GLStreamBuffer buffer;
+
+			// holds the corners of the quad when instancing is used
+			IGLDevice::UInteger cornerBuffer;
+
+			std::vector<Instance> instances;
+			// the image and the first instance of each draw call
+			std::vector<std::pair<GLImage *, std::size_t>> batches;
+
+			// used only without instancing
+			std::vector<Vertex> vertices;
+			std::vector<std::uint32_t> indices;
+
+			GLProgramAttribute positionAttribute;
+			GLProgramAttribute colorAttribute;
+			GLProgramAttribute angleAttribute;
+			GLProgramAttribute cornerAttribute;
+
+			void SetInstanceAttributes(std::size_t offset, std::size_t stride);
+
+		public:
+			GLSpriteInstancer(GLRenderer *);
+			~GLSpriteInstancer();
+
+			/** Enables the vertex attributes of `program`, which must be in use. */
+			void Begin(GLProgram *program);
+
+			void Add(GLImage *image, const Instance &instance) {
+				if (batches.empty() || batches.back().first != image) {
+					batches.emplace_back(image, instances.size());
+				}
+				instances.push_back(instance);
+			}
+
+			/** Draws and removes the added sprites. Binds the texture unit 0. */
+			void Flush();
+
+			/** Disables the vertex attributes enabled by `Begin`. */
+			void End();
+		};
+	}
+}
@@ -33,6 +33,7 @@ namespace spades {
 		    : renderer(renderer),
 		      device(renderer->GetGLDevice()),
 		      settings(renderer->GetSettings()),
+		      instancer(renderer),
 		      projectionViewMatrix("projectionViewMatrix"),
 		      rightVector("rightVector"),
 		      upVector("upVector"),
@@ -40,10 +41,7 @@ namespace spades {
 		      viewMatrix("viewMatrix"),
 		      fogDistance("fogDistance"),
 		      fogColor("fogColor"),
-		      viewOriginVector("viewOriginVector"),
-		      positionAttribute("positionAttribute"),
-		      spritePosAttribute("spritePosAttribute"),
-		      colorAttribute("colorAttribute") {
+		      viewOriginVector("viewOriginVector") {
 			SPADES_MARK_FUNCTION();
 
 			program = renderer->RegisterProgram("Shaders/Sprite.program");
@@ -76,16 +74,19 @@ namespace spades {
 			}
 			spr.color = color;
 			sprites.push_back(spr);
+
+			const client::SceneDefinition &def = renderer->GetSceneDef();
+			sorter.Add(img, Vector3::Dot(center - def.viewOrigin, def.viewAxis[2]));
 		}
 
 		void GLSpriteRenderer::Clear() {
 			SPADES_MARK_FUNCTION();
 			sprites.clear();
+			sorter.Clear();
 		}
 
 		void GLSpriteRenderer::Render() {
 			SPADES_MARK_FUNCTION();
-			lastImage = NULL;
 			program->Use();
 
 			projectionViewMatrix(program);
@@ -97,10 +98,6 @@ namespace spades {
 			fogColor(program);
 			viewOriginVector(program);
 
-			positionAttribute(program);
-			spritePosAttribute(program);
-			colorAttribute(program);
-
 			projectionViewMatrix.SetValue(renderer->GetProjectionViewMatrix());
 			viewMatrix.SetValue(renderer->GetViewMatrix());
 
@@ -120,80 +117,30 @@ namespace spades {
 
 			device->ActiveTexture(0);
 
-			device->EnableVertexAttribArray(positionAttribute(), true);
-			device->EnableVertexAttribArray(spritePosAttribute(), true);
-			device->EnableVertexAttribArray(colorAttribute(), true);
-
-			for (size_t i = 0; i < sprites.size(); i++) {
-				Sprite &spr = sprites[i];
-				if (spr.image != lastImage) {
-					Flush();
-					lastImage = spr.image;
-					SPAssert(vertices.empty());
-				}
-
-				Vertex v;
-				v.x = spr.center.x;
-				v.y = spr.center.y;
-				v.z = spr.center.z;
-				v.radius = spr.radius;
-				v.angle = spr.angle;
-				v.r = spr.color.x;
-				v.g = spr.color.y;
-				v.b = spr.color.z;
-				v.a = spr.color.w;
-
-				uint32_t idx = (uint32_t)vertices.size();
-				v.sx = -1;
-				v.sy = -1;
-				vertices.push_back(v);
-				v.sx = 1;
-				v.sy = -1;
-				vertices.push_back(v);
-				v.sx = -1;
-				v.sy = 1;
-				vertices.push_back(v);
-				v.sx = 1;
-				v.sy = 1;
-				vertices.push_back(v);
-
-				indices.push_back(idx);
-				indices.push_back(idx + 1);
-				indices.push_back(idx + 2);
-				indices.push_back(idx + 1);
-				indices.push_back(idx + 3);
-				indices.push_back(idx + 2);
+			// grouping the sprites by image changes the blending order of the
+			// sprites of different images, so it's opt-in
+			if (settings.r_spriteSorting) {
+				sorter.Sort();
 			}
 
-			Flush();
-
-			device->EnableVertexAttribArray(positionAttribute(), false);
-			device->EnableVertexAttribArray(spritePosAttribute(), false);
-			device->EnableVertexAttribArray(colorAttribute(), false);
-		}
-
-		void GLSpriteRenderer::Flush() {
-			SPADES_MARK_FUNCTION_DEBUG();
-
-			if (vertices.empty())
-				return;
-
-			device->VertexAttribPointer(positionAttribute(), 4, IGLDevice::FloatType, false,
-			                            sizeof(Vertex), &(vertices[0].x));
-			device->VertexAttribPointer(spritePosAttribute(), 4, IGLDevice::FloatType, false,
-			                            sizeof(Vertex), &(vertices[0].sx));
-			device->VertexAttribPointer(colorAttribute(), 4, IGLDevice::FloatType, false,
-			                            sizeof(Vertex), &(vertices[0].r));
-
-			SPAssert(lastImage);
-			lastImage->Bind(IGLDevice::Texture2D);
-
-			device->DrawElements(IGLDevice::Triangles,
-			                     static_cast<IGLDevice::Sizei>(indices.size()),
-			                     IGLDevice::UnsignedInt, indices.data());
-
-			vertices.clear();
-			indices.clear();
+			instancer.Begin(program);
+			for (std::size_t i = 0; i < sorter.GetNumSprites(); i++) {
+				const Sprite &spr = sprites[sorter.GetSpriteIndex(i)];
+
+				GLSpriteInstancer::Instance instance;
+				instance.x = spr.center.x;
+				instance.y = spr.center.y;
+				instance.z = spr.center.z;
+				instance.radius = spr.radius;
+				instance.angle = spr.angle;
+				instance.r = spr.color.x;
+				instance.g = spr.color.y;
+				instance.b = spr.color.z;
+				instance.a = spr.color.w;
+				instancer.Add(spr.image, instance);
+			}
+			instancer.Flush();
+			instancer.End();
 		}
 	}
 }
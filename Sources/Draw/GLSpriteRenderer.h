@@ -20,12 +20,12 @@
 
 #pragma once
 
-#include <cstdint>
 #include <vector>
 
 #include <Core/Math.h>
-#include "GLProgramAttribute.h"
 #include "GLProgramUniform.h"
+#include "GLSpriteInstancer.h"
+#include "GLSpriteSorter.h"
 #include "IGLSpriteRenderer.h"
 
 namespace spades {
@@ -43,28 +43,12 @@ namespace spades {
 				Vector4 color;
 			};
 
-			struct Vertex {
-				// center position
-				float x, y, z;
-				float radius;
-
-				// point coord
-				float sx, sy;
-				float angle;
-
-				// color
-				float r, g, b, a;
-			};
-
 			GLRenderer *renderer;
 			IGLDevice *device;
 			GLSettings &settings;
 			std::vector<Sprite> sprites;
-
-			GLImage *lastImage;
-
-			std::vector<Vertex> vertices;
-			std::vector<uint32_t> indices;
+			GLSpriteSorter sorter;
+			GLSpriteInstancer instancer;
 
 			GLProgram *program;
 			GLProgramUniform projectionViewMatrix;
@@ -76,12 +60,6 @@ namespace spades {
 			GLProgramUniform fogColor;
 			GLProgramUniform viewOriginVector;
 
-			GLProgramAttribute positionAttribute;
-			GLProgramAttribute spritePosAttribute;
-			GLProgramAttribute colorAttribute;
-
-			void Flush();
-
 		public:
 			GLSpriteRenderer(GLRenderer *);
 			~GLSpriteRenderer();
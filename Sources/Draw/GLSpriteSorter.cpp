@@ -0,0 +1,83 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+
+#include "GLSpriteSorter.h"
+#include <Core/Debug.h>
+
+namespace spades {
+	namespace draw {
+		GLSpriteSorter::GLSpriteSorter() : lastImage(nullptr), lastRank(0) {}
+
+		void GLSpriteSorter::Clear() {
+			keys.clear();
+			imageRanks.clear();
+			lastImage = nullptr;
+		}
+
+		void GLSpriteSorter::SetImage(GLImage *image) {
+			std::uint32_t maxRank = (1U << RankBits) - 1;
+			auto rank = std::min(static_cast<std::uint32_t>(imageRanks.size()), maxRank);
+			lastRank = imageRanks.emplace(image, rank).first->second;
+			lastImage = image;
+		}
+
+		void GLSpriteSorter::Sort() {
+			SPADES_MARK_FUNCTION();
+
+			// the sprites often arrive already grouped (e.g., only one kind of
+			// particle is visible), in which case the radix passes are skipped
+			if (std::is_sorted(keys.begin(), keys.end())) {
+				return;
+			}
+
+			// the indices are already in order and LSD radix sort is stable
+			const int NumDigits = (DepthBits + RankBits) / 8;
+			std::size_t offsets[NumDigits][256] = {{0}};
+			std::uint64_t varyingBits = 0;
+			for (std::uint64_t key : keys) {
+				varyingBits |= key ^ keys[0];
+				for (int digit = 0; digit < NumDigits; digit++) {
+					offsets[digit][(key >> (IndexBits + digit * 8)) & 0xff]++;
+				}
+			}
+
+			scratch.resize(keys.size());
+			for (int digit = 0; digit < NumDigits; digit++) {
+				int shift = IndexBits + digit * 8;
+				if (((varyingBits >> shift) & 0xff) == 0) {
+					continue;
+				}
+
+				std::size_t sum = 0;
+				for (std::size_t &offset : offsets[digit]) {
+					std::size_t count = offset;
+					offset = sum;
+					sum += count;
+				}
+				for (std::uint64_t key : keys) {
+					scratch[offsets[digit][(key >> shift) & 0xff]++] = key;
+				}
+				keys.swap(scratch);
+			}
+		}
+	}
+}
@@ -0,0 +1,95 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <Core/Debug.h>
+
+namespace spades {
+	namespace draw {
+		class GLImage;
+
+		/**
+		 * Orders sprites so that the ones sharing an image are adjacent and can
+		 * be drawn by one draw call.
+		 *
+		 * Images are ordered by their first appearance, and the sprites of an
+		 * image are ordered back to front. Each sprite is represented by a 64-bit
+		 * key (image rank, inverted depth and index, from the most significant
+		 * bits) that is sorted by a LSD radix sort.
+		 */
+		class GLSpriteSorter {
+			std::vector<std::uint64_t> keys;
+			std::vector<std::uint64_t> scratch;
+			std::unordered_map<GLImage *, std::uint32_t> imageRanks;
+			GLImage *lastImage;
+			std::uint32_t lastRank;
+
+			void SetImage(GLImage *);
+
+		public:
+			enum { IndexBits = 24, DepthBits = 16, RankBits = 16 };
+
+			GLSpriteSorter();
+
+			void Clear();
+
+			/** Adds a sprite. `depth` is its distance from the camera along the
+			 * view direction. */
+			void Add(GLImage *image, float depth) {
+				SPAssert(keys.size() < (1ULL << IndexBits));
+
+				// particles of the same kind are usually added in a row
+				if (image != lastImage) {
+					SetImage(image);
+				}
+
+				// the bit pattern of a non-negative float increases with its value
+				std::uint32_t depthBits;
+				depth = std::max(depth, 0.f);
+				std::memcpy(&depthBits, &depth, sizeof(depthBits));
+				std::uint64_t depthKey =
+				  ((1ULL << DepthBits) - 1) - (depthBits >> (31 - DepthBits));
+
+				keys.push_back((static_cast<std::uint64_t>(lastRank) << (IndexBits + DepthBits)) |
+				               (depthKey << IndexBits) | keys.size());
+			}
+
+			/** Sorts the sprites. Until this is called, they are in the order they
+			 * were added. */
+			void Sort();
+
+			std::size_t GetNumSprites() const { return keys.size(); }
+
+			/** Returns the index (the order of `Add` calls) of the `i`-th sprite in
+			 * the sorted order. */
+			std::size_t GetSpriteIndex(std::size_t i) const {
+				return static_cast<std::size_t>(keys[i] & ((1ULL << IndexBits) - 1));
+			}
+		};
+	}
+}
@@ -0,0 +1,148 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "GLStreamBuffer.h"
+#include <Core/Debug.h>
+#include <Core/Exception.h>
+
+namespace spades {
+	namespace draw {
+		namespace {
+			const std::size_t InitialSegmentSize = 256 * 1024;
+
+			// a segment is reused three frames later, so this is only reached
+			// if the GPU is hung
+			const IGLDevice::UInteger64 FenceTimeout = 1000000000ULL; // 1 second
+		}
+
+		GLStreamBuffer::GLStreamBuffer(IGLDevice *device, bool persistent)
+		    : device(device),
+		      buffer(0),
+		      persistent(persistent),
+		      mappedData(nullptr),
+		      segmentSize(0),
+		      currentSegment(0),
+		      currentOffset(0) {
+			SPADES_MARK_FUNCTION();
+
+			std::fill(fences, fences + NumSegments, nullptr);
+			if (persistent) {
+				Allocate(InitialSegmentSize);
+			} else {
+				buffer = device->GenBuffer();
+			}
+		}
+
+		GLStreamBuffer::~GLStreamBuffer() {
+			SPADES_MARK_FUNCTION();
+			Release();
+		}
+
+		void GLStreamBuffer::Release() {
+			for (IGLDevice::Sync &fence : fences) {
+				if (fence) {
+					device->DeleteSync(fence);
+					fence = nullptr;
+				}
+			}
+			if (buffer) {
+				if (mappedData) {
+					device->BindBuffer(IGLDevice::ArrayBuffer, buffer);
+					device->UnmapBuffer(IGLDevice::ArrayBuffer);
+					device->BindBuffer(IGLDevice::ArrayBuffer, 0);
+					mappedData = nullptr;
+				}
+				device->DeleteBuffer(buffer);
+				buffer = 0;
+			}
+		}
+
+		void GLStreamBuffer::Allocate(std::size_t newSegmentSize) {
+			SPADES_MARK_FUNCTION();
+
+			// the GPU might still read the old buffer, but the driver keeps it
+			// alive until then
+			Release();
+
+			segmentSize = newSegmentSize;
+			currentSegment = 0;
+			currentOffset = 0;
+
+			auto flags = static_cast<IGLDevice::Enum>(
+			  IGLDevice::MapWriteBit | IGLDevice::MapPersistentBit | IGLDevice::MapCoherentBit);
+			auto totalSize = static_cast<IGLDevice::Sizei>(segmentSize * NumSegments);
+
+			buffer = device->GenBuffer();
+			device->BindBuffer(IGLDevice::ArrayBuffer, buffer);
+			device->BufferStorage(IGLDevice::ArrayBuffer, totalSize, nullptr, flags);
+			mappedData = reinterpret_cast<char *>(
+			  device->MapBufferRange(IGLDevice::ArrayBuffer, 0, totalSize, flags));
+			if (!mappedData) {
+				SPRaise("Failed to map a stream buffer of %d bytes", (int)totalSize);
+			}
+			SPLog("Stream buffer allocated: %d bytes", (int)totalSize);
+		}
+
+		std::size_t GLStreamBuffer::Upload(const void *data, std::size_t size) {
+			SPADES_MARK_FUNCTION_DEBUG();
+
+			if (!persistent) {
+				device->BindBuffer(IGLDevice::ArrayBuffer, buffer);
+				device->BufferData(IGLDevice::ArrayBuffer, static_cast<IGLDevice::Sizei>(size),
+				                   data, IGLDevice::StreamDraw);
+				return 0;
+			}
+
+			if (size > segmentSize) {
+				std::size_t newSegmentSize = segmentSize;
+				while (newSegmentSize < size) {
+					newSegmentSize *= 2;
+				}
+				Allocate(newSegmentSize);
+			} else if (currentOffset + size > segmentSize) {
+				// the commands reading the current segment were all issued
+				fences[currentSegment] = device->FenceSync();
+
+				currentSegment = (currentSegment + 1) % NumSegments;
+				currentOffset = 0;
+
+				IGLDevice::Sync &fence = fences[currentSegment];
+				if (fence) {
+					if (device->ClientWaitSync(fence, IGLDevice::SyncFlushCommandsBit,
+					                           FenceTimeout) == IGLDevice::TimeoutExpired) {
+						SPLog("Warning: timed out waiting for a stream buffer segment");
+					}
+					device->DeleteSync(fence);
+					fence = nullptr;
+				}
+			}
+
+			std::size_t offset = currentSegment * segmentSize + currentOffset;
+			std::memcpy(mappedData + offset, data, size);
+			currentOffset += (size + Alignment - 1) & ~(std::size_t)(Alignment - 1);
+
+			device->BindBuffer(IGLDevice::ArrayBuffer, buffer);
+			return offset;
+		}
+	}
+}
@@ -0,0 +1,66 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "IGLDevice.h"
+
+namespace spades {
+	namespace draw {
+		/**
+		 * A vertex buffer whose contents are written by the CPU every frame.
+		 *
+		 * With `r_bufferStorage`, this is a ring buffer that stays mapped for its
+		 * whole lifetime (GL_ARB_buffer_storage). The ring is divided into
+		 * segments, and a fence is inserted when the writer leaves a segment so
+		 * that the segment is not overwritten while the GPU still reads it.
+		 * Otherwise, every upload orphans the buffer with `BufferData`.
+		 */
+		class GLStreamBuffer {
+			enum { NumSegments = 3, Alignment = 64 };
+
+			IGLDevice *device;
+			IGLDevice::UInteger buffer;
+			bool persistent;
+
+			char *mappedData;
+			std::size_t segmentSize;
+			int currentSegment;
+			std::size_t currentOffset;
+			IGLDevice::Sync fences[NumSegments];
+
+			void Allocate(std::size_t segmentSize);
+			void Release();
+
+		public:
+			GLStreamBuffer(IGLDevice *, bool persistent);
+			~GLStreamBuffer();
+
+			/**
+			 * Copies `size` bytes to the buffer and binds the buffer to
+			 * `ArrayBuffer`.
+			 * @return The byte offset of the copy in the buffer.
+			 */
+			std::size_t Upload(const void *data, std::size_t size);
+		};
+	}
+}
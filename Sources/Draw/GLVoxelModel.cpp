@@ -21,6 +21,7 @@
 #include "GLVoxelModel.h"
 #include "GLDynamicLightShader.h"
 #include "GLImage.h"
+#include "GLImageManager.h"
 #include "GLProgram.h"
 #include "GLProgramAttribute.h"
 #include "GLProgramUniform.h"
@@ -36,7 +37,7 @@ namespace spades {
 			renderer->RegisterProgram("Shaders/VoxelModel.program");
 			renderer->RegisterProgram("Shaders/VoxelModelDynamicLit.program");
 			renderer->RegisterProgram("Shaders/VoxelModelShadowMap.program");
-			renderer->RegisterImage("Gfx/AmbientOcclusion.png");
+			renderer->GetImageManager()->RegisterImage("Gfx/AmbientOcclusion.png");
 		}
 		GLVoxelModel::GLVoxelModel(VoxelModel *m, GLRenderer *r) {
 			SPADES_MARK_FUNCTION();
@@ -47,7 +48,7 @@ namespace spades {
 			program = renderer->RegisterProgram("Shaders/VoxelModel.program");
 			dlightProgram = renderer->RegisterProgram("Shaders/VoxelModelDynamicLit.program");
 			shadowMapProgram = renderer->RegisterProgram("Shaders/VoxelModelShadowMap.program");
-			aoImage = (GLImage *)renderer->RegisterImage("Gfx/AmbientOcclusion.png");
+			aoImage = renderer->GetImageManager()->RegisterImage("Gfx/AmbientOcclusion.png");
 
 			// ADDED: Load the outlines program
 			voxelModelOutlinesProgram =
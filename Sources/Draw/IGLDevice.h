@@ -131,6 +131,7 @@ namespace spades {
 				StaticDraw,
 				StreamDraw,
 				DynamicDraw,
+				StreamRead,
 
 				// Buffer Map access
 				ReadOnly,
@@ -215,6 +216,10 @@ namespace spades {
 				ValidateStatus,
 				/* InfoLogLength, */
 				AttachedShaders,
+				ProgramBinaryLength,
+
+				// program parameter
+				ProgramBinaryRetrievableHint,
 
 				// renderbuffer target
 				Renderbuffer,
@@ -250,9 +255,25 @@ namespace spades {
 				// EXT_timer_query
 				TimeElapsed,
 
+				// ClientWaitSync result
+				AlreadySignaled,
+				TimeoutExpired,
+				ConditionSatisfied,
+				WaitFailed,
+
 				ColorBufferBit = 1,
 				DepthBufferBit = 2,
-				StencilBufferBit = 4
+				StencilBufferBit = 4,
+
+				// BufferStorage flags and MapBufferRange access
+				MapReadBit = 1,
+				MapWriteBit = 2,
+				MapPersistentBit = 4,
+				MapCoherentBit = 8,
+				DynamicStorageBit = 16,
+
+				// ClientWaitSync flags
+				SyncFlushCommandsBit = 1
 
 			};
 			typedef unsigned int UInteger;
@@ -260,6 +281,7 @@ namespace spades {
 			typedef float Float;
 			typedef unsigned int Sizei;
 			typedef std::uint64_t UInteger64;
+			typedef void *Sync;
 
 			virtual void DepthRange(Float near, Float far) = 0;
 			virtual void Viewport(Integer x, Integer y, Sizei width, Sizei height) = 0;
@@ -296,6 +318,7 @@ namespace spades {
 
 			virtual void BufferData(Enum target, Sizei size, const void *data, Enum usage) = 0;
 			virtual void BufferSubData(Enum target, Sizei offset, Sizei size, const void *data) = 0;
+			virtual void BufferStorage(Enum target, Sizei size, const void *data, Enum flags) = 0;
 
 			virtual UInteger GenQuery() = 0;
 			virtual void DeleteQuery(UInteger) = 0;
@@ -307,8 +330,14 @@ namespace spades {
 			virtual void EndConditionalRender() = 0;
 
 			virtual void *MapBuffer(Enum target, Enum access) = 0;
+			virtual void *MapBufferRange(Enum target, Sizei offset, Sizei length,
+			                             Enum access) = 0;
 			virtual void UnmapBuffer(Enum target) = 0;
 
+			virtual Sync FenceSync() = 0;
+			virtual Enum ClientWaitSync(Sync, Enum flags, UInteger64 timeout) = 0;
+			virtual void DeleteSync(Sync) = 0;
+
 			virtual UInteger GenTexture() = 0;
 			virtual void DeleteTexture(UInteger) = 0;
 
@@ -371,6 +400,11 @@ namespace spades {
 			virtual void UseProgram(UInteger program) = 0;
 			virtual void DeleteProgram(UInteger program) = 0;
 			virtual void ValidateProgram(UInteger program) = 0;
+			virtual void ProgramParameter(UInteger program, Enum pname, Integer value) = 0;
+			virtual void GetProgramBinary(UInteger program, Sizei bufferSize, Sizei *length,
+			                              UInteger *binaryFormat, void *binary) = 0;
+			virtual void ProgramBinary(UInteger program, UInteger binaryFormat, const void *binary,
+			                           Sizei length) = 0;
 			virtual Integer GetAttribLocation(UInteger program, const char *name) = 0;
 			virtual void BindAttribLocation(UInteger program, UInteger index, const char *name) = 0;
 			virtual Integer GetUniformLocation(UInteger program, const char *name) = 0;
@@ -47,12 +47,31 @@
 #define ENABLE_SSE2 0
 #endif
 
+// AVX2 code paths are compiled with a per-function target attribute and
+// selected at run time, so the rest of the program doesn't require AVX2.
+#if ENABLE_SSE2
+#if defined(_MSC_VER)
+#define ENABLE_AVX2 1
+#define SPADES_TARGET_AVX2
+#elif defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define ENABLE_AVX2 1
+#define SPADES_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+#ifndef ENABLE_AVX2
+#define ENABLE_AVX2 0
+#endif
+
 #if ENABLE_SSE
 #include <xmmintrin.h>
 #endif
 #if ENABLE_SSE2
 #include <emmintrin.h>
 #endif
+#if ENABLE_AVX2
+#include <immintrin.h>
+#endif
 
 #include <Core/ConcurrentDispatch.h>
 #include <Core/Debug.h>
@@ -74,6 +93,9 @@ namespace spades {
 #endif
 #if ENABLE_SSE2
 			SSE2,
+#endif
+#if ENABLE_AVX2
+			AVX2, // with FMA
 #endif
 		};
 
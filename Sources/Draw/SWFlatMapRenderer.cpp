@@ -92,16 +92,13 @@ namespace spades {
 		}
 
 		uint32_t SWFlatMapRenderer::GeneratePixel(int x, int y) {
-			const int depth = map->Depth();
-			for (int z = 0; z < depth; z++) {
-				if (map->IsSolid(x, y, z)) {
-					uint32_t col = map->GetColor(x, y, z);
-					col = (col & 0xff00) | ((col & 0xff) << 16) | ((col & 0xff0000) >> 16);
-					col |= 0xff000000;
-					return col;
-				}
+			uint32_t col = map->GetTopColor(x, y);
+			if ((col >> 24) >= 64) {
+				return 0; // shouldn't reach here for valid maps
 			}
-			return 0; // shouldn't reach here for valid maps
+			col = (col & 0xff00) | ((col & 0xff) << 16) | ((col & 0xff0000) >> 16);
+			col |= 0xff000000;
+			return col;
 		}
 
 		void SWFlatMapRenderer::SetNeedsUpdate(int x, int y) {
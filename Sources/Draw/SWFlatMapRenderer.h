@@ -54,6 +54,9 @@ namespace spades {
 				return img;
 			}
 
+			/** Returns the image without applying the pending map changes. */
+			SWImage *GetImageWithoutUpdate() { return img; }
+
 			void Update(bool firstTime = false);
 			void SetNeedsUpdate(int x, int y);
 		};
@@ -21,7 +21,10 @@
 #include <algorithm>
 #include <array>
 #include <cfenv>
+#include <condition_variable>
 #include <cstdlib>
+#include <exception>
+#include <mutex>
 
 #include "SWFlatMapRenderer.h"
 #include "SWImage.h"
@@ -34,19 +37,140 @@
 #include <Client/GameMap.h>
 #include <Core/Bitmap.h>
 #include <Core/Settings.h>
+#include <Core/Thread.h>
 
 #include "SWUtils.h"
 
 DEFINE_SPADES_SETTING(r_swStatistics, "0");
 DEFINE_SPADES_SETTING(r_swNumThreads, "4");
+DEFINE_SPADES_SETTING(r_swPipelining, "0");
 
 namespace spades {
 	namespace draw {
+		struct SWRenderer::ImageCommand {
+			Handle<SWImage> img;
+			// draws the flat map image instead of `img`. The flat map image is
+			// updated when the command list starts to be executed.
+			bool flatMap;
+			std::array<SWImageRenderer::Vertex, 4> vertices;
+		};
+
+		/** Scenes and 2D draws of a frame, in the order they were submitted. */
+		struct SWRenderer::FrameCommandList {
+			enum class Type { Scene, Image };
+			std::vector<std::pair<Type, std::size_t>> order;
+			std::vector<SceneCommand> scenes;
+			std::vector<ImageCommand> images;
+
+			void Clear() {
+				order.clear();
+				scenes.clear();
+				images.clear();
+			}
+		};
+
+		/** Rasterizes the previous frame's command list while the main thread
+		 * builds the next one. Each pass is still split across the software
+		 * renderer's worker pool.
+		 *
+		 * The game map is modified by the main thread without synchronization,
+		 * so the command list only reads it (by the map passes and by the flat
+		 * map image update) while the main thread waits in `Flip`. Only the
+		 * passes following the last map pass run concurrently with it. */
+		class SWRenderer::PipelineThread : public Thread {
+			SWRenderer &renderer;
+
+			std::mutex mutex;
+			std::condition_variable cond;
+
+			// guarded by `mutex`
+			std::unique_ptr<FrameCommandList> job;
+			std::exception_ptr exception;
+			bool mapReadsDone = false;
+			bool quit = false;
+
+			void NotifyMapReadsDone() {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					mapReadsDone = true;
+				}
+				cond.notify_all();
+			}
+
+		public:
+			PipelineThread(SWRenderer &renderer) : renderer(renderer) {}
+
+			~PipelineThread() {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					quit = true;
+				}
+				cond.notify_all();
+				Join();
+			}
+
+			void Run() override {
+				std::unique_lock<std::mutex> lock(mutex);
+				while (true) {
+					cond.wait(lock, [&] { return quit || job; });
+					if (!job) {
+						return;
+					}
+
+					// `job` is only touched by this thread until it's cleared
+					lock.unlock();
+					std::exception_ptr ex;
+					try {
+						renderer.ExecuteCommands(*job, [this] { NotifyMapReadsDone(); });
+					} catch (...) {
+						ex = std::current_exception();
+					}
+					lock.lock();
+
+					exception = ex;
+					job.reset();
+					cond.notify_all();
+				}
+			}
+
+			void Submit(std::unique_ptr<FrameCommandList> list) {
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					SPAssert(!job);
+					job = std::move(list);
+					mapReadsDone = false;
+				}
+				cond.notify_all();
+			}
+
+			/** Waits until the submitted command list no longer reads the game map. */
+			void WaitForMapReads() {
+				std::unique_lock<std::mutex> lock(mutex);
+				cond.wait(lock, [&] { return !job || mapReadsDone; });
+			}
+
+			/** Waits for the submitted command list to be rasterized, and rethrows
+			 * the exception thrown during that, if any. */
+			void Wait() {
+				std::exception_ptr ex;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					cond.wait(lock, [&] { return !job; });
+					std::swap(ex, exception);
+				}
+				if (ex) {
+					std::rethrow_exception(ex);
+				}
+			}
+		};
+
 		SWRenderer::SWRenderer(SWPort *port, SWFeatureLevel level)
 		    : featureLevel(level),
 		      port(port),
 		      map(nullptr),
 		      fb(nullptr),
+		      pipelineActive(false),
+		      hasUnpresentedFrame(false),
 		      inited(false),
 		      sceneUsedInThisFrame(false),
 		      fogDistance(128.f),
@@ -54,6 +178,9 @@ namespace spades {
 		      drawColorAlphaPremultiplied(MakeVector4(1, 1, 1, 1)),
 		      legacyColorPremultiply(false),
 		      lastTime(0),
+		      frameTimeSum(0.0),
+		      frameTimeSquaredSum(0.0),
+		      numFramesMeasured(0),
 		      duringSceneRendering(false) {
 
 			SPADES_MARK_FUNCTION();
@@ -127,6 +254,12 @@ namespace spades {
 		void SWRenderer::Shutdown() {
 			SPADES_MARK_FUNCTION();
 
+			try {
+				EndPipelining();
+			} catch (const std::exception &ex) {
+				SPLog("Error while rasterizing the last frame: %s", ex.what());
+			}
+
 			SetGameMap(nullptr);
 
 			imageRenderer.reset();
@@ -171,6 +304,10 @@ namespace spades {
 			if (map == this->map)
 				return;
 
+			// the pipeline thread might be using the current map renderer
+			if (pipelineActive)
+				FinishPipelinedFrame();
+
 			flatMapRenderer.reset();
 			mapRenderer.reset();
 
@@ -258,7 +395,147 @@ namespace spades {
 			  sceneDef.viewOrigin, sceneDef.viewAxis[2] * ySin + sceneDef.viewAxis[1] * yCos);
 		}
 
-		template <SWFeatureLevel> void SWRenderer::ApplyDynamicLight(const DynamicLight &light) {
+#if ENABLE_AVX2
+		namespace {
+			/** Lights the first `count & ~7` pixels of a span, and returns the
+			 * number of the processed pixels. */
+			SPADES_TARGET_AVX2 int ApplyDynamicLightSpanAVX2(uint32_t *fb, const float *db,
+			                                                 int count, float vx, float vy,
+			                                                 float dvx, Vector3 lightCenter,
+			                                                 int lightR, int lightG, int lightB,
+			                                                 float invRadius2) {
+				auto vxs = _mm256_add_ps(
+				  _mm256_set1_ps(vx),
+				  _mm256_mul_ps(_mm256_set1_ps(dvx),
+				                _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f)));
+				auto dvx8 = _mm256_set1_ps(dvx * 8.f);
+				auto vys = _mm256_set1_ps(vy);
+				auto centerX = _mm256_set1_ps(lightCenter.x);
+				auto centerY = _mm256_set1_ps(lightCenter.y);
+				auto centerZ = _mm256_set1_ps(lightCenter.z);
+				auto invRadius = _mm256_set1_ps(invRadius2);
+				auto one = _mm256_set1_ps(1.f);
+				auto lightR8 = _mm256_set1_epi32(lightR);
+				auto lightG8 = _mm256_set1_epi32(lightG);
+				auto lightB8 = _mm256_set1_epi32(lightB);
+				auto mask8 = _mm256_set1_epi32(0xff);
+				auto max8 = _mm256_set1_epi32(255);
+
+				int processed = count & ~7;
+				for (int i = 0; i < processed; i += 8) {
+					auto z = _mm256_loadu_ps(db + i);
+					auto x = _mm256_fmsub_ps(vxs, z, centerX);
+					auto y = _mm256_fmsub_ps(vys, z, centerY);
+					z = _mm256_sub_ps(z, centerZ);
+
+					auto dist = _mm256_mul_ps(x, x);
+					dist = _mm256_fmadd_ps(y, y, dist);
+					dist = _mm256_fmadd_ps(z, z, dist);
+					dist = _mm256_mul_ps(dist, invRadius);
+
+					auto lit = _mm256_castps_si256(_mm256_cmp_ps(dist, one, _CMP_LT_OQ));
+					auto strength = _mm256_sub_ps(one, dist);
+					strength = _mm256_mul_ps(strength, strength);
+					strength = _mm256_mul_ps(strength, _mm256_set1_ps(256.f));
+					auto factor = _mm256_and_si256(_mm256_cvttps_epi32(strength), lit);
+
+					auto src = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fb + i));
+					auto srcR = _mm256_and_si256(_mm256_srli_epi32(src, 16), mask8);
+					auto srcG = _mm256_and_si256(_mm256_srli_epi32(src, 8), mask8);
+					auto srcB = _mm256_and_si256(src, mask8);
+
+					auto destR = _mm256_mullo_epi32(_mm256_mullo_epi32(lightR8, factor), srcR);
+					auto destG = _mm256_mullo_epi32(_mm256_mullo_epi32(lightG8, factor), srcG);
+					auto destB = _mm256_mullo_epi32(_mm256_mullo_epi32(lightB8, factor), srcB);
+					destR = _mm256_min_epi32(_mm256_add_epi32(_mm256_srli_epi32(destR, 16), srcR),
+					                         max8);
+					destG = _mm256_min_epi32(_mm256_add_epi32(_mm256_srli_epi32(destG, 16), srcG),
+					                         max8);
+					destB = _mm256_min_epi32(_mm256_add_epi32(_mm256_srli_epi32(destB, 16), srcB),
+					                         max8);
+
+					auto dest = _mm256_or_si256(
+					  _mm256_or_si256(_mm256_slli_epi32(destR, 16), _mm256_slli_epi32(destG, 8)),
+					  destB);
+
+					// unlit pixels are left untouched
+					dest = _mm256_blendv_epi8(src, dest, lit);
+					_mm256_storeu_si256(reinterpret_cast<__m256i *>(fb + i), dest);
+
+					vxs = _mm256_add_ps(vxs, dvx8);
+				}
+
+				return processed;
+			}
+
+			/** Applies fog to a row of 4x4 blocks. Performs exactly the same
+			 * computation as the SSE2 version, eight pixels at once. */
+			SPADES_TARGET_AVX2 void ApplyFogBlockRowAVX2(uint32_t *fb, const float *db, int fw,
+			                                             float vx, float vy, float dvx,
+			                                             float scale, int fogR, int fogG,
+			                                             int fogB) {
+				auto fog = _mm256_setr_epi16(fogB, fogG, fogR, 0, fogB, fogG, fogR, 0, fogB, fogG,
+				                             fogR, 0, fogB, fogG, fogR, 0);
+
+				for (int x = 0; x < fw; x += 8) {
+					float depthScale1 = (1.f + vx * vx + vy * vy);
+					depthScale1 *= fastRSqrt(depthScale1) * scale;
+					vx += dvx;
+					float depthScale2 = (1.f + vx * vx + vy * vy);
+					depthScale2 *= fastRSqrt(depthScale2) * scale;
+					vx += dvx;
+					auto depthScale8 =
+					  _mm256_setr_ps(depthScale1, depthScale1, depthScale1, depthScale1,
+					                 depthScale2, depthScale2, depthScale2, depthScale2);
+
+					auto *fb2 = fb + x;
+					auto *db2 = db + x;
+					for (int by = 0; by < 4; by++) {
+						auto dist = _mm256_loadu_ps(db2);
+						auto color = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fb2));
+
+						dist = _mm256_mul_ps(dist, depthScale8);
+						dist = _mm256_max_ps(dist, _mm256_set1_ps(0.f));
+						dist = _mm256_min_ps(dist, _mm256_set1_ps(256.f));
+						auto factorX = _mm256_cvtps_epi32(dist);
+
+						auto factorY = _mm256_sub_epi32(_mm256_set1_epi32(0x100), factorX);
+
+						factorX = _mm256_shufflelo_epi16(factorX, 0xa0);
+						factorX = _mm256_shufflehi_epi16(factorX, 0xa0);
+						factorY = _mm256_shufflelo_epi16(factorY, 0xa0);
+						factorY = _mm256_shufflehi_epi16(factorY, 0xa0);
+
+						// pixels 0, 1, 4, 5
+						auto color1 = _mm256_unpacklo_epi8(color, _mm256_setzero_si256());
+						auto factor1X = _mm256_shuffle_epi32(factorY, 0x50);
+						auto factor1Y = _mm256_shuffle_epi32(factorX, 0x50);
+						color1 = _mm256_mullo_epi16(color1, factor1X);
+						auto fog1 = _mm256_mullo_epi16(fog, factor1Y);
+						fog1 = _mm256_adds_epu16(fog1, color1);
+						fog1 = _mm256_srli_epi16(fog1, 8);
+
+						// pixels 2, 3, 6, 7
+						auto color2 = _mm256_unpackhi_epi8(color, _mm256_setzero_si256());
+						auto factor2X = _mm256_shuffle_epi32(factorY, 0xfa);
+						auto factor2Y = _mm256_shuffle_epi32(factorX, 0xfa);
+						color2 = _mm256_mullo_epi16(color2, factor2X);
+						auto fog2 = _mm256_mullo_epi16(fog, factor2Y);
+						fog2 = _mm256_adds_epu16(fog2, color2);
+						fog2 = _mm256_srli_epi16(fog2, 8);
+
+						auto pack = _mm256_packus_epi16(fog1, fog2);
+						_mm256_storeu_si256(reinterpret_cast<__m256i *>(fb2), pack);
+
+						fb2 += fw;
+						db2 += fw;
+					}
+				}
+			}
+		}
+#endif
+
+		template <SWFeatureLevel level> void SWRenderer::ApplyDynamicLight(const DynamicLight &light) {
 			int fw = this->fb->GetWidth();
 			int fh = this->fb->GetHeight();
 
@@ -311,8 +588,21 @@ namespace spades {
 					float vx2 = vx;
 					auto *fb2 = fb;
 					auto *db2 = db;
+					int x = lightWidth;
+
+#if ENABLE_AVX2
+					if (level == SWFeatureLevel::AVX2) {
+						int processed = ApplyDynamicLightSpanAVX2(
+						  fb2, db2, x, vx2, vy, dvx, lightCenter, lightR, lightG, lightB,
+						  invRadius2);
+						x -= processed;
+						fb2 += processed;
+						db2 += processed;
+						vx2 += dvx * static_cast<float>(processed);
+					}
+#endif
 
-					for (int x = lightWidth; x > 0; x--) {
+					for (; x > 0; x--) {
 						Vector3 pos;
 
 						pos.z = *db2;
@@ -380,13 +670,13 @@ namespace spades {
 			float dvx = -fovX * 2.f / static_cast<float>(fw / 4);
 			float dvy = -fovY * 2.f / static_cast<float>(fh / 4);
 
-			int fogR = ToFixed8(fogColor.x);
-			int fogG = ToFixed8(fogColor.y);
-			int fogB = ToFixed8(fogColor.z);
+			int fogR = ToFixed8(sceneFogColor.x);
+			int fogG = ToFixed8(sceneFogColor.y);
+			int fogB = ToFixed8(sceneFogColor.z);
 			uint32_t fog1 = static_cast<uint32_t>(fogB + fogR * 0x10000);
 			uint32_t fog2 = static_cast<uint32_t>(fogG * 0x100);
 
-			float scale = 255.f / fogDistance;
+			float scale = 255.f / sceneFogDistance;
 
 			InvokeParallel2([&](unsigned int threadId, unsigned int numThreads) {
 				int startY = fh * threadId / numThreads;
@@ -461,12 +751,12 @@ namespace spades {
 			float dvx = -fovX * 2.f / static_cast<float>(fw / 4);
 			float dvy = -fovY * 2.f / static_cast<float>(fh / 4);
 
-			int fogR = ToFixed8(fogColor.x);
-			int fogG = ToFixed8(fogColor.y);
-			int fogB = ToFixed8(fogColor.z);
+			int fogR = ToFixed8(sceneFogColor.x);
+			int fogG = ToFixed8(sceneFogColor.y);
+			int fogB = ToFixed8(sceneFogColor.z);
 			__m128i fog = _mm_setr_epi16(fogB, fogG, fogR, 0, fogB, fogG, fogR, 0);
 
-			float scale = 255.f / fogDistance;
+			float scale = 255.f / sceneFogDistance;
 
 			InvokeParallel2([&](unsigned int threadId, unsigned int numThreads) {
 				int startY = fh * threadId / numThreads;
@@ -547,6 +837,51 @@ namespace spades {
 
 		} // ApplyFog()
 
+#endif
+
+#if ENABLE_AVX2
+
+		template <> void SWRenderer::ApplyFog<SWFeatureLevel::AVX2>() {
+			int fw = this->fb->GetWidth();
+			int fh = this->fb->GetHeight();
+
+			float fovX = tanf(sceneDef.fovX * 0.5f);
+			float fovY = tanf(sceneDef.fovY * 0.5f);
+
+			float dvx = -fovX * 2.f / static_cast<float>(fw / 4);
+			float dvy = -fovY * 2.f / static_cast<float>(fh / 4);
+
+			int fogR = ToFixed8(sceneFogColor.x);
+			int fogG = ToFixed8(sceneFogColor.y);
+			int fogB = ToFixed8(sceneFogColor.z);
+
+			float scale = 255.f / sceneFogDistance;
+
+			InvokeParallel2([&](unsigned int threadId, unsigned int numThreads) {
+				int startY = fh * threadId / numThreads;
+				int endY = fh * (threadId + 1) / numThreads;
+				startY &= ~3;
+				endY &= ~3;
+
+				float vy = fovY;
+				auto *fb = this->fb->GetPixels();
+				float *db = depthBuffer.data();
+
+				vy += dvy * (startY >> 2);
+				fb += fw * startY;
+				db += fw * startY;
+
+				for (int y = startY; y < endY; y += 4) {
+					ApplyFogBlockRowAVX2(fb, db, fw, fovX, vy, dvx, scale, fogR, fogG, fogB);
+
+					vy += dvy;
+					fb += fw * 4;
+					db += fw * 4;
+				}
+			});
+
+		} // ApplyFog()
+
 #endif
 
 		void SWRenderer::EnsureSceneStarted() {
@@ -584,14 +919,10 @@ namespace spades {
 			EnsureInitialized();
 			EnsureSceneNotStarted();
 
-			sceneDef = def;
+			currentScene.sceneDef = def;
+			currentScene.fogColor = fogColor;
+			currentScene.fogDistance = fogDistance;
 			duringSceneRendering = true;
-
-			BuildProjectionMatrix();
-			BuildView();
-			BuildFrustrum();
-
-			projectionViewMatrix = projectionMatrix * viewMatrix;
 		}
 
 		void SWRenderer::RenderModel(client::IModel *model, const client::ModelRenderParam &param) {
@@ -607,7 +938,7 @@ namespace spades {
 			m.model = mdl;
 			m.param = param;
 
-			models.push_back(m);
+			currentScene.models.push_back(m);
 		}
 
 		void SWRenderer::AddLight(const client::DynamicLightParam &param) {
@@ -620,17 +951,22 @@ namespace spades {
 				return;
 			}
 
+			// culled when the scene is rasterized
+			currentScene.lights.push_back(param);
+		}
+
+		bool SWRenderer::SetupDynamicLight(const client::DynamicLightParam &param,
+		                                   DynamicLight &light) {
 			auto diff = param.origin - sceneDef.viewOrigin;
 			float rad2 = param.radius * param.radius;
 			float poweredLength = diff.GetPoweredLength();
 
-			float fogCullRange = param.radius + fogDistance;
+			float fogCullRange = param.radius + sceneFogDistance;
 			if (poweredLength > fogCullRange * fogCullRange) {
 				// fog cull
-				return;
+				return false;
 			}
 
-			DynamicLight light;
 			if (poweredLength < rad2) {
 				light.minX = 0;
 				light.minY = 0;
@@ -638,7 +974,7 @@ namespace spades {
 				light.maxY = fb->GetHeight();
 			} else if (Vector3::Dot(diff, sceneDef.viewAxis[2]) < 0.f) {
 				// view plane cull
-				return;
+				return false;
 			} else {
 				auto viewRange = [](float cx, float cy, float fov,
 				                    float screenSize) -> std::array<int, 2> {
@@ -687,7 +1023,7 @@ namespace spades {
 			}
 
 			light.param = param;
-			lights.push_back(light);
+			return true;
 		}
 
 		void SWRenderer::AddDebugLine(spades::Vector3 a, spades::Vector3 b, spades::Vector4 color) {
@@ -695,7 +1031,7 @@ namespace spades {
 			EnsureSceneStarted();
 
 			DebugLine l = {a, b, color};
-			debugLines.push_back(l);
+			currentScene.debugLines.push_back(l);
 		}
 
 		void SWRenderer::AddSprite(client::IImage *image, spades::Vector3 center, float radius,
@@ -704,16 +1040,14 @@ namespace spades {
 			EnsureInitialized();
 			EnsureSceneStarted();
 
-			if (!SphereFrustrumCull(center, radius * 1.5f))
-				return;
-
 			SWImage *img = dynamic_cast<SWImage *>(image);
 			if (!img) {
 				SPInvalidArgument("image");
 			}
 
-			sprites.push_back(Sprite());
-			auto &spr = sprites.back();
+			// culled when the scene is rasterized
+			currentScene.sprites.push_back(Sprite());
+			auto &spr = currentScene.sprites.back();
 
 			spr.img = img;
 			spr.center = center;
@@ -747,12 +1081,50 @@ namespace spades {
 			EnsureInitialized();
 			EnsureSceneStarted();
 
+			duringSceneRendering = false;
+
+			if (pipelineActive) {
+				// rasterized by the pipeline thread after `Flip`
+				auto &commands = *recordedCommands;
+				commands.order.emplace_back(FrameCommandList::Type::Scene,
+				                            commands.scenes.size());
+				commands.scenes.push_back(std::move(currentScene));
+				currentScene = SceneCommand();
+				return;
+			}
+
+			RenderScene(currentScene, nullptr);
+			lastPassTimings = passTimings;
+
+			currentScene.models.clear();
+			currentScene.lights.clear();
+			currentScene.sprites.clear();
+			currentScene.debugLines.clear();
+		}
+
+		void SWRenderer::RenderScene(SceneCommand &scene,
+		                             const std::function<void()> &mapPassDone) {
+			SPADES_MARK_FUNCTION();
+
+			sceneDef = scene.sceneDef;
+			sceneFogColor = scene.fogColor;
+			sceneFogDistance = scene.fogDistance;
+
+			BuildProjectionMatrix();
+			BuildView();
+			BuildFrustrum();
+
+			projectionViewMatrix = projectionMatrix * viewMatrix;
+
 			// clear scene
 			std::fill(fb->GetPixels(), fb->GetPixels() + fb->GetWidth() * fb->GetHeight(),
-			          ConvertColor32(MakeVector4(fogColor.x, fogColor.y, fogColor.z, 1.f)));
+			          ConvertColor32(MakeVector4(sceneFogColor.x, sceneFogColor.y,
+			                                     sceneFogColor.z, 1.f)));
 			std::fill(fb->GetPixels(), fb->GetPixels() + fb->GetWidth() * fb->GetHeight(),
 			          0x7f7f7f);
 
+			Stopwatch passStopwatch;
+
 			// draw map
 			if (mapRenderer) {
 				// flat map renderer sends 'Update RLE' to map renderer.
@@ -760,25 +1132,48 @@ namespace spades {
 				flatMapRenderer->Update();
 				mapRenderer->Render(sceneDef, fb, depthBuffer.data());
 			}
+			passTimings.map = passStopwatch.GetTime();
+			if (mapPassDone) {
+				mapPassDone();
+			}
+			passStopwatch.Reset();
 
 			// draw models
-			for (auto &m : models) {
+			for (auto &m : scene.models) {
 				modelRenderer->Render(m.model, m.param);
 			}
-			models.clear();
+			passTimings.models = passStopwatch.GetTime();
+			passStopwatch.Reset();
 
 			// deferred lighting
-			for (const auto &light : lights) {
-				ApplyDynamicLight<SWFeatureLevel::None>(light);
+			for (const auto &param : scene.lights) {
+				DynamicLight light;
+				if (!SetupDynamicLight(param, light)) {
+					continue;
+				}
+#if ENABLE_AVX2
+				if (featureLevel >= SWFeatureLevel::AVX2)
+					ApplyDynamicLight<SWFeatureLevel::AVX2>(light);
+				else
+#endif
+					ApplyDynamicLight<SWFeatureLevel::None>(light);
 			}
-			lights.clear();
+			passTimings.dynamicLights = passStopwatch.GetTime();
+			passStopwatch.Reset();
 
+#if ENABLE_AVX2
+			if (featureLevel >= SWFeatureLevel::AVX2)
+				ApplyFog<SWFeatureLevel::AVX2>();
+			else
+#endif
 #if ENABLE_SSE2
 			if (static_cast<int>(featureLevel) >= static_cast<int>(SWFeatureLevel::SSE2))
 				ApplyFog<SWFeatureLevel::SSE2>();
 			else
 #endif
 				ApplyFog<SWFeatureLevel::None>();
+			passTimings.fog = passStopwatch.GetTime();
+			passStopwatch.Reset();
 
 			// render sprites
 			{
@@ -788,8 +1183,11 @@ namespace spades {
 
 				auto right = sceneDef.viewAxis[0];
 				auto up = sceneDef.viewAxis[1];
-				for (std::size_t i = 0; i < sprites.size(); i++) {
-					auto &spr = sprites[i];
+				for (std::size_t i = 0; i < scene.sprites.size(); i++) {
+					auto &spr = scene.sprites[i];
+					if (!SphereFrustrumCull(spr.center, spr.radius * 1.5f)) {
+						continue;
+					}
 					float s = sinf(spr.rotation) * spr.radius;
 					float c = cosf(spr.rotation) * spr.radius;
 					auto trans = [s, c, &spr, right, up](float x, float y) {
@@ -819,15 +1217,15 @@ namespace spades {
 					v3.position = x3;
 					imageRenderer->DrawPolygon(spr.img, v1, v2, v3);
 				}
-				sprites.clear();
 			}
+			passTimings.sprites = passStopwatch.GetTime();
 
 			// render debug lines
 			{
 				float cw = fb->GetWidth() * 0.5f;
 				float ch = fb->GetHeight() * 0.5f;
-				for (size_t i = 0; i < debugLines.size(); i++) {
-					auto &l = debugLines[i];
+				for (size_t i = 0; i < scene.debugLines.size(); i++) {
+					auto &l = scene.debugLines[i];
 					auto v1 = projectionViewMatrix * l.v1;
 					auto v2 = projectionViewMatrix * l.v2;
 					if (v1.z < 0.001f || v2.z < 0.001f)
@@ -946,12 +1344,7 @@ namespace spades {
 						}
 					}
 				}
-				debugLines.clear();
 			}
-
-			// all objects were rendered
-
-			duringSceneRendering = false;
 		}
 
 		void SWRenderer::MultiplyScreenColor(spades::Vector3 v) { EnsureSceneNotStarted(); }
@@ -1024,8 +1417,6 @@ namespace spades {
 				SPInvalidArgument("image");
 			}
 
-			imageRenderer->SetShaderType(SWImageRenderer::ShaderType::Image);
-
 			Vector4 col = drawColorAlphaPremultiplied;
 			if (legacyColorPremultiply) {
 				// in legacy mode, image color is
@@ -1035,7 +1426,11 @@ namespace spades {
 				col.z *= col.w;
 			}
 
-			std::array<SWImageRenderer::Vertex, 4> vtx;
+			ImageCommand cmd;
+			cmd.img = img;
+			cmd.flatMap = false;
+
+			auto &vtx = cmd.vertices;
 			vtx[0].color = col;
 			vtx[1].color = col;
 			vtx[2].color = col;
@@ -1053,10 +1448,59 @@ namespace spades {
 				vtx[3].uv = MakeVector2(inRect.max.x, inRect.max.y) * scl;
 			}
 
+			if (pipelineActive) {
+				auto &commands = *recordedCommands;
+				commands.order.emplace_back(FrameCommandList::Type::Image,
+				                            commands.images.size());
+				commands.images.push_back(std::move(cmd));
+				return;
+			}
+
+			DrawImagePolygons(img, cmd);
+		}
+
+		void SWRenderer::DrawImagePolygons(SWImage *img, const ImageCommand &cmd) {
+			const auto &vtx = cmd.vertices;
+			imageRenderer->SetShaderType(SWImageRenderer::ShaderType::Image);
 			imageRenderer->DrawPolygon(img, vtx[0], vtx[1], vtx[2]);
 			imageRenderer->DrawPolygon(img, vtx[1], vtx[3], vtx[2]);
 		}
 
+		void SWRenderer::ExecuteCommands(FrameCommandList &commands,
+		                                 const std::function<void()> &mapReadsDone) {
+			SPADES_MARK_FUNCTION();
+
+			// the game map is read until `mapReadsDone` is called: here (the flat
+			// map image update also updates the map renderer's RLE data) and by
+			// the map pass of each scene
+			if (flatMapRenderer) {
+				flatMapRenderer->Update();
+			}
+			if (commands.scenes.empty() && mapReadsDone) {
+				mapReadsDone();
+			}
+
+			for (const auto &item : commands.order) {
+				switch (item.first) {
+					case FrameCommandList::Type::Scene: {
+						bool isLastScene = item.second + 1 == commands.scenes.size();
+						RenderScene(commands.scenes[item.second],
+						            isLastScene ? mapReadsDone : std::function<void()>());
+						break;
+					}
+					case FrameCommandList::Type::Image: {
+						auto &cmd = commands.images[item.second];
+						if (!cmd.flatMap) {
+							DrawImagePolygons(cmd.img, cmd);
+						} else if (flatMapRenderer) {
+							DrawImagePolygons(flatMapRenderer->GetImageWithoutUpdate(), cmd);
+						}
+						break;
+					}
+				}
+			}
+		}
+
 		void SWRenderer::DrawFlatGameMap(const spades::AABB2 &outRect,
 		                                 const spades::AABB2 &inRect) {
 			SPADES_MARK_FUNCTION();
@@ -1067,7 +1511,20 @@ namespace spades {
 				SPRaise("DrawFlatGameMap was called without an active map.");
 			}
 
-			DrawImage(flatMapRenderer->GetImage(), outRect, inRect);
+			if (!pipelineActive) {
+				DrawImage(flatMapRenderer->GetImage(), outRect, inRect);
+				return;
+			}
+
+			// updating the image reads the game map and touches the map renderer,
+			// which might be in use by the pipeline thread, so record the command
+			// with the current image's size. The image is updated before the
+			// command list is executed
+			DrawImage(flatMapRenderer->GetImageWithoutUpdate(), outRect, inRect);
+			auto &commands = *recordedCommands;
+			auto &cmd = commands.images.back();
+			cmd.img = nullptr;
+			cmd.flatMap = true;
 		}
 
 		void SWRenderer::FrameDone() {
@@ -1076,16 +1533,119 @@ namespace spades {
 			EnsureSceneNotStarted();
 		}
 
+		void SWRenderer::BeginPipelining() {
+			SPADES_MARK_FUNCTION();
+			SPAssert(!pipelineActive);
+
+			SPLog("Enabling one-frame-latency rasterization");
+
+			// frames are rasterized into a private framebuffer, and copied to the
+			// port's one when presented
+			pipelineFramebuffer.Set(new Bitmap(fb->GetWidth(), fb->GetHeight()), false);
+			SetFramebuffer(pipelineFramebuffer);
+
+			recordedCommands.reset(new FrameCommandList());
+			pipelineThread.reset(new PipelineThread(*this));
+			pipelineThread->Start();
+			hasUnpresentedFrame = false;
+			pipelineActive = true;
+		}
+
+		void SWRenderer::EndPipelining() {
+			SPADES_MARK_FUNCTION();
+			if (!pipelineActive) {
+				return;
+			}
+
+			SPLog("Disabling one-frame-latency rasterization");
+
+			pipelineActive = false;
+
+			// commands recorded after the last `Flip` are discarded
+			recordedCommands.reset();
+
+			std::exception_ptr exception;
+			try {
+				FinishPipelinedFrame();
+			} catch (...) {
+				exception = std::current_exception();
+			}
+
+			pipelineThread.reset();
+			if (port) {
+				SetFramebuffer(port->GetFramebuffer());
+			}
+			pipelineFramebuffer = nullptr;
+
+			if (exception) {
+				std::rethrow_exception(exception);
+			}
+		}
+
+		void SWRenderer::FinishPipelinedFrame() {
+			SPADES_MARK_FUNCTION();
+			if (!pipelineThread) {
+				return;
+			}
+
+			bool presentable = hasUnpresentedFrame;
+			hasUnpresentedFrame = false;
+
+			pipelineThread->Wait();
+			lastPassTimings = passTimings;
+
+			if (presentable) {
+				PresentPipelinedFrame();
+			}
+		}
+
+		void SWRenderer::PresentPipelinedFrame() {
+			SPADES_MARK_FUNCTION();
+
+			Bitmap *target = port->GetFramebuffer();
+			SPAssert(target->GetWidth() == pipelineFramebuffer->GetWidth());
+			SPAssert(target->GetHeight() == pipelineFramebuffer->GetHeight());
+			const uint32_t *pixels = pipelineFramebuffer->GetPixels();
+			std::copy(pixels, pixels + target->GetWidth() * target->GetHeight(),
+			          target->GetPixels());
+			port->Swap();
+		}
+
 		void SWRenderer::Flip() {
 			SPADES_MARK_FUNCTION();
 			EnsureValid();
 			EnsureSceneNotStarted();
 
+			if (pipelineActive) {
+				// wait for the previous frame and show it
+				FinishPipelinedFrame();
+			}
+
 			if (r_swStatistics) {
 				double dur = renderStopwatch.GetTime();
 				SPLog("==== SWRenderer Statistics ====");
 				SPLog("Elapsed Time: %.3fus", dur * 1000000.0);
 				SPLog("Polygon pixels drawn: %llu", imageRenderer->GetPixelsDrawn());
+				SPLog("Last scene: map %.3fms, models %.3fms, lights %.3fms, fog %.3fms, "
+				      "sprites %.3fms",
+				      lastPassTimings.map * 1000.0, lastPassTimings.models * 1000.0,
+				      lastPassTimings.dynamicLights * 1000.0, lastPassTimings.fog * 1000.0,
+				      lastPassTimings.sprites * 1000.0);
+
+				// report the mean and the standard deviation of the frame time
+				// every 60 frames
+				frameTimeSum += dur;
+				frameTimeSquaredSum += dur * dur;
+				if (++numFramesMeasured >= 60) {
+					double mean = frameTimeSum / numFramesMeasured;
+					double variance = frameTimeSquaredSum / numFramesMeasured - mean * mean;
+					SPLog("Frame Time (last %d frames): %.3fms avg, %.3fms stddev",
+					      numFramesMeasured, mean * 1000.0,
+					      std::sqrt(std::max(variance, 0.0)) * 1000.0);
+					frameTimeSum = 0.0;
+					frameTimeSquaredSum = 0.0;
+					numFramesMeasured = 0;
+				}
 			}
 
 			imageRenderer->ResetPixelStatistics();
@@ -1103,10 +1663,29 @@ namespace spades {
 			    }
 			}
 			*/
-			port->Swap();
+			if (pipelineActive) {
+				// rasterize this frame while the caller builds the next one. The
+				// caller may modify the game map after returning, so wait for
+				// the map passes (see `PipelineThread`)
+				pipelineThread->Submit(std::move(recordedCommands));
+				recordedCommands.reset(new FrameCommandList());
+				hasUnpresentedFrame = true;
+				pipelineThread->WaitForMapReads();
+			} else {
+				port->Swap();
 
-			// next frame's framebuffer
-			SetFramebuffer(port->GetFramebuffer());
+				// next frame's framebuffer
+				SetFramebuffer(port->GetFramebuffer());
+			}
+
+			bool pipelining = r_swPipelining;
+			if (pipelining != pipelineActive) {
+				if (pipelining) {
+					BeginPipelining();
+				} else {
+					EndPipelining();
+				}
+			}
 		}
 
 		Bitmap *SWRenderer::ReadBitmap() {
@@ -1114,9 +1693,29 @@ namespace spades {
 			EnsureValid();
 			EnsureSceneNotStarted();
 
-			int w = fb->GetWidth();
-			int h = fb->GetHeight();
-			uint32_t *inPix = fb->GetPixels();
+			Handle<Bitmap> source = fb;
+			if (pipelineActive) {
+				// the previous frame is still presented by the next `Flip`
+				pipelineThread->Wait();
+				lastPassTimings = passTimings;
+
+				// rasterize the commands recorded so far in this frame on top of
+				// a copy of the previous frame. They stay recorded, and are
+				// rasterized again by the pipeline thread after `Flip`
+				source = pipelineFramebuffer->Clone();
+				SetFramebuffer(source);
+				try {
+					ExecuteCommands(*recordedCommands, nullptr);
+				} catch (...) {
+					SetFramebuffer(pipelineFramebuffer);
+					throw;
+				}
+				SetFramebuffer(pipelineFramebuffer);
+			}
+
+			int w = source->GetWidth();
+			int h = source->GetHeight();
+			uint32_t *inPix = source->GetPixels();
 			Bitmap *bm = new Bitmap(w, h);
 			uint32_t *outPix = bm->GetPixels();
 			for (int y = 0; y < h; y++) {
@@ -21,6 +21,7 @@
 #pragma once
 
 #include <array>
+#include <functional>
 #include <map>
 #include <memory>
 #include <vector>
@@ -50,6 +51,18 @@ namespace spades {
 			friend class SWModelRenderer;
 			friend class SWMapRenderer;
 
+		public:
+			/** Time spent in each pass of `EndScene`, in seconds. */
+			struct PassTimings {
+				double map = 0.0;
+				double models = 0.0;
+				double dynamicLights = 0.0;
+				double fog = 0.0;
+				double sprites = 0.0;
+			};
+
+		private:
+
 			SWFeatureLevel featureLevel;
 
 			Handle<SWPort> port;
@@ -74,7 +87,6 @@ namespace spades {
 				float rotation;
 				Vector4 color;
 			};
-			std::vector<Sprite> sprites;
 
 			struct LongSprite {
 				Handle<SWImage> img;
@@ -89,26 +101,50 @@ namespace spades {
 				Handle<SWModel> model;
 				client::ModelRenderParam param;
 			};
-			std::vector<Model> models;
 
 			struct DynamicLight {
 				client::DynamicLightParam param;
 				int minX, maxX, minY, maxY;
 			};
-			std::vector<DynamicLight> lights;
-
-			bool inited;
-			bool sceneUsedInThisFrame;
-
-			client::SceneDefinition sceneDef;
-			std::array<Plane3, 6> frustrum;
 
 			struct DebugLine {
 				Vector3 v1, v2;
 				Vector4 color;
 			};
 
-			std::vector<DebugLine> debugLines;
+			/** Everything submitted between `StartScene` and `EndScene`.
+			 * Not modified after `EndScene` returns, so it can be rasterized on
+			 * another thread while the next frame is being built. */
+			struct SceneCommand {
+				client::SceneDefinition sceneDef;
+				Vector3 fogColor;
+				float fogDistance;
+				std::vector<Model> models;
+				std::vector<client::DynamicLightParam> lights;
+				std::vector<Sprite> sprites;
+				std::vector<DebugLine> debugLines;
+			};
+			SceneCommand currentScene;
+
+			struct ImageCommand;
+			struct FrameCommandList;
+			class PipelineThread;
+
+			// one-frame-latency mode (r_swPipelining)
+			bool pipelineActive;
+			std::unique_ptr<FrameCommandList> recordedCommands;
+			std::unique_ptr<PipelineThread> pipelineThread;
+			Handle<Bitmap> pipelineFramebuffer;
+			bool hasUnpresentedFrame;
+
+			bool inited;
+			bool sceneUsedInThisFrame;
+
+			// the scene being rasterized
+			client::SceneDefinition sceneDef;
+			std::array<Plane3, 6> frustrum;
+			Vector3 sceneFogColor;
+			float sceneFogDistance;
 
 			float fogDistance;
 			Vector3 fogColor;
@@ -124,6 +160,16 @@ namespace spades {
 
 			Stopwatch renderStopwatch;
 
+			/** Measured by the thread rasterizing a scene, and copied to
+			 * `lastPassTimings` once the scene is complete. */
+			PassTimings passTimings;
+			PassTimings lastPassTimings;
+
+			// frame time statistics (r_swStatistics)
+			double frameTimeSum;
+			double frameTimeSquaredSum;
+			int numFramesMeasured;
+
 			bool duringSceneRendering;
 
 			void BuildProjectionMatrix();
@@ -134,6 +180,16 @@ namespace spades {
 
 			void RenderObjects();
 
+			bool SetupDynamicLight(const client::DynamicLightParam &, DynamicLight &);
+			void RenderScene(SceneCommand &, const std::function<void()> &mapPassDone);
+			void DrawImagePolygons(SWImage *, const ImageCommand &);
+			void ExecuteCommands(FrameCommandList &, const std::function<void()> &mapReadsDone);
+
+			void BeginPipelining();
+			void EndPipelining();
+			void FinishPipelinedFrame();
+			void PresentPipelinedFrame();
+
 			void EnsureInitialized();
 			void EnsureSceneStarted();
 			void EnsureSceneNotStarted();
@@ -213,6 +269,10 @@ namespace spades {
 
 			const client::SceneDefinition &GetSceneDef() const { return sceneDef; }
 
+			/** Returns the pass timings of the last completed scene. With
+			 * r_swPipelining, that's the one of the previous frame. */
+			const PassTimings &GetLastPassTimings() const { return lastPassTimings; }
+
 			bool BoxFrustrumCull(const AABB3 &);
 			bool SphereFrustrumCull(const Vector3 &center, float radius);
 		};
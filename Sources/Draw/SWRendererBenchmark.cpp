@@ -0,0 +1,386 @@
+/*
+ Copyright (c) 2017 yvt
+
+ This file is part of OpenSpades.
+
+ OpenSpades is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ OpenSpades is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with OpenSpades.  If not, see <http://www.gnu.org/licenses/>.
+
+ */
+
+#include <cmath>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <zlib.h>
+
+#include "SWPort.h"
+#include "SWRenderer.h"
+#include <Client/GameMap.h>
+#include <Client/IImage.h>
+#include <Client/IModel.h>
+#include <Core/Benchmark.h>
+#include <Core/Bitmap.h>
+#include <Core/Debug.h>
+#include <Core/Exception.h>
+#include <Core/FileManager.h>
+#include <Core/IStream.h>
+#include <Core/MemoryStream.h>
+#include <Core/Settings.h>
+#include <Core/Stopwatch.h>
+
+// Renders canned scenes on the Title map through SWRenderer into an offscreen
+// bitmap, and reports the time spent in each pass together with the checksum
+// of the rendered images.
+//
+// The checksums are compared against the golden ones in
+// `Resources/Benchmarks/SWRenderer.txt`, and a scene without a golden checksum
+// fails. With `r_swBenchmarkUpdateGolden`, the checksums are written to
+// `Benchmarks/SWRenderer.recorded.txt` (in the user resource directory)
+// instead, to be merged into the golden file.
+
+DEFINE_SPADES_SETTING(r_swBenchmarkWidth, "1920");
+DEFINE_SPADES_SETTING(r_swBenchmarkHeight, "1080");
+DEFINE_SPADES_SETTING(r_swBenchmarkFrames, "120");
+DEFINE_SPADES_SETTING(r_swBenchmarkUpdateGolden, "0");
+
+SPADES_SETTING(r_swPipelining);
+
+namespace spades {
+	namespace draw {
+		namespace {
+			const char *goldenFileName = "Benchmarks/SWRenderer.txt";
+			const char *recordedFileName = "Benchmarks/SWRenderer.recorded.txt";
+
+			class OffscreenPort : public SWPort {
+				Handle<Bitmap> bmp;
+
+			public:
+				OffscreenPort(int width, int height) {
+					SPADES_MARK_FUNCTION();
+					bmp.Set(new Bitmap(width, height), false);
+				}
+				Bitmap *GetFramebuffer() override { return bmp; }
+				void Swap() override {
+					// nothing to do here
+				}
+			};
+
+			enum class SceneContents { MapOnly, Effects };
+
+			struct Scene {
+				const char *name;
+				SceneContents contents;
+				// camera path; `t` ranges from 0 to 1
+				void (*camera)(float t, Vector3 &eye, Vector3 &at);
+			};
+
+			const Scene scenes[] = {
+			  // the same camera path as the main screen
+			  {"title", SceneContents::MapOnly,
+			   [](float t, Vector3 &eye, Vector3 &at) {
+				   float x = 512.f - t * 256.f;
+				   eye = MakeVector3(x, 256.f, 12.f);
+				   at = MakeVector3(x + .1f, 257.f, 12.5f);
+			   }},
+			  // looking down from the sky while orbiting around the center
+			  {"orbit", SceneContents::MapOnly,
+			   [](float t, Vector3 &eye, Vector3 &at) {
+				   float angle = t * 6.2831853f;
+				   eye = MakeVector3(256.f + cosf(angle) * 96.f, 256.f + sinf(angle) * 96.f, 0.f);
+				   at = MakeVector3(256.f, 256.f, 48.f);
+			   }},
+			  // walking at the eye level with models, sprites and dynamic lights
+			  {"effects", SceneContents::Effects,
+			   [](float t, Vector3 &eye, Vector3 &at) {
+				   float x = 320.f - t * 64.f;
+				   eye = MakeVector3(x, 256.f, 12.f);
+				   at = MakeVector3(x - 8.f, 256.f + sinf(t * 6.2831853f) * 4.f, 13.f);
+			   }},
+			};
+
+			const char *GetFeatureLevelName(SWFeatureLevel level) {
+				switch (level) {
+					case SWFeatureLevel::None: return "None";
+#if ENABLE_MMX
+					case SWFeatureLevel::MMX: return "MMX";
+#endif
+#if ENABLE_SSE
+					case SWFeatureLevel::SSE: return "SSE";
+#endif
+#if ENABLE_SSE2
+					case SWFeatureLevel::SSE2: return "SSE2";
+#endif
+#if ENABLE_AVX2
+					case SWFeatureLevel::AVX2: return "AVX2";
+#endif
+				}
+				return "Unknown";
+			}
+
+			client::SceneDefinition MakeSceneDefinition(Vector3 eye, Vector3 at, int width,
+			                                            int height) {
+				client::SceneDefinition def;
+				Vector3 dir = (at - eye).Normalize();
+				Vector3 side = Vector3::Cross(dir, MakeVector3(0.f, 0.f, -1.f)).Normalize();
+				Vector3 up = -Vector3::Cross(dir, side);
+				def.viewOrigin = eye;
+				def.viewAxis[0] = side;
+				def.viewAxis[1] = up;
+				def.viewAxis[2] = dir;
+				def.fovY = 60.f * static_cast<float>(M_PI) / 180.f;
+				def.fovX = atanf(tanf(def.fovY * .5f) * width / height) * 2.f;
+				def.zNear = 0.05f;
+				def.zFar = 130.f;
+				def.skipWorld = false;
+				def.viewportLeft = 0;
+				def.viewportTop = 0;
+				def.viewportWidth = width;
+				def.viewportHeight = height;
+				return def;
+			}
+
+			uint32_t ComputeChecksum(Bitmap &bmp) {
+				// the upper 8 bits may contain non-color information
+				std::vector<uint32_t> row(static_cast<std::size_t>(bmp.GetWidth()));
+				uLong crc = crc32(0L, Z_NULL, 0);
+				const uint32_t *pixels = bmp.GetPixels();
+				for (int y = 0; y < bmp.GetHeight(); y++) {
+					for (std::size_t x = 0; x < row.size(); x++) {
+						row[x] = pixels[x] & 0xffffff;
+					}
+					pixels += row.size();
+					crc = crc32(crc, reinterpret_cast<const Bytef *>(row.data()),
+					            static_cast<uInt>(row.size() * 4));
+				}
+				return static_cast<uint32_t>(crc);
+			}
+
+			std::map<std::string, uint32_t> LoadGoldenChecksums() {
+				std::map<std::string, uint32_t> golden;
+				if (!FileManager::FileExists(goldenFileName)) {
+					return golden;
+				}
+				std::istringstream iss(FileManager::ReadAllBytes(goldenFileName));
+				std::string key;
+				std::string value;
+				while (iss >> key >> value) {
+					golden[key] = static_cast<uint32_t>(std::stoul(value, nullptr, 16));
+				}
+				return golden;
+			}
+
+			void SaveRecordedChecksums(const std::map<std::string, uint32_t> &checksums) {
+				std::ostringstream oss;
+				for (const auto &item : checksums) {
+					char buf[16];
+					sprintf(buf, "%08x", item.second);
+					oss << item.first << ' ' << buf << '\n';
+				}
+				std::unique_ptr<IStream> stream(FileManager::OpenForWriting(recordedFileName));
+				stream->Write(oss.str());
+			}
+
+			struct SceneResult {
+				SWRenderer::PassTimings passTotal;
+				double frameTimeSum = 0.0;
+				double frameTimeSquaredSum = 0.0;
+				uint32_t checksum = 0;
+			};
+
+			void SWRendererBenchmark() {
+				int width = std::max((int)r_swBenchmarkWidth & ~7, 8);
+				int height = std::max((int)r_swBenchmarkHeight & ~7, 8);
+				int numFrames = std::max((int)r_swBenchmarkFrames, 1);
+
+				// the framebuffer and the pass timings must be of the scene just
+				// ended, so disable one-frame-latency rasterization
+				struct PipeliningDisabler {
+					std::string oldValue = r_swPipelining;
+					PipeliningDisabler() { r_swPipelining = 0; }
+					~PipeliningDisabler() { r_swPipelining = oldValue; }
+				} pipeliningDisabler;
+
+				// the rendered images depend on the assets, which differ between
+				// the source tree (with the fallback models) and the releases
+				uLong assetCrc = crc32(0L, Z_NULL, 0);
+				auto hashAsset = [&](const std::string &data) {
+					assetCrc = crc32(assetCrc, reinterpret_cast<const Bytef *>(data.data()),
+					                 static_cast<uInt>(data.size()));
+				};
+
+				Handle<client::GameMap> map;
+				{
+					std::string data = FileManager::ReadAllBytes("Maps/Title.vxl");
+					hashAsset(data);
+					MemoryStream stream(data.data(), data.size());
+					map.Set(client::GameMap::Load(&stream), false);
+				}
+
+				auto port = Handle<OffscreenPort>::New(width, height);
+				Handle<SWRenderer> renderer(new SWRenderer(port), false);
+				renderer->Init();
+				renderer->SetGameMap(map);
+				renderer->SetFogColor(MakeVector3(0.f, 0.f, 0.5f));
+				renderer->SetFogDistance(128.f);
+
+				// optional assets; the benchmark still runs without them
+				std::vector<Handle<client::IModel>> models;
+				for (const char *name : {"Models/Player/Torso.kv6", "Models/Player/Head.kv6",
+				                         "Models/Weapons/Grenade/Grenade.kv6"}) {
+					try {
+						models.emplace_back(renderer->RegisterModel(name), false);
+						hashAsset(FileManager::ReadAllBytes(name));
+					} catch (const std::exception &ex) {
+						SPLog("Model '%s' couldn't be loaded; skipped: %s", name, ex.what());
+					}
+				}
+				Handle<client::IImage> spriteImage(renderer->RegisterImage("Gfx/White.tga"),
+				                                   false);
+
+				std::string levelName = GetFeatureLevelName(DetectFeatureLevel());
+				SPLog("Resolution: %dx%d, %d frame(s) per scene, feature level: %s", width,
+				      height, numFrames, levelName.c_str());
+
+				auto golden = LoadGoldenChecksums();
+				std::map<std::string, uint32_t> recorded;
+				int numMismatches = 0;
+
+				for (const Scene &scene : scenes) {
+					SceneResult result;
+					uLong sceneCrc = crc32(0L, Z_NULL, 0);
+
+					for (int frame = 0; frame < numFrames; frame++) {
+						float t = static_cast<float>(frame) / static_cast<float>(numFrames);
+						Vector3 eye, at;
+						scene.camera(t, eye, at);
+
+						auto def = MakeSceneDefinition(eye, at, width, height);
+						def.time = static_cast<unsigned int>(frame * 16);
+
+						Stopwatch frameStopwatch;
+						renderer->StartScene(def);
+
+						if (scene.contents == SceneContents::Effects) {
+							Vector3 front = def.viewAxis[2];
+							Vector3 right = def.viewAxis[0];
+
+							// a row of models in front of the camera
+							for (std::size_t i = 0; i < models.size() * 4; i++) {
+								client::ModelRenderParam param;
+								float offset = static_cast<float>(i) - models.size() * 2.f;
+								Vector3 pos = eye + front * 6.f + right * (offset * 1.5f);
+								param.matrix = Matrix4::Translate(pos) *
+								               Matrix4::Rotate(MakeVector3(0.f, 0.f, 1.f),
+								                               t * 6.2831853f + i) *
+								               Matrix4::Scale(0.1f);
+								renderer->RenderModel(models[i % models.size()], param);
+							}
+
+							// a cloud of smoke-like sprites
+							renderer->SetColorAlphaPremultiplied(
+							  MakeVector4(0.3f, 0.3f, 0.3f, 0.5f));
+							for (int i = 0; i < 256; i++) {
+								float a = static_cast<float>(i) * 2.3999632f + t;
+								float r = 1.f + static_cast<float>(i % 16) * 0.4f;
+								Vector3 pos = eye + front * (10.f + static_cast<float>(i % 8)) +
+								              right * (cosf(a) * r) +
+								              MakeVector3(0.f, 0.f, sinf(a) * r * 0.5f);
+								renderer->AddSprite(spriteImage, pos, 0.8f, a);
+							}
+
+							// flickering dynamic lights
+							for (int i = 0; i < 8; i++) {
+								client::DynamicLightParam light;
+								light.origin = eye + front * (4.f + static_cast<float>(i) * 2.f) +
+								               right * (static_cast<float>(i % 3) - 1.f) * 3.f;
+								light.radius = 6.f + static_cast<float>((frame + i) % 5);
+								light.color = MakeVector3(1.f, 0.6f, 0.3f);
+								renderer->AddLight(light);
+							}
+						}
+
+						renderer->EndScene();
+						double frameTime = frameStopwatch.GetTime();
+
+						const auto &passes = renderer->GetLastPassTimings();
+						result.passTotal.map += passes.map;
+						result.passTotal.models += passes.models;
+						result.passTotal.sprites += passes.sprites;
+						result.passTotal.fog += passes.fog;
+						result.passTotal.dynamicLights += passes.dynamicLights;
+						result.frameTimeSum += frameTime;
+						result.frameTimeSquaredSum += frameTime * frameTime;
+
+						uint32_t frameCrc = ComputeChecksum(*port->GetFramebuffer());
+						sceneCrc = crc32(sceneCrc, reinterpret_cast<const Bytef *>(&frameCrc),
+						                 sizeof(frameCrc));
+
+						renderer->FrameDone();
+						renderer->Flip();
+					}
+
+					result.checksum = static_cast<uint32_t>(sceneCrc);
+
+					double mean = result.frameTimeSum / numFrames;
+					double stddev =
+					  std::sqrt(std::max(result.frameTimeSquaredSum / numFrames - mean * mean, 0.0));
+					double scale = 1000.0 / numFrames;
+					SPLog("[%s] frame %.3fms (stddev %.3fms): map %.3fms, models %.3fms, "
+					      "sprites %.3fms, fog %.3fms, lights %.3fms",
+					      scene.name, mean * 1000.0, stddev * 1000.0, result.passTotal.map * scale,
+					      result.passTotal.models * scale, result.passTotal.sprites * scale,
+					      result.passTotal.fog * scale, result.passTotal.dynamicLights * scale);
+
+					// golden images depend on the resolution, the code path and the assets
+					char key[256];
+					sprintf(key, "%s-%dx%d-%d-%s-%08x", scene.name, width, height, numFrames,
+					        levelName.c_str(), static_cast<uint32_t>(assetCrc));
+					auto it = golden.find(key);
+					if (r_swBenchmarkUpdateGolden) {
+						SPLog("[%s] checksum %08x (recorded)", scene.name, result.checksum);
+						recorded[key] = result.checksum;
+					} else if (it == golden.end()) {
+						SPLog("[%s] checksum %08x MISSING (no golden checksum for '%s')",
+						      scene.name, result.checksum, key);
+						numMismatches++;
+					} else if (it->second != result.checksum) {
+						SPLog("[%s] checksum %08x MISMATCH (expected %08x)", scene.name,
+						      result.checksum, it->second);
+						numMismatches++;
+					} else {
+						SPLog("[%s] checksum %08x (matches)", scene.name, result.checksum);
+					}
+				}
+
+				renderer->SetGameMap(nullptr);
+				renderer->Shutdown();
+
+				if (r_swBenchmarkUpdateGolden) {
+					SaveRecordedChecksums(recorded);
+					SPLog("Checksums were written to '%s'; merge them into '%s' of the resources",
+					      recordedFileName, goldenFileName);
+				}
+				if (numMismatches > 0) {
+					SPRaise("%d scene(s) rendered differently from the golden images or have no "
+					        "golden checksum (set r_swBenchmarkUpdateGolden to record them)",
+					        numMismatches);
+				}
+			}
+
+			Benchmark swRendererBenchmark("swrenderer", SWRendererBenchmark);
+		}
+	}
+}
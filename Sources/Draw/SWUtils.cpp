@@ -18,13 +18,235 @@
 
  */
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+#if defined(WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/sysinfo.h>
+#endif
+
 #include "SWUtils.h"
 #include <Core/Settings.h>
+#include <Core/Thread.h>
 
 SPADES_SETTING(r_swNumThreads);
+DEFINE_SPADES_SETTING(r_swPinThreads, "0");
 
 namespace spades {
 	namespace draw {
 		int GetNumSWRendererThreads() { return r_swNumThreads; }
+
+		namespace {
+			// Each thread gets this many tiles so that a worker that finishes early
+			// can pick up the remaining work of a slower one.
+			enum { TilesPerThread = 4 };
+
+			class SWWorkerPool;
+
+			class SWWorkerThread : public Thread {
+			public:
+				SWWorkerThread(SWWorkerPool &pool, unsigned int index)
+				    : pool(pool), index(index) {}
+				void Run() override;
+
+			private:
+				SWWorkerPool &pool;
+				unsigned int index;
+			};
+
+			/** Fork/join pool used by the software renderer. Workers sleep on
+			 * `forkCond` between jobs and grab tiles from a shared atomic counter. */
+			class SWWorkerPool {
+				friend class SWWorkerThread;
+
+				std::vector<std::unique_ptr<SWWorkerThread>> threads;
+
+				std::mutex mutex;
+				std::condition_variable forkCond;
+				std::condition_variable joinCond;
+
+				// guarded by `mutex`
+				unsigned int generation = 0;
+				unsigned int numWorkersInJob = 0;
+				bool jobOpen = false;
+				bool quit = false;
+
+				void (*jobFunction)(void *, unsigned int, unsigned int) = nullptr;
+				void *jobContext = nullptr;
+				unsigned int jobNumTiles = 0;
+				std::atomic<unsigned int> nextTile{0};
+
+				void ProcessTiles() {
+					auto *fn = jobFunction;
+					auto *context = jobContext;
+					unsigned int numTiles = jobNumTiles;
+					while (true) {
+						unsigned int tile = nextTile.fetch_add(1, std::memory_order_relaxed);
+						if (tile >= numTiles) {
+							break;
+						}
+						fn(context, tile, numTiles);
+					}
+				}
+
+				void WorkerMain(unsigned int index) {
+					PinCurrentThread(index + 1);
+
+					unsigned int lastGeneration = 0;
+					while (true) {
+						{
+							std::unique_lock<std::mutex> lock(mutex);
+							forkCond.wait(lock, [&] {
+								return quit || (jobOpen && generation != lastGeneration);
+							});
+							if (quit) {
+								return;
+							}
+							lastGeneration = generation;
+							numWorkersInJob++;
+						}
+
+						try {
+							ProcessTiles();
+						} catch (const std::exception &ex) {
+							fprintf(stderr, "-- UNHANDLED SW RENDERER WORKER EXCEPTION ---\n");
+							fprintf(stderr, "%s\n", ex.what());
+						} catch (...) {
+							fprintf(stderr, "-- UNHANDLED SW RENDERER WORKER EXCEPTION ---\n");
+							fprintf(stderr, "(no information provided)\n");
+						}
+
+						std::lock_guard<std::mutex> lock(mutex);
+						if (--numWorkersInJob == 0) {
+							joinCond.notify_one();
+						}
+					}
+				}
+
+				void PinCurrentThread(unsigned int cpu) {
+					if (!r_swPinThreads) {
+						return;
+					}
+#if defined(WIN32)
+					unsigned int numCpus = 8 * sizeof(DWORD_PTR);
+					SYSTEM_INFO sysinfo;
+					GetSystemInfo(&sysinfo);
+					numCpus = std::min<unsigned int>(numCpus, sysinfo.dwNumberOfProcessors);
+					SetThreadAffinityMask(GetCurrentThread(),
+					                      static_cast<DWORD_PTR>(1) << (cpu % numCpus));
+#elif defined(__linux__) && defined(CPU_SET)
+					unsigned int numCpus = static_cast<unsigned int>(get_nprocs());
+					cpu_set_t set;
+					CPU_ZERO(&set);
+					CPU_SET(cpu % std::max(numCpus, 1U), &set);
+					pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+					(void)cpu;
+#endif
+				}
+
+			public:
+				SWWorkerPool(unsigned int numWorkers) {
+					SPLog("Creating %u software renderer worker thread(s)", numWorkers);
+					for (unsigned int i = 0; i < numWorkers; i++) {
+						auto *t = new SWWorkerThread(*this, i);
+						threads.emplace_back(t);
+						t->Start();
+					}
+				}
+
+				~SWWorkerPool() {
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						quit = true;
+					}
+					forkCond.notify_all();
+
+					// `Thread`'s destructor waits for the thread to exit
+					threads.clear();
+				}
+
+				std::size_t GetNumWorkers() const { return threads.size(); }
+
+				void Run(void (*fn)(void *, unsigned int, unsigned int), void *context,
+				         unsigned int numTiles) {
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						jobFunction = fn;
+						jobContext = context;
+						jobNumTiles = numTiles;
+						nextTile.store(0, std::memory_order_relaxed);
+						jobOpen = true;
+						generation++;
+					}
+					forkCond.notify_all();
+
+					// the calling thread works on the tiles, too
+					std::exception_ptr exception;
+					try {
+						ProcessTiles();
+					} catch (...) {
+						// drain the remaining tiles so the workers finish early
+						nextTile.store(numTiles, std::memory_order_relaxed);
+						exception = std::current_exception();
+					}
+
+					{
+						// Workers which didn't wake up in time are locked out by
+						// clearing `jobOpen` while `mutex` is held
+						std::unique_lock<std::mutex> lock(mutex);
+						joinCond.wait(lock, [&] { return numWorkersInJob == 0; });
+						jobOpen = false;
+					}
+
+					if (exception) {
+						std::rethrow_exception(exception);
+					}
+				}
+			};
+
+			void SWWorkerThread::Run() { pool.WorkerMain(index); }
+
+			std::unique_ptr<SWWorkerPool> workerPool;
+
+			unsigned int GetClampedNumThreads() {
+				int numThreads = GetNumSWRendererThreads();
+				numThreads = std::max(numThreads, 1);
+				numThreads = std::min(numThreads, 32);
+				return static_cast<unsigned int>(numThreads);
+			}
+		}
+
+		unsigned int GetNumSWRendererTiles() { return GetClampedNumThreads() * TilesPerThread; }
+
+		void RunParallelTiles(void (*fn)(void *, unsigned int, unsigned int), void *context,
+		                      unsigned int numTiles) {
+			unsigned int numWorkers = GetClampedNumThreads() - 1;
+			if (numWorkers == 0) {
+				workerPool.reset();
+			}
+			if (numWorkers == 0 || numTiles <= 1) {
+				for (unsigned int i = 0; i < numTiles; i++) {
+					fn(context, i, numTiles);
+				}
+				return;
+			}
+
+			// `r_swNumThreads` might have been changed since the pool was created
+			if (!workerPool || workerPool->GetNumWorkers() != numWorkers) {
+				workerPool.reset();
+				workerPool.reset(new SWWorkerPool(numWorkers));
+			}
+
+			workerPool->Run(fn, context, numTiles);
+		}
 	}
 }
@@ -46,23 +46,23 @@ namespace spades {
 			}
 		}
 
-		template <class F> static void InvokeParallel2(F f) {
+		/** Runs `fn(context, i, numTiles)` for every `i` in `[0, numTiles)` on the
+		 * persistent software renderer worker pool and the calling thread, and
+		 * returns when all of them have completed. Idle workers take the next
+		 * unprocessed tile, so tiles should be small enough to balance the load.
+		 * Nothing is allocated per call. */
+		void RunParallelTiles(void (*fn)(void *, unsigned int, unsigned int), void *context,
+		                      unsigned int numTiles);
 
-			unsigned int numThreads = static_cast<unsigned int>(GetNumSWRendererThreads());
-			numThreads = std::max(numThreads, 1U);
-			numThreads = std::min(numThreads, 32U);
+		/** Returns the number of tiles `InvokeParallel2` splits its work into. */
+		unsigned int GetNumSWRendererTiles();
 
-			std::array<std::unique_ptr<ConcurrentDispatch>, 32> disp;
-			for (auto i = 1U; i < numThreads; i++) {
-				auto ff = [i, &f, numThreads]() { f(i, numThreads); };
-				disp[i] = std::unique_ptr<ConcurrentDispatch>(
-				  static_cast<ConcurrentDispatch *>(new FunctionDispatch<decltype(ff)>(ff)));
-				disp[i]->Start();
-			}
-			f(0, numThreads);
-			for (auto i = 1U; i < numThreads; i++) {
-				disp[i]->Join();
-			}
+		template <class F> static void InvokeParallel2(F f) {
+			RunParallelTiles(
+			  [](void *context, unsigned int tileId, unsigned int numTiles) {
+				  (*static_cast<F *>(context))(tileId, numTiles);
+			  },
+			  &f, GetNumSWRendererTiles());
 		}
 
 		static inline int ToFixed8(float v) {
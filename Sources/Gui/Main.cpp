@@ -37,15 +37,18 @@
 #include <Client/Client.h>
 #include <Client/Fonts.h>
 #include <Client/GameMap.h>
+#include <Core/Benchmark.h>
 #include <Core/ConcurrentDispatch.h>
 #include <Core/CpuID.h>
 #include <Core/Debug.h>
 #include <Core/DirectoryFileSystem.h>
 #include <Core/FileManager.h>
+#include <Core/FilePrefetcher.h>
 #include <Core/ServerAddress.h>
 #include <Core/Settings.h>
 #include <Core/Strings.h>
 #include <Core/Thread.h>
+#include <Core/TraceRecorder.h>
 #include <Core/ZipFileSystem.h>
 #include <Gui/PackageUpdateManager.h>
 #include <Gui/StartupScreen.h>
@@ -182,8 +185,11 @@ namespace {
 	bool g_printVersion = false;
 	bool g_printHelp = false;
 
+	std::string g_benchmarkName;
+
 	void printHelp(char *binaryName) {
-		printf("usage: %s [server_address] [v=protocol_version] [-h|--help] [-v|--version] \n",
+		printf("usage: %s [server_address] [v=protocol_version] [-h|--help] [-v|--version] "
+		       "[--benchmark name] \n",
 		       binaryName);
 	}
 
@@ -214,6 +220,10 @@ namespace {
 				g_printHelp = true;
 				return ++i;
 			}
+			if (!strcasecmp(a, "--benchmark") && i + 1 < argc) {
+				g_benchmarkName = argv[i + 1];
+				return i += 2;
+			}
 		}
 
 		return 0;
@@ -320,6 +330,7 @@ int main(int argc, char **argv) {
 		// initialize threads
 		spades::Thread::InitThreadSystem();
 		spades::DispatchQueue::GetThreadQueue()->MarkSDLVideoThread();
+		spades::TraceRecorder::SetThreadName("Main thread");
 
 		SPLog("Package: " PACKAGE_STRING);
 
@@ -577,6 +588,27 @@ int main(int argc, char **argv) {
 		_Tr("Main", "Localization System Loaded");
 		pumpEvents();
 
+		if (!g_benchmarkName.empty()) {
+			splashWindow.reset();
+
+			spades::Benchmark *benchmark = spades::Benchmark::Find(g_benchmarkName);
+			if (!benchmark) {
+				std::string names;
+				for (const auto &name : spades::Benchmark::GetAllNames()) {
+					names += " " + name;
+				}
+				SPRaise("Unknown benchmark '%s'. Available benchmarks:%s",
+				        g_benchmarkName.c_str(), names.c_str());
+			}
+			benchmark->Run();
+
+			spades::FileManager::Close();
+			return 0;
+		}
+
+		// read the files used by the last session while the splash window is shown
+		spades::FilePrefetcher::Start();
+
 		// parse args
 
 		// initialize AngelScript
@@ -485,6 +485,30 @@ namespace spades {
 			return ret;
 		}
 
+		void *SDLGLDevice::MapBufferRange(Enum target, Sizei offset, Sizei length, Enum access) {
+			SPADES_MARK_FUNCTION_DEBUG();
+			void *ret = nullptr;
+#if GLEW
+			GLbitfield acc = 0;
+			if (access & MapReadBit)
+				acc |= GL_MAP_READ_BIT;
+			if (access & MapWriteBit)
+				acc |= GL_MAP_WRITE_BIT;
+			if (access & MapPersistentBit)
+				acc |= GL_MAP_PERSISTENT_BIT;
+			if (access & MapCoherentBit)
+				acc |= GL_MAP_COHERENT_BIT;
+			if (glMapBufferRange)
+				ret = glMapBufferRange(parseBufferTarget(target), offset, length, acc);
+			else
+				ReportMissingFunc("glMapBufferRange");
+#else
+			ReportMissingFunc("glMapBufferRange");
+#endif
+			CheckError();
+			return ret;
+		}
+
 		void SDLGLDevice::UnmapBuffer(Enum target) {
 #if GLEW
 			if (glUnmapBuffer)
@@ -533,6 +557,7 @@ namespace spades {
 				case StaticDraw: usageVal = GL_STATIC_DRAW; break;
 				case StreamDraw: usageVal = GL_STREAM_DRAW; break;
 				case DynamicDraw: usageVal = GL_DYNAMIC_DRAW; break;
+				case StreamRead: usageVal = GL_STREAM_READ; break;
 				default: SPInvalidEnum("usage", usage);
 			}
 #if GLEW
@@ -563,6 +588,82 @@ namespace spades {
 			CheckError();
 		}
 
+		void SDLGLDevice::BufferStorage(Enum target, Sizei size, const void *data, Enum flags) {
+			SPADES_MARK_FUNCTION();
+#if GLEW
+			GLbitfield fl = 0;
+			if (flags & MapReadBit)
+				fl |= GL_MAP_READ_BIT;
+			if (flags & MapWriteBit)
+				fl |= GL_MAP_WRITE_BIT;
+			if (flags & MapPersistentBit)
+				fl |= GL_MAP_PERSISTENT_BIT;
+			if (flags & MapCoherentBit)
+				fl |= GL_MAP_COHERENT_BIT;
+			if (flags & DynamicStorageBit)
+				fl |= GL_DYNAMIC_STORAGE_BIT;
+			if (glBufferStorage)
+				glBufferStorage(parseBufferTarget(target), size, data, fl);
+			else
+				ReportMissingFunc("glBufferStorage");
+#else
+			ReportMissingFunc("glBufferStorage");
+#endif
+			CheckError();
+		}
+
+		IGLDevice::Sync SDLGLDevice::FenceSync() {
+			SPADES_MARK_FUNCTION();
+			Sync ret = nullptr;
+#if GLEW
+			if (glFenceSync)
+				ret = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			else
+				ReportMissingFunc("glFenceSync");
+#else
+			ReportMissingFunc("glFenceSync");
+#endif
+			CheckError();
+			return ret;
+		}
+
+		IGLDevice::Enum SDLGLDevice::ClientWaitSync(Sync sync, Enum flags, UInteger64 timeout) {
+			SPADES_MARK_FUNCTION();
+#if GLEW
+			GLbitfield fl = 0;
+			if (flags & SyncFlushCommandsBit)
+				fl |= GL_SYNC_FLUSH_COMMANDS_BIT;
+			GLenum ret = GL_WAIT_FAILED;
+			if (glClientWaitSync)
+				ret = glClientWaitSync(reinterpret_cast<GLsync>(sync), fl, timeout);
+			else
+				ReportMissingFunc("glClientWaitSync");
+			CheckError();
+			switch (ret) {
+				case GL_ALREADY_SIGNALED: return AlreadySignaled;
+				case GL_TIMEOUT_EXPIRED: return TimeoutExpired;
+				case GL_CONDITION_SATISFIED: return ConditionSatisfied;
+				default: return WaitFailed;
+			}
+#else
+			ReportMissingFunc("glClientWaitSync");
+			return WaitFailed;
+#endif
+		}
+
+		void SDLGLDevice::DeleteSync(Sync sync) {
+			SPADES_MARK_FUNCTION();
+#if GLEW
+			if (glDeleteSync)
+				glDeleteSync(reinterpret_cast<GLsync>(sync));
+			else
+				ReportMissingFunc("glDeleteSync");
+#else
+			ReportMissingFunc("glDeleteSync");
+#endif
+			CheckError();
+		}
+
 		IGLDevice::UInteger SDLGLDevice::GenQuery() {
 			SPADES_MARK_FUNCTION_DEBUG();
 			GLuint val = 0;
@@ -1462,6 +1563,9 @@ namespace spades {
 					case LinkStatus: glGetProgramiv(shader, GL_LINK_STATUS, &ret); break;
 					case ValidateStatus: glGetProgramiv(shader, GL_VALIDATE_STATUS, &ret); break;
 					case InfoLogLength: glGetProgramiv(shader, GL_INFO_LOG_LENGTH, &ret); break;
+					case ProgramBinaryLength:
+						glGetProgramiv(shader, GL_PROGRAM_BINARY_LENGTH, &ret);
+						break;
 					default: SPInvalidEnum("param", param);
 				}
 			else if (glGetObjectParameterivARB)
@@ -1618,6 +1722,55 @@ namespace spades {
 			CheckError();
 		}
 
+		void SDLGLDevice::ProgramParameter(UInteger program, Enum pname, Integer value) {
+			SPADES_MARK_FUNCTION();
+#if GLEW
+			GLenum pn;
+			switch (pname) {
+				case ProgramBinaryRetrievableHint: pn = GL_PROGRAM_BINARY_RETRIEVABLE_HINT; break;
+				default: SPInvalidEnum("pname", pname);
+			}
+			if (glProgramParameteri)
+				glProgramParameteri(program, pn, value);
+			else if (glProgramParameteriARB)
+				glProgramParameteriARB(program, pn, value);
+			else
+				ReportMissingFunc("glProgramParameteri");
+#else
+			ReportMissingFunc("glProgramParameteri");
+#endif
+			CheckError();
+		}
+
+		void SDLGLDevice::GetProgramBinary(UInteger program, Sizei bufferSize, Sizei *length,
+		                                   UInteger *binaryFormat, void *binary) {
+			SPADES_MARK_FUNCTION();
+#if GLEW
+			if (glGetProgramBinary)
+				glGetProgramBinary(program, bufferSize, (GLsizei *)length, (GLenum *)binaryFormat,
+				                   binary);
+			else
+				ReportMissingFunc("glGetProgramBinary");
+#else
+			ReportMissingFunc("glGetProgramBinary");
+#endif
+			CheckError();
+		}
+
+		void SDLGLDevice::ProgramBinary(UInteger program, UInteger binaryFormat,
+		                                const void *binary, Sizei length) {
+			SPADES_MARK_FUNCTION();
+#if GLEW
+			if (glProgramBinary)
+				glProgramBinary(program, binaryFormat, binary, length);
+			else
+				ReportMissingFunc("glProgramBinary");
+#else
+			ReportMissingFunc("glProgramBinary");
+#endif
+			CheckError();
+		}
+
 		IGLDevice::Integer SDLGLDevice::GetAttribLocation(UInteger program, const char *name) {
 #if GLEW
 			if (glGetAttribLocation)
@@ -72,10 +72,16 @@ namespace spades {
 			void BindBuffer(Enum, UInteger) override;
 
 			void *MapBuffer(Enum target, Enum access) override;
+			void *MapBufferRange(Enum target, Sizei offset, Sizei length, Enum access) override;
 			void UnmapBuffer(Enum target) override;
 
 			void BufferData(Enum target, Sizei size, const void *data, Enum usage) override;
 			void BufferSubData(Enum target, Sizei offset, Sizei size, const void *data) override;
+			void BufferStorage(Enum target, Sizei size, const void *data, Enum flags) override;
+
+			Sync FenceSync() override;
+			Enum ClientWaitSync(Sync, Enum flags, UInteger64 timeout) override;
+			void DeleteSync(Sync) override;
 
 			UInteger GenQuery() override;
 			void DeleteQuery(UInteger) override;
@@ -147,6 +153,11 @@ namespace spades {
 			void UseProgram(UInteger program) override;
 			void DeleteProgram(UInteger program) override;
 			void ValidateProgram(UInteger program) override;
+			void ProgramParameter(UInteger program, Enum pname, Integer value) override;
+			void GetProgramBinary(UInteger program, Sizei bufferSize, Sizei *length,
+			                      UInteger *binaryFormat, void *binary) override;
+			void ProgramBinary(UInteger program, UInteger binaryFormat, const void *binary,
+			                   Sizei length) override;
 			Integer GetAttribLocation(UInteger program, const char *name) override;
 			void BindAttribLocation(UInteger program, UInteger index, const char *name) override;
 			Integer GetUniformLocation(UInteger program, const char *name) override;
@@ -72,6 +72,11 @@ SPADES_SETTING(r_vsync);
 SPADES_SETTING(r_renderer);
 SPADES_SETTING(r_swUndersampling);
 SPADES_SETTING(r_hdr);
+SPADES_SETTING(r_modelInstancing);
+SPADES_SETTING(r_spriteInstancing);
+SPADES_SETTING(r_bufferStorage);
+SPADES_SETTING(r_programBinaryCache);
+SPADES_SETTING(r_asyncReadback);
 
 namespace spades {
 	namespace gui {
@@ -441,6 +446,103 @@ namespace spades {
 					AddReport("  r_occlusionQuery is disabled.", MakeVector4(1.f, 1.f, 1.f, 0.7f));
 				}
 
+				if (extensions.find("GL_ARB_instanced_arrays") == std::string::npos) {
+					if (r_modelInstancing) {
+						r_modelInstancing = 0;
+						SPLog("Disabling r_modelInstancing: no GL_ARB_instanced_arrays");
+					}
+					incapableConfigs.insert(
+					  std::make_pair("r_modelInstancing", [](std::string value) -> std::string {
+						  if (std::stoi(value)) {
+							  return "Instanced model rendering is disabled because your video "
+							         "card doesn't support GL_ARB_instanced_arrays.";
+						  } else {
+							  return std::string();
+						  }
+					  }));
+					AddReport("GL_ARB_instanced_arrays is NOT SUPPORTED",
+					          MakeVector4(1.f, 1.f, 0.5f, 1.f));
+					AddReport("  r_modelInstancing is disabled.", MakeVector4(1.f, 1.f, 1.f, 0.7f));
+
+					if (r_spriteInstancing) {
+						r_spriteInstancing = 0;
+						SPLog("Disabling r_spriteInstancing: no GL_ARB_instanced_arrays");
+					}
+					incapableConfigs.insert(
+					  std::make_pair("r_spriteInstancing", [](std::string value) -> std::string {
+						  if (std::stoi(value)) {
+							  return "Instanced sprite rendering is disabled because your video "
+							         "card doesn't support GL_ARB_instanced_arrays.";
+						  } else {
+							  return std::string();
+						  }
+					  }));
+					AddReport("  r_spriteInstancing is disabled.",
+					          MakeVector4(1.f, 1.f, 1.f, 0.7f));
+				}
+
+				if (extensions.find("GL_ARB_buffer_storage") == std::string::npos) {
+					if (r_bufferStorage) {
+						r_bufferStorage = 0;
+						SPLog("Disabling r_bufferStorage: no GL_ARB_buffer_storage");
+					}
+					incapableConfigs.insert(
+					  std::make_pair("r_bufferStorage", [](std::string value) -> std::string {
+						  if (std::stoi(value)) {
+							  return "Persistently mapped buffers are disabled because your "
+							         "video card doesn't support GL_ARB_buffer_storage.";
+						  } else {
+							  return std::string();
+						  }
+					  }));
+					AddReport("GL_ARB_buffer_storage is NOT SUPPORTED",
+					          MakeVector4(1.f, 1.f, 0.5f, 1.f));
+					AddReport("  r_bufferStorage is disabled.", MakeVector4(1.f, 1.f, 1.f, 0.7f));
+				}
+
+				if (extensions.find("GL_ARB_get_program_binary") == std::string::npos) {
+					if (r_programBinaryCache) {
+						r_programBinaryCache = 0;
+						SPLog("Disabling r_programBinaryCache: no GL_ARB_get_program_binary");
+					}
+					incapableConfigs.insert(
+					  std::make_pair("r_programBinaryCache", [](std::string value) -> std::string {
+						  if (std::stoi(value)) {
+							  return "Program binary cache is disabled because your video card "
+							         "doesn't support GL_ARB_get_program_binary.";
+						  } else {
+							  return std::string();
+						  }
+					  }));
+					AddReport("GL_ARB_get_program_binary is NOT SUPPORTED",
+					          MakeVector4(1.f, 1.f, 0.5f, 1.f));
+					AddReport("  r_programBinaryCache is disabled.",
+					          MakeVector4(1.f, 1.f, 1.f, 0.7f));
+				}
+
+				if (extensions.find("GL_ARB_sync") == std::string::npos ||
+				    (extensions.find("GL_ARB_pixel_buffer_object") == std::string::npos &&
+				     extensions.find("GL_EXT_pixel_buffer_object") == std::string::npos)) {
+					if (r_asyncReadback) {
+						r_asyncReadback = 0;
+						SPLog("Disabling r_asyncReadback: no GL_ARB_sync or "
+						      "GL_ARB_pixel_buffer_object");
+					}
+					incapableConfigs.insert(
+					  std::make_pair("r_asyncReadback", [](std::string value) -> std::string {
+						  if (std::stoi(value)) {
+							  return "Asynchronous framebuffer reads are disabled because your "
+							         "video card doesn't support GL_ARB_sync or "
+							         "GL_ARB_pixel_buffer_object.";
+						  } else {
+							  return std::string();
+						  }
+					  }));
+					AddReport("GL_ARB_sync or GL_ARB_pixel_buffer_object is NOT SUPPORTED",
+					          MakeVector4(1.f, 1.f, 0.5f, 1.f));
+					AddReport("  r_asyncReadback is disabled.", MakeVector4(1.f, 1.f, 1.f, 0.7f));
+				}
+
 				if (extensions.find("GL_ARB_color_buffer_float") == std::string::npos) {
 					if (r_hdr) {
 						r_hdr = 0;
@@ -50,6 +50,14 @@ namespace spades {
 					return nullptr;
 				}
 			}
+			static void PreloadImage(const std::string& str,
+									 IRenderer *r) {
+				try{
+					r->PreloadImage(str.c_str());
+				}catch(const std::exception& ex) {
+					ScriptContextUtils().SetNativeException(ex);
+				}
+			}
 			static void AddDebugLine(const Vector3& a, const Vector3& b,
 									 const Vector4& color,
 									 IRenderer *r) {
@@ -385,6 +393,11 @@ namespace spades {
 													  asFUNCTION(RegisterImage),
 													  asCALL_CDECL_OBJLAST);
 						manager->CheckError(r);
+						r = eng->RegisterObjectMethod("Renderer",
+													  "void PreloadImage(const string& in)",
+													  asFUNCTION(PreloadImage),
+													  asCALL_CDECL_OBJLAST);
+						manager->CheckError(r);
 						r = eng->RegisterObjectMethod("Renderer",
 													  "Model@ RegisterModel(const string& in)",
 													  asFUNCTION(RegisterModel),
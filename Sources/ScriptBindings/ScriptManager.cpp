@@ -22,10 +22,16 @@
 #include <Core/Debug.h>
 #include <vector>
 #include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <Core/Exception.h>
 #include <Core/AutoLocker.h>
 #include <Core/FileManager.h>
 #include <Core/IStream.h>
+#include <Core/Settings.h>
+
+DEFINE_SPADES_SETTING(core_scriptCache, "1");
 
 namespace spades {
 	
@@ -45,11 +51,219 @@ namespace spades {
 		SPLog("%s (%d, %d) : %s : %s\n", msg->section, msg->row, msg->col, type, msg->message);
 	}
 	
+	static std::string ASErrorToString(int ret);
+
+	namespace {
+		const char *ScriptCacheFileName = "ScriptCache.bin";
+		const char ScriptCacheMagic[8] = {'O', 'S', 'S', 'C', 'R', 'B', 'C', '1'};
+
+		/** 64-bit FNV-1a hash. */
+		class Hasher {
+			uint64_t value = 14695981039346656037ULL;
+		public:
+			void Add(const void *data, std::size_t size) {
+				auto *bytes = static_cast<const unsigned char *>(data);
+				for(std::size_t i = 0; i < size; i++) {
+					value = (value ^ bytes[i]) * 1099511628211ULL;
+				}
+			}
+			void Add(uint64_t v) { Add(&v, sizeof(v)); }
+			void Add(const char *str) {
+				// the length keeps adjacent strings from running together
+				std::size_t len = str ? std::strlen(str) : 0;
+				Add(static_cast<uint64_t>(len));
+				Add(str, len);
+			}
+			uint64_t Get() const { return value; }
+		};
+
+		/** Reads and writes the bytecode from/to a `std::string`. */
+		class StringBinaryStream: public asIBinaryStream {
+			std::string &buffer;
+			std::size_t position;
+			bool overrun;
+		public:
+			StringBinaryStream(std::string &buffer, std::size_t position = 0):
+			buffer(buffer), position(position), overrun(false) {}
+
+			void Read(void *ptr, asUINT size) override {
+				if(size > buffer.size() - position) {
+					// AngelScript doesn't check the end of the stream
+					std::memset(ptr, 0, size);
+					position = buffer.size();
+					overrun = true;
+					return;
+				}
+				std::memcpy(ptr, buffer.data() + position, size);
+				position += size;
+			}
+			void Write(const void *ptr, asUINT size) override {
+				buffer.append(static_cast<const char *>(ptr), size);
+			}
+
+			bool IsOverrun() const { return overrun; }
+		};
+
+		/** Hashes everything the compiled bytecode depends on except the
+		 * scripts: the engine version and options, and the registered API. */
+		uint64_t HashEngineConfiguration(asIScriptEngine *engine) {
+			SPADES_MARK_FUNCTION();
+
+			Hasher hasher;
+			hasher.Add(ANGELSCRIPT_VERSION_STRING);
+			hasher.Add(asGetLibraryOptions());
+			hasher.Add(static_cast<uint64_t>(sizeof(void *)));
+
+			for(asUINT i = 0; i < engine->GetObjectTypeCount(); i++) {
+				asITypeInfo *type = engine->GetObjectTypeByIndex(i);
+				hasher.Add(type->GetNamespace());
+				hasher.Add(type->GetName());
+				hasher.Add(static_cast<uint64_t>(type->GetFlags()));
+				hasher.Add(static_cast<uint64_t>(type->GetSize()));
+				for(asUINT k = 0; k < type->GetBehaviourCount(); k++) {
+					asEBehaviours beh;
+					asIScriptFunction *func = type->GetBehaviourByIndex(k, &beh);
+					hasher.Add(static_cast<uint64_t>(beh));
+					hasher.Add(func->GetDeclaration(true, true));
+				}
+				for(asUINT k = 0; k < type->GetFactoryCount(); k++) {
+					hasher.Add(type->GetFactoryByIndex(k)->GetDeclaration(true, true));
+				}
+				for(asUINT k = 0; k < type->GetMethodCount(); k++) {
+					hasher.Add(type->GetMethodByIndex(k)->GetDeclaration(true, true));
+				}
+				for(asUINT k = 0; k < type->GetPropertyCount(); k++) {
+					int offset = 0;
+					type->GetProperty(k, nullptr, nullptr, nullptr, nullptr, &offset);
+					hasher.Add(type->GetPropertyDeclaration(k, true));
+					hasher.Add(static_cast<uint64_t>(offset));
+				}
+			}
+			for(asUINT i = 0; i < engine->GetGlobalFunctionCount(); i++) {
+				hasher.Add(engine->GetGlobalFunctionByIndex(i)->GetDeclaration(true, true));
+			}
+			for(asUINT i = 0; i < engine->GetGlobalPropertyCount(); i++) {
+				const char *name, *nameSpace;
+				int typeId;
+				bool isConst;
+				engine->GetGlobalPropertyByIndex(i, &name, &nameSpace, &typeId, &isConst);
+				hasher.Add(nameSpace);
+				hasher.Add(name);
+				hasher.Add(engine->GetTypeDeclaration(typeId, true));
+				hasher.Add(static_cast<uint64_t>(isConst));
+			}
+			for(asUINT i = 0; i < engine->GetEnumCount(); i++) {
+				asITypeInfo *type = engine->GetEnumByIndex(i);
+				hasher.Add(type->GetNamespace());
+				hasher.Add(type->GetName());
+				for(asUINT k = 0; k < type->GetEnumValueCount(); k++) {
+					int value;
+					hasher.Add(type->GetEnumValueByIndex(k, &value));
+					hasher.Add(static_cast<uint64_t>(value));
+				}
+			}
+			for(asUINT i = 0; i < engine->GetFuncdefCount(); i++) {
+				asITypeInfo *type = engine->GetFuncdefByIndex(i);
+				hasher.Add(type->GetFuncdefSignature()->GetDeclaration(true, true));
+			}
+			for(asUINT i = 0; i < engine->GetTypedefCount(); i++) {
+				asITypeInfo *type = engine->GetTypedefByIndex(i);
+				hasher.Add(type->GetNamespace());
+				hasher.Add(type->GetName());
+				hasher.Add(engine->GetTypeDeclaration(type->GetTypedefTypeId(), true));
+			}
+			return hasher.Get();
+		}
+
+		/** Loads the module from the script cache if its key matches. Failures
+		 * are silent since the module is just built from the scripts then. */
+		bool LoadCachedModule(asIScriptModule *module, uint64_t key) {
+			SPADES_MARK_FUNCTION();
+
+			std::string data;
+			try {
+				if(!FileManager::FileExists(ScriptCacheFileName)) {
+					return false;
+				}
+				data = FileManager::ReadAllBytes(ScriptCacheFileName);
+			} catch(const std::exception& ex) {
+				SPLog("Failed to read the script cache: %s", ex.what());
+				return false;
+			}
+
+			// header: magic, key, and the hash of the bytecode
+			const std::size_t headerSize = sizeof(ScriptCacheMagic) + sizeof(uint64_t) * 2;
+			if(data.size() < headerSize ||
+			   std::memcmp(data.data(), ScriptCacheMagic, sizeof(ScriptCacheMagic)) != 0) {
+				return false;
+			}
+			uint64_t storedKey, storedHash;
+			std::memcpy(&storedKey, data.data() + sizeof(ScriptCacheMagic), sizeof(uint64_t));
+			std::memcpy(&storedHash, data.data() + sizeof(ScriptCacheMagic) + sizeof(uint64_t),
+			            sizeof(uint64_t));
+			if(storedKey != key) {
+				SPLog("Script cache is outdated");
+				return false;
+			}
+			Hasher hasher;
+			hasher.Add(data.data() + headerSize, data.size() - headerSize);
+			if(hasher.Get() != storedHash) {
+				SPLog("Script cache is broken");
+				return false;
+			}
+
+			// errors are expected if the cache is somehow incompatible, so
+			// don't show them as script errors
+			asIScriptEngine *engine = module->GetEngine();
+			engine->ClearMessageCallback();
+			StringBinaryStream stream(data, headerSize);
+			int r = module->LoadByteCode(&stream);
+			engine->SetMessageCallback(asFUNCTION(MessageCallback), 0, asCALL_CDECL);
+
+			if(r < 0 || stream.IsOverrun()) {
+				SPLog("Failed to load the script cache: %s", ASErrorToString(r).c_str());
+				return false;
+			}
+			return true;
+		}
+
+		void SaveCachedModule(asIScriptModule *module, uint64_t key) {
+			SPADES_MARK_FUNCTION();
+
+			// the debug info is kept for the locations in script exceptions
+			std::string bytecode;
+			StringBinaryStream stream(bytecode);
+			int r = module->SaveByteCode(&stream, false);
+			if(r < 0) {
+				SPLog("Failed to save the script cache: %s", ASErrorToString(r).c_str());
+				return;
+			}
+
+			Hasher hasher;
+			hasher.Add(bytecode.data(), bytecode.size());
+			uint64_t hash = hasher.Get();
+
+			try {
+				std::unique_ptr<IStream> file(FileManager::OpenForWriting(ScriptCacheFileName));
+				file->Write(ScriptCacheMagic, sizeof(ScriptCacheMagic));
+				file->Write(&key, sizeof(key));
+				file->Write(&hash, sizeof(hash));
+				file->Write(bytecode);
+			} catch(const std::exception& ex) {
+				SPLog("Failed to write the script cache: %s", ex.what());
+			}
+		}
+	}
+
 	class ScriptBuilder: public CScriptBuilder {
+		Hasher sourceHasher;
 	public:
 		ScriptBuilder(){
 			
 		}
+
+		/** Returns the hash of the names and contents of the loaded scripts. */
+		uint64_t GetSourceHash() const { return sourceHasher.Get(); }
 	protected:
 		int  LoadScriptSection(const char *filename) override {
 			if(filename[0] != '/') {
@@ -69,6 +283,8 @@ namespace spades {
 			}
 			
 			SPLog("Loading script '%s'", filename);
+			sourceHasher.Add(filename);
+			sourceHasher.Add(data.c_str());
 			return ProcessScriptSection(data.c_str(), (unsigned int)(data.length()), filename, 0);
 		}
 	};
@@ -76,6 +292,7 @@ namespace spades {
 	
 	ScriptManager::ScriptManager() {
 		SPADES_MARK_FUNCTION();
+		SPADES_SETTING(core_scriptCache);
 		
 		SPLog("Creating script engine");
 		engine = asCreateScriptEngine(ANGELSCRIPT_VERSION);
@@ -112,9 +329,25 @@ namespace spades {
 			if(builder.AddSectionFromFile("/Main.as") < 0){
 				SPRaise("Failed to load '/Main.as'.");
 			}
-			SPLog("Building");
-			if(builder.BuildModule() < 0){
-				SPRaise("Failed to build at least one of the scripts.");
+
+			// the scripts are only preprocessed so far, which is much faster
+			// than compiling them
+			Hasher keyHasher;
+			keyHasher.Add(HashEngineConfiguration(engine));
+			keyHasher.Add(builder.GetSourceHash());
+			uint64_t cacheKey = keyHasher.Get();
+
+			asIScriptModule *module = builder.GetModule();
+			if(core_scriptCache && LoadCachedModule(module, cacheKey)){
+				SPLog("Loaded scripts from the cache");
+			}else{
+				SPLog("Building");
+				if(builder.BuildModule() < 0){
+					SPRaise("Failed to build at least one of the scripts.");
+				}
+				if(core_scriptCache){
+					SaveCachedModule(module, cacheKey);
+				}
 			}
 			
 		}catch(...){